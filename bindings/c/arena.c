@@ -0,0 +1,99 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// =========================================================
+// Arena: bump allocation with whole-message release
+// =========================================================
+
+// Every block starts with a header linking it to the previously retired block
+struct ute_arena_header
+{
+    uint8_t *prev;
+    size_t pad; // keeps the first allocation 16-byte aligned
+};
+
+#define HEADER_SIZE sizeof(struct ute_arena_header)
+
+// Free every retired block behind block (but not block itself)
+static void free_retired(uint8_t *block)
+{
+    uint8_t *prev = ((struct ute_arena_header *)block)->prev;
+    while (prev)
+    {
+        uint8_t *next = ((struct ute_arena_header *)prev)->prev;
+        free(prev);
+        prev = next;
+    }
+    ((struct ute_arena_header *)block)->prev = NULL;
+}
+
+// Start a new block with room for at least size bytes, retiring the current one
+static int grow(struct ute_arena *arena, size_t size)
+{
+    // Blocks double in size while a message keeps spilling over
+    size_t cap = arena->cap < UTE_ARENA_BLOCK_SIZE ? UTE_ARENA_BLOCK_SIZE : arena->cap;
+    if (arena->block && cap <= SIZE_MAX / 2)
+        cap *= 2;
+    while (cap - HEADER_SIZE < size)
+    {
+        if (cap > SIZE_MAX / 2)
+            return -1;
+        cap *= 2;
+    }
+    uint8_t *block = malloc(cap);
+    if (!block)
+        return -1;
+    ((struct ute_arena_header *)block)->prev = arena->block;
+    arena->block = block;
+    arena->used = HEADER_SIZE;
+    arena->cap = cap;
+    return 0;
+}
+
+void *ute_arena_alloc(struct ute_arena *arena, size_t size, size_t align)
+{
+    if (!arena || !align || (align & (align - 1)))
+        return NULL;
+    size_t at = (arena->used + align - 1) & ~(align - 1);
+    if (!arena->block || at > arena->cap || arena->cap - at < size)
+    {
+        if (size > SIZE_MAX - HEADER_SIZE - align || grow(arena, size + align) != 0)
+            return NULL;
+        at = (arena->used + align - 1) & ~(align - 1);
+    }
+    arena->peak += at - arena->used + size;
+    arena->used = at + size;
+    return arena->block + at;
+}
+
+void ute_arena_reset(struct ute_arena *arena)
+{
+    if (!arena || !arena->block)
+        return;
+    if (((struct ute_arena_header *)arena->block)->prev)
+    {
+        // The last message spilled over several blocks: replace them by one
+        // block that fits it, so the next one stays contiguous
+        size_t peak = arena->peak;
+        free_retired(arena->block);
+        free(arena->block);
+        arena->block = NULL;
+        if (grow(arena, peak) != 0)
+            arena->cap = 0;
+    }
+    arena->used = HEADER_SIZE;
+    arena->peak = 0;
+}
+
+void ute_arena_free(struct ute_arena *arena)
+{
+    if (!arena)
+        return;
+    if (arena->block)
+    {
+        free_retired(arena->block);
+        free(arena->block);
+    }
+    memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,43 @@
+#ifndef UTE_ARENA_H
+#define UTE_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default size of the first arena block
+#define UTE_ARENA_BLOCK_SIZE 4096
+
+// Alignment of decoded values allocated by the codex (strictest C layout alignment)
+#define UTE_ARENA_ALIGN 8
+
+// Bump allocator for decoded messages (zero-initialize before first use).
+// Allocations are carved out of one block; when it runs out a larger block
+// is started and the old one is retired until the next reset. A reset after
+// an overflow replaces all blocks by a single one large enough for the peak
+// usage, so a steady stream of similar messages decodes into one contiguous
+// region without calling malloc.
+struct ute_arena
+{
+    uint8_t *block; // current block (starts with a link to the retired blocks)
+    size_t used;    // bytes used in the current block
+    size_t cap;     // capacity of the current block
+    size_t peak;    // bytes allocated since the last reset, over all blocks
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Allocate size bytes aligned to align (a power of two); returns NULL on failure
+    void *ute_arena_alloc(struct ute_arena *arena, size_t size, size_t align);
+    // Release every allocation at once, keeping the memory for reuse
+    void ute_arena_reset(struct ute_arena *arena);
+    // Free all memory owned by the arena
+    void ute_arena_free(struct ute_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_ARENA_H
@@ -0,0 +1,573 @@
+// Benchmark driver for the C codex: generates payloads of a configurable
+// shape from YAML schemas, measures encode/decode throughput and latency and
+// prints a JSON report that can be diffed against an earlier run.
+//
+//   ./ute_bench [-d schema_dir] [-t seconds] [-l list_len] [-s string_len] [-o report.json] [case|schema.yaml ...]
+//
+// Without arguments every built-in case of schemas/bench is run. -l and -s
+// override the payload shape of all cases.
+
+#include "arena.h"
+#include "codex.h"
+#include "plan.h"
+#include "schema.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+// Maximum number of latency samples taken per operation
+#define BENCH_MAX_SAMPLES 100000
+
+// Number of hardware counters read around the throughput loop
+#define BENCH_NUM_COUNTERS 3
+
+// Size of generated payloads: elements per list, bytes per string or bytes value
+struct bench_shape
+{
+    size_t list;
+    size_t string;
+};
+
+// A built-in case: a schema of the corpus and the shape that stresses it
+struct bench_case
+{
+    const char *name;
+    const char *schema;
+    struct bench_shape shape;
+};
+
+static const struct bench_case cases[] = {
+    {"wide", "wide.yaml", {4, 16}},
+    {"deep", "deep.yaml", {16, 12}},
+    {"long_list", "list.yaml", {10000, 12}},
+    {"large_strings", "strings.yaml", {4, 256 * 1024}},
+};
+
+// Results of one measured operation
+struct bench_result
+{
+    size_t iterations;
+    double ns_per_msg;
+    double p50, p90, p99, max; // latency percentiles (ns)
+    double counters[BENCH_NUM_COUNTERS];
+    int have_counters[BENCH_NUM_COUNTERS];
+};
+
+// Keeps the optimizer from dropping benchmarked work
+static volatile size_t sink;
+
+// =========================================================
+// Payload generation
+// =========================================================
+
+static struct ute_arena data_arena;
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+// xorshift64*: deterministic, so every run encodes the same bytes
+static uint64_t next_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static void *alloc_zeroed(size_t size, size_t align)
+{
+    void *p = ute_arena_alloc(&data_arena, size ? size : 1, align);
+    if (!p)
+    {
+        fprintf(stderr, "Out of memory generating payload\n");
+        exit(1);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+// Length of a generated string or bytes value, within the field's capacity
+static size_t value_len(const struct ute_field *f, const struct bench_shape *shape)
+{
+    size_t len = shape->string;
+    if (f->type == UTE_TYPE_STRING && f->capacity && len >= f->capacity)
+        len = f->capacity - 1;
+    if (f->type == UTE_TYPE_BYTES && f->capacity && len > f->capacity)
+        len = f->capacity;
+    return len;
+}
+
+static void fill_chars(char *dst, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        dst[i] = (char)('a' + next_random() % 26);
+    dst[len] = 0;
+}
+
+static void **make_list(const struct ute_field *f, const struct bench_shape *shape);
+static void *make_value(const struct ute_field *f, const struct bench_shape *shape);
+
+// Write a generated value into its inline storage at dst
+static void fill_inline(const struct ute_field *f, uint8_t *dst, const struct bench_shape *shape)
+{
+    uint64_t r = next_random();
+    switch (f->type)
+    {
+    case UTE_TYPE_BOOL:
+        *dst = (uint8_t)(r & 1);
+        break;
+    case UTE_TYPE_INT:
+    case UTE_TYPE_SINT:
+    {
+        // Spread the values over all varint lengths
+        uint64_t v = r >> (next_random() % 64);
+        memcpy(dst, &v, sizeof(v));
+        break;
+    }
+    case UTE_TYPE_FLOAT32:
+    {
+        float v = (float)(r % 1000000) / 7.0f;
+        memcpy(dst, &v, sizeof(v));
+        break;
+    }
+    case UTE_TYPE_FLOAT64:
+    {
+        double v = (double)(r % 1000000000) / 7.0;
+        memcpy(dst, &v, sizeof(v));
+        break;
+    }
+    case UTE_TYPE_FIXED32:
+    {
+        uint32_t v = (uint32_t)r;
+        memcpy(dst, &v, sizeof(v));
+        break;
+    }
+    case UTE_TYPE_FIXED64:
+        memcpy(dst, &r, sizeof(r));
+        break;
+    case UTE_TYPE_STRING:
+        fill_chars((char *)dst, value_len(f, shape));
+        break;
+    case UTE_TYPE_BYTES:
+    {
+        struct ute_bytes *b = (struct ute_bytes *)dst;
+        b->len = value_len(f, shape);
+        for (size_t i = 0; i < b->len; ++i)
+            b->data[i] = (uint8_t)next_random();
+        break;
+    }
+    case UTE_TYPE_LIST:
+        *(void ***)dst = make_list(f, shape);
+        break;
+    case UTE_TYPE_STRUCT:
+        for (size_t i = 0; i < f->num_fields; ++i)
+        {
+            const struct ute_field *m = &f->fields[i];
+            if (m->storage == UTE_STORAGE_POINTER && m->type != UTE_TYPE_LIST)
+                *(void **)(dst + m->offset) = make_value(m, shape);
+            else
+                fill_inline(m, dst + m->offset, shape);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Allocate and fill a value reached through a pointer (top-level values,
+// list elements and pointer members)
+static void *make_value(const struct ute_field *f, const struct bench_shape *shape)
+{
+    if (f->type == UTE_TYPE_LIST)
+        return make_list(f, shape);
+    size_t size = ute_sizeof(f);
+    // Values behind pointers are sized to fit
+    if (f->type == UTE_TYPE_STRING)
+        size = value_len(f, shape) + 1;
+    else if (f->type == UTE_TYPE_BYTES)
+        size = sizeof(struct ute_bytes) + value_len(f, shape);
+    uint8_t *value = alloc_zeroed(size, UTE_ARENA_ALIGN);
+    fill_inline(f, value, shape);
+    return value;
+}
+
+// Allocate a [count, ptr, ...] list. Fixed-width elements share one C array,
+// as an arena decode would lay them out.
+static void **make_list(const struct ute_field *f, const struct bench_shape *shape)
+{
+    size_t count = shape->list;
+    void **arr = alloc_zeroed((1 + count) * sizeof(void *), sizeof(void *));
+    arr[0] = (void *)(uintptr_t)count;
+    int fixed = f->elem->type >= UTE_TYPE_FLOAT32 && f->elem->type <= UTE_TYPE_FIXED64;
+    uint8_t *block = fixed ? alloc_zeroed(count * f->elem->size, f->elem->align) : NULL;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (fixed)
+        {
+            arr[1 + i] = block + i * f->elem->size;
+            fill_inline(f->elem, arr[1 + i], shape);
+        }
+        else
+            arr[1 + i] = make_value(f->elem, shape);
+    }
+    return arr;
+}
+
+// =========================================================
+// Measurement
+// =========================================================
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Hardware counters of this thread (instructions, cache misses, branch
+// misses); unavailable counters have fd -1
+struct bench_counters
+{
+    int fd[BENCH_NUM_COUNTERS];
+};
+
+static const char *const counter_names[BENCH_NUM_COUNTERS] = {"instructions", "cache_misses", "branch_misses"};
+
+static void counters_open(struct bench_counters *c)
+{
+#ifdef __linux__
+    static const uint64_t configs[BENCH_NUM_COUNTERS] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int i = 0; i < BENCH_NUM_COUNTERS; ++i)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        c->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#else
+    for (int i = 0; i < BENCH_NUM_COUNTERS; ++i)
+        c->fd[i] = -1;
+#endif
+}
+
+static void counters_close(struct bench_counters *c)
+{
+    for (int i = 0; i < BENCH_NUM_COUNTERS; ++i)
+        if (c->fd[i] >= 0)
+            close(c->fd[i]);
+}
+
+static void counters_start(const struct bench_counters *c)
+{
+#ifdef __linux__
+    for (int i = 0; i < BENCH_NUM_COUNTERS; ++i)
+        if (c->fd[i] >= 0)
+        {
+            ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#else
+    (void)c;
+#endif
+}
+
+// Stop the counters and store their values per message into result
+static void counters_stop(const struct bench_counters *c, size_t iterations, struct bench_result *result)
+{
+    for (int i = 0; i < BENCH_NUM_COUNTERS; ++i)
+    {
+        uint64_t value = 0;
+        result->have_counters[i] = 0;
+#ifdef __linux__
+        if (c->fd[i] >= 0)
+        {
+            ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(c->fd[i], &value, sizeof(value)) == (ssize_t)sizeof(value))
+                result->have_counters[i] = 1;
+        }
+#endif
+        result->counters[i] = (double)value / (double)iterations;
+    }
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// One benchmarked operation: run() encodes or decodes one message
+struct bench_op
+{
+    size_t (*run)(void *ctx);
+    void *ctx;
+};
+
+// Run op for at least seconds in a tight loop (throughput, counters), then
+// time single calls for the latency percentiles. Latencies include the
+// overhead of reading the clock.
+static int measure(const struct bench_op *op, double seconds, const struct bench_counters *counters, struct bench_result *result)
+{
+    // Warm up caches, branch predictors and the arena
+    for (int i = 0; i < 3; ++i)
+        if (op->run(op->ctx) == UTE_BUF_ERROR)
+            return -1;
+    size_t iterations = 0, batch = 1;
+    double start = now_ns(), elapsed = 0;
+    counters_start(counters);
+    while (elapsed < seconds * 1e9)
+    {
+        for (size_t i = 0; i < batch; ++i)
+            sink = sink + op->run(op->ctx);
+        iterations += batch;
+        if (batch < 1024)
+            batch *= 2;
+        elapsed = now_ns() - start;
+    }
+    counters_stop(counters, iterations, result);
+    result->iterations = iterations;
+    result->ns_per_msg = elapsed / (double)iterations;
+
+    size_t samples = iterations < BENCH_MAX_SAMPLES ? iterations : BENCH_MAX_SAMPLES;
+    double *lat = malloc(samples * sizeof(double));
+    if (!lat)
+        return -1;
+    for (size_t i = 0; i < samples; ++i)
+    {
+        double t0 = now_ns();
+        sink = sink + op->run(op->ctx);
+        lat[i] = now_ns() - t0;
+    }
+    qsort(lat, samples, sizeof(double), compare_doubles);
+    result->p50 = lat[samples / 2];
+    result->p90 = lat[samples * 9 / 10];
+    result->p99 = lat[samples * 99 / 100];
+    result->max = lat[samples - 1];
+    free(lat);
+    return 0;
+}
+
+// State shared by the encode and decode operations of a case
+struct bench_codec
+{
+    const struct ute_plan *plan;
+    void **data;       // generated top-level values
+    uint8_t *buf;      // encoded message
+    size_t size;       // its size
+    void **out;        // decode target (top-level slots)
+    struct ute_arena arena;
+};
+
+static size_t run_encode(void *ctx)
+{
+    struct bench_codec *c = ctx;
+    return ute_serialize_plan(c->data, c->plan, c->buf, c->size);
+}
+
+static size_t run_decode(void *ctx)
+{
+    struct bench_codec *c = ctx;
+    ute_arena_reset(&c->arena);
+    memset(c->out, 0, c->plan->num_fields * sizeof(void *));
+    return ute_deserialize_arena_plan(c->buf, c->size, c->plan, &c->arena, c->out);
+}
+
+// =========================================================
+// Report
+// =========================================================
+
+static void print_result(FILE *f, const char *name, const struct bench_result *r, size_t size, int last)
+{
+    double msgs = 1e9 / r->ns_per_msg;
+    fprintf(f, "      \"%s\": {\"iterations\": %zu, \"ns_per_msg\": %.1f, \"msgs_per_s\": %.1f, \"mb_per_s\": %.2f,\n", name, r->iterations, r->ns_per_msg, msgs,
+            msgs * (double)size / 1e6);
+    fprintf(f, "        \"latency_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f},\n", r->p50, r->p90, r->p99, r->max);
+    fprintf(f, "        \"counters_per_msg\": {");
+    for (int i = 0; i < BENCH_NUM_COUNTERS; ++i)
+    {
+        if (r->have_counters[i])
+            fprintf(f, "\"%s\": %.1f", counter_names[i], r->counters[i]);
+        else
+            fprintf(f, "\"%s\": null", counter_names[i]);
+        fprintf(f, i + 1 < BENCH_NUM_COUNTERS ? ", " : "");
+    }
+    fprintf(f, "}}%s\n", last ? "" : ",");
+}
+
+// Run one case and append its JSON object to the report
+static int run_case(FILE *f, const char *name, const char *path, const struct bench_shape *shape, double seconds,
+                    const struct bench_counters *counters, int first)
+{
+    struct ute_schema schema = {0};
+    struct ute_plan plan;
+    if (ParseSchema(path, &schema) != 0 || schema.num_versions == 0)
+    {
+        fprintf(stderr, "Failed to load schema %s\n", path);
+        return -1;
+    }
+    const struct ute_schema_version *version = &schema.versions[schema.num_versions - 1];
+    if (ute_compile(version, &plan) != 0)
+    {
+        fprintf(stderr, "Failed to compile schema %s\n", path);
+        FreeSchema(&schema);
+        return -1;
+    }
+
+    ute_arena_reset(&data_arena);
+    struct bench_codec codec = {&plan, NULL, NULL, 0, NULL, {0}};
+    codec.data = alloc_zeroed(version->num_fields * sizeof(void *), sizeof(void *));
+    for (size_t i = 0; i < version->num_fields; ++i)
+        codec.data[i] = make_value(&version->fields[i], shape);
+    codec.size = ute_serialized_size_plan(codec.data, &plan);
+    codec.buf = codec.size != UTE_BUF_ERROR ? malloc(codec.size) : NULL;
+    codec.out = calloc(version->num_fields ? version->num_fields : 1, sizeof(void *));
+    int rc = -1;
+    if (!codec.buf || !codec.out || run_encode(&codec) != codec.size)
+        fprintf(stderr, "Failed to encode the payload of %s\n", name);
+    else
+    {
+        // The decoded message must encode to the same bytes
+        uint8_t *check = malloc(codec.size);
+        if (run_decode(&codec) != codec.size || !check || ute_serialize_plan(codec.out, &plan, check, codec.size) != codec.size ||
+            memcmp(check, codec.buf, codec.size) != 0)
+            fprintf(stderr, "Decoding %s does not round-trip\n", name);
+        else
+            rc = 0;
+        free(check);
+    }
+
+    struct bench_result enc, dec;
+    struct bench_op encode = {run_encode, &codec}, decode = {run_decode, &codec};
+    if (rc == 0 && (measure(&encode, seconds, counters, &enc) != 0 || measure(&decode, seconds, counters, &dec) != 0))
+        rc = -1;
+    if (rc == 0)
+    {
+        fprintf(f, "%s    {\"name\": \"%s\", \"schema\": \"%s\", \"list_len\": %zu, \"string_len\": %zu, \"bytes\": %zu,\n", first ? "" : ",\n", name, path, shape->list,
+                shape->string, codec.size);
+        print_result(f, "encode", &enc, codec.size, 0);
+        print_result(f, "decode", &dec, codec.size, 1);
+        fprintf(f, "    }");
+    }
+    ute_arena_free(&codec.arena);
+    free(codec.buf);
+    free(codec.out);
+    ute_plan_free(&plan);
+    FreeSchema(&schema);
+    return rc;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ute_bench [-d schema_dir] [-t seconds] [-l list_len] [-s string_len] [-o report.json] [case|schema.yaml ...]\n");
+    fprintf(stderr, "cases:");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+        fprintf(stderr, " %s", cases[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = "../../schemas/bench";
+    const char *output = NULL;
+    double seconds = 0.5;
+    long list = -1, string = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:t:l:s:o:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            dir = optarg;
+            break;
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'l':
+            list = atol(optarg);
+            break;
+        case 's':
+            string = atol(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (seconds <= 0)
+    {
+        usage();
+        return 2;
+    }
+    size_t num_cases = sizeof(cases) / sizeof(cases[0]);
+    for (int a = optind; a < argc; ++a)
+    {
+        size_t i = 0;
+        while (i < num_cases && strcmp(argv[a], cases[i].name) != 0)
+            ++i;
+        if (i == num_cases && !strstr(argv[a], ".yaml"))
+        {
+            fprintf(stderr, "Unknown case %s\n", argv[a]);
+            usage();
+            return 2;
+        }
+    }
+    FILE *f = output ? fopen(output, "w") : stdout;
+    if (!f)
+    {
+        fprintf(stderr, "Cannot open %s\n", output);
+        return 1;
+    }
+
+    struct bench_counters counters;
+    counters_open(&counters);
+    fprintf(f, "{\n  \"format\": 1,\n  \"seconds_per_op\": %.2f,\n  \"cases\": [\n", seconds);
+    int rc = 0, first = 1;
+    size_t runs = optind < argc ? (size_t)(argc - optind) : num_cases;
+    for (size_t r = 0; r < runs && rc == 0; ++r)
+    {
+        // A case name, or any schema file with the shape given by -l/-s
+        struct bench_case c = {NULL, NULL, {16, 16}};
+        char path[1024];
+        if (optind < argc)
+        {
+            const char *arg = argv[optind + r];
+            for (size_t i = 0; i < num_cases; ++i)
+                if (strcmp(arg, cases[i].name) == 0)
+                    c = cases[i];
+            if (!c.name)
+                c.name = arg;
+        }
+        else
+            c = cases[r];
+        if (c.schema)
+            snprintf(path, sizeof(path), "%s/%s", dir, c.schema);
+        else
+            snprintf(path, sizeof(path), "%s", c.name);
+        if (list >= 0)
+            c.shape.list = (size_t)list;
+        if (string >= 0)
+            c.shape.string = (size_t)string;
+        rc = run_case(f, c.name, path, &c.shape, seconds, &counters, first) ? 1 : 0;
+        first = 0;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    counters_close(&counters);
+    ute_arena_free(&data_arena);
+    if (output)
+        fclose(f);
+    return rc;
+}
@@ -1,19 +1,50 @@
-
 #include "codex.h"
+#include "arena.h"
+#include "plan.h"
 #include "schema.h"
+#include "utf8.h"
+#include "varint.h"
+#include "wire.h"
+#include <limits.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#ifdef UTE_STATS
+#include "stats.h"
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 
 // Sentinel value returned when buffers are too small
 #define ERR UTE_BUF_ERROR
 
+// Number of instructions compiled on the stack by ute_serialize/ute_deserialize
+#define UTE_LOCAL_INSNS 64
+
+// Number of packed list values gathered for one call of the bulk varint kernels
+#define UTE_PACKED_CHUNK 256
+
+// Return ERR for a failure with a UTE_ERROR_* cause, which UTE_STATS builds
+// count at the field being run (see stats.h)
+#ifdef UTE_STATS
+#define FAIL(why)            \
+    do                       \
+    {                        \
+        trace.cause = (why); \
+        return ERR;          \
+    } while (0)
+#else
+#define FAIL(why) return ERR
+#endif
+
 // Macro to ensure there is enough space remaining in an output buffer
 #define ENSURE_SPACE(wanted)               \
     do                                     \
     {                                      \
         if (out_size - written < (wanted)) \
-            return ERR;                    \
+            FAIL(UTE_ERROR_SPACE);         \
     } while (0)
 
 // Macro to ensure there is enough data left in an input buffer
@@ -21,18 +52,271 @@
     do                                 \
     {                                  \
         if (in_size - read < (wanted)) \
-            return ERR;                \
+            FAIL(UTE_ERROR_SPACE);     \
+    } while (0)
+
+// Macros to append to the output buffer. A NULL out only counts bytes,
+// which is how ute_serialized_size runs the encoder as a sizing pass.
+#define PUT_BYTE(b)                      \
+    do                                   \
+    {                                    \
+        ENSURE_SPACE(1);                 \
+        if (out)                         \
+            out[written] = (uint8_t)(b); \
+        written++;                       \
+    } while (0)
+
+#define PUT_BYTES(src, len)                        \
+    do                                             \
+    {                                              \
+        ENSURE_SPACE(len);                         \
+        if (out)                                   \
+            memcpy(out + written, (src), (len));   \
+        written += (len);                          \
+    } while (0)
+
+#define PUT_VARINT(n)                                         \
+    do                                                        \
+    {                                                         \
+        if (!out)                                             \
+            written += ute_varint_len(n);                     \
+        else if (out_size - written >= 10)                    \
+            written += ute_encode_varint((n), out + written); \
+        else                                                  \
+        {                                                     \
+            uint8_t tmp[10];                                  \
+            size_t var_len = ute_encode_varint((n), tmp);     \
+            ENSURE_SPACE(var_len);                            \
+            memcpy(out + written, tmp, var_len);              \
+            written += var_len;                               \
+        }                                                     \
+    } while (0)
+
+// Macro to read a varint from the input buffer into dst
+#define GET_VARINT(dst)                                                         \
+    do                                                                          \
+    {                                                                           \
+        if (read < in_size && in[read] < 0x80)                                  \
+            (dst) = in[read++];                                                 \
+        else                                                                    \
+        {                                                                       \
+            size_t var_len = ute_decode_varint(in + read, in_size - read, &(dst)); \
+            if (var_len == 0 || read + var_len > in_size)                       \
+                FAIL(UTE_ERROR_VARINT);                                         \
+            read += var_len;                                                    \
+        }                                                                       \
     } while (0)
 
 // =========================================================
 // Ultra Tiny Encoding (UTE) - Serialization/Deserialization
 // =========================================================
 
+// Saved state of an open list or struct while the VM runs its body
+struct ute_frame
+{
+    uint8_t *base;         // base pointer of the enclosing node
+    size_t remaining;      // list elements left (including the current one);
+                           // decoding a sparse struct: (index, value) pairs left
+    const uint8_t *bitmap; // decoding a bitmap struct: its presence bits
+    uint8_t form;          // sparse struct: UTE_STRUCT_* flags of this instance
+#ifdef UTE_STATS
+    size_t start; // where the encoding of the list or struct begins
+#endif
+};
+
+// Scatter-gather state of an iovec encode: scratch bytes before flushed are
+// already covered by iovecs
+struct ute_gather
+{
+    struct ute_iov *iov;
+    size_t flushed;
+};
+
+// Parallel run: the chunks of chunked lists are spread over the workers of
+// an executor. Lists nested inside a chunk are handled by its worker alone.
+struct ute_parallel
+{
+    const struct ute_executor *exec;
+    struct ute_arena *arenas; // decoding: one arena per worker (NULL: user memory)
+};
+
+// Chunks of one chunked list, encoded or decoded by the tasks of an executor
+struct ute_chunk_job
+{
+    const struct ute_insn *insns;
+    size_t pc;                // the LIST instruction
+    void **arr;               // [count, ptr, ptr, ...]
+    size_t count;
+    size_t per;               // elements per chunk
+    uint8_t *out;             // encoding: output buffer (NULL while sizing the chunks)
+    const uint8_t *in;        // decoding: input buffer
+    size_t *offsets;          // start of every chunk, then the end of the last one
+    size_t *results;          // per chunk: its size (sizing), end offset or ERR
+    struct ute_arena *arenas; // decoding: one arena per worker (NULL: user memory)
+    const struct ute_dictionary *dict;
+#ifdef UTE_STATS
+    struct ute_stats *stats; // counters of the calling thread (NULL: not counted)
+    int failed;              // set by the first failing task, which records where and why
+    size_t fail_pc;
+    int fail_cause;
+#endif
+};
+
+// -------------------------
+// Instrumentation (UTE_STATS builds, see stats.h)
+// -------------------------
+
+#ifdef UTE_STATS
+// State of the top-level call running on this thread: the counters of its
+// plan (NULL in sizing passes), the instruction being run and the cause of
+// the last failure
+struct ute_trace
+{
+    struct ute_stats *stats;
+    size_t pc;
+    int cause;
+};
+static _Thread_local struct ute_trace trace;
+static const struct ute_tracer *tracer;
+
+#define STAT_ADD(counter, n) __atomic_fetch_add(&(counter), (uint64_t)(n), __ATOMIC_RELAXED)
+
+// Cycle counter for UTE_STATS_TIMING
+static inline uint64_t ute_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Count a value of the instruction at pc that took bytes
+static inline void stat_value(int kind, size_t pc, size_t bytes)
+{
+    struct ute_stats *stats = trace.stats;
+    if (!stats)
+        return;
+    struct ute_field_stats *field = &stats->fields[pc];
+    if (kind == UTE_TRACE_ENCODE)
+    {
+        STAT_ADD(field->encoded, 1);
+        STAT_ADD(field->bytes_written, bytes);
+    }
+    else
+    {
+        STAT_ADD(field->decoded, 1);
+        STAT_ADD(field->bytes_read, bytes);
+    }
+}
+
+// Start a top-level call of plan (sizing passes are not counted or traced).
+// Returns the cycle count at its start.
+static uint64_t stat_begin(const struct ute_plan *plan, int kind, int counted)
+{
+    trace.stats = counted ? plan->stats : NULL;
+    trace.pc = 0;
+    trace.cause = UTE_ERROR_OTHER;
+    const struct ute_tracer *t = __atomic_load_n(&tracer, __ATOMIC_ACQUIRE);
+    if (counted && t && t->begin)
+        t->begin(t->ctx, kind, plan);
+    return trace.stats && (trace.stats->flags & UTE_STATS_TIMING) ? ute_cycles() : 0;
+}
+
+// End a top-level call with its result
+static void stat_end(const struct ute_plan *plan, int kind, int counted, uint64_t start, size_t result)
+{
+    struct ute_stats *stats = trace.stats;
+    if (stats)
+    {
+        struct ute_call_stats *call = kind == UTE_TRACE_ENCODE ? &stats->encode : &stats->decode;
+        if (stats->flags & UTE_STATS_TIMING)
+            STAT_ADD(call->cycles, ute_cycles() - start);
+        STAT_ADD(call->calls, 1);
+        if (result == ERR)
+        {
+            STAT_ADD(call->errors, 1);
+            STAT_ADD(stats->fields[trace.pc].errors[trace.cause], 1);
+        }
+        else
+            STAT_ADD(call->bytes, result);
+    }
+    trace.stats = NULL;
+    const struct ute_tracer *t = __atomic_load_n(&tracer, __ATOMIC_ACQUIRE);
+    if (counted && t && t->end)
+        t->end(t->ctx, kind, plan, result);
+}
+
+void ute_set_tracer(const struct ute_tracer *t)
+{
+    __atomic_store_n(&tracer, t, __ATOMIC_RELEASE);
+}
+
+// Chunk tasks count into the counters of the call that started them; a
+// failing task leaves its instruction and cause for the caller
+static inline struct ute_stats *stat_task_begin(const struct ute_chunk_job *job, int counted)
+{
+    struct ute_stats *saved = trace.stats;
+    trace.stats = counted ? job->stats : NULL;
+    return saved;
+}
+
+static inline void stat_task_end(struct ute_chunk_job *job, struct ute_stats *saved, size_t result)
+{
+    int expected = 0;
+    if (result == ERR && __atomic_compare_exchange_n(&job->failed, &expected, 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        job->fail_pc = trace.pc;
+        job->fail_cause = trace.cause;
+    }
+    trace.stats = saved;
+}
+
+// The VMs note the instruction they run and where its value starts; values
+// are counted once complete, lists and structs with frames at their end
+#define STAT_INSN(pc, pos)   \
+    size_t stat_start = (pos); \
+    trace.pc = (pc)
+#define STAT_VALUE(kind, pc, pos) stat_value(kind, pc, (pos) - stat_start)
+#define STAT_OPEN(frame) ((frame).start = stat_start)
+#define STAT_CLOSE(kind, pc, frame, pos) stat_value(kind, pc, (pos) - (frame).start)
+#define STAT_TASK_BEGIN(job, counted) struct ute_stats *stat_saved = stat_task_begin(job, counted)
+#define STAT_TASK_END(job, result) stat_task_end(job, stat_saved, result)
+#define STAT_JOB_INIT , trace.stats, 0, 0, 0
+#define STAT_JOB_FAILED(job) ((job).failed ? (void)(trace.pc = (job).fail_pc, trace.cause = (job).fail_cause) : (void)0)
+// Flat lists and structs are run instruction by instruction so that their
+// members are counted
+#define FAST_FLAT 0
+#else
+#define STAT_INSN(pc, pos) ((void)0)
+#define STAT_VALUE(kind, pc, pos) ((void)0)
+#define STAT_OPEN(frame) ((void)0)
+#define STAT_CLOSE(kind, pc, frame, pos) ((void)0)
+#define STAT_TASK_BEGIN(job, counted) ((void)0)
+#define STAT_TASK_END(job, result) ((void)0)
+#define STAT_JOB_INIT
+#define STAT_JOB_FAILED(job) ((void)0)
+#define FAST_FLAT UTE_INSN_FLAT
+#endif
+
 // Internal helpers (static)
-static size_t ute_encode_varint(uint64_t n, uint8_t *out);
-static size_t ute_decode_varint(const uint8_t *in, size_t in_size, uint64_t *out);
-static size_t ute_write_field(const struct ute_field *field, const void *value, uint8_t *out, size_t out_size);
-static size_t ute_read_field(const struct ute_field *field, const uint8_t *in, size_t in_size, void *value);
+struct ute_ref_targets;
+static size_t ute_run_encode(const struct ute_plan *plan, const void *data, uint8_t *out, size_t out_size, struct ute_gather *gather,
+                             const struct ute_parallel *par);
+static size_t ute_run_decode(const struct ute_plan *plan, const uint8_t *in, size_t in_size, void *data, struct ute_arena *arena,
+                             const struct ute_parallel *par);
+static size_t ute_vm_encode(const struct ute_insn *insns, size_t pc, uint8_t *base, size_t elems, uint8_t *out, size_t written,
+                            size_t out_size, struct ute_gather *gather, const struct ute_dictionary *dict, const struct ute_parallel *par);
+static size_t ute_vm_decode(const struct ute_insn *insns, size_t pc, const uint8_t *in, size_t read, size_t in_size, uint8_t *base,
+                            size_t elems, struct ute_arena *arena, const struct ute_dictionary *dict, const struct ute_parallel *par);
+static size_t ute_run_versioned(const uint8_t *in_buf, size_t in_buf_size, const struct ute_evolution *evo, struct ute_arena *arena, void *out_data);
+static size_t ute_vm_validate(const struct ute_insn *insns, size_t pc, const uint8_t *in, size_t read, size_t in_size, size_t elems,
+                              const struct ute_dictionary *dict, int flags, struct ute_ref_targets *targets);
+static int ute_compile_local(const void *schema, struct ute_insn *local, struct ute_plan *plan);
+static int ute_compile_version_local(const struct ute_schema_version *version, struct ute_insn *local, struct ute_plan *plan);
+static void ute_release_local(struct ute_plan *plan, struct ute_insn *local);
 
 // -------------------------
 // Public API
@@ -43,16 +327,12 @@ size_t ute_serialize(const void *data, const void *schema, uint8_t *out_buf, siz
 {
     // data: pointer to array of pointers (one per top-level field)
     // schema: pointer to ute_field array (top-level fields)
-    const struct ute_field *fields = (const struct ute_field *)schema;
-    size_t num_fields = 1; // for demo, only one top-level field ("devices")
-    size_t written = 0;
-    for (size_t i = 0; i < num_fields; ++i)
-    {
-        size_t sub = ute_write_field(&fields[i], ((const void *const *)data)[i], out_buf + written, out_buf_size - written);
-        if (sub == ERR)
-            return ERR;
-        written += sub;
-    }
+    struct ute_insn local[UTE_LOCAL_INSNS];
+    struct ute_plan plan;
+    if (ute_compile_local(schema, local, &plan) != 0)
+        return ERR;
+    size_t written = ute_serialize_plan(data, &plan, out_buf, out_buf_size);
+    ute_release_local(&plan, local);
     return written;
 }
 
@@ -60,263 +340,2846 @@ size_t ute_serialize(const void *data, const void *schema, uint8_t *out_buf, siz
 size_t ute_deserialize(const uint8_t *in_buf, size_t in_buf_size, const void *schema, void *out_data)
 {
     // schema: pointer to ute_field array (top-level fields)
-    const struct ute_field *fields = (const struct ute_field *)schema;
-    size_t num_fields = 1; // for demo, only one top-level field ("devices")
-    size_t read = 0;
-    for (size_t i = 0; i < num_fields; ++i)
+    struct ute_insn local[UTE_LOCAL_INSNS];
+    struct ute_plan plan;
+    if (ute_compile_local(schema, local, &plan) != 0)
+        return ERR;
+    size_t read = ute_deserialize_plan(in_buf, in_buf_size, &plan, out_data);
+    ute_release_local(&plan, local);
+    return read;
+}
+
+// Deserialize data according to a schema version, allocating missing storage from an arena
+size_t ute_deserialize_arena(const uint8_t *in_buf, size_t in_buf_size, const struct ute_schema_version *version, struct ute_arena *arena,
+                             void *out_data)
+{
+    struct ute_insn local[UTE_LOCAL_INSNS];
+    struct ute_plan plan;
+    if (ute_compile_version_local(version, local, &plan) != 0)
+        return ERR;
+    size_t read = ute_deserialize_arena_plan(in_buf, in_buf_size, &plan, arena, out_data);
+    ute_release_local(&plan, local);
+    return read;
+}
+
+// Serialize data according to a schema version into iovecs
+size_t ute_serialize_iov(const void *data, const struct ute_schema_version *version, struct ute_iov *iov)
+{
+    struct ute_insn local[UTE_LOCAL_INSNS];
+    struct ute_plan plan;
+    if (ute_compile_version_local(version, local, &plan) != 0)
+        return ERR;
+    size_t total = ute_serialize_iov_plan(data, &plan, iov);
+    ute_release_local(&plan, local);
+    return total;
+}
+
+// Compute the exact serialized size of data according to a schema version
+size_t ute_serialized_size(const void *data, const struct ute_schema_version *version)
+{
+    struct ute_insn local[UTE_LOCAL_INSNS];
+    struct ute_plan plan;
+    if (ute_compile_version_local(version, local, &plan) != 0)
+        return ERR;
+    size_t size = ute_serialized_size_plan(data, &plan);
+    ute_release_local(&plan, local);
+    return size;
+}
+
+// Serialize data according to a schema version into a writer
+size_t ute_serialize_writer(const void *data, const struct ute_schema_version *version, const struct ute_writer *writer)
+{
+    struct ute_insn local[UTE_LOCAL_INSNS];
+    struct ute_plan plan;
+    if (ute_compile_version_local(version, local, &plan) != 0)
+        return ERR;
+    size_t written = ute_serialize_writer_plan(data, &plan, writer);
+    ute_release_local(&plan, local);
+    return written;
+}
+
+// Serialize data according to a compiled plan
+size_t ute_serialize_plan(const void *data, const struct ute_plan *plan, uint8_t *out_buf, size_t out_buf_size)
+{
+    if (!data || !plan || !plan->insns || !out_buf)
+        return ERR;
+    return ute_run_encode(plan, data, out_buf, out_buf_size, NULL, NULL);
+}
+
+// Serialize data according to a compiled plan into iovecs: the plain encoder
+// with large strings diverted to iovecs of their own
+size_t ute_serialize_iov_plan(const void *data, const struct ute_plan *plan, struct ute_iov *iov)
+{
+    if (!data || !plan || !plan->insns || !iov || !iov->iov != !iov->scratch)
+        return ERR;
+    iov->iov_count = 0;
+    iov->scratch_len = 0;
+    iov->referenced = 0;
+    struct ute_gather gather = {iov, 0};
+    size_t written = ute_run_encode(plan, data, iov->scratch, iov->scratch ? iov->scratch_cap : SIZE_MAX, &gather, NULL);
+    if (written == ERR)
+        return ERR;
+    // Trailing scratch bytes after the last referenced string
+    if (written > gather.flushed)
     {
-        size_t sub = ute_read_field(&fields[i], in_buf + read, in_buf_size - read, ((void **)out_data)[i]);
-        if (sub == ERR)
-            return ERR;
-        read += sub;
+        if (iov->iov)
+        {
+            if (iov->iov_count == iov->iov_cap)
+                return ERR;
+            iov->iov[iov->iov_count].iov_base = iov->scratch + gather.flushed;
+            iov->iov[iov->iov_count].iov_len = written - gather.flushed;
+        }
+        iov->iov_count++;
     }
+    iov->scratch_len = written;
+    return written + iov->referenced;
+}
+
+// Deserialize data according to a compiled plan
+size_t ute_deserialize_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, void *out_data)
+{
+    if (!in_buf || !plan || !plan->insns || !out_data)
+        return ERR;
+    return ute_run_decode(plan, in_buf, in_buf_size, out_data, NULL, NULL);
+}
+
+// Deserialize data according to a compiled plan, allocating missing storage from an arena
+size_t ute_deserialize_arena_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, struct ute_arena *arena, void *out_data)
+{
+    if (!in_buf || !plan || !plan->insns || !arena || !out_data)
+        return ERR;
+    return ute_run_decode(plan, in_buf, in_buf_size, out_data, arena, NULL);
+}
+
+// Serialize data according to a compiled plan, encoding the chunks of chunked lists in parallel
+size_t ute_serialize_parallel(const void *data, const struct ute_plan *plan, uint8_t *out_buf, size_t out_buf_size, const struct ute_executor *exec)
+{
+    if (!data || !plan || !plan->insns || !out_buf || !exec || !exec->run || !exec->num_workers)
+        return ERR;
+    struct ute_parallel par = {exec, NULL};
+    return ute_run_encode(plan, data, out_buf, out_buf_size, NULL, &par);
+}
+
+// Deserialize data according to a compiled plan, decoding the chunks of chunked lists in parallel
+size_t ute_deserialize_parallel(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, const struct ute_executor *exec, void *out_data)
+{
+    if (!in_buf || !plan || !plan->insns || !exec || !exec->run || !exec->num_workers || !out_data)
+        return ERR;
+    struct ute_parallel par = {exec, NULL};
+    return ute_run_decode(plan, in_buf, in_buf_size, out_data, NULL, &par);
+}
+
+// Deserialize data according to a compiled plan in parallel, allocating
+// missing storage from one arena per worker (the caller uses the first one)
+size_t ute_deserialize_arena_parallel(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, struct ute_arena *arenas, const struct ute_executor *exec, void *out_data)
+{
+    if (!in_buf || !plan || !plan->insns || !arenas || !exec || !exec->run || !exec->num_workers || !out_data)
+        return ERR;
+    struct ute_parallel par = {exec, arenas};
+    return ute_run_decode(plan, in_buf, in_buf_size, out_data, &arenas[0], &par);
+}
+
+// Check an encoded message against a schema version without decoding it
+size_t ute_validate(const uint8_t *in_buf, size_t in_buf_size, const struct ute_schema_version *version, int flags)
+{
+    struct ute_insn local[UTE_LOCAL_INSNS];
+    struct ute_plan plan;
+    if (ute_compile_version_local(version, local, &plan) != 0)
+        return ERR;
+    size_t read = ute_validate_plan(in_buf, in_buf_size, &plan, flags);
+    ute_release_local(&plan, local);
+    return read;
+}
+
+// Check an encoded message against a compiled plan without decoding it
+size_t ute_validate_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, int flags)
+{
+    if ((!in_buf && in_buf_size) || !plan || !plan->insns)
+        return ERR;
+    return ute_vm_validate(plan->insns, 0, in_buf, 0, in_buf_size, 0, &plan->dictionary, flags, NULL);
+}
+
+// Compute the exact serialized size of data according to a compiled plan
+size_t ute_serialized_size_plan(const void *data, const struct ute_plan *plan)
+{
+    if (!data || !plan || !plan->insns)
+        return ERR;
+    // A NULL output buffer makes the encoder count instead of write
+    return ute_run_encode(plan, data, NULL, SIZE_MAX, NULL, NULL);
+}
+
+// Serialize data according to a compiled plan into a writer: one sizing
+// pass, one reserve of the exact size, one encode pass
+size_t ute_serialize_writer_plan(const void *data, const struct ute_plan *plan, const struct ute_writer *writer)
+{
+    if (!writer || !writer->reserve)
+        return ERR;
+    size_t size = ute_serialized_size_plan(data, plan);
+    if (size == ERR)
+        return ERR;
+    uint8_t *region = writer->reserve(writer->ctx, size);
+    if (!region)
+        return ERR;
+    size_t written = ute_run_encode(plan, data, region, size, NULL, NULL);
+    if (written == ERR)
+        return ERR;
+    if (writer->commit)
+        writer->commit(writer->ctx, written);
+    return written;
+}
+
+// Serialize data according to a compiled plan, preceded by its version tag
+size_t ute_serialize_tagged_plan(const void *data, const struct ute_plan *plan, uint8_t *out_buf, size_t out_buf_size)
+{
+    if (!plan || !out_buf || plan->version < 0)
+        return ERR;
+    uint8_t *out = out_buf;
+    size_t out_size = out_buf_size;
+    size_t written = 0;
+    PUT_BYTE(UTE_VERSION_TAG);
+    PUT_VARINT((uint64_t)plan->version);
+    size_t body = ute_serialize_plan(data, plan, out_buf + written, out_buf_size - written);
+    return body == ERR ? ERR : written + body;
+}
+
+// Read the version tag in front of a message (0 if there is none)
+size_t ute_read_version_tag(const uint8_t *in_buf, size_t in_buf_size, int *out_version)
+{
+    if (!in_buf || !out_version)
+        return ERR;
+    const uint8_t *in = in_buf;
+    size_t in_size = in_buf_size;
+    size_t read = 0;
+    if (in_size == 0 || (in[0] >> 5) != (UTE_VERSION_TAG >> 5))
+        return 0;
+    if (in[read++] != UTE_VERSION_TAG)
+        return ERR;
+    uint64_t version = 0;
+    GET_VARINT(version);
+    if (version > INT_MAX)
+        return ERR;
+    *out_version = (int)version;
     return read;
 }
 
+// Deserialize a message of any version of an evolution
+size_t ute_deserialize_versioned(const uint8_t *in_buf, size_t in_buf_size, const struct ute_evolution *evo, void *out_data)
+{
+    return ute_run_versioned(in_buf, in_buf_size, evo, NULL, out_data);
+}
+
+// Deserialize a message of any version of an evolution, allocating missing storage from an arena
+size_t ute_deserialize_arena_versioned(const uint8_t *in_buf, size_t in_buf_size, const struct ute_evolution *evo, struct ute_arena *arena, void *out_data)
+{
+    if (!arena)
+        return ERR;
+    return ute_run_versioned(in_buf, in_buf_size, evo, arena, out_data);
+}
+
+// Built-in growable buffer: reserve callback
+static uint8_t *ute_buffer_reserve(void *ctx, size_t size)
+{
+    struct ute_buffer *buf = (struct ute_buffer *)ctx;
+    if (buf->cap - buf->len < size)
+    {
+        size_t cap = buf->cap ? buf->cap : 64;
+        while (cap - buf->len < size)
+        {
+            if (cap > SIZE_MAX / 2)
+                return NULL;
+            cap *= 2;
+        }
+        uint8_t *data = realloc(buf->data, cap);
+        if (!data)
+            return NULL;
+        buf->data = data;
+        buf->cap = cap;
+    }
+    return buf->data + buf->len;
+}
+
+// Built-in growable buffer: commit callback
+static void ute_buffer_commit(void *ctx, size_t size)
+{
+    struct ute_buffer *buf = (struct ute_buffer *)ctx;
+    buf->len += size;
+}
+
+// Create a writer that appends to a growable buffer
+struct ute_writer ute_buffer_writer(struct ute_buffer *buf)
+{
+    struct ute_writer writer = {ute_buffer_reserve, ute_buffer_commit, buf};
+    return writer;
+}
+
+// Free the memory of a growable buffer
+void ute_buffer_free(struct ute_buffer *buf)
+{
+    if (!buf)
+        return;
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
 // -------------------------
 // Internal helpers (static)
 // -------------------------
 
-// Encode varint (returns bytes written)
-static size_t ute_encode_varint(uint64_t n, uint8_t *out)
+// Compile the top-level schema fields into stack storage, falling back to the heap
+static int ute_compile_local(const void *schema, struct ute_insn *local, struct ute_plan *plan)
 {
-    size_t i = 0;
-    while (n >= 0x80)
+    const struct ute_field *fields = (const struct ute_field *)schema;
+    size_t num_fields = 1; // for demo, only one top-level field ("devices")
+    int rc = ute_compile_into(fields, num_fields, local, UTE_LOCAL_INSNS, plan);
+    if (rc == -2)
+        rc = ute_compile_fields(fields, num_fields, plan);
+    return rc;
+}
+
+// Compile every field of a schema version, with its dictionary, into stack
+// storage, falling back to the heap
+static int ute_compile_version_local(const struct ute_schema_version *version, struct ute_insn *local, struct ute_plan *plan)
+{
+    if (!version)
+        return -1;
+    int rc = ute_compile_into(version->fields, version->num_fields, local, UTE_LOCAL_INSNS, plan);
+    if (rc == -2)
+        return ute_compile(version, plan);
+    if (rc == 0)
     {
-        out[i++] = (uint8_t)(n | 0x80);
-        n >>= 7;
+        plan->version = version->version;
+        plan->dictionary = version->dictionary;
     }
-    out[i++] = (uint8_t)n;
-    return i;
+    return rc;
 }
 
-// Decode varint (returns bytes read)
-static size_t ute_decode_varint(const uint8_t *in, size_t in_size, uint64_t *out)
+// Free a plan produced by ute_compile_local or ute_compile_version_local
+static void ute_release_local(struct ute_plan *plan, struct ute_insn *local)
 {
-    size_t i = 0;
-    uint64_t result = 0;
-    int shift = 0;
-    while (i < in_size)
+    if (plan->insns != local)
+        ute_plan_free(plan);
+}
+
+// Resolve the value pointer of an instruction relative to the current base
+static inline uint8_t *slot_value(uint8_t *base, const struct ute_insn *insn)
+{
+    uint8_t *p = base + insn->offset;
+    if (insn->flags & UTE_INSN_INDIRECT)
+        p = *(uint8_t **)p;
+    return p;
+}
+
+// Append an iovec for the scratch bytes written since the last flush (if
+// any) and one referencing len bytes of user memory. Without an iovec array
+// only the number of iovecs is counted.
+static int ute_gather_ref(struct ute_gather *gather, uint8_t *out, size_t written, const void *data, size_t len)
+{
+    struct ute_iov *iov = gather->iov;
+    size_t need = written > gather->flushed ? 2 : 1;
+    if (iov->iov)
     {
-        uint8_t b = in[i++];
-        result |= (uint64_t)(b & 0x7F) << shift;
-        if (!(b & 0x80))
-            break;
-        shift += 7;
+        if (iov->iov_cap - iov->iov_count < need)
+            return -1;
+        struct iovec *v = iov->iov + iov->iov_count;
+        if (need == 2)
+        {
+            v->iov_base = out + gather->flushed;
+            v->iov_len = written - gather->flushed;
+            v++;
+        }
+        v->iov_base = (void *)data;
+        v->iov_len = len;
     }
-    *out = result;
-    return i;
+    iov->iov_count += need;
+    iov->referenced += len;
+    gather->flushed = written;
+    return 0;
 }
 
-// Write a field value to buffer (recursive for struct/list)
-static size_t ute_write_field(const struct ute_field *field, const void *value, uint8_t *out, size_t out_size)
+// Encode a leaf value at out + written (returns the new written count or ERR)
+static inline size_t ute_put_leaf(const struct ute_insn *insn, const uint8_t *value, uint8_t *out, size_t written, size_t out_size, struct ute_gather *gather)
 {
-    size_t written = 0;
-    if (!field || !out)
+    if (!value)
         return ERR;
-#ifdef UTE_DEBUG
-    printf("ute_write_field: field=%s type=%d value=%p out=%p out_size=%zu\n",
-           field->name ? field->name : "(anon)", field->type, value, out, out_size);
-    fflush(stdout);
-#endif
-    switch (field->type)
+    switch (insn->op)
     {
-    case UTE_TYPE_INT:
+    case UTE_OP_NULL:
+        PUT_BYTE(0 << 5); // tNull
+        return written;
+    case UTE_OP_BOOL:
+        PUT_BYTE((1 << 5) | (*value ? 0x10 : 0)); // tBool
+        return written;
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+    {
+        uint64_t v;
+        memcpy(&v, value, sizeof(v));
+        PUT_BYTE(2 << 5); // tInt
+        PUT_VARINT(insn->op == UTE_OP_SINT ? ute_zigzag_encode(v) : v);
+        return written;
+    }
+    case UTE_OP_STRING:
     {
-#ifdef UTE_DEBUG
-        printf("  UTE_TYPE_INT: value ptr=%p\n", value);
-#endif
-        if (!value)
-        {
-#ifdef UTE_DEBUG
-            printf("  ERROR: value is NULL\n");
-#endif
-            return ERR;
-        }
-        uint64_t v = *(const uint64_t *)value;
-#ifdef UTE_DEBUG
-        printf("  UTE_TYPE_INT: value=%llu\n", (unsigned long long)v);
-#endif
-        ENSURE_SPACE(1);
-        out[written++] = (2 << 5); // tInt
-        uint8_t tmp[10];
-        size_t var_len = ute_encode_varint(v, tmp);
-        ENSURE_SPACE(var_len);
-        memcpy(out + written, tmp, var_len);
-        written += var_len;
-        break;
-    }
-    case UTE_TYPE_STRING:
-    {
-#ifdef UTE_DEBUG
-        printf("  UTE_TYPE_STRING: value ptr=%p\n", value);
-#endif
-        if (!value)
-        {
-#ifdef UTE_DEBUG
-            printf("  ERROR: value is NULL\n");
-#endif
-            return ERR;
-        }
         const char *s = (const char *)value;
-#ifdef UTE_DEBUG
-        printf("  UTE_TYPE_STRING: value='%s'\n", s);
-#endif
-        ENSURE_SPACE(1);
-        out[written++] = (3 << 5); // tBytes
         size_t len = strlen(s);
-        uint8_t tmp[10];
-        size_t var_len = ute_encode_varint(len, tmp);
-        ENSURE_SPACE(var_len + len);
-        memcpy(out + written, tmp, var_len);
-        written += var_len;
-        memcpy(out + written, s, len);
-        written += len;
-        break;
+        PUT_BYTE(3 << 5); // tBytes
+        PUT_VARINT(len);
+        if (gather && len && len >= gather->iov->threshold)
+            return ute_gather_ref(gather, out, written, s, len) == 0 ? written : ERR;
+        PUT_BYTES(s, len);
+        return written;
     }
-    case UTE_TYPE_LIST:
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
     {
-#ifdef UTE_DEBUG
-        printf("  UTE_TYPE_LIST: value ptr=%p\n", value);
-#endif
-        ENSURE_SPACE(1);
-        out[written++] = (4 << 5); // tList
-        size_t count = (size_t)(uintptr_t)(((const void **)value)[0]);
-#ifdef UTE_DEBUG
-        printf("  UTE_TYPE_LIST: count=%zu\n", count);
-#endif
-        uint8_t tmp[10];
-        size_t var_len = ute_encode_varint(count, tmp);
-        ENSURE_SPACE(var_len);
-        memcpy(out + written, tmp, var_len);
-        written += var_len;
-        const void **arr = &((const void **)value)[1];
-        for (size_t i = 0; i < count; ++i)
-        {
-#ifdef UTE_DEBUG
-            printf("    UTE_TYPE_LIST: arr[%zu]=%p\n", i, arr[i]);
-#endif
-            size_t sub = ute_write_field(field->elem, arr[i], out + written, out_size - written);
-            if (sub == ERR)
-                return ERR;
-            written += sub;
-        }
-        break;
+        size_t width = UTE_OP_WIDTH(insn->op);
+        PUT_BYTE(UTE_FIXED_PREFIX(width)); // tFixed
+        ENSURE_SPACE(width);
+        if (out)
+            ute_copy_le(out + written, value, 1, width);
+        return written + width;
     }
-    case UTE_TYPE_STRUCT:
+    case UTE_OP_BYTES:
     {
-#ifdef UTE_DEBUG
-        printf("  UTE_TYPE_STRUCT: struct_data=%p, num_fields=%zu\n", value, field->num_fields);
-#endif
-        ENSURE_SPACE(1);
-        out[written++] = (5 << 5); // tStruct
-        uint8_t tmp[10];
-        size_t var_len = ute_encode_varint(field->num_fields, tmp);
-        ENSURE_SPACE(var_len);
-        memcpy(out + written, tmp, var_len);
-        written += var_len;
-        const void *struct_data = value;
-        for (size_t i = 0; i < field->num_fields; ++i)
-        {
-#ifdef UTE_DEBUG
-            printf("    UTE_TYPE_STRUCT: field %zu: name=%s offset=%zu\n", i, field->fields[i].name, field->fields[i].offset);
-#endif
-            size_t sub = ute_write_field(&field->fields[i], (const char *)struct_data + field->fields[i].offset, out + written, out_size - written);
-            if (sub == ERR)
-                return ERR;
-            written += sub;
-        }
-        break;
+        const struct ute_bytes *bytes = (const struct ute_bytes *)value;
+        if (insn->arg && bytes->len > insn->arg)
+            return ERR;
+        PUT_BYTE(6 << 5); // tFixed without width: bytes
+        PUT_VARINT(bytes->len);
+        if (gather && bytes->len && bytes->len >= gather->iov->threshold)
+            return ute_gather_ref(gather, out, written, bytes->data, bytes->len) == 0 ? written : ERR;
+        PUT_BYTES(bytes->data, bytes->len);
+        return written;
     }
     default:
-        break;
+        return ERR;
     }
-    return written;
 }
 
-// Read a field value from buffer (recursive for struct/list)
-static size_t ute_read_field(const struct ute_field *field, const uint8_t *in, size_t in_size, void *value)
+// Encode a flat node: a leaf, or a struct whose members are all leaves
+static inline size_t ute_put_flat(const struct ute_insn *insn, const uint8_t *value, uint8_t *out, size_t written, size_t out_size, struct ute_gather *gather)
 {
-    size_t read = 0;
-    if (!field || !in)
+    if (insn->op != UTE_OP_STRUCT)
+        return ute_put_leaf(insn, value, out, written, out_size, gather);
+    if (!value)
         return ERR;
-    ENSURE_RSPACE(1);
-    uint8_t h = in[read++];
-    switch (field->type)
-    {
-    case UTE_TYPE_INT:
+    PUT_BYTE(5 << 5); // tStruct
+    PUT_VARINT(insn->nfields);
+    const struct ute_insn *member = insn + 1;
+    for (uint32_t i = 0; i < insn->nfields; ++i, ++member)
     {
-        if ((h >> 5) != 2)
-            return ERR;
-        uint64_t v = 0;
-        size_t var_len = ute_decode_varint(in + read, in_size - read, &v);
-        if (var_len == 0 || read + var_len > in_size)
+        written = ute_put_leaf(member, slot_value((uint8_t *)value, member), out, written, out_size, gather);
+        if (written == ERR)
             return ERR;
-        read += var_len;
-        *(uint64_t *)value = v;
-        break;
     }
-    case UTE_TYPE_STRING:
+    return written;
+}
+
+// Copy the len bytes of a string. Strings of up to 16 bytes, the common case
+// in lists of flat structs, are copied with two overlapping fixed-size moves
+// instead of a call to memcpy.
+static inline void ute_copy_string(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    if (len >= 8 && len <= 16)
     {
-        if ((h >> 5) != 3)
-            return ERR;
-        uint64_t len = 0;
-        size_t var_len = ute_decode_varint(in + read, in_size - read, &len);
-        if (var_len == 0 || read + var_len + len > in_size)
-            return ERR;
-        read += var_len;
-        memcpy(value, in + read, len);
-        ((char *)value)[len] = 0;
-        read += len;
-        break;
+        memcpy(dst, src, 8);
+        memcpy(dst + len - 8, src + len - 8, 8);
     }
-    case UTE_TYPE_LIST:
+    else if (len >= 4 && len < 8)
     {
-        if ((h >> 5) != 4)
-            return ERR;
-        uint64_t count = 0;
-        size_t var_len = ute_decode_varint(in + read, in_size - read, &count);
-        if (var_len == 0 || read + var_len > in_size)
-            return ERR;
-        read += var_len;
-        size_t *out_count = (size_t *)value;
-        *out_count = (size_t)count;
-        void **arr = (void **)((size_t *)value + 1);
-        // IMPORTANT: arr[i] must point to user-allocated memory for each element.
-        for (size_t i = 0; i < count; ++i)
+        memcpy(dst, src, 4);
+        memcpy(dst + len - 4, src + len - 4, 4);
+    }
+    else if (len < 4)
+    {
+        for (size_t i = 0; i < len; ++i)
+            dst[i] = src[i];
+    }
+    else
+        memcpy(dst, src, len);
+}
+
+// Encode elements [first, first + n) of a list of flat structs into out
+// (not a sizing pass or a gather encode). The struct prefix is encoded once
+// for the list, and each int or string member checks the space for its
+// whole encoding once instead of byte by byte.
+static size_t ute_put_flat_structs(const struct ute_insn *elem, void **arr, size_t first, size_t n, uint8_t *out, size_t written,
+                                   size_t out_size)
+{
+    const struct ute_insn *members = elem + 1;
+    uint32_t nfields = elem->nfields;
+    uint8_t prefix[11];
+    prefix[0] = 5 << 5; // tStruct
+    size_t prefix_len = 1 + ute_encode_varint(nfields, prefix + 1);
+    for (size_t i = first + 1; i <= first + n; ++i)
+    {
+        uint8_t *value = (uint8_t *)arr[i];
+        if (!value)
+            return ERR;
+        ENSURE_SPACE(prefix_len);
+        out[written] = prefix[0];
+        out[written + 1] = prefix[1];
+        if (prefix_len > 2)
+            memcpy(out + written + 2, prefix + 2, prefix_len - 2);
+        written += prefix_len;
+        const struct ute_insn *member = members;
+        for (uint32_t f = 0; f < nfields; ++f, ++member)
+        {
+            const uint8_t *p = slot_value(value, member);
+            if (!p)
+                return ERR;
+            switch (member->op)
+            {
+            case UTE_OP_BOOL:
+                ENSURE_SPACE(1);
+                out[written++] = (uint8_t)((1 << 5) | (*p ? 0x10 : 0)); // tBool
+                break;
+            case UTE_OP_INT:
+            case UTE_OP_SINT:
+            {
+                uint64_t v;
+                memcpy(&v, p, sizeof(v));
+                if (member->op == UTE_OP_SINT)
+                    v = ute_zigzag_encode(v);
+                ENSURE_SPACE(1 + ute_varint_len(v));
+                out[written++] = 2 << 5; // tInt
+                written += ute_encode_varint(v, out + written);
+                break;
+            }
+            case UTE_OP_STRING:
+            {
+                size_t len = strlen((const char *)p);
+                if (out_size - written < len || out_size - written - len < 1 + ute_varint_len(len))
+                    FAIL(UTE_ERROR_SPACE);
+                out[written++] = 3 << 5; // tBytes
+                written += ute_encode_varint(len, out + written);
+                ute_copy_string(out + written, p, len);
+                written += len;
+                break;
+            }
+            default:
+                // Other leaves are rare in flat lists
+                written = ute_put_leaf(member, p, out, written, out_size, NULL);
+                if (written == ERR)
+                    return ERR;
+                break;
+            }
+        }
+    }
+    return written;
+}
+
+// Resolve the storage of a value slot for decoding. In arena mode an empty
+// INDIRECT slot gets fresh zeroed storage of size bytes from the arena.
+static inline uint8_t *decode_slot(uint8_t *base, const struct ute_insn *insn, struct ute_arena *arena, size_t size)
+{
+    uint8_t *p = base + insn->offset;
+    if (!(insn->flags & UTE_INSN_INDIRECT))
+        return p;
+    uint8_t **slot = (uint8_t **)p;
+    if (!*slot && arena)
+    {
+        *slot = ute_arena_alloc(arena, size ? size : 1, UTE_ARENA_ALIGN);
+        if (*slot)
+            memset(*slot, 0, size);
+    }
+    return *slot;
+}
+
+// Store a decoded string of len bytes (plus NUL) into the slot of a STRING instruction
+static inline int store_string(const struct ute_insn *insn, uint8_t *base, struct ute_arena *arena, const uint8_t *src, size_t len)
+{
+    uint8_t *value = base + insn->offset;
+    if (insn->flags & UTE_INSN_INDIRECT)
+    {
+        uint8_t **slot = (uint8_t **)value;
+        if (!*slot && arena)
+        {
+            // Arena strings are sized to fit, so the capacity does not apply
+            *slot = ute_arena_alloc(arena, len + 1, 1);
+            if (!*slot)
+                return -1;
+            memcpy(*slot, src, len);
+            (*slot)[len] = 0;
+            return 0;
+        }
+        value = *slot;
+    }
+    if (!value || (insn->arg && len >= insn->arg))
+        return -1;
+    memcpy(value, src, len);
+    value[len] = 0;
+    return 0;
+}
+
+// Store decoded bytes into the slot of a BYTES instruction (a struct ute_bytes)
+static inline int store_bytes(const struct ute_insn *insn, uint8_t *base, struct ute_arena *arena, const uint8_t *src, size_t len)
+{
+    struct ute_bytes *value = (struct ute_bytes *)(base + insn->offset);
+    if (insn->flags & UTE_INSN_INDIRECT)
+    {
+        struct ute_bytes **slot = (struct ute_bytes **)value;
+        if (!*slot && arena)
+        {
+            // Arena bytes are sized to fit, so the capacity does not apply
+            if (len > SIZE_MAX - sizeof(struct ute_bytes))
+                return -1;
+            *slot = ute_arena_alloc(arena, sizeof(struct ute_bytes) + len, UTE_ARENA_ALIGN);
+            if (!*slot)
+                return -1;
+            (*slot)->len = len;
+            memcpy((*slot)->data, src, len);
+            return 0;
+        }
+        value = *slot;
+    }
+    if (!value || (insn->arg && len > insn->arg))
+        return -1;
+    value->len = len;
+    memcpy(value->data, src, len);
+    return 0;
+}
+
+// Decode a leaf value at in + read (returns the new read count or ERR)
+static inline size_t ute_get_leaf(const struct ute_insn *insn, uint8_t *base, struct ute_arena *arena, const uint8_t *in, size_t read, size_t in_size)
+{
+    ENSURE_RSPACE(1);
+    uint8_t h = in[read++];
+    switch (insn->op)
+    {
+    case UTE_OP_NULL:
+        if ((h >> 5) != 0)
+            FAIL(UTE_ERROR_TYPE);
+        return read;
+    case UTE_OP_BOOL:
+    {
+        if ((h >> 5) != 1)
+            FAIL(UTE_ERROR_TYPE);
+        uint8_t *value = decode_slot(base, insn, arena, sizeof(uint8_t));
+        if (!value)
+            return ERR;
+        *value = (h & 0x10) ? 1 : 0;
+        return read;
+    }
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+    {
+        if ((h >> 5) != 2)
+            FAIL(UTE_ERROR_TYPE);
+        uint8_t *value = decode_slot(base, insn, arena, sizeof(uint64_t));
+        if (!value)
+            return ERR;
+        uint64_t v = 0;
+        GET_VARINT(v);
+        if (insn->op == UTE_OP_SINT)
+            v = ute_zigzag_decode(v);
+        memcpy(value, &v, sizeof(v));
+        return read;
+    }
+    case UTE_OP_STRING:
+    {
+        // Back-references and dictionary ids only appear in DICT instructions
+        if (h != (3 << 5))
+            FAIL(UTE_ERROR_TYPE);
+        uint64_t len = 0;
+        GET_VARINT(len);
+        if (len > in_size - read || store_string(insn, base, arena, in + read, (size_t)len) != 0)
+            return ERR;
+        return read + len;
+    }
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
+    {
+        size_t width = UTE_OP_WIDTH(insn->op);
+        if (h != UTE_FIXED_PREFIX(width))
+            FAIL(UTE_ERROR_TYPE);
+        uint8_t *value = decode_slot(base, insn, arena, width);
+        if (!value)
+            return ERR;
+        ENSURE_RSPACE(width);
+        ute_copy_le(value, in + read, 1, width);
+        return read + width;
+    }
+    case UTE_OP_BYTES:
+    {
+        if (h != (6 << 5))
+            FAIL(UTE_ERROR_TYPE);
+        uint64_t len = 0;
+        GET_VARINT(len);
+        if (len > in_size - read || store_bytes(insn, base, arena, in + read, (size_t)len) != 0)
+            return ERR;
+        return read + len;
+    }
+    default:
+        return ERR;
+    }
+}
+
+// Decode a flat node: a leaf, or a struct whose members are all leaves
+static inline size_t ute_get_flat(const struct ute_insn *insn, uint8_t *base, struct ute_arena *arena, const uint8_t *in, size_t read, size_t in_size)
+{
+    if (insn->op != UTE_OP_STRUCT)
+        return ute_get_leaf(insn, base, arena, in, read, in_size);
+    uint8_t *value = decode_slot(base, insn, arena, insn->arg);
+    if (!value)
+        return ERR;
+    ENSURE_RSPACE(1);
+    if (in[read++] != (5 << 5))
+        FAIL(UTE_ERROR_TYPE);
+    uint64_t nfields = 0;
+    GET_VARINT(nfields);
+    if (nfields != insn->nfields)
+        return ERR;
+    const struct ute_insn *member = insn + 1;
+    for (uint32_t i = 0; i < insn->nfields; ++i, ++member)
+    {
+        read = ute_get_leaf(member, value, arena, in, read, in_size);
+        if (read == ERR)
+            return ERR;
+    }
+    return read;
+}
+
+// Decode a varint from in, which has at least 10 readable bytes (returns
+// bytes read, or 0 if the varint does not fit in 64 bits)
+static inline size_t ute_decode_varint_unchecked(const uint8_t *in, uint64_t *out)
+{
+    uint64_t result = 0;
+    size_t i = 0;
+    uint8_t b;
+    do
+    {
+        b = in[i];
+        result |= (uint64_t)(b & 0x7F) << (7 * i);
+        i++;
+    } while ((b & 0x80) && i < 10);
+    // The tenth byte only holds bit 63
+    if ((b & 0x80) || (i == 10 && b > 1))
+        return 0;
+    *out = result;
+    return i;
+}
+
+// Shape of a flat struct whose members are all ints, sints, bools and
+// strings stored in place: the kind of member i in bits 2i..2i+1
+#define UTE_FLAT_INT 0
+#define UTE_FLAT_SINT 1
+#define UTE_FLAT_BOOL 2
+#define UTE_FLAT_STRING 3
+#define UTE_FLAT_MEMBERS 16 // members of the largest struct with a shape
+// Key of the specialised loop of a shape of n members
+#define UTE_FLAT_KEY(shape, n) ((uint64_t)(shape) << 5 | (n))
+#define UTE_FLAT_KEY2(a, b) UTE_FLAT_KEY((a) | (b) << 2, 2)
+#define UTE_FLAT_KEY3(a, b, c) UTE_FLAT_KEY((a) | (b) << 2 | (c) << 4, 3)
+
+#if defined(__GNUC__)
+#define UTE_ALWAYS_INLINE inline __attribute__((always_inline))
+#define UTE_UNROLL _Pragma("GCC unroll 16")
+#else
+#define UTE_ALWAYS_INLINE inline
+#define UTE_UNROLL
+#endif
+
+// Decode a flat struct of the given shape at in + read into value while the
+// input has room for the header byte and longest varint of each member
+// (returns the new read count, ERR on an error, or read itself if the
+// element must be decoded by ute_get_flat_element: its prefix differs, or
+// the input ends too soon). Called with a constant shape,
+// the member loop unrolls into straight-line code without any dispatch on
+// the member kinds.
+static UTE_ALWAYS_INLINE size_t ute_get_flat_shape(uint32_t shape, uint32_t nfields, const uint32_t *offsets, const uint32_t *caps,
+                                                   uint8_t *value, const uint8_t *in, size_t read, size_t in_size)
+{
+    const uint8_t *q = in + read, *end = in + in_size;
+    if (end - q < 2 || q[0] != (5 << 5) || q[1] != nfields)
+        return read;
+    q += 2;
+    UTE_UNROLL
+    for (uint32_t f = 0; f < nfields; ++f, shape >>= 2)
+    {
+        if (end - q < 11)
+            return read;
+        uint8_t *p = value + offsets[f];
+        uint32_t kind = shape & 3;
+        if (kind == UTE_FLAT_BOOL)
+        {
+            if ((*q >> 5) != 1)
+                FAIL(UTE_ERROR_TYPE);
+            *p = (*q++ & 0x10) ? 1 : 0;
+            continue;
+        }
+        if (*q++ != (kind == UTE_FLAT_STRING ? 3 << 5 : 2 << 5))
+            FAIL(UTE_ERROR_TYPE);
+        uint64_t v = 0;
+        size_t var_len = ute_decode_varint_unchecked(q, &v);
+        if (!var_len)
+            FAIL(UTE_ERROR_VARINT);
+        q += var_len;
+        if (kind == UTE_FLAT_STRING)
+        {
+            if (v > (size_t)(end - q) || (caps[f] && v >= caps[f]))
+                return ERR;
+            ute_copy_string(p, q, (size_t)v);
+            p[v] = 0;
+            q += v;
+            continue;
+        }
+        if (kind == UTE_FLAT_SINT)
+            v = ute_zigzag_decode(v);
+        memcpy(p, &v, sizeof(v));
+    }
+    return (size_t)(q - in);
+}
+
+// Decode one element of a list of flat structs into the slot at elem_slot.
+// With the struct prefix (see ute_get_flat_structs) written as expected, the
+// members are decoded one by one, ints and strings stored in place without
+// going through the slot helpers.
+static size_t ute_get_flat_element(const struct ute_insn *elem, const uint8_t *prefix, size_t prefix_len, uint8_t *elem_slot,
+                                   struct ute_arena *arena, const uint8_t *in, size_t read, size_t in_size)
+{
+    uint8_t *value = decode_slot(elem_slot, elem, arena, elem->arg);
+    if (!value)
+        return ERR;
+    if (in_size - read < prefix_len || in[read] != prefix[0] || in[read + 1] != prefix[1] ||
+        (prefix_len > 2 && memcmp(in + read, prefix, prefix_len) != 0))
+    {
+        // A field count written with a longer varint still matches
+        return ute_get_flat(elem, elem_slot, arena, in, read, in_size);
+    }
+    read += prefix_len;
+    const struct ute_insn *member = elem + 1;
+    for (uint32_t f = 0; f < elem->nfields; ++f, ++member)
+    {
+        if (member->flags & UTE_INSN_INDIRECT)
+        {
+            read = ute_get_leaf(member, value, arena, in, read, in_size);
+            if (read == ERR)
+                return ERR;
+            continue;
+        }
+        uint8_t *p = value + member->offset;
+        switch (member->op)
+        {
+        case UTE_OP_INT:
+        case UTE_OP_SINT:
+        {
+            ENSURE_RSPACE(1);
+            if (in[read++] != (2 << 5))
+                FAIL(UTE_ERROR_TYPE);
+            uint64_t v = 0;
+            GET_VARINT(v);
+            if (member->op == UTE_OP_SINT)
+                v = ute_zigzag_decode(v);
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+        case UTE_OP_STRING:
+        {
+            ENSURE_RSPACE(1);
+            if (in[read++] != (3 << 5))
+                FAIL(UTE_ERROR_TYPE);
+            uint64_t len = 0;
+            GET_VARINT(len);
+            if (len > in_size - read || (member->arg && len >= member->arg))
+                return ERR;
+            ute_copy_string(p, in + read, (size_t)len);
+            p[len] = 0;
+            read += (size_t)len;
+            break;
+        }
+        default:
+            read = ute_get_leaf(member, value, arena, in, read, in_size);
+            if (read == ERR)
+                return ERR;
+            break;
+        }
+    }
+    return read;
+}
+
+// Decode elements [first, first + n) of a list of flat structs of the given
+// shape (see ute_get_flat_shape). Elements the shape loop leaves are decoded
+// by ute_get_flat_element.
+static UTE_ALWAYS_INLINE size_t ute_get_shaped_structs(uint32_t shape, uint32_t nfields, const uint32_t *offsets, const uint32_t *caps,
+                                                       const struct ute_insn *elem, const uint8_t *prefix, void **arr, size_t first,
+                                                       size_t n, struct ute_arena *arena, const uint8_t *in, size_t read, size_t in_size)
+{
+    for (size_t i = first + 1; i <= first + n; ++i)
+    {
+        uint8_t *value = decode_slot((uint8_t *)&arr[i], elem, arena, elem->arg);
+        if (!value)
+            return ERR;
+        size_t next = ute_get_flat_shape(shape, nfields, offsets, caps, value, in, read, in_size);
+        if (next == read)
+            next = ute_get_flat_element(elem, prefix, 2, (uint8_t *)&arr[i], arena, in, read, in_size);
+        if (next == ERR)
+            return ERR;
+        read = next;
+    }
+    return read;
+}
+
+// Decode elements [first, first + n) of a list of flat structs (see
+// ute_put_flat_structs). The struct prefix is compared as a whole. Structs
+// whose members are all ints, sints, bools and strings stored in place run
+// ute_get_shaped_structs, specialised to the common shapes of two and three
+// members; others are decoded element by element.
+static size_t ute_get_flat_structs(const struct ute_insn *elem, void **arr, size_t first, size_t n, struct ute_arena *arena,
+                                   const uint8_t *in, size_t read, size_t in_size)
+{
+    const struct ute_insn *members = elem + 1;
+    uint32_t nfields = elem->nfields;
+    uint8_t prefix[11];
+    prefix[0] = 5 << 5; // tStruct
+    size_t prefix_len = 1 + ute_encode_varint(nfields, prefix + 1);
+    uint32_t offsets[UTE_FLAT_MEMBERS];
+    uint32_t caps[UTE_FLAT_MEMBERS];
+    uint32_t shape = 0;
+    // The prefix of a shape is two bytes
+    int shaped = nfields <= UTE_FLAT_MEMBERS;
+    for (uint32_t f = 0; shaped && f < nfields; ++f)
+    {
+        const struct ute_insn *member = &members[f];
+        uint32_t kind = UTE_FLAT_INT;
+        if (member->flags & UTE_INSN_INDIRECT)
+            shaped = 0;
+        else if (member->op == UTE_OP_SINT)
+            kind = UTE_FLAT_SINT;
+        else if (member->op == UTE_OP_BOOL)
+            kind = UTE_FLAT_BOOL;
+        else if (member->op == UTE_OP_STRING)
+            kind = UTE_FLAT_STRING;
+        else if (member->op != UTE_OP_INT)
+            shaped = 0;
+        shape |= kind << (2 * f);
+        offsets[f] = member->offset;
+        caps[f] = member->arg;
+    }
+    if (shaped)
+    {
+        switch (UTE_FLAT_KEY(shape, nfields))
+        {
+#define UTE_FLAT_CASE(count, ...)                                                                                              \
+    case UTE_FLAT_KEY##count(__VA_ARGS__):                                                                                     \
+        return ute_get_shaped_structs((uint32_t)(UTE_FLAT_KEY##count(__VA_ARGS__) >> 5), count, offsets, caps, elem, prefix, arr, \
+                                      first, n, arena, in, read, in_size);
+            UTE_FLAT_CASE(2, UTE_FLAT_INT, UTE_FLAT_STRING)
+            UTE_FLAT_CASE(2, UTE_FLAT_STRING, UTE_FLAT_INT)
+            UTE_FLAT_CASE(2, UTE_FLAT_INT, UTE_FLAT_INT)
+            UTE_FLAT_CASE(2, UTE_FLAT_STRING, UTE_FLAT_STRING)
+            UTE_FLAT_CASE(3, UTE_FLAT_INT, UTE_FLAT_BOOL, UTE_FLAT_STRING)
+            UTE_FLAT_CASE(3, UTE_FLAT_INT, UTE_FLAT_STRING, UTE_FLAT_STRING)
+            UTE_FLAT_CASE(3, UTE_FLAT_INT, UTE_FLAT_INT, UTE_FLAT_STRING)
+            UTE_FLAT_CASE(3, UTE_FLAT_INT, UTE_FLAT_STRING, UTE_FLAT_INT)
+#undef UTE_FLAT_CASE
+        default:
+            return ute_get_shaped_structs(shape, nfields, offsets, caps, elem, prefix, arr, first, n, arena, in, read, in_size);
+        }
+    }
+    for (size_t i = first + 1; i <= first + n; ++i)
+    {
+        read = ute_get_flat_element(elem, prefix, prefix_len, (uint8_t *)&arr[i], arena, in, read, in_size);
+        if (read == ERR)
+            return ERR;
+    }
+    return read;
+}
+
+// Strings written by one encoder run (a message, or a chunk of a chunked
+// list) that later equal values of DICT instructions may refer back to: a
+// direct-mapped cache of the latest plain encoding of each value, cleared on
+// first use
+#define UTE_REF_SLOTS 256
+
+// A back-reference may only target one of the latest UTE_REF_WINDOW plain
+// strings of DICT instructions of its run (see RFC section 4.1)
+#define UTE_REF_WINDOW 256
+
+struct ute_refs
+{
+    int ready;
+    size_t count; // plain strings of DICT instructions written so far
+    struct
+    {
+        const char *s;
+        size_t len;
+        size_t pos;     // offset of the string's prefix in the message + 1 (0: empty slot)
+        size_t ordinal; // its number among the plain strings of the run
+    } slots[UTE_REF_SLOTS];
+};
+
+// The plain strings of DICT instructions one decoder run has read: the offsets
+// of the prefixes of the latest UTE_REF_WINDOW of them, string i at
+// starts[i % UTE_REF_WINDOW], so in ascending order from the oldest
+struct ute_ref_targets
+{
+    size_t count;
+    size_t starts[UTE_REF_WINDOW];
+};
+
+static inline void ute_ref_record(struct ute_ref_targets *targets, size_t at)
+{
+    targets->starts[targets->count++ & (UTE_REF_WINDOW - 1)] = at;
+}
+
+// Resolve the back-reference at in + at (see ute_resolve_ref), whose target
+// must be a string the run has recorded: binary search of the window
+static size_t ute_resolve_run_ref(const struct ute_ref_targets *targets, const uint8_t *in, size_t at, uint64_t distance, size_t *out_len)
+{
+    if (distance == 0 || distance > at)
+        return ERR;
+    size_t target = at - (size_t)distance;
+    size_t lo = targets->count > UTE_REF_WINDOW ? targets->count - UTE_REF_WINDOW : 0;
+    size_t hi = targets->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t start = targets->starts[mid & (UTE_REF_WINDOW - 1)];
+        if (start == target)
+            return ute_resolve_ref(in, at, distance, out_len);
+        if (start < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return ERR;
+}
+
+// Encode the string of a DICT instruction: its dictionary id (shared mode),
+// a back-reference to an earlier equal string of the run if that is
+// shorter, or the string itself
+static size_t ute_put_dict_string(const struct ute_insn *insn, const char *s, const struct ute_dictionary *dict, struct ute_refs *refs,
+                                  uint8_t *out, size_t written, size_t out_size, struct ute_gather *gather)
+{
+    if (!s)
+        return ERR;
+    size_t len = strlen(s);
+    if (insn->nfields == UTE_DICT_SHARED)
+    {
+        size_t id = ute_dictionary_find(dict, s, len);
+        if (id != UTE_DICT_MISSING)
+        {
+            PUT_BYTE((3 << 5) | UTE_STRING_DICT);
+            PUT_VARINT(id);
+            return written;
+        }
+    }
+    if (!refs->ready)
+    {
+        memset(refs->slots, 0, sizeof(refs->slots));
+        refs->count = 0;
+        refs->ready = 1;
+    }
+    // Bytes referenced by iovecs are part of the message too
+    size_t pos = written + (gather ? gather->iov->referenced : 0);
+    size_t slot = (size_t)ute_string_hash(s, len) & (UTE_REF_SLOTS - 1);
+    if (refs->slots[slot].pos && refs->count - refs->slots[slot].ordinal <= UTE_REF_WINDOW && refs->slots[slot].len == len &&
+        memcmp(refs->slots[slot].s, s, len) == 0)
+    {
+        size_t distance = pos - (refs->slots[slot].pos - 1);
+        if (ute_varint_len(distance) < ute_varint_len(len) + len)
+        {
+            PUT_BYTE((3 << 5) | UTE_STRING_REF);
+            PUT_VARINT(distance);
+            return written;
+        }
+    }
+    // Later values refer to the nearest occurrence
+    refs->slots[slot].s = s;
+    refs->slots[slot].len = len;
+    refs->slots[slot].pos = pos + 1;
+    refs->slots[slot].ordinal = refs->count++;
+    return ute_put_leaf(insn, (const uint8_t *)s, out, written, out_size, gather);
+}
+
+// Decode the string of a DICT instruction: a plain string (recorded as a
+// target of the run), a back-reference to one of the targets, or a
+// dictionary id. An empty INDIRECT slot is pointed at the dictionary value
+// instead of receiving a copy.
+static size_t ute_get_dict_string(const struct ute_insn *insn, uint8_t *base, struct ute_arena *arena, const struct ute_dictionary *dict,
+                                  const uint8_t *in, size_t read, size_t in_size, struct ute_ref_targets *targets)
+{
+    ENSURE_RSPACE(1);
+    uint8_t h = in[read];
+    if (h == (3 << 5))
+    {
+        ute_ref_record(targets, read);
+        return ute_get_leaf(insn, base, arena, in, read, in_size);
+    }
+    size_t at = read++;
+    uint64_t n = 0;
+    size_t len = 0;
+    GET_VARINT(n);
+    if (h == ((3 << 5) | UTE_STRING_REF))
+    {
+        size_t target = ute_resolve_run_ref(targets, in, at, n, &len);
+        if (target == ERR || store_string(insn, base, arena, in + target, len) != 0)
+            return ERR;
+        return read;
+    }
+    if (h != ((3 << 5) | UTE_STRING_DICT) || insn->nfields != UTE_DICT_SHARED)
+        FAIL(UTE_ERROR_TYPE);
+    const char *value = ute_dictionary_value(dict, n, &len);
+    if (!value)
+        return ERR;
+    if ((insn->flags & UTE_INSN_INDIRECT) && !*(const char **)(base + insn->offset))
+    {
+        *(const char **)(base + insn->offset) = value;
+        return read;
+    }
+    return store_string(insn, base, arena, (const uint8_t *)value, len) == 0 ? read : ERR;
+}
+
+// Arena mode: allocate the [count, ptr, ptr, ...] array of a list. Elements
+// with a fixed storage size (insn->arg) share one zeroed block right behind
+// the array; the others are allocated when they are decoded. Fixed-width
+// elements are packed without padding, so the block is a plain C array.
+static void **alloc_list(const struct ute_insn *insn, struct ute_arena *arena, size_t count)
+{
+    size_t elem_size = insn->flags & UTE_INSN_FIXED ? insn->arg : (insn->arg + UTE_ARENA_ALIGN - 1) & ~(size_t)(UTE_ARENA_ALIGN - 1);
+    if (count > (SIZE_MAX / sizeof(void *)) - 1 || (elem_size && count > SIZE_MAX / 2 / elem_size))
+        return NULL;
+    size_t array_size = (count + 1) * sizeof(void *);
+    size_t elems_size = count * elem_size;
+    if (array_size > SIZE_MAX - elems_size)
+        return NULL;
+    void **arr = ute_arena_alloc(arena, array_size + elems_size, UTE_ARENA_ALIGN);
+    if (!arr)
+        return NULL;
+    uint8_t *elems = (uint8_t *)arr + array_size;
+    if (elem_size)
+        memset(elems, 0, elems_size);
+    for (size_t i = 1; i <= count; ++i)
+        arr[i] = elem_size ? elems + (i - 1) * elem_size : NULL;
+    return arr;
+}
+
+// Value of element i of a list: the element itself, or with a member
+// instruction the member of a struct element (NULL if missing)
+static inline uint8_t *elem_value(void *const *arr, size_t i, const struct ute_insn *member)
+{
+    uint8_t *value = (uint8_t *)arr[i];
+    return value && member ? slot_value(value, member) : value;
+}
+
+// Encode int values as bare varints: the elements of a packed list, or one
+// member of all elements of a columnar list. Values are gathered in chunks so
+// the bulk kernels see contiguous input, and transformed there (mode:
+// UTE_INTS_*).
+static size_t ute_put_packed(void *const *arr, size_t count, const struct ute_insn *member, int mode, uint8_t *out, size_t written, size_t out_size)
+{
+    uint64_t chunk[UTE_PACKED_CHUNK];
+    struct ute_ints_state state = {0, 0};
+    for (size_t i = 1; i <= count;)
+    {
+        size_t n = count - i + 1 < UTE_PACKED_CHUNK ? count - i + 1 : UTE_PACKED_CHUNK;
+        for (size_t j = 0; j < n; ++j)
+        {
+            const uint8_t *value = elem_value(arr, i + j, member);
+            if (!value)
+                return ERR;
+            memcpy(&chunk[j], value, sizeof(uint64_t));
+        }
+        ute_ints_encode(chunk, n, mode, &state);
+        size_t len = ute_varints_len(chunk, n);
+        ENSURE_SPACE(len);
+        if (out)
+            ute_encode_varints(chunk, n, out + written);
+        written += len;
+        i += n;
+    }
+    return written;
+}
+
+// Decode bare varints into the elements of a packed list, or into one member
+// of all elements of a columnar list, undoing the transform mode (UTE_INTS_*).
+// When the values are contiguous (a packed list freshly allocated from an
+// arena) they are decoded and transformed in place, otherwise in chunks that
+// are scattered to the element pointers.
+static size_t ute_get_packed(void **arr, size_t count, const struct ute_insn *member, int mode, struct ute_arena *arena, int contiguous,
+                             const uint8_t *in, size_t read, size_t in_size)
+{
+    struct ute_ints_state state = {0, 0};
+    if (count == 0)
+        return read;
+    if (contiguous)
+    {
+        size_t len = ute_decode_varints(in + read, in_size - read, (uint64_t *)arr[1], count);
+        ute_ints_decode((uint64_t *)arr[1], len ? count : 0, mode, &state);
+        return len ? read + len : ERR;
+    }
+    uint64_t chunk[UTE_PACKED_CHUNK];
+    for (size_t i = 1; i <= count;)
+    {
+        size_t n = count - i + 1 < UTE_PACKED_CHUNK ? count - i + 1 : UTE_PACKED_CHUNK;
+        size_t len = ute_decode_varints(in + read, in_size - read, chunk, n);
+        if (!len)
+            return ERR;
+        read += len;
+        ute_ints_decode(chunk, n, mode, &state);
+        for (size_t j = 0; j < n; ++j)
+        {
+            uint8_t *value = member ? decode_slot((uint8_t *)arr[i + j], member, arena, sizeof(uint64_t)) : (uint8_t *)arr[i + j];
+            if (!value)
+                return ERR;
+            memcpy(value, &chunk[j], sizeof(uint64_t));
+        }
+        i += n;
+    }
+    return read;
+}
+
+// Encode the elements of a fixed list as one raw little-endian array. When
+// the elements are contiguous in memory (a C array, or a list decoded into an
+// arena) they are copied in one go, and on little-endian hosts an iovec
+// encode references them in place.
+static size_t ute_put_fixed(const struct ute_insn *insn, void *const *arr, size_t count, uint8_t *out, size_t written, size_t out_size, struct ute_gather *gather)
+{
+    size_t width = insn->arg;
+    if (count > SIZE_MAX / width)
+        return ERR;
+    size_t size = count * width;
+    const uint8_t *first = count ? (const uint8_t *)arr[1] : NULL;
+    size_t run = 0;
+    while (first && run < count && (const uint8_t *)arr[1 + run] == first + run * width)
+        run++;
+    if (run == count)
+    {
+        if (UTE_NATIVE_LE && gather && size && size >= gather->iov->threshold)
+            return ute_gather_ref(gather, out, written, first, size) == 0 ? written : ERR;
+        ENSURE_SPACE(size);
+        if (out && size)
+            ute_copy_le(out + written, first, count, width);
+        return written + size;
+    }
+    ENSURE_SPACE(size);
+    for (size_t i = 1; i <= count; ++i, written += width)
+    {
+        if (!arr[i])
+            return ERR;
+        if (out)
+            ute_copy_le(out + written, arr[i], 1, width);
+    }
+    return written;
+}
+
+// Decode the raw array of a fixed list into its elements: one copy when the
+// list was freshly allocated from an arena (its elements form one block),
+// otherwise one copy per element
+static size_t ute_get_fixed(const struct ute_insn *insn, void **arr, size_t count, struct ute_arena *arena, int contiguous,
+                            const uint8_t *in, size_t read, size_t in_size)
+{
+    size_t width = insn->arg;
+    if (count > (in_size - read) / width)
+        return ERR;
+    if (contiguous)
+    {
+        if (count)
+            ute_copy_le(arr[1], in + read, count, width);
+        return read + count * width;
+    }
+    for (size_t i = 1; i <= count; ++i, read += width)
+    {
+        uint8_t *value = decode_slot((uint8_t *)&arr[i], insn + 1, arena, width);
+        if (!value)
+            return ERR;
+        ute_copy_le(value, in + read, 1, width);
+    }
+    return read;
+}
+
+// Read the chunk header of a chunked list (see wire.h)
+size_t ute_read_chunks(const uint8_t *in, size_t read, size_t in_size, uint64_t count, uint64_t *out_per, size_t *out_end)
+{
+    uint64_t per = 0;
+    GET_VARINT(per);
+    if (per == 0)
+        return ERR;
+    uint64_t nchunks = count / per + (count % per != 0);
+    if (nchunks > (in_size - read) / UTE_CHUNK_ENTRY)
+        return ERR;
+    const uint8_t *table = in + read;
+    read += (size_t)nchunks * UTE_CHUNK_ENTRY;
+    size_t end = read;
+    for (size_t c = 0; c < nchunks; ++c)
+    {
+        size_t size = ute_chunk_size(table, c);
+        if (size > in_size - end)
+            return ERR;
+        end += size;
+    }
+    *out_per = per;
+    if (out_end)
+        *out_end = end;
+    return read;
+}
+
+// Resolve a back-reference (see wire.h)
+size_t ute_resolve_ref(const uint8_t *in, size_t at, uint64_t distance, size_t *out_len)
+{
+    // The target ends before the reference
+    if (distance == 0 || distance > at)
+        return ERR;
+    size_t read = at - (size_t)distance;
+    size_t in_size = at;
+    if (in[read++] != (3 << 5))
+        FAIL(UTE_ERROR_TYPE);
+    uint64_t len = 0;
+    GET_VARINT(len);
+    if (len > in_size - read)
+        return ERR;
+    *out_len = (size_t)len;
+    return read;
+}
+
+// Skip one encoded value of any type (translation plans: a field only the
+// writer has; views: a sparse struct). The encoding delimits itself, so no
+// plan is needed: open lists and structs are tracked by the number of values
+// they still contain, and whether an index precedes each of them.
+size_t ute_skip_value(const uint8_t *in, size_t read, size_t in_size)
+{
+    uint64_t pending[UTE_PLAN_MAX_DEPTH + 1];
+    uint8_t indexed[UTE_PLAN_MAX_DEPTH + 1];
+    size_t sp = 0;
+    pending[0] = 1;
+    indexed[0] = 0;
+    for (;;)
+    {
+        if (pending[sp] == 0)
+        {
+            if (sp == 0)
+                return read;
+            sp--;
+            continue;
+        }
+        pending[sp]--;
+        uint64_t n = 0;
+        if (indexed[sp])
+            GET_VARINT(n);
+        ENSURE_RSPACE(1);
+        uint8_t h = in[read++];
+        uint8_t flags = h & UTE_PREFIX_FLAGS;
+        switch (h >> 5)
+        {
+        case 0: // null
+        case 1: // bool
+            break;
+        case 2: // int
+            GET_VARINT(n);
+            break;
+        case 3: // string, back-reference or dictionary id
+            GET_VARINT(n);
+            if (flags == UTE_STRING_REF || flags == UTE_STRING_DICT)
+                break;
+            if (flags || n > in_size - read)
+                return ERR;
+            read += (size_t)n;
+            break;
+        case 6: // fixed-width value, or bytes
+            if (flags == UTE_FIXED_32 || flags == UTE_FIXED_64)
+                n = flags == UTE_FIXED_64 ? 8 : 4;
+            else if (flags == 0)
+                GET_VARINT(n);
+            else
+                return ERR;
+            if (n > in_size - read)
+                return ERR;
+            read += (size_t)n;
+            break;
+        case 4: // list
+        case 5: // struct
+            GET_VARINT(n);
+            if ((h >> 5) == 4 && flags == UTE_LIST_PACKED)
+            {
+                // Every varint takes at least one byte
+                size_t len = n > in_size - read ? 0 : ute_skip_varints(in + read, in_size - read, (size_t)n);
+                if (n && !len)
+                    return ERR;
+                read += len;
+            }
+            else if ((h >> 5) == 4 && (flags == UTE_LIST_FIXED32 || flags == UTE_LIST_FIXED64))
+            {
+                size_t width = flags == UTE_LIST_FIXED64 ? 8 : 4;
+                if (n > (in_size - read) / width)
+                    return ERR;
+                read += (size_t)n * width;
+            }
+            else if ((h >> 5) == 4 && flags == UTE_LIST_CHUNKED)
+            {
+                // The chunk table gives the size of all elements
+                uint64_t per = 0;
+                size_t end = 0;
+                if (ute_read_chunks(in, read, in_size, n, &per, &end) == ERR)
+                    return ERR;
+                read = end;
+            }
+            else if ((h >> 5) == 4 && flags == UTE_LIST_COLUMNAR)
+            {
+                uint64_t nfields = 0;
+                GET_VARINT(nfields);
+                for (uint64_t f = 0; f < nfields; ++f)
+                {
+                    uint64_t size = 0;
+                    GET_VARINT(size);
+                    if (size > in_size - read)
+                        return ERR;
+                    read += (size_t)size;
+                }
+            }
+            else
+            {
+                uint8_t known = (h >> 5) == 5 ? UTE_STRUCT_SPARSE | UTE_STRUCT_BITMAP : 0;
+                if ((flags & ~known) || flags == (UTE_STRUCT_SPARSE | UTE_STRUCT_BITMAP) || sp == UTE_PLAN_MAX_DEPTH)
+                    return ERR;
+                if (flags == UTE_STRUCT_BITMAP)
+                {
+                    // Only the members whose bit is set follow; unused bits must be clear
+                    size_t nbytes = n / 8 + (n % 8 != 0);
+                    if (n / 8 > in_size - read)
+                        return ERR;
+                    ENSURE_RSPACE(nbytes);
+                    if (n % 8 && (in[read + nbytes - 1] >> (n % 8)))
+                        return ERR;
+                    for (n = 0; nbytes; --nbytes)
+                        n += (uint64_t)__builtin_popcount(in[read++]);
+                }
+                // Elements and fields each take at least one byte
+                if (n > in_size - read)
+                    return ERR;
+                pending[++sp] = n;
+                indexed[sp] = flags == UTE_STRUCT_SPARSE;
+            }
+            break;
+        default:
+            return ERR;
+        }
+    }
+}
+
+// Store the default value of a leaf (0, false, "" or no bytes) without reading input
+static int ute_default_leaf(const struct ute_insn *insn, uint8_t *base, struct ute_arena *arena)
+{
+    uint8_t *value;
+    switch (insn->op)
+    {
+    case UTE_OP_NULL:
+        return 0;
+    case UTE_OP_BOOL:
+        value = decode_slot(base, insn, arena, sizeof(uint8_t));
+        if (!value)
+            return -1;
+        *value = 0;
+        return 0;
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+        value = decode_slot(base, insn, arena, sizeof(uint64_t));
+        if (!value)
+            return -1;
+        memset(value, 0, sizeof(uint64_t));
+        return 0;
+    case UTE_OP_STRING:
+        return store_string(insn, base, arena, (const uint8_t *)"", 0);
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
+        value = decode_slot(base, insn, arena, UTE_OP_WIDTH(insn->op));
+        if (!value)
+            return -1;
+        memset(value, 0, UTE_OP_WIDTH(insn->op));
+        return 0;
+    case UTE_OP_BYTES:
+        return store_bytes(insn, base, arena, (const uint8_t *)"", 0);
+    default:
+        return -1;
+    }
+}
+
+// Store the default value of the field subtree at insns[pc] (translation
+// plans: a field only the reader has; sparse structs: an absent member).
+// Lists become empty and structs get the defaults of their members.
+static int ute_default_node(const struct ute_insn *insns, size_t pc, uint8_t *base, struct ute_arena *arena)
+{
+    uint8_t *stack[UTE_PLAN_MAX_DEPTH];
+    size_t sp = 0;
+    size_t end = insns[pc].next;
+    while (pc < end)
+    {
+        const struct ute_insn *insn = &insns[pc];
+        if (insn->op == UTE_OP_LIST)
+        {
+            void **arr = (void **)slot_value(base, insn);
+            if (!arr && arena)
+            {
+                arr = alloc_list(insn, arena, 0);
+                *(void **)(base + insn->offset) = arr;
+            }
+            if (!arr)
+                return -1;
+            arr[0] = (void *)(uintptr_t)0;
+            pc = insn->next;
+        }
+        else if (insn->op == UTE_OP_STRUCT)
+        {
+            uint8_t *value = decode_slot(base, insn, arena, insn->arg);
+            if (!value || sp == UTE_PLAN_MAX_DEPTH)
+                return -1;
+            stack[sp++] = base;
+            base = value;
+            pc++;
+        }
+        else if (insn->op == UTE_OP_STRUCT_END)
+        {
+            base = stack[--sp];
+            pc++;
+        }
+        else if (insn->op == UTE_OP_SKIP)
+            pc = insn->next;
+        else if (insn->op == UTE_OP_MEMBER || insn->op == UTE_OP_DEFAULT)
+        {
+            // Markers of a translated subtree: the reader fields they wrap follow
+            pc++;
+        }
+        else
+        {
+            if (ute_default_leaf(insn, base, arena) != 0)
+                return -1;
+            pc++;
+        }
+    }
+    return 0;
+}
+
+// Size in bytes of the column of one member over all elements of a columnar list
+static size_t column_size(const struct ute_insn *member, void *const *arr, size_t count)
+{
+    size_t size = 0;
+    switch (member->op)
+    {
+    case UTE_OP_NULL:
+        return 0;
+    case UTE_OP_BOOL:
+        return count / 8 + (count % 8 != 0);
+    case UTE_OP_INT:
+    case UTE_OP_STRING:
+        for (size_t i = 1; i <= count; ++i)
+        {
+            const uint8_t *value = elem_value(arr, i, member);
+            if (!value)
+                return ERR;
+            if (member->op == UTE_OP_INT)
+            {
+                uint64_t v;
+                memcpy(&v, value, sizeof(v));
+                size += ute_varint_len(v);
+            }
+            else
+            {
+                size_t len = strlen((const char *)value);
+                size += ute_varint_len(len) + len;
+            }
+        }
+        return size;
+    default:
+        return ERR;
+    }
+}
+
+// Encode a columnar list body: the member count, then per member a column of
+// all element values preceded by its size (bools: bitmap, ints: bare varints,
+// strings: all lengths, then all bytes)
+static size_t ute_put_columnar(const struct ute_insn *insn, void *const *arr, size_t count, uint8_t *out, size_t written, size_t out_size, struct ute_gather *gather)
+{
+    const struct ute_insn *elem = insn + 1;
+    PUT_VARINT(elem->nfields);
+    const struct ute_insn *member = elem + 1;
+    for (uint32_t f = 0; f < elem->nfields; ++f, ++member)
+    {
+        size_t size = column_size(member, arr, count);
+        if (size == ERR)
+            return ERR;
+        PUT_VARINT(size);
+        switch (member->op)
+        {
+        case UTE_OP_BOOL:
+            for (size_t i = 1; i <= count; i += 8)
+            {
+                uint8_t bits = 0;
+                for (size_t j = 0; j < 8 && i + j <= count; ++j)
+                {
+                    const uint8_t *value = elem_value(arr, i + j, member);
+                    if (!value)
+                        return ERR;
+                    bits |= (uint8_t)((*value ? 1 : 0) << j);
+                }
+                PUT_BYTE(bits);
+            }
+            break;
+        case UTE_OP_INT:
+            written = ute_put_packed(arr, count, member, UTE_INTS_PLAIN, out, written, out_size);
+            if (written == ERR)
+                return ERR;
+            break;
+        case UTE_OP_STRING:
+            for (size_t i = 1; i <= count; ++i)
+                PUT_VARINT(strlen((const char *)elem_value(arr, i, member)));
+            for (size_t i = 1; i <= count; ++i)
+            {
+                const char *s = (const char *)elem_value(arr, i, member);
+                size_t len = strlen(s);
+                if (gather && len && len >= gather->iov->threshold)
+                {
+                    if (ute_gather_ref(gather, out, written, s, len) != 0)
+                        return ERR;
+                }
+                else
+                    PUT_BYTES(s, len);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return written;
+}
+
+// Decode the column of one member into all elements of a columnar list. The
+// column ends at in_size; returns the offset past the decoded values.
+static size_t ute_get_column(const struct ute_insn *member, void **arr, size_t count, struct ute_arena *arena, const uint8_t *in, size_t read, size_t in_size)
+{
+    switch (member->op)
+    {
+    case UTE_OP_NULL:
+        return read;
+    case UTE_OP_BOOL:
+    {
+        size_t nbytes = count / 8 + (count % 8 != 0);
+        ENSURE_RSPACE(nbytes);
+        // Bits past the last element must be clear
+        if (count % 8 && (in[read + nbytes - 1] >> (count % 8)))
+            return ERR;
+        for (size_t i = 1; i <= count; ++i)
+        {
+            uint8_t *value = decode_slot((uint8_t *)arr[i], member, arena, sizeof(uint8_t));
+            if (!value)
+                return ERR;
+            *value = (in[read + (i - 1) / 8] >> ((i - 1) % 8)) & 1;
+        }
+        return read + nbytes;
+    }
+    case UTE_OP_INT:
+        return ute_get_packed(arr, count, member, UTE_INTS_PLAIN, arena, 0, in, read, in_size);
+    case UTE_OP_STRING:
+    {
+        if (count == 0)
+            return read;
+        // Lengths come first: the bytes start after the last of them
+        size_t lengths = ute_skip_varints(in + read, in_size - read, count);
+        if (!lengths)
+            return ERR;
+        size_t bytes = read + lengths;
+        for (size_t i = 1; i <= count; ++i)
+        {
+            uint64_t len = 0;
+            GET_VARINT(len);
+            if (len > in_size - bytes || store_string(member, (uint8_t *)arr[i], arena, in + bytes, (size_t)len) != 0)
+                return ERR;
+            bytes += (size_t)len;
+        }
+        return bytes;
+    }
+    default:
+        return ERR;
+    }
+}
+
+// Decode a columnar list body into count elements (see ute_put_columnar)
+static size_t ute_get_columnar(const struct ute_insn *insn, void **arr, size_t count, struct ute_arena *arena, const uint8_t *in, size_t read, size_t in_size)
+{
+    const struct ute_insn *elem = insn + 1;
+    uint64_t nfields = 0;
+    GET_VARINT(nfields);
+    if (nfields != elem->nfields)
+        return ERR;
+    // Element storage first, the columns then fill it member by member
+    for (size_t i = 1; i <= count; ++i)
+    {
+        if (!decode_slot((uint8_t *)&arr[i], elem, arena, elem->arg))
+            return ERR;
+    }
+    const struct ute_insn *member = elem + 1;
+    for (uint32_t f = 0; f < elem->nfields; ++f, ++member)
+    {
+        uint64_t size = 0;
+        GET_VARINT(size);
+        if (size > in_size - read)
+            return ERR;
+        size_t end = read + (size_t)size;
+        // Columns of members the reader does not have are skipped whole
+        if (member->op != UTE_OP_SKIP && ute_get_column(member, arr, count, arena, in, read, end) != end)
+            return ERR;
+        read = end;
+    }
+    // Translation plans: members only the reader has follow as DEFAULT + leaf
+    for (; member->op == UTE_OP_DEFAULT; member += 2)
+    {
+        for (size_t i = 1; i <= count; ++i)
+        {
+            if (ute_default_leaf(member + 1, (uint8_t *)arr[i], arena) != 0)
+                return ERR;
+        }
+    }
+    return read;
+}
+
+// Presence of a member of a sparse struct when encoding
+#define UTE_MEMBER_PRESENT 0
+#define UTE_MEMBER_DEFAULT 1 // has its default value and may be omitted
+#define UTE_MEMBER_MISSING 2 // has no value (a NULL pointer) and must be omitted
+
+// Presence of the member encoded by insn inside a struct at base. Structs
+// count as present unless they are missing.
+static int member_presence(const struct ute_insn *insn, uint8_t *base)
+{
+    const uint8_t *value = slot_value(base, insn);
+    if (!value)
+        return UTE_MEMBER_MISSING;
+    switch (insn->op)
+    {
+    case UTE_OP_NULL:
+        return UTE_MEMBER_DEFAULT;
+    case UTE_OP_BOOL:
+        return *value ? UTE_MEMBER_PRESENT : UTE_MEMBER_DEFAULT;
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+    {
+        uint64_t v;
+        memcpy(&v, value, sizeof(v));
+        return v ? UTE_MEMBER_PRESENT : UTE_MEMBER_DEFAULT;
+    }
+    case UTE_OP_STRING:
+        return value[0] ? UTE_MEMBER_PRESENT : UTE_MEMBER_DEFAULT;
+    case UTE_OP_LIST:
+        return ((void *const *)value)[0] ? UTE_MEMBER_PRESENT : UTE_MEMBER_DEFAULT;
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
+    {
+        // All bits zero: a float -0.0 is present
+        static const uint8_t zero[8];
+        return memcmp(value, zero, UTE_OP_WIDTH(insn->op)) ? UTE_MEMBER_PRESENT : UTE_MEMBER_DEFAULT;
+    }
+    case UTE_OP_BYTES:
+        return ((const struct ute_bytes *)value)->len ? UTE_MEMBER_PRESENT : UTE_MEMBER_DEFAULT;
+    default:
+        return UTE_MEMBER_PRESENT;
+    }
+}
+
+// Size of the dense encoding of a member with its default value
+static size_t default_size(const struct ute_insn *insn)
+{
+    // An empty columnar list still lists its columns, all of size 0
+    if (insn->op == UTE_OP_LIST && (insn->flags & UTE_INSN_COLUMNAR))
+        return 2 + ute_varint_len(insn[1].nfields) + insn[1].nfields;
+    // An empty chunked list still has its chunk size, and no chunks
+    if (insn->op == UTE_OP_LIST && (insn->flags & UTE_INSN_CHUNKED))
+        return 2 + ute_varint_len(insn->nfields);
+    if (UTE_OP_IS_FIXED(insn->op))
+        return 1 + UTE_OP_WIDTH(insn->op);
+    return insn->op == UTE_OP_NULL || insn->op == UTE_OP_BOOL ? 1 : 2;
+}
+
+// Choose the smallest encoding of one instance of the sparse struct at
+// insns[pc]: dense (0), UTE_STRUCT_SPARSE or UTE_STRUCT_BITMAP, preferring
+// them in this order on ties. Present values cost the same in every form, so
+// only the counts, the indices or the bitmap and the defaults dense writes
+// for absent members are compared.
+static uint8_t sparse_form(const struct ute_insn *insns, size_t pc, uint8_t *value, size_t *out_present)
+{
+    const struct ute_insn *insn = &insns[pc];
+    size_t present = 0, indices = 0, defaults = 0;
+    int missing = 0;
+    for (size_t m = pc + 1; insns[m].op == UTE_OP_MEMBER; m = insns[m].next)
+    {
+        int presence = member_presence(&insns[m + 1], value);
+        if (presence == UTE_MEMBER_PRESENT)
+        {
+            present++;
+            indices += ute_varint_len(insns[m].arg);
+        }
+        else
+        {
+            missing |= presence == UTE_MEMBER_MISSING;
+            defaults += default_size(&insns[m + 1]);
+        }
+    }
+    size_t count = ute_varint_len(insn->nfields);
+    size_t dense = missing ? SIZE_MAX : count + defaults;
+    size_t sparse = ute_varint_len(present) + indices;
+    size_t bitmap = count + insn->nfields / 8 + (insn->nfields % 8 != 0);
+    *out_present = present;
+    if (dense <= sparse && dense <= bitmap)
+        return 0;
+    return bitmap <= sparse ? UTE_STRUCT_BITMAP : UTE_STRUCT_SPARSE;
+}
+
+// Encode the presence bitmap of a sparse struct instance at base: bit i % 8
+// of byte i / 8 is set if member i is present
+static size_t ute_put_bitmap(const struct ute_insn *insns, size_t pc, uint8_t *base, uint8_t *out, size_t written, size_t out_size)
+{
+    uint8_t bits = 0;
+    size_t i = 0;
+    for (size_t m = pc + 1; insns[m].op == UTE_OP_MEMBER; m = insns[m].next, ++i)
+    {
+        if (member_presence(&insns[m + 1], base) == UTE_MEMBER_PRESENT)
+            bits |= (uint8_t)(1 << (i % 8));
+        if (i % 8 == 7)
+        {
+            PUT_BYTE(bits);
+            bits = 0;
+        }
+    }
+    if (i % 8)
+        PUT_BYTE(bits);
+    return written;
+}
+
+// Number of chunks of a chunked list
+static inline size_t chunk_count(size_t count, size_t per)
+{
+    return count / per + (count % per != 0);
+}
+
+// Store the size of chunk i into a chunk table (u32 little-endian)
+static inline void put_chunk_size(uint8_t *table, size_t i, size_t size)
+{
+    uint8_t *p = table + i * UTE_CHUNK_ENTRY;
+    p[0] = (uint8_t)size;
+    p[1] = (uint8_t)(size >> 8);
+    p[2] = (uint8_t)(size >> 16);
+    p[3] = (uint8_t)(size >> 24);
+}
+
+// Encode elements [first, first + n) of the list at insns[pc]: flat elements
+// in a tight loop, others by a range run of the VM over the element
+static size_t ute_put_elems(const struct ute_insn *insns, size_t pc, void **arr, size_t first, size_t n, uint8_t *out, size_t written,
+                            size_t out_size, struct ute_gather *gather, const struct ute_dictionary *dict)
+{
+    const struct ute_insn *elem = &insns[pc + 1];
+    if (!n)
+        return written;
+    if (insns[pc].flags & FAST_FLAT)
+    {
+        if (elem->op == UTE_OP_STRUCT && out && !gather)
+            return ute_put_flat_structs(elem, arr, first, n, out, written, out_size);
+        for (size_t i = first + 1; i <= first + n; ++i)
         {
-            if (!arr[i])
+            written = ute_put_flat(elem, (const uint8_t *)arr[i], out, written, out_size, gather);
+            if (written == ERR)
+                return ERR;
+        }
+        return written;
+    }
+    return ute_vm_encode(insns, pc + 1, (uint8_t *)&arr[first + 1], n, out, written, out_size, gather, dict, NULL);
+}
+
+// Executor task: size chunk task of a chunked list, or encode it in place
+// once the offsets of all chunks are known
+static void ute_encode_chunk(void *arg, size_t task, size_t worker)
+{
+    struct ute_chunk_job *job = arg;
+    size_t first = task * job->per;
+    size_t n = job->count - first < job->per ? job->count - first : job->per;
+    (void)worker;
+    STAT_TASK_BEGIN(job, job->out != NULL);
+    if (!job->out)
+        job->results[task] = ute_put_elems(job->insns, job->pc, job->arr, first, n, NULL, 0, SIZE_MAX, NULL, job->dict);
+    else
+        job->results[task] = ute_put_elems(job->insns, job->pc, job->arr, first, n, job->out, job->offsets[task], job->offsets[task + 1], NULL, job->dict);
+    STAT_TASK_END(job, job->results[task]);
+}
+
+// Encode the chunks of a chunked list in parallel: one task pass sizes every
+// chunk, the sizes give the table and the offsets, and a second pass encodes
+// each chunk straight into its place in out
+static size_t ute_put_chunks_parallel(const struct ute_insn *insns, size_t pc, void **arr, size_t count, uint8_t *table, uint8_t *out,
+                                      size_t written, size_t out_size, const struct ute_dictionary *dict, const struct ute_executor *exec)
+{
+    size_t per = insns[pc].nfields;
+    size_t nchunks = chunk_count(count, per);
+    size_t *offsets = malloc((2 * nchunks + 1) * sizeof(size_t));
+    if (!offsets)
+        return ERR;
+    struct ute_chunk_job job = {insns, pc, arr, count, per, NULL, NULL, offsets, offsets + nchunks + 1, NULL, dict STAT_JOB_INIT};
+    exec->run(exec->ctx, nchunks, ute_encode_chunk, &job);
+    offsets[0] = written;
+    for (size_t c = 0; c < nchunks && written != ERR; ++c)
+    {
+        size_t size = job.results[c];
+        if (size == ERR || size > UINT32_MAX || size > out_size - written)
+            written = ERR;
+        else
+        {
+            put_chunk_size(table, c, size);
+            written += size;
+            offsets[c + 1] = written;
+        }
+    }
+    if (written != ERR)
+    {
+        job.out = out;
+        exec->run(exec->ctx, nchunks, ute_encode_chunk, &job);
+        for (size_t c = 0; c < nchunks; ++c)
+            if (job.results[c] != offsets[c + 1])
+                written = ERR;
+    }
+    if (written == ERR)
+        STAT_JOB_FAILED(job);
+    free(offsets);
+    return written;
+}
+
+// Encode the elements of a chunked list after its count: the number of
+// elements per chunk, the table of chunk sizes, then the chunks. Sequentially
+// each size is patched into the table once its chunk is written; in iovec
+// mode it includes the bytes referenced by the chunk.
+static size_t ute_put_chunked(const struct ute_insn *insns, size_t pc, void **arr, size_t count, uint8_t *out, size_t written,
+                              size_t out_size, struct ute_gather *gather, const struct ute_dictionary *dict, const struct ute_parallel *par)
+{
+    size_t per = insns[pc].nfields;
+    size_t nchunks = chunk_count(count, per);
+    PUT_VARINT(per);
+    if (nchunks > (out_size - written) / UTE_CHUNK_ENTRY)
+        return ERR;
+    uint8_t *table = out ? out + written : NULL;
+    written += nchunks * UTE_CHUNK_ENTRY;
+    if (par && out && nchunks > 1)
+        return ute_put_chunks_parallel(insns, pc, arr, count, table, out, written, out_size, dict, par->exec);
+    for (size_t c = 0; c < nchunks; ++c)
+    {
+        size_t start = written;
+        size_t referenced = gather ? gather->iov->referenced : 0;
+        size_t first = c * per;
+        written = ute_put_elems(insns, pc, arr, first, count - first < per ? count - first : per, out, written, out_size, gather, dict);
+        if (written == ERR)
+            return ERR;
+        size_t size = written - start + (gather ? gather->iov->referenced - referenced : 0);
+        if (size > UINT32_MAX)
+            return ERR;
+        if (table)
+            put_chunk_size(table, c, size);
+    }
+    return written;
+}
+
+// Run the plan over data and write the encoding to out (every top-level
+// encode goes through here)
+static size_t ute_run_encode(const struct ute_plan *plan, const void *data, uint8_t *out, size_t out_size, struct ute_gather *gather,
+                             const struct ute_parallel *par)
+{
+#ifdef UTE_STATS
+    uint64_t start = stat_begin(plan, UTE_TRACE_ENCODE, out != NULL);
+    size_t written = ute_vm_encode(plan->insns, 0, (uint8_t *)data, 0, out, 0, out_size, gather, &plan->dictionary, par);
+    stat_end(plan, UTE_TRACE_ENCODE, out != NULL, start, written);
+    return written;
+#else
+    return ute_vm_encode(plan->insns, 0, (uint8_t *)data, 0, out, 0, out_size, gather, &plan->dictionary, par);
+#endif
+}
+
+// Run the instructions from pc over base and append the encoding at out +
+// written (non-recursive). With elems, pc is the element of a list and base
+// its element slots: the VM encodes that many elements and stops at LIST_END.
+static size_t ute_vm_encode(const struct ute_insn *insns, size_t pc, uint8_t *base, size_t elems, uint8_t *out, size_t written,
+                            size_t out_size, struct ute_gather *gather, const struct ute_dictionary *dict, const struct ute_parallel *par)
+{
+    struct ute_frame stack[UTE_PLAN_MAX_DEPTH];
+    size_t sp = 0;
+    struct ute_refs refs;
+    refs.ready = 0;
+    if (elems)
+    {
+        stack[0].base = base;
+        stack[0].remaining = elems;
+        sp = 1;
+    }
+    for (;;)
+    {
+        const struct ute_insn *insn = &insns[pc];
+        STAT_INSN(pc, written);
+        switch (insn->op)
+        {
+        case UTE_OP_HALT:
+            return written;
+        case UTE_OP_NULL:
+        case UTE_OP_BOOL:
+        case UTE_OP_INT:
+        case UTE_OP_STRING:
+        case UTE_OP_FLOAT32:
+        case UTE_OP_FLOAT64:
+        case UTE_OP_FIXED32:
+        case UTE_OP_FIXED64:
+        case UTE_OP_BYTES:
+        case UTE_OP_SINT:
+            if (insn->flags & UTE_INSN_DICT)
+                written = ute_put_dict_string(insn, (const char *)slot_value(base, insn), dict, &refs, out, written, out_size, gather);
+            else
+                written = ute_put_leaf(insn, slot_value(base, insn), out, written, out_size, gather);
+            if (written == ERR)
+                return ERR;
+            STAT_VALUE(UTE_TRACE_ENCODE, pc, written);
+            pc++;
+            break;
+        case UTE_OP_LIST:
+        {
+            uint8_t *value = slot_value(base, insn);
+            if (!value)
+                return ERR;
+            void **arr = (void **)value;
+            size_t count = (size_t)(uintptr_t)arr[0];
+            PUT_BYTE((4 << 5) | UTE_LIST_FLAGS(insn)); // tList
+            PUT_VARINT(count);
+            if (insn->flags & UTE_INSN_CHUNKED)
+            {
+                written = ute_put_chunked(insns, pc, arr, count, out, written, out_size, gather, dict, par);
+                if (written == ERR)
+                    return ERR;
+                STAT_VALUE(UTE_TRACE_ENCODE, pc, written);
+                pc = insn->next;
+                break;
+            }
+            if (insn->flags & (UTE_INSN_PACKED | UTE_INSN_COLUMNAR | UTE_INSN_FIXED))
+            {
+                if (insn->flags & UTE_INSN_PACKED)
+                    written = ute_put_packed(arr, count, NULL, insn->nfields, out, written, out_size);
+                else if (insn->flags & UTE_INSN_FIXED)
+                    written = ute_put_fixed(insn, arr, count, out, written, out_size, gather);
+                else
+                    written = ute_put_columnar(insn, arr, count, out, written, out_size, gather);
+                if (written == ERR)
+                    return ERR;
+                STAT_VALUE(UTE_TRACE_ENCODE, pc, written);
+                pc = insn->next;
+                break;
+            }
+            if (insn->flags & FAST_FLAT)
+            {
+                // Elements need no frame: encode them in a tight loop
+                const struct ute_insn *elem = insn + 1;
+                if (elem->op == UTE_OP_STRUCT && out && !gather)
+                {
+                    written = ute_put_flat_structs(elem, arr, 0, count, out, written, out_size);
+                    if (written == ERR)
+                        return ERR;
+                    pc = insn->next;
+                    break;
+                }
+                for (size_t i = 1; i <= count; ++i)
+                {
+                    written = ute_put_flat(elem, (const uint8_t *)arr[i], out, written, out_size, gather);
+                    if (written == ERR)
+                        return ERR;
+                }
+                pc = insn->next;
+                break;
+            }
+            if (count == 0)
+            {
+                STAT_VALUE(UTE_TRACE_ENCODE, pc, written);
+                pc = insn->next;
+                break;
+            }
+            if (sp == UTE_PLAN_MAX_DEPTH)
+                return ERR;
+            stack[sp].base = base;
+            stack[sp].remaining = count;
+            STAT_OPEN(stack[sp]);
+            sp++;
+            base = (uint8_t *)&arr[1];
+            pc++;
+            break;
+        }
+        case UTE_OP_LIST_END:
+            if (--stack[sp - 1].remaining)
+            {
+                base += sizeof(void *);
+                pc = insn->next + 1;
+            }
+            else
+            {
+                // A range run ends with its own list
+                if (--sp == 0 && elems)
+                    return written;
+                base = stack[sp].base;
+                STAT_CLOSE(UTE_TRACE_ENCODE, insn->next, stack[sp], written);
+                pc++;
+            }
+            break;
+        case UTE_OP_STRUCT:
+        {
+            uint8_t *value = slot_value(base, insn);
+            if (insn->flags & FAST_FLAT)
+            {
+                written = ute_put_flat(insn, value, out, written, out_size, gather);
+                if (written == ERR)
+                    return ERR;
+                pc = insn->next;
+                break;
+            }
+            if (!value || sp == UTE_PLAN_MAX_DEPTH)
+                return ERR;
+            uint8_t form = 0;
+            size_t present = 0;
+            if (insn->flags & UTE_INSN_SPARSE)
+                form = sparse_form(insns, pc, value, &present);
+            PUT_BYTE((5 << 5) | form); // tStruct
+            PUT_VARINT(form == UTE_STRUCT_SPARSE ? present : insn->nfields);
+            if (form == UTE_STRUCT_BITMAP)
+            {
+                written = ute_put_bitmap(insns, pc, value, out, written, out_size);
+                if (written == ERR)
+                    return ERR;
+            }
+            stack[sp].base = base;
+            stack[sp].form = form;
+            STAT_OPEN(stack[sp]);
+            sp++;
+            base = value;
+            pc++;
+            break;
+        }
+        case UTE_OP_STRUCT_END:
+            base = stack[--sp].base;
+            STAT_CLOSE(UTE_TRACE_ENCODE, insn->next, stack[sp], written);
+            pc++;
+            break;
+        case UTE_OP_MEMBER:
+            // Sparse and bitmap instances omit the members that are not present
+            if (stack[sp - 1].form)
+            {
+                if (member_presence(insn + 1, base) != UTE_MEMBER_PRESENT)
+                {
+                    pc = insn->next;
+                    break;
+                }
+                if (stack[sp - 1].form == UTE_STRUCT_SPARSE)
+                    PUT_VARINT(insn->arg);
+            }
+            pc++;
+            break;
+        default:
+            return ERR;
+        }
+    }
+}
+
+// Decode elements [first, first + n) of the list at insns[pc] (see ute_put_elems)
+static size_t ute_get_elems(const struct ute_insn *insns, size_t pc, void **arr, size_t first, size_t n, struct ute_arena *arena,
+                            const uint8_t *in, size_t read, size_t in_size, const struct ute_dictionary *dict)
+{
+    const struct ute_insn *elem = &insns[pc + 1];
+    if (!n)
+        return read;
+    if (insns[pc].flags & FAST_FLAT)
+    {
+        if (elem->op == UTE_OP_STRUCT)
+            return ute_get_flat_structs(elem, arr, first, n, arena, in, read, in_size);
+        for (size_t i = first + 1; i <= first + n; ++i)
+        {
+            read = ute_get_flat(elem, (uint8_t *)&arr[i], arena, in, read, in_size);
+            if (read == ERR)
+                return ERR;
+        }
+        return read;
+    }
+    return ute_vm_decode(insns, pc + 1, in, read, in_size, (uint8_t *)&arr[first + 1], n, arena, dict, NULL);
+}
+
+// Executor task: decode chunk task of a chunked list with the arena of its worker
+static void ute_decode_chunk(void *arg, size_t task, size_t worker)
+{
+    struct ute_chunk_job *job = arg;
+    size_t first = task * job->per;
+    size_t n = job->count - first < job->per ? job->count - first : job->per;
+    struct ute_arena *arena = job->arenas ? &job->arenas[worker] : NULL;
+    STAT_TASK_BEGIN(job, 1);
+    job->results[task] = ute_get_elems(job->insns, job->pc, job->arr, first, n, arena, job->in, job->offsets[task], job->offsets[task + 1], job->dict);
+    STAT_TASK_END(job, job->results[task]);
+}
+
+// Decode the elements of a chunked list after its count. Each chunk is
+// bounded by its size in the table and must end exactly there; with an
+// executor the chunks are decoded in parallel.
+static size_t ute_get_chunked(const struct ute_insn *insns, size_t pc, void **arr, size_t count, struct ute_arena *arena,
+                              const uint8_t *in, size_t read, size_t in_size, const struct ute_dictionary *dict, const struct ute_parallel *par)
+{
+    uint64_t per = 0;
+    size_t end = 0;
+    read = ute_read_chunks(in, read, in_size, count, &per, &end);
+    if (read == ERR)
+        return ERR;
+    size_t nchunks = (size_t)(count / per + (count % per != 0));
+    const uint8_t *table = in + read - nchunks * UTE_CHUNK_ENTRY;
+    if (par && nchunks > 1)
+    {
+        size_t *offsets = malloc((2 * nchunks + 1) * sizeof(size_t));
+        if (!offsets)
+            return ERR;
+        struct ute_chunk_job job = {insns, pc, arr, count, (size_t)per, NULL, in, offsets, offsets + nchunks + 1, par->arenas, dict STAT_JOB_INIT};
+        offsets[0] = read;
+        for (size_t c = 0; c < nchunks; ++c)
+            offsets[c + 1] = offsets[c] + ute_chunk_size(table, c);
+        par->exec->run(par->exec->ctx, nchunks, ute_decode_chunk, &job);
+        for (size_t c = 0; c < nchunks; ++c)
+            if (job.results[c] != offsets[c + 1])
+                end = ERR;
+        if (end == ERR)
+            STAT_JOB_FAILED(job);
+        free(offsets);
+        return end;
+    }
+    for (size_t c = 0; c < nchunks; ++c)
+    {
+        size_t first = c * (size_t)per;
+        size_t stop = read + ute_chunk_size(table, c);
+        if (ute_get_elems(insns, pc, arr, first, count - first < per ? count - first : (size_t)per, arena, in, read, stop, dict) != stop)
+            return ERR;
+        read = stop;
+    }
+    return read;
+}
+
+// Run the plan over an encoded buffer and store the values into data (every
+// top-level decode goes through here). With an arena, empty INDIRECT slots
+// are filled with storage allocated from it.
+static size_t ute_run_decode(const struct ute_plan *plan, const uint8_t *in, size_t in_size, void *data, struct ute_arena *arena,
+                             const struct ute_parallel *par)
+{
+#ifdef UTE_STATS
+    uint64_t start = stat_begin(plan, UTE_TRACE_DECODE, 1);
+    size_t read = ute_vm_decode(plan->insns, 0, in, 0, in_size, (uint8_t *)data, 0, arena, &plan->dictionary, par);
+    stat_end(plan, UTE_TRACE_DECODE, 1, start, read);
+    return read;
+#else
+    return ute_vm_decode(plan->insns, 0, in, 0, in_size, (uint8_t *)data, 0, arena, &plan->dictionary, par);
+#endif
+}
+
+// Run the instructions from pc over the input at in + read and store the
+// values under base (non-recursive). With elems, pc is the element of a list
+// and base its element slots: the VM decodes that many elements and stops at LIST_END.
+static size_t ute_vm_decode(const struct ute_insn *insns, size_t pc, const uint8_t *in, size_t read, size_t in_size, uint8_t *base,
+                            size_t elems, struct ute_arena *arena, const struct ute_dictionary *dict, const struct ute_parallel *par)
+{
+    struct ute_frame stack[UTE_PLAN_MAX_DEPTH];
+    size_t sp = 0;
+    struct ute_ref_targets targets; // back-references stay within the run
+    targets.count = 0;
+    if (elems)
+    {
+        stack[0].base = base;
+        stack[0].remaining = elems;
+        sp = 1;
+    }
+    for (;;)
+    {
+        const struct ute_insn *insn = &insns[pc];
+        STAT_INSN(pc, read);
+        switch (insn->op)
+        {
+        case UTE_OP_HALT:
+            return read;
+        case UTE_OP_NULL:
+        case UTE_OP_BOOL:
+        case UTE_OP_INT:
+        case UTE_OP_STRING:
+        case UTE_OP_FLOAT32:
+        case UTE_OP_FLOAT64:
+        case UTE_OP_FIXED32:
+        case UTE_OP_FIXED64:
+        case UTE_OP_BYTES:
+        case UTE_OP_SINT:
+            // IMPORTANT: without an arena every value slot (including list elements) must point to user-allocated memory
+            if (insn->flags & UTE_INSN_DICT)
+                read = ute_get_dict_string(insn, base, arena, dict, in, read, in_size, &targets);
+            else
+                read = ute_get_leaf(insn, base, arena, in, read, in_size);
+            if (read == ERR)
+                return ERR;
+            STAT_VALUE(UTE_TRACE_DECODE, pc, read);
+            pc++;
+            break;
+        case UTE_OP_LIST:
+        {
+            ENSURE_RSPACE(1);
+            uint8_t h = in[read++];
+            if ((h >> 5) != 4 || (h & UTE_PREFIX_FLAGS) != UTE_LIST_FLAGS(insn))
+                FAIL(UTE_ERROR_TYPE);
+            uint64_t count = 0;
+            GET_VARINT(count);
+            // Every element takes at least one byte (one bit in a columnar list)
+            if (count > in_size - read && (!(insn->flags & UTE_INSN_COLUMNAR) || count / 8 > in_size - read))
+                return ERR;
+            void **arr = (void **)slot_value(base, insn);
+            int fresh = 0;
+            if (!arr && arena)
+            {
+                arr = alloc_list(insn, arena, (size_t)count);
+                *(void **)(base + insn->offset) = arr;
+                fresh = 1;
+            }
+            if (!arr)
+                return ERR;
+            arr[0] = (void *)(uintptr_t)count;
+            if (insn->flags & UTE_INSN_CHUNKED)
+            {
+                read = ute_get_chunked(insns, pc, arr, (size_t)count, arena, in, read, in_size, dict, par);
+                if (read == ERR)
+                    return ERR;
+                STAT_VALUE(UTE_TRACE_DECODE, pc, read);
+                pc = insn->next;
+                break;
+            }
+            if (insn->flags & (UTE_INSN_PACKED | UTE_INSN_COLUMNAR | UTE_INSN_FIXED))
+            {
+                if (insn->flags & UTE_INSN_PACKED)
+                    read = ute_get_packed(arr, (size_t)count, NULL, insn->nfields, arena, fresh, in, read, in_size);
+                else if (insn->flags & UTE_INSN_FIXED)
+                    read = ute_get_fixed(insn, arr, (size_t)count, arena, fresh, in, read, in_size);
+                else
+                    read = ute_get_columnar(insn, arr, (size_t)count, arena, in, read, in_size);
+                if (read == ERR)
+                    return ERR;
+                STAT_VALUE(UTE_TRACE_DECODE, pc, read);
+                pc = insn->next;
+                break;
+            }
+            if (insn->flags & FAST_FLAT)
+            {
+                const struct ute_insn *elem = insn + 1;
+                if (elem->op == UTE_OP_STRUCT)
+                {
+                    read = ute_get_flat_structs(elem, arr, 0, (size_t)count, arena, in, read, in_size);
+                    if (read == ERR)
+                        return ERR;
+                    pc = insn->next;
+                    break;
+                }
+                for (size_t i = 1; i <= count; ++i)
+                {
+                    read = ute_get_flat(elem, (uint8_t *)&arr[i], arena, in, read, in_size);
+                    if (read == ERR)
+                        return ERR;
+                }
+                pc = insn->next;
+                break;
+            }
+            if (count == 0)
+            {
+                STAT_VALUE(UTE_TRACE_DECODE, pc, read);
+                pc = insn->next;
+                break;
+            }
+            if (sp == UTE_PLAN_MAX_DEPTH)
+                return ERR;
+            stack[sp].base = base;
+            stack[sp].remaining = (size_t)count;
+            STAT_OPEN(stack[sp]);
+            sp++;
+            base = (uint8_t *)&arr[1];
+            pc++;
+            break;
+        }
+        case UTE_OP_LIST_END:
+            if (--stack[sp - 1].remaining)
+            {
+                base += sizeof(void *);
+                pc = insn->next + 1;
+            }
+            else
+            {
+                // A range run ends with its own list
+                if (--sp == 0 && elems)
+                    return read;
+                base = stack[sp].base;
+                STAT_CLOSE(UTE_TRACE_DECODE, insn->next, stack[sp], read);
+                pc++;
+            }
+            break;
+        case UTE_OP_STRUCT:
+        {
+            if (insn->flags & FAST_FLAT)
+            {
+                read = ute_get_flat(insn, base, arena, in, read, in_size);
+                if (read == ERR)
+                    return ERR;
+                pc = insn->next;
+                break;
+            }
+            uint8_t *value = decode_slot(base, insn, arena, insn->arg);
+            if (!value || sp == UTE_PLAN_MAX_DEPTH)
+                return ERR;
+            ENSURE_RSPACE(1);
+            uint8_t h = in[read++];
+            uint8_t form = h & UTE_PREFIX_FLAGS;
+            // A sparse struct may be encoded in any of the three forms
+            if ((h >> 5) != 5 || (form && (!(insn->flags & UTE_INSN_SPARSE) || (form != UTE_STRUCT_SPARSE && form != UTE_STRUCT_BITMAP))))
+                FAIL(UTE_ERROR_TYPE);
+            uint64_t nfields = 0;
+            GET_VARINT(nfields);
+            if (form == UTE_STRUCT_SPARSE ? nfields > insn->nfields : nfields != insn->nfields)
+                return ERR;
+            stack[sp].remaining = (size_t)nfields;
+            if (form == UTE_STRUCT_BITMAP)
+            {
+                // Bits past the last member must be clear
+                size_t nbytes = insn->nfields / 8 + (insn->nfields % 8 != 0);
+                ENSURE_RSPACE(nbytes);
+                if (insn->nfields % 8 && (in[read + nbytes - 1] >> (insn->nfields % 8)))
+                    return ERR;
+                stack[sp].bitmap = in + read;
+                read += nbytes;
+            }
+            stack[sp].base = base;
+            stack[sp].form = form;
+            STAT_OPEN(stack[sp]);
+            sp++;
+            base = value;
+            pc++;
+            break;
+        }
+        case UTE_OP_STRUCT_END:
+            // Indices past the last member leave pairs unread
+            if (stack[sp - 1].form == UTE_STRUCT_SPARSE && stack[sp - 1].remaining)
+                return ERR;
+            base = stack[--sp].base;
+            STAT_CLOSE(UTE_TRACE_DECODE, insn->next, stack[sp], read);
+            pc++;
+            break;
+        case UTE_OP_MEMBER:
+        {
+            struct ute_frame *frame = &stack[sp - 1];
+            int present = 1;
+            if (frame->form == UTE_STRUCT_BITMAP)
+                present = (frame->bitmap[insn->arg / 8] >> (insn->arg % 8)) & 1;
+            else if (frame->form == UTE_STRUCT_SPARSE)
+            {
+                // Peek at the next index: indices ascend, so a smaller one is
+                // out of order or repeated and a larger one belongs to a later member
+                present = 0;
+                if (frame->remaining)
+                {
+                    uint64_t index = 0;
+                    size_t at = read;
+                    GET_VARINT(index);
+                    if (index < insn->arg)
+                        return ERR;
+                    present = index == insn->arg;
+                    if (present)
+                        frame->remaining--;
+                    else
+                        read = at;
+                }
+            }
+            if (!present)
             {
-                // Defensive: skip if pointer is NULL
-                continue;
+                if (ute_default_node(insns, pc + 1, base, arena) != 0)
+                    return ERR;
+                pc = insn->next;
+                break;
             }
-            size_t sub = ute_read_field(field->elem, in + read, in_size - read, arr[i]);
-            if (sub == ERR)
+            pc++;
+            break;
+        }
+        case UTE_OP_SKIP:
+            // A skipped field with DICT strings carries its writer instructions,
+            // so that back-references may target its strings
+            if (insn->next != pc + 1)
+                read = ute_vm_validate(insns, pc + 1, in, read, in_size, 0, dict, 0, &targets);
+            else
+                read = ute_skip_value(in, read, in_size);
+            if (read == ERR)
+                return ERR;
+            STAT_VALUE(UTE_TRACE_DECODE, pc, read);
+            pc = insn->next;
+            break;
+        case UTE_OP_DEFAULT:
+            if (ute_default_node(insns, pc + 1, base, arena) != 0)
                 return ERR;
-            read += sub;
+            pc = insn->next;
+            break;
+        default:
+            return ERR;
         }
-        break;
     }
-    case UTE_TYPE_STRUCT:
+}
+
+// Pick the plan of a message's version from an evolution and decode it
+static size_t ute_run_versioned(const uint8_t *in_buf, size_t in_buf_size, const struct ute_evolution *evo, struct ute_arena *arena, void *out_data)
+{
+    if (!in_buf || !evo || !out_data)
+        return ERR;
+    int version = evo->untagged_version;
+    size_t tag = ute_read_version_tag(in_buf, in_buf_size, &version);
+    if (tag == ERR)
+        return ERR;
+    const struct ute_plan *plan = ute_evolution_plan(evo, version);
+    if (!plan || !plan->insns)
+        return ERR;
+    size_t read = ute_run_decode(plan, in_buf + tag, in_buf_size - tag, out_data, arena, NULL);
+    return read == ERR ? ERR : tag + read;
+}
+
+// =========================================================
+// Validation: the decoder's checks, without storing anything
+// =========================================================
+
+// True if a string or bytes value of len bytes fits the buffer of an inline
+// slot (see store_string and store_bytes). Values behind a pointer may be
+// decoded into an arena, which sizes them to fit.
+static inline int fits_inline(const struct ute_insn *insn, uint64_t len)
+{
+    if ((insn->flags & UTE_INSN_INDIRECT) || !insn->arg)
+        return 1;
+    return insn->op == UTE_OP_STRING ? len < insn->arg : len <= insn->arg;
+}
+
+// Check a leaf value. Unlike the decoder, which ignores them, the unused low
+// bits of null, bool, int, string and bytes prefixes must be clear.
+static inline size_t ute_check_leaf(const struct ute_insn *insn, const uint8_t *in, size_t read, size_t in_size, int flags)
+{
+    ENSURE_RSPACE(1);
+    uint8_t h = in[read++];
+    uint64_t n = 0;
+    switch (insn->op)
+    {
+    case UTE_OP_NULL:
+        return h == 0 ? read : ERR;
+    case UTE_OP_BOOL:
+        return (h & ~0x10) == (1 << 5) ? read : ERR;
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+        if (h != (2 << 5))
+            return ERR;
+        GET_VARINT(n);
+        return read;
+    case UTE_OP_STRING:
+    case UTE_OP_BYTES:
+        if (h != (insn->op == UTE_OP_STRING ? 3 << 5 : 6 << 5))
+            return ERR;
+        GET_VARINT(n);
+        if (n > in_size - read || !fits_inline(insn, n))
+            return ERR;
+        if (insn->op == UTE_OP_STRING && (flags & UTE_VALIDATE_UTF8) && !ute_utf8_valid(in + read, (size_t)n))
+            return ERR;
+        return read + (size_t)n;
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
+        if (h != UTE_FIXED_PREFIX(UTE_OP_WIDTH(insn->op)))
+            return ERR;
+        ENSURE_RSPACE(UTE_OP_WIDTH(insn->op));
+        return read + UTE_OP_WIDTH(insn->op);
+    default:
+        return ERR;
+    }
+}
+
+// Check the string of a DICT instruction (see ute_get_dict_string)
+static size_t ute_check_dict_string(const struct ute_insn *insn, const struct ute_dictionary *dict, const uint8_t *in, size_t read, size_t in_size,
+                                    struct ute_ref_targets *targets, int flags)
+{
+    ENSURE_RSPACE(1);
+    uint8_t h = in[read];
+    if (h == (3 << 5))
+    {
+        ute_ref_record(targets, read);
+        return ute_check_leaf(insn, in, read, in_size, flags);
+    }
+    size_t at = read++;
+    uint64_t n = 0;
+    size_t len = 0;
+    GET_VARINT(n);
+    if (h == ((3 << 5) | UTE_STRING_REF))
+    {
+        // The target may be a string of another field, so it is checked like one of this field
+        size_t target = ute_resolve_run_ref(targets, in, at, n, &len);
+        if (target == ERR || !fits_inline(insn, len) || ((flags & UTE_VALIDATE_UTF8) && !ute_utf8_valid(in + target, len)))
+            return ERR;
+        return read;
+    }
+    if (h != ((3 << 5) | UTE_STRING_DICT) || insn->nfields != UTE_DICT_SHARED || !ute_dictionary_value(dict, n, &len) || !fits_inline(insn, len))
+        return ERR;
+    return read;
+}
+
+// Check one column of count elements of a columnar list (see ute_get_column)
+static size_t ute_check_column(const struct ute_insn *member, size_t count, const uint8_t *in, size_t read, size_t in_size, int flags)
+{
+    if (count == 0)
+        return read;
+    switch (member->op)
     {
-        if ((h >> 5) != 5)
+    case UTE_OP_NULL:
+        return read;
+    case UTE_OP_BOOL:
+    {
+        size_t nbytes = count / 8 + (count % 8 != 0);
+        ENSURE_RSPACE(nbytes);
+        if (count % 8 && (in[read + nbytes - 1] >> (count % 8)))
             return ERR;
-        uint64_t nfields = 0;
-        size_t var_len = ute_decode_varint(in + read, in_size - read, &nfields);
-        if (var_len == 0 || read + var_len > in_size)
+        return read + nbytes;
+    }
+    case UTE_OP_INT:
+    {
+        size_t len = ute_check_varints(in + read, in_size - read, count);
+        return len ? read + len : ERR;
+    }
+    case UTE_OP_STRING:
+    {
+        size_t lengths = ute_check_varints(in + read, in_size - read, count);
+        if (!lengths)
             return ERR;
-        read += var_len;
-        for (size_t i = 0; i < nfields; ++i)
+        size_t bytes = read + lengths;
+        for (size_t i = 0; i < count; ++i)
         {
-            size_t sub = ute_read_field(&field->fields[i], in + read, in_size - read, (char *)value + i * sizeof(void *));
-            if (sub == ERR)
+            uint64_t len = 0;
+            GET_VARINT(len);
+            if (len > in_size - bytes || !fits_inline(member, len) || ((flags & UTE_VALIDATE_UTF8) && !ute_utf8_valid(in + bytes, (size_t)len)))
                 return ERR;
-            read += sub;
+            bytes += (size_t)len;
         }
-        break;
+        return bytes;
     }
     default:
-        break;
+        return ERR;
+    }
+}
+
+// Check a columnar list body of count elements: every column must end
+// exactly at its size
+static size_t ute_check_columnar(const struct ute_insn *insn, size_t count, const uint8_t *in, size_t read, size_t in_size, int flags)
+{
+    const struct ute_insn *elem = insn + 1;
+    uint64_t nfields = 0;
+    GET_VARINT(nfields);
+    if (nfields != elem->nfields)
+        return ERR;
+    const struct ute_insn *member = elem + 1;
+    for (uint32_t f = 0; f < elem->nfields; ++f, ++member)
+    {
+        uint64_t size = 0;
+        GET_VARINT(size);
+        if (size > in_size - read)
+            return ERR;
+        size_t end = read + (size_t)size;
+        if (member->op != UTE_OP_SKIP && ute_check_column(member, count, in, read, end, flags) != end)
+            return ERR;
+        read = end;
+    }
+    return read;
+}
+
+// Check the chunks of a chunked list: each must hold its elements exactly
+static size_t ute_check_chunked(const struct ute_insn *insns, size_t pc, size_t count, const uint8_t *in, size_t read, size_t in_size,
+                                const struct ute_dictionary *dict, int flags)
+{
+    uint64_t per = 0;
+    read = ute_read_chunks(in, read, in_size, count, &per, NULL);
+    if (read == ERR)
+        return ERR;
+    size_t nchunks = (size_t)(count / per + (count % per != 0));
+    const uint8_t *table = in + read - nchunks * UTE_CHUNK_ENTRY;
+    for (size_t c = 0; c < nchunks; ++c)
+    {
+        size_t first = c * (size_t)per;
+        size_t stop = read + ute_chunk_size(table, c);
+        size_t n = count - first < per ? count - first : (size_t)per;
+        if (ute_vm_validate(insns, pc + 1, in, read, stop, n, dict, flags, NULL) != stop)
+            return ERR;
+        read = stop;
     }
     return read;
 }
+
+// Run the instructions from pc over the input like ute_vm_decode, checking
+// the encoding without storing values. With elems, pc is the element of a
+// list: the VM checks that many elements and stops at LIST_END. With
+// targets, the instructions are the field a translation plan skips (up to
+// its HALT), whose strings are targets of the enclosing run.
+static size_t ute_vm_validate(const struct ute_insn *insns, size_t pc, const uint8_t *in, size_t read, size_t in_size, size_t elems,
+                              const struct ute_dictionary *dict, int flags, struct ute_ref_targets *targets)
+{
+    struct ute_frame stack[UTE_PLAN_MAX_DEPTH];
+    size_t sp = 0;
+    struct ute_ref_targets own;
+    struct ute_ref_targets *run = targets ? targets : &own;
+    own.count = 0;
+    if (elems)
+    {
+        stack[0].remaining = elems;
+        sp = 1;
+    }
+    for (;;)
+    {
+        const struct ute_insn *insn = &insns[pc];
+        switch (insn->op)
+        {
+        case UTE_OP_HALT:
+            return read;
+        case UTE_OP_NULL:
+        case UTE_OP_BOOL:
+        case UTE_OP_INT:
+        case UTE_OP_STRING:
+        case UTE_OP_FLOAT32:
+        case UTE_OP_FLOAT64:
+        case UTE_OP_FIXED32:
+        case UTE_OP_FIXED64:
+        case UTE_OP_BYTES:
+        case UTE_OP_SINT:
+            if (insn->flags & UTE_INSN_DICT)
+                read = ute_check_dict_string(insn, dict, in, read, in_size, run, flags);
+            else
+                read = ute_check_leaf(insn, in, read, in_size, flags);
+            if (read == ERR)
+                return ERR;
+            pc++;
+            break;
+        case UTE_OP_LIST:
+        {
+            ENSURE_RSPACE(1);
+            if (in[read++] != ((4 << 5) | UTE_LIST_FLAGS(insn)))
+                return ERR;
+            uint64_t count = 0;
+            GET_VARINT(count);
+            // Every element takes at least one byte (one bit in a columnar list)
+            if (count > in_size - read && (!(insn->flags & UTE_INSN_COLUMNAR) || count / 8 > in_size - read))
+                return ERR;
+            if (insn->flags & (UTE_INSN_CHUNKED | UTE_INSN_PACKED | UTE_INSN_FIXED | UTE_INSN_COLUMNAR))
+            {
+                if (insn->flags & UTE_INSN_CHUNKED)
+                    read = ute_check_chunked(insns, pc, (size_t)count, in, read, in_size, dict, flags);
+                else if (insn->flags & UTE_INSN_PACKED)
+                {
+                    size_t len = count ? ute_check_varints(in + read, in_size - read, (size_t)count) : 0;
+                    read = count && !len ? ERR : read + len;
+                }
+                else if (insn->flags & UTE_INSN_FIXED)
+                    read = count > (in_size - read) / insn->arg ? ERR : read + (size_t)count * insn->arg;
+                else
+                    read = ute_check_columnar(insn, (size_t)count, in, read, in_size, flags);
+                if (read == ERR)
+                    return ERR;
+                pc = insn->next;
+                break;
+            }
+            if (count == 0)
+            {
+                pc = insn->next;
+                break;
+            }
+            if (sp == UTE_PLAN_MAX_DEPTH)
+                return ERR;
+            stack[sp].remaining = (size_t)count;
+            sp++;
+            pc++;
+            break;
+        }
+        case UTE_OP_LIST_END:
+            if (--stack[sp - 1].remaining)
+                pc = insn->next + 1;
+            else
+            {
+                if (--sp == 0 && elems)
+                    return read;
+                pc++;
+            }
+            break;
+        case UTE_OP_STRUCT:
+        {
+            if (sp == UTE_PLAN_MAX_DEPTH)
+                return ERR;
+            ENSURE_RSPACE(1);
+            uint8_t h = in[read++];
+            uint8_t form = h & UTE_PREFIX_FLAGS;
+            if ((h >> 5) != 5 || (form && (!(insn->flags & UTE_INSN_SPARSE) || (form != UTE_STRUCT_SPARSE && form != UTE_STRUCT_BITMAP))))
+                return ERR;
+            uint64_t nfields = 0;
+            GET_VARINT(nfields);
+            if (form == UTE_STRUCT_SPARSE ? nfields > insn->nfields : nfields != insn->nfields)
+                return ERR;
+            stack[sp].remaining = (size_t)nfields;
+            if (form == UTE_STRUCT_BITMAP)
+            {
+                size_t nbytes = insn->nfields / 8 + (insn->nfields % 8 != 0);
+                ENSURE_RSPACE(nbytes);
+                if (insn->nfields % 8 && (in[read + nbytes - 1] >> (insn->nfields % 8)))
+                    return ERR;
+                stack[sp].bitmap = in + read;
+                read += nbytes;
+            }
+            stack[sp].form = form;
+            sp++;
+            pc++;
+            break;
+        }
+        case UTE_OP_STRUCT_END:
+            if (stack[sp - 1].form == UTE_STRUCT_SPARSE && stack[sp - 1].remaining)
+                return ERR;
+            sp--;
+            pc++;
+            break;
+        case UTE_OP_MEMBER:
+        {
+            struct ute_frame *frame = &stack[sp - 1];
+            int present = 1;
+            if (frame->form == UTE_STRUCT_BITMAP)
+                present = (frame->bitmap[insn->arg / 8] >> (insn->arg % 8)) & 1;
+            else if (frame->form == UTE_STRUCT_SPARSE)
+            {
+                // Indices must ascend (see ute_vm_decode)
+                present = 0;
+                if (frame->remaining)
+                {
+                    uint64_t index = 0;
+                    size_t at = read;
+                    GET_VARINT(index);
+                    if (index < insn->arg)
+                        return ERR;
+                    present = index == insn->arg;
+                    if (present)
+                        frame->remaining--;
+                    else
+                        read = at;
+                }
+            }
+            pc = present ? pc + 1 : insn->next;
+            break;
+        }
+        case UTE_OP_SKIP:
+            if (insn->next != pc + 1)
+                read = ute_vm_validate(insns, pc + 1, in, read, in_size, 0, dict, flags, run);
+            else
+                read = ute_skip_value(in, read, in_size);
+            if (read == ERR)
+                return ERR;
+            pc = insn->next;
+            break;
+        case UTE_OP_DEFAULT:
+            pc = insn->next;
+            break;
+        default:
+            return ERR;
+        }
+    }
+}
@@ -3,12 +3,72 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 // Returned when serialization or deserialization fails due to insufficient
 // buffer space. Since size_t is unsigned, this uses the maximum value as an
 // error sentinel.
 #define UTE_BUF_ERROR ((size_t)-1)
 
+struct ute_plan;
+struct ute_arena;
+struct ute_evolution;
+struct ute_schema_version;
+
+// Output sink for serialization. reserve() returns a writable region of at
+// least size bytes (or NULL on failure); commit() reports how many bytes of
+// that region were written. commit may be NULL.
+struct ute_writer
+{
+    uint8_t *(*reserve)(void *ctx, size_t size);
+    void (*commit)(void *ctx, size_t size);
+    void *ctx;
+};
+
+// Built-in growable output buffer (zero-initialize before first use)
+struct ute_buffer
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+};
+
+// Suggested ute_iov threshold: below this size copying a string into the
+// scratch buffer is cheaper than an extra iovec
+#define UTE_IOV_THRESHOLD 512
+
+// Scatter-gather output for writev/sendmsg. Type prefixes, varints and short
+// strings are written to the scratch buffer; strings of at least threshold
+// bytes are referenced in place, so they must stay valid until the iovecs
+// have been sent. With iov and scratch both NULL, only iov_count and
+// scratch_len are computed (the capacities a real encode needs).
+struct ute_iov
+{
+    struct iovec *iov;  // iovec array
+    size_t iov_cap;     // capacity of iov
+    size_t iov_count;   // out: iovecs used
+    uint8_t *scratch;   // buffer for everything that is not referenced
+    size_t scratch_cap; // capacity of scratch
+    size_t scratch_len; // out: scratch bytes used
+    size_t referenced;  // out: string bytes referenced in place
+    size_t threshold;   // strings of at least this many bytes are referenced (0: all non-empty strings)
+};
+
+// ute_validate flag: strings must also be well-formed UTF-8
+#define UTE_VALIDATE_UTF8 0x01
+
+// Task runner for the parallel entry points. run() calls fn(arg, task,
+// worker) once for every task below num_tasks, possibly concurrently, and
+// returns when all calls have completed. worker (below num_workers) names
+// the thread of a call: two calls never run on the same worker at once.
+// ute_pool_executor (pool.h) provides one backed by a thread pool.
+struct ute_executor
+{
+    void (*run)(void *ctx, size_t num_tasks, void (*fn)(void *arg, size_t task, size_t worker), void *arg);
+    void *ctx;
+    size_t num_workers;
+};
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -20,6 +80,83 @@ extern "C"
     // Deserialize UTE binary data to a C struct (as a map)
     size_t ute_deserialize(const uint8_t *in_buf, size_t in_buf_size, const void *schema, void *out_data);
 
+    // Deserialize every field of version into out_data, allocating lists, structs and
+    // strings for every empty (NULL) pointer slot from an arena; one ute_arena_reset frees them all
+    size_t ute_deserialize_arena(const uint8_t *in_buf, size_t in_buf_size, const struct ute_schema_version *version, struct ute_arena *arena,
+                                 void *out_data);
+
+    // Compute the exact number of bytes a message of every field of version
+    // takes (UTE_BUF_ERROR on invalid data)
+    size_t ute_serialized_size(const void *data, const struct ute_schema_version *version);
+
+    // Serialize every field of version into a writer with exactly one reserve() of the final size
+    size_t ute_serialize_writer(const void *data, const struct ute_schema_version *version, const struct ute_writer *writer);
+
+    // Serialize every field of version into iovecs, referencing large strings
+    // instead of copying them (returns the total size)
+    size_t ute_serialize_iov(const void *data, const struct ute_schema_version *version, struct ute_iov *iov);
+
+    // Serialize data using a plan compiled by ute_compile (see plan.h)
+    size_t ute_serialize_plan(const void *data, const struct ute_plan *plan, uint8_t *out_buf, size_t out_buf_size);
+
+    // Deserialize UTE binary data using a plan compiled by ute_compile (see plan.h)
+    size_t ute_deserialize_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, void *out_data);
+
+    // Deserialize using a compiled plan, allocating missing storage from an arena
+    size_t ute_deserialize_arena_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, struct ute_arena *arena, void *out_data);
+
+    // Compute the exact serialized size using a compiled plan
+    size_t ute_serialized_size_plan(const void *data, const struct ute_plan *plan);
+
+    // Serialize into a writer using a compiled plan
+    size_t ute_serialize_writer_plan(const void *data, const struct ute_plan *plan, const struct ute_writer *writer);
+
+    // Serialize into iovecs using a compiled plan
+    size_t ute_serialize_iov_plan(const void *data, const struct ute_plan *plan, struct ute_iov *iov);
+
+    // Serialize using a compiled plan, preceded by a version tag with plan->version
+    size_t ute_serialize_tagged_plan(const void *data, const struct ute_plan *plan, uint8_t *out_buf, size_t out_buf_size);
+
+    // Read the version tag in front of a message: returns its size in bytes,
+    // 0 for an untagged message (out_version is not changed) or UTE_BUF_ERROR
+    size_t ute_read_version_tag(const uint8_t *in_buf, size_t in_buf_size, int *out_version);
+
+    // Deserialize a tagged or untagged message of any version of an evolution
+    // into the layout of its reader version (see plan.h)
+    size_t ute_deserialize_versioned(const uint8_t *in_buf, size_t in_buf_size, const struct ute_evolution *evo, void *out_data);
+
+    // Deserialize a message of any version of an evolution, allocating missing storage from an arena
+    size_t ute_deserialize_arena_versioned(const uint8_t *in_buf, size_t in_buf_size, const struct ute_evolution *evo, struct ute_arena *arena, void *out_data);
+
+    // Serialize using a compiled plan, encoding the chunks of chunked lists
+    // on the workers of exec (the output is identical to ute_serialize_plan)
+    size_t ute_serialize_parallel(const void *data, const struct ute_plan *plan, uint8_t *out_buf, size_t out_buf_size, const struct ute_executor *exec);
+
+    // Deserialize using a compiled plan, decoding the chunks of chunked lists
+    // on the workers of exec (every value slot must point to user memory)
+    size_t ute_deserialize_parallel(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, const struct ute_executor *exec, void *out_data);
+
+    // Deserialize in parallel, allocating missing storage from an array of
+    // exec->num_workers arenas: each worker uses its own, the caller the first
+    size_t ute_deserialize_arena_parallel(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, struct ute_arena *arenas, const struct ute_executor *exec, void *out_data);
+
+    // Check that in_buf starts with a well-formed message of every field of
+    // version without decoding it: type prefixes and flags, varints (at most
+    // 10 bytes and 64 bits), string, bytes and list bounds, field counts,
+    // sparse indices, bitmaps, columns and chunks; UTF-8 too with
+    // UTE_VALIDATE_UTF8. Nothing is written. Returns the size of the
+    // message, or UTE_BUF_ERROR.
+    size_t ute_validate(const uint8_t *in_buf, size_t in_buf_size, const struct ute_schema_version *version, int flags);
+
+    // Validate using a compiled plan; allocates nothing
+    size_t ute_validate_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, int flags);
+
+    // Create a writer that appends to a growable buffer
+    struct ute_writer ute_buffer_writer(struct ute_buffer *buf);
+
+    // Free the memory of a growable buffer
+    void ute_buffer_free(struct ute_buffer *buf);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,446 @@
+#include "compress.h"
+#include "arena.h"
+#include "codex.h"
+#include "decoder.h"
+#include "varint.h"
+#include "wire.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UTE_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef UTE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define ERR UTE_BUF_ERROR
+
+// =========================================================
+// Compressed envelopes: block codecs and the envelope format
+// =========================================================
+
+// Largest envelope header: prefix, codec id and the message size
+#define HEADER_MAX (2 + 10)
+// Largest block header: varint of (size << 1) | stored for a full block
+#define BLOCK_HEADER_MAX 3
+// Low bit of a block header: the block is stored uncompressed
+#define BLOCK_STORED 1
+
+// -------------------------
+// Built-in LZ codec
+// -------------------------
+
+// A block is a sequence of varint literal counts, each followed by that many
+// literal bytes and, unless the block is complete, a match: the varint
+// distance back into the output and the varint match length minus
+// LZ_MIN_MATCH. Matches are found through a hash table of 4-byte prefixes.
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 13
+
+static inline uint32_t lz_hash(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Append a varint at out + w if it fits (returns the new offset, or 0)
+static inline size_t lz_put_varint(uint8_t *out, size_t w, size_t out_size, uint64_t v)
+{
+    if (ute_varint_len(v) > out_size - w)
+        return 0;
+    return w + ute_encode_varint(v, out + w);
+}
+
+// Append a literal run at out + w if it fits (returns the new offset, or 0)
+static inline size_t lz_put_literals(uint8_t *out, size_t w, size_t out_size, const uint8_t *lit, size_t n)
+{
+    w = lz_put_varint(out, w, out_size, n);
+    if (!w || n > out_size - w)
+        return 0;
+    memcpy(out + w, lit, n);
+    return w + n;
+}
+
+static size_t lz_compress(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_size)
+{
+    (void)ctx;
+    // Positions + 1 of the last 4-byte prefix with each hash (0: none)
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    size_t pos = 0, anchor = 0, w = 0;
+    while (len >= LZ_MIN_MATCH && pos <= len - LZ_MIN_MATCH)
+    {
+        uint32_t h = lz_hash(in + pos);
+        size_t cand = table[h];
+        table[h] = (uint32_t)pos + 1;
+        if (!cand || memcmp(in + cand - 1, in + pos, LZ_MIN_MATCH) != 0)
+        {
+            // Step faster through input that does not match
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+        cand--;
+        size_t m = LZ_MIN_MATCH;
+        while (pos + m < len && in[cand + m] == in[pos + m])
+            m++;
+        w = lz_put_literals(out, w, out_size, in + anchor, pos - anchor);
+        if (w)
+            w = lz_put_varint(out, w, out_size, pos - cand);
+        if (w)
+            w = lz_put_varint(out, w, out_size, m - LZ_MIN_MATCH);
+        if (!w)
+            return 0;
+        pos += m;
+        anchor = pos;
+    }
+    return lz_put_literals(out, w, out_size, in + anchor, len - anchor);
+}
+
+static int lz_decompress(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_len)
+{
+    (void)ctx;
+    size_t r = 0, w = 0;
+    for (;;)
+    {
+        uint64_t lit, dist, extra;
+        size_t n = ute_decode_varint(in + r, len - r, &lit);
+        if (!n || lit > len - r - n || lit > out_len - w)
+            return -1;
+        r += n;
+        memcpy(out + w, in + r, (size_t)lit);
+        r += (size_t)lit;
+        w += (size_t)lit;
+        if (w == out_len)
+            return r == len ? 0 : -1;
+        n = ute_decode_varint(in + r, len - r, &dist);
+        if (!n)
+            return -1;
+        r += n;
+        n = ute_decode_varint(in + r, len - r, &extra);
+        if (!n || dist == 0 || dist > w || out_len - w < LZ_MIN_MATCH || extra > out_len - w - LZ_MIN_MATCH)
+            return -1;
+        r += n;
+        size_t m = (size_t)extra + LZ_MIN_MATCH;
+        const uint8_t *src = out + w - dist;
+        // Overlapping matches repeat the last dist bytes
+        if (dist >= m)
+            memcpy(out + w, src, m);
+        else
+            for (size_t i = 0; i < m; ++i)
+                out[w + i] = src[i];
+        w += m;
+    }
+}
+
+static const struct ute_compressor lz_compressor = {UTE_CODEC_LZ, "lz", lz_compress, lz_decompress, NULL};
+
+const struct ute_compressor *ute_compressor_lz(void)
+{
+    return &lz_compressor;
+}
+
+// -------------------------
+// Library codecs
+// -------------------------
+
+#ifdef UTE_HAVE_LZ4
+static size_t lz4_compress(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_size)
+{
+    (void)ctx;
+    int n = LZ4_compress_default((const char *)in, (char *)out, (int)len, out_size > INT_MAX ? INT_MAX : (int)out_size);
+    return n > 0 ? (size_t)n : 0;
+}
+
+static int lz4_decompress(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_len)
+{
+    (void)ctx;
+    if (len > INT_MAX || out_len > INT_MAX)
+        return -1;
+    return LZ4_decompress_safe((const char *)in, (char *)out, (int)len, (int)out_len) == (int)out_len ? 0 : -1;
+}
+
+static const struct ute_compressor lz4_compressor = {UTE_CODEC_LZ4, "lz4", lz4_compress, lz4_decompress, NULL};
+#endif
+
+const struct ute_compressor *ute_compressor_lz4(void)
+{
+#ifdef UTE_HAVE_LZ4
+    return &lz4_compressor;
+#else
+    return NULL;
+#endif
+}
+
+#ifdef UTE_HAVE_ZSTD
+// Speed over ratio: messages are compressed on the hot path
+#define ZSTD_LEVEL 3
+
+static size_t zstd_compress(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_size)
+{
+    (void)ctx;
+    size_t n = ZSTD_compress(out, out_size, in, len, ZSTD_LEVEL);
+    return ZSTD_isError(n) ? 0 : n;
+}
+
+static int zstd_decompress(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_len)
+{
+    (void)ctx;
+    size_t n = ZSTD_decompress(out, out_len, in, len);
+    return !ZSTD_isError(n) && n == out_len ? 0 : -1;
+}
+
+static const struct ute_compressor zstd_compressor = {UTE_CODEC_ZSTD, "zstd", zstd_compress, zstd_decompress, NULL};
+#endif
+
+const struct ute_compressor *ute_compressor_zstd(void)
+{
+#ifdef UTE_HAVE_ZSTD
+    return &zstd_compressor;
+#else
+    return NULL;
+#endif
+}
+
+const struct ute_compressor *ute_compressor_find(int id)
+{
+    switch (id)
+    {
+    case UTE_CODEC_LZ:
+        return ute_compressor_lz();
+    case UTE_CODEC_LZ4:
+        return ute_compressor_lz4();
+    case UTE_CODEC_ZSTD:
+        return ute_compressor_zstd();
+    default:
+        return NULL;
+    }
+}
+
+// -------------------------
+// Writing envelopes
+// -------------------------
+
+size_t ute_compress_bound(size_t len)
+{
+    size_t blocks = len / UTE_COMPRESS_BLOCK + (len % UTE_COMPRESS_BLOCK != 0);
+    size_t overhead = HEADER_MAX + blocks * BLOCK_HEADER_MAX;
+    return len > SIZE_MAX - overhead ? SIZE_MAX : len + overhead;
+}
+
+// Write the envelope of msg to out, block by block through a scratch block.
+// The message may lie in out itself, at or after ute_compress_bound(len) -
+// len: every block then ends before the input that is still to be read.
+// Returns ERR if the envelope does not fit or would not be smaller than len.
+static size_t compress_blocks(const uint8_t *msg, size_t len, const struct ute_compressor *c, uint8_t *out, size_t out_size)
+{
+    if (out_size < 2 + ute_varint_len(len))
+        return ERR;
+    uint8_t *scratch = malloc(UTE_COMPRESS_BLOCK);
+    if (!scratch)
+        return ERR;
+    size_t w = 0;
+    out[w++] = UTE_ENVELOPE;
+    out[w++] = c->id;
+    w += ute_encode_varint(len, out + w);
+    for (size_t r = 0; r < len && w != ERR;)
+    {
+        size_t n = len - r < UTE_COMPRESS_BLOCK ? len - r : UTE_COMPRESS_BLOCK;
+        // Only a smaller block is worth decompressing
+        size_t packed = c->compress(c->ctx, msg + r, n, scratch, n - 1);
+        const uint8_t *block = packed ? scratch : msg + r;
+        size_t size = packed ? packed : n;
+        uint64_t head = ((uint64_t)size << 1) | (packed ? 0 : BLOCK_STORED);
+        size_t need = ute_varint_len(head) + size;
+        if (need > out_size - w || w + need >= len)
+            w = ERR;
+        else
+        {
+            w += ute_encode_varint(head, out + w);
+            memmove(out + w, block, size);
+            w += size;
+            r += n;
+        }
+    }
+    free(scratch);
+    return w;
+}
+
+size_t ute_compress(const uint8_t *msg, size_t len, const struct ute_compressor *c, size_t threshold, uint8_t *out_buf, size_t out_buf_size)
+{
+    if ((!msg && len) || !out_buf)
+        return ERR;
+    if (c && len && len >= threshold)
+    {
+        size_t written = compress_blocks(msg, len, c, out_buf, out_buf_size);
+        if (written != ERR)
+            return written;
+    }
+    if (len > out_buf_size)
+        return ERR;
+    memcpy(out_buf, msg, len);
+    return len;
+}
+
+size_t ute_serialize_compressed_plan(const void *data, const struct ute_plan *plan, const struct ute_compressor *c, size_t threshold, uint8_t *out_buf, size_t out_buf_size)
+{
+    size_t size = ute_serialized_size_plan(data, plan);
+    if (size == ERR || !out_buf)
+        return ERR;
+    if (!c || !size || size < threshold)
+        return ute_serialize_plan(data, plan, out_buf, out_buf_size);
+    // Encode into the tail of the output, then compress it towards the front
+    size_t at = ute_compress_bound(size) - size;
+    if (at > out_buf_size || size > out_buf_size - at || ute_serialize_plan(data, plan, out_buf + at, size) != size)
+        return ERR;
+    size_t written = compress_blocks(out_buf + at, size, c, out_buf, out_buf_size);
+    if (written != ERR)
+        return written;
+    // Incompressible: the message was overwritten, encode it again
+    return ute_serialize_plan(data, plan, out_buf, out_buf_size);
+}
+
+// -------------------------
+// Reading envelopes
+// -------------------------
+
+// Read an envelope header: returns the offset of its first block, and sets
+// the message size and the compressor of its codec (c if it has that id)
+static size_t read_envelope(const uint8_t *in, size_t in_size, const struct ute_compressor *c, const struct ute_compressor **out_c, size_t *out_size)
+{
+    uint64_t size = 0;
+    if (in_size < 2 || in[0] != UTE_ENVELOPE)
+        return ERR;
+    *out_c = c && c->id == in[1] ? c : ute_compressor_find(in[1]);
+    size_t len = ute_decode_varint(in + 2, in_size - 2, &size);
+    if (!*out_c || !len || size > SIZE_MAX)
+        return ERR;
+    *out_size = (size_t)size;
+    return 2 + len;
+}
+
+// Decompress the block at in + pos into out_len bytes at out (returns the
+// offset past the block)
+static size_t read_block(const struct ute_compressor *c, const uint8_t *in, size_t in_size, size_t pos, uint8_t *out, size_t out_len)
+{
+    uint64_t head = 0;
+    size_t len = ute_decode_varint(in + pos, in_size - pos, &head);
+    if (!len || (head >> 1) > in_size - pos - len)
+        return ERR;
+    pos += len;
+    size_t size = (size_t)(head >> 1);
+    if (head & BLOCK_STORED)
+    {
+        if (size != out_len)
+            return ERR;
+        memcpy(out, in + pos, size);
+    }
+    else if (c->decompress(c->ctx, in + pos, size, out, out_len) != 0)
+        return ERR;
+    return pos + size;
+}
+
+// Decompress all blocks of an envelope into out (size bytes); returns the
+// offset past the envelope
+static size_t read_blocks(const struct ute_compressor *c, const uint8_t *in, size_t in_size, size_t pos, uint8_t *out, size_t size)
+{
+    for (size_t w = 0; w < size && pos != ERR; w += UTE_COMPRESS_BLOCK)
+        pos = read_block(c, in, in_size, pos, out + w, size - w < UTE_COMPRESS_BLOCK ? size - w : UTE_COMPRESS_BLOCK);
+    return pos;
+}
+
+size_t ute_decompressed_size(const uint8_t *in_buf, size_t in_buf_size)
+{
+    uint64_t size = 0;
+    if (!in_buf && in_buf_size)
+        return ERR;
+    if (in_buf_size == 0 || in_buf[0] != UTE_ENVELOPE)
+        return in_buf_size;
+    // The codec of the envelope does not matter here
+    if (in_buf_size < 2 || !ute_decode_varint(in_buf + 2, in_buf_size - 2, &size) || size > SIZE_MAX)
+        return ERR;
+    return (size_t)size;
+}
+
+size_t ute_decompress(const uint8_t *in_buf, size_t in_buf_size, const struct ute_compressor *c, uint8_t *out_buf, size_t out_buf_size)
+{
+    const struct ute_compressor *codec;
+    size_t size = 0;
+    if ((!in_buf && in_buf_size) || (!out_buf && out_buf_size))
+        return ERR;
+    if (in_buf_size == 0 || in_buf[0] != UTE_ENVELOPE)
+    {
+        if (in_buf_size > out_buf_size)
+            return ERR;
+        memcpy(out_buf, in_buf, in_buf_size);
+        return in_buf_size;
+    }
+    size_t pos = read_envelope(in_buf, in_buf_size, c, &codec, &size);
+    if (pos == ERR || size > out_buf_size)
+        return ERR;
+    return read_blocks(codec, in_buf, in_buf_size, pos, out_buf, size) == ERR ? ERR : size;
+}
+
+size_t ute_deserialize_arena_compressed_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, const struct ute_compressor *c,
+                                             struct ute_arena *arena, void *out_data)
+{
+    const struct ute_compressor *codec;
+    size_t size = 0;
+    if (!in_buf || !arena)
+        return ERR;
+    if (in_buf_size == 0 || in_buf[0] != UTE_ENVELOPE)
+        return ute_deserialize_arena_plan(in_buf, in_buf_size, plan, arena, out_data);
+    size_t pos = read_envelope(in_buf, in_buf_size, c, &codec, &size);
+    // Every block takes at least one byte, which bounds the allocation
+    if (pos == ERR || size / UTE_COMPRESS_BLOCK > in_buf_size - pos)
+        return ERR;
+    // The plan reads chunk tables, columns and back-references out of order,
+    // so it needs the whole message at once. Decoded values never point into
+    // it, so the message is freed again instead of taking arena space.
+    uint8_t *msg = malloc(size ? size : 1);
+    if (!msg)
+        return ERR;
+    pos = read_blocks(codec, in_buf, in_buf_size, pos, msg, size);
+    if (pos != ERR && ute_deserialize_arena_plan(msg, size, plan, arena, out_data) != size)
+        pos = ERR;
+    free(msg);
+    return pos;
+}
+
+int ute_decompress_feed(const uint8_t *in_buf, size_t in_buf_size, const struct ute_compressor *c, struct ute_decoder *dec)
+{
+    const struct ute_compressor *codec;
+    size_t size = 0, used = 0;
+    if (!in_buf || !dec)
+        return UTE_DECODER_ERROR;
+    if (in_buf_size == 0 || in_buf[0] != UTE_ENVELOPE)
+    {
+        int rc = ute_decoder_feed(dec, in_buf, in_buf_size, &used);
+        return rc == UTE_DECODER_DONE && used != in_buf_size ? UTE_DECODER_ERROR : rc;
+    }
+    size_t pos = read_envelope(in_buf, in_buf_size, c, &codec, &size);
+    if (pos == ERR)
+        return UTE_DECODER_ERROR;
+    uint8_t *window = malloc(size < UTE_COMPRESS_BLOCK ? (size ? size : 1) : UTE_COMPRESS_BLOCK);
+    if (!window)
+        return UTE_DECODER_ERROR;
+    int rc = UTE_DECODER_MORE;
+    for (size_t w = 0; w < size && rc == UTE_DECODER_MORE; w += UTE_COMPRESS_BLOCK)
+    {
+        size_t n = size - w < UTE_COMPRESS_BLOCK ? size - w : UTE_COMPRESS_BLOCK;
+        pos = read_block(codec, in_buf, in_buf_size, pos, window, n);
+        if (pos == ERR)
+            rc = UTE_DECODER_ERROR;
+        else
+        {
+            rc = ute_decoder_feed(dec, window, n, &used);
+            // The message must end with the envelope
+            if (rc == UTE_DECODER_DONE && (used != n || w + n != size))
+                rc = UTE_DECODER_ERROR;
+        }
+    }
+    free(window);
+    return rc;
+}
@@ -0,0 +1,84 @@
+#ifndef UTE_COMPRESS_H
+#define UTE_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ute_plan;
+struct ute_arena;
+struct ute_decoder;
+
+// Compressed envelope around an encoded message (see RFC section 10): the
+// message is cut into blocks of UTE_COMPRESS_BLOCK bytes that are compressed
+// independently, so a reader needs one block of memory to stream it.
+
+// Message bytes per block (the last block may be shorter)
+#define UTE_COMPRESS_BLOCK 65536
+// Suggested threshold: smaller messages are not worth compressing
+#define UTE_COMPRESS_THRESHOLD 1024
+
+// Codec ids written into the envelope
+#define UTE_CODEC_LZ 1   // built-in LZ77 codec, always available
+#define UTE_CODEC_LZ4 2  // LZ4 block format (built with liblz4)
+#define UTE_CODEC_ZSTD 3 // Zstandard frames (built with libzstd)
+
+// Block codec. compress() writes at most out_size bytes and returns their
+// number, or 0 if the block does not fit (it is then stored as is);
+// decompress() must produce exactly out_len bytes and returns 0 on success.
+// Both may be called from several threads at once. Further codecs can use
+// ids from 16 on.
+struct ute_compressor
+{
+    uint8_t id;
+    const char *name;
+    size_t (*compress)(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_size);
+    int (*decompress)(void *ctx, const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+    void *ctx;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Built-in codecs; the lz4 and zstd ones are NULL unless the library was found at build time
+    const struct ute_compressor *ute_compressor_lz(void);
+    const struct ute_compressor *ute_compressor_lz4(void);
+    const struct ute_compressor *ute_compressor_zstd(void);
+    // Built-in codec with the given id, or NULL
+    const struct ute_compressor *ute_compressor_find(int id);
+
+    // Largest output of ute_compress for a message of len bytes
+    size_t ute_compress_bound(size_t len);
+    // Wrap an encoded message into an envelope (msg and out_buf must not
+    // overlap). Messages shorter than threshold, and those that do not
+    // shrink, are copied unchanged. Returns the output size, or UTE_BUF_ERROR.
+    size_t ute_compress(const uint8_t *msg, size_t len, const struct ute_compressor *c, size_t threshold, uint8_t *out_buf, size_t out_buf_size);
+    // Serialize using a compiled plan and compress the result like ute_compress,
+    // in place: out_buf_size must be at least ute_compress_bound of the
+    // serialized size, and no second message-sized buffer is needed
+    size_t ute_serialize_compressed_plan(const void *data, const struct ute_plan *plan, const struct ute_compressor *c, size_t threshold, uint8_t *out_buf, size_t out_buf_size);
+
+    // Size of the message inside an envelope (in_buf_size for a message
+    // without one), or UTE_BUF_ERROR
+    size_t ute_decompressed_size(const uint8_t *in_buf, size_t in_buf_size);
+    // Decompress an envelope, or copy a message without one. Envelopes of
+    // other codecs than the built-in ones need their compressor c (NULL: look
+    // the id up). Returns the message size, or UTE_BUF_ERROR.
+    size_t ute_decompress(const uint8_t *in_buf, size_t in_buf_size, const struct ute_compressor *c, uint8_t *out_buf, size_t out_buf_size);
+    // Deserialize a message with or without an envelope. A compressed message
+    // is decompressed into a temporary buffer first, as the plan decoder needs
+    // the whole message; only the decoded values stay in the arena. Returns the
+    // bytes read of in_buf.
+    size_t ute_deserialize_arena_compressed_plan(const uint8_t *in_buf, size_t in_buf_size, const struct ute_plan *plan, const struct ute_compressor *c,
+                                                 struct ute_arena *arena, void *out_data);
+    // Feed a message with or without an envelope to a streaming decoder, one
+    // decompressed block at a time (allocates one block). Returns UTE_DECODER_*;
+    // DONE only if the message ends exactly at the end of the envelope.
+    int ute_decompress_feed(const uint8_t *in_buf, size_t in_buf_size, const struct ute_compressor *c, struct ute_decoder *dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_COMPRESS_H
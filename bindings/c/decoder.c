@@ -0,0 +1,387 @@
+#include "decoder.h"
+#include "varint.h"
+#include "wire.h"
+#include <string.h>
+
+// =========================================================
+// Streaming decoder: resumable, plan-driven state machine
+// =========================================================
+
+// Decoder states
+#define ST_PREFIX 0 // expecting the type prefix of insns[pc]
+#define ST_VARINT 1 // inside the varint that follows a prefix (or a packed element)
+#define ST_STRING 2 // inside the bytes of a string (or bytes value)
+#define ST_DONE 3
+#define ST_ERROR 4
+#define ST_FIXED 5 // inside a little-endian fixed-width value (or fixed list element)
+#define ST_SKIP 6  // inside the chunk table of a chunked list
+
+// What the pending varint is, beyond the value, count or length of insns[pc]
+#define TARGET_NODE 0
+#define TARGET_CHUNK 1 // elements per chunk of a chunked list (its count is in remaining)
+
+// Emit an event for the node at pc (returns 0, or UTE_DECODER_ABORTED)
+static int emit(struct ute_decoder *dec, int type, uint32_t pc, uint64_t value, const uint8_t *data, size_t len)
+{
+    struct ute_event ev;
+    ev.type = type;
+    ev.pc = pc;
+    ev.index = dec->stack[dec->sp - 1].index;
+    ev.value = value;
+    ev.data = data;
+    ev.len = len;
+    if (dec->callback(dec->user, &ev) != 0)
+    {
+        dec->state = ST_ERROR;
+        return UTE_DECODER_ABORTED;
+    }
+    return 0;
+}
+
+// Start reading width little-endian bytes of a fixed-width value
+static void begin_fixed(struct ute_decoder *dec, size_t width)
+{
+    dec->state = ST_FIXED;
+    dec->varint = 0;
+    dec->shift = 0;
+    dec->remaining = width;
+}
+
+// Move to the node at dec->pc: close the lists and structs that end there and
+// set up the state for reading the next node
+static int settle(struct ute_decoder *dec)
+{
+    const struct ute_insn *insns = dec->plan->insns;
+    for (;;)
+    {
+        const struct ute_insn *insn = &insns[dec->pc];
+        if (insn->op == UTE_OP_LIST_END)
+        {
+            struct ute_decoder_frame *frame = &dec->stack[dec->sp - 1];
+            if (--frame->remaining)
+            {
+                dec->pc = insn->next + 1;
+                break;
+            }
+            dec->sp--;
+        }
+        else if (insn->op == UTE_OP_STRUCT_END)
+            dec->sp--;
+        else if (insn->op == UTE_OP_HALT)
+        {
+            dec->state = ST_DONE;
+            return 0;
+        }
+        else
+            break;
+        int type = insn->op == UTE_OP_LIST_END ? UTE_EVENT_LIST_END : UTE_EVENT_STRUCT_END;
+        int rc = emit(dec, type, insn->next, 0, NULL, 0);
+        if (rc)
+            return rc;
+        dec->stack[dec->sp - 1].index++;
+        dec->pc++;
+    }
+    // Elements of a packed list are bare varints without a prefix
+    uint32_t pc = dec->pc;
+    if (pc > 0 && insns[pc - 1].op == UTE_OP_LIST && (insns[pc - 1].flags & UTE_INSN_PACKED))
+    {
+        dec->state = ST_VARINT;
+        dec->varint = 0;
+        dec->shift = 0;
+    }
+    // Elements of a fixed list are bare little-endian values
+    else if (pc > 0 && insns[pc - 1].op == UTE_OP_LIST && (insns[pc - 1].flags & UTE_INSN_FIXED))
+        begin_fixed(dec, insns[pc - 1].arg);
+    else
+        dec->state = ST_PREFIX;
+    return 0;
+}
+
+// The node at dec->pc is complete: continue with next
+static int finish(struct ute_decoder *dec, uint32_t next)
+{
+    dec->stack[dec->sp - 1].index++;
+    dec->pc = next;
+    return settle(dec);
+}
+
+// Open a list or struct frame whose children start at dec->pc + 1
+static int open_frame(struct ute_decoder *dec, uint64_t remaining)
+{
+    if (dec->sp > UTE_PLAN_MAX_DEPTH)
+    {
+        dec->state = ST_ERROR;
+        return UTE_DECODER_ERROR;
+    }
+    dec->stack[dec->sp].remaining = remaining;
+    dec->stack[dec->sp].index = 0;
+    dec->sp++;
+    dec->pc++;
+    return settle(dec);
+}
+
+// Handle a type prefix byte for insns[dec->pc]
+static int on_prefix(struct ute_decoder *dec, uint8_t h)
+{
+    const struct ute_insn *insn = &dec->plan->insns[dec->pc];
+    int type = h >> 5;
+    uint8_t flags = h & UTE_PREFIX_FLAGS;
+    switch (insn->op)
+    {
+    case UTE_OP_NULL:
+        if (type != 0)
+            break;
+        return emit(dec, UTE_EVENT_NULL, dec->pc, 0, NULL, 0) ? UTE_DECODER_ABORTED : finish(dec, insn->next);
+    case UTE_OP_BOOL:
+        if (type != 1)
+            break;
+        return emit(dec, UTE_EVENT_BOOL, dec->pc, (h & 0x10) != 0, NULL, 0) ? UTE_DECODER_ABORTED : finish(dec, insn->next);
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
+        if (h != UTE_FIXED_PREFIX(UTE_OP_WIDTH(insn->op)))
+            break;
+        begin_fixed(dec, UTE_OP_WIDTH(insn->op));
+        return 0;
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+    case UTE_OP_STRING:
+    case UTE_OP_BYTES:
+    case UTE_OP_LIST:
+    case UTE_OP_STRUCT:
+    {
+        int expected = UTE_OP_IS_INT(insn->op) ? 2 : insn->op == UTE_OP_STRING ? 3 : insn->op == UTE_OP_BYTES ? 6 : insn->op == UTE_OP_LIST ? 4 : 5;
+        if (type != expected || (insn->op == UTE_OP_LIST && flags != UTE_LIST_FLAGS(insn)) || ((insn->op == UTE_OP_STRUCT || insn->op == UTE_OP_STRING || insn->op == UTE_OP_BYTES) && flags))
+            break;
+        dec->state = ST_VARINT;
+        dec->varint = 0;
+        dec->shift = 0;
+        return 0;
+    }
+    default:
+        break;
+    }
+    dec->state = ST_ERROR;
+    return UTE_DECODER_ERROR;
+}
+
+// The chunk table of the chunked list at dec->pc is skipped: open its elements
+static int end_table(struct ute_decoder *dec)
+{
+    if (dec->varint == 0)
+    {
+        int rc = emit(dec, UTE_EVENT_LIST_END, dec->pc, 0, NULL, 0);
+        return rc ? rc : finish(dec, dec->plan->insns[dec->pc].next);
+    }
+    return open_frame(dec, dec->varint);
+}
+
+// Handle a complete varint for insns[dec->pc]
+static int on_varint(struct ute_decoder *dec, uint64_t v)
+{
+    const struct ute_insn *insn = &dec->plan->insns[dec->pc];
+    int rc;
+    switch (insn->op)
+    {
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+        // Elements of a packed list may be transformed (zigzag, deltas)
+        if (dec->pc > 0 && insn[-1].op == UTE_OP_LIST && (insn[-1].flags & UTE_INSN_PACKED))
+            ute_ints_decode(&v, 1, (int)insn[-1].nfields, &dec->ints);
+        else if (insn->op == UTE_OP_SINT)
+            v = ute_zigzag_decode(v);
+        rc = emit(dec, UTE_EVENT_INT, dec->pc, v, NULL, 0);
+        return rc ? rc : finish(dec, insn->next);
+    case UTE_OP_STRING:
+    case UTE_OP_BYTES:
+        rc = emit(dec, UTE_EVENT_STRING_BEGIN, dec->pc, v, NULL, 0);
+        if (rc)
+            return rc;
+        if (v == 0)
+        {
+            rc = emit(dec, UTE_EVENT_STRING_END, dec->pc, 0, NULL, 0);
+            return rc ? rc : finish(dec, insn->next);
+        }
+        dec->remaining = v;
+        dec->state = ST_STRING;
+        return 0;
+    case UTE_OP_LIST:
+        if (dec->target == TARGET_CHUNK)
+        {
+            // Chunks are contiguous: skip their table and read the elements
+            uint64_t count = dec->remaining;
+            uint64_t nchunks = v ? count / v + (count % v != 0) : 0;
+            if (v == 0 || nchunks > UINT64_MAX / UTE_CHUNK_ENTRY)
+                break;
+            dec->target = TARGET_NODE;
+            dec->varint = count;
+            dec->remaining = nchunks * UTE_CHUNK_ENTRY;
+            dec->state = ST_SKIP;
+            return dec->remaining ? 0 : end_table(dec);
+        }
+        rc = emit(dec, UTE_EVENT_LIST_BEGIN, dec->pc, v, NULL, 0);
+        if (rc)
+            return rc;
+        if (insn->flags & UTE_INSN_CHUNKED)
+        {
+            dec->target = TARGET_CHUNK;
+            dec->state = ST_VARINT;
+            dec->remaining = v;
+            dec->varint = 0;
+            dec->shift = 0;
+            return 0;
+        }
+        if (v == 0)
+        {
+            rc = emit(dec, UTE_EVENT_LIST_END, dec->pc, 0, NULL, 0);
+            return rc ? rc : finish(dec, insn->next);
+        }
+        dec->ints.prev = 0;
+        dec->ints.delta = 0;
+        return open_frame(dec, v);
+    case UTE_OP_STRUCT:
+        if (v != insn->nfields)
+            break;
+        rc = emit(dec, UTE_EVENT_STRUCT_BEGIN, dec->pc, v, NULL, 0);
+        return rc ? rc : open_frame(dec, 0);
+    default:
+        break;
+    }
+    dec->state = ST_ERROR;
+    return UTE_DECODER_ERROR;
+}
+
+// =====================
+// Streaming decoder API
+// =====================
+
+int ute_decoder_init(struct ute_decoder *dec, const struct ute_plan *plan, ute_event_fn callback, void *user)
+{
+    if (!dec || !plan || !plan->insns || !callback)
+        return -1;
+    // Columnar lists store each element across all columns, which cannot be
+    // reported element by element without buffering the whole list, and
+    // back-references point at input that has already been handed out.
+    // Translation plans (SKIP/DEFAULT) and sparse structs (MEMBER) only drive
+    // ute_deserialize_*.
+    for (size_t i = 0; i < plan->num_insns; ++i)
+    {
+        uint8_t op = plan->insns[i].op;
+        if ((plan->insns[i].flags & (UTE_INSN_COLUMNAR | UTE_INSN_DICT)) || (op > UTE_OP_STRUCT_END && !UTE_OP_IS_LEAF(op)))
+            return -1;
+    }
+    dec->plan = plan;
+    dec->callback = callback;
+    dec->user = user;
+    ute_decoder_reset(dec);
+    return 0;
+}
+
+void ute_decoder_reset(struct ute_decoder *dec)
+{
+    if (!dec || !dec->plan)
+        return;
+    dec->pc = 0;
+    dec->varint = 0;
+    dec->shift = 0;
+    dec->remaining = 0;
+    dec->ints.prev = 0;
+    dec->ints.delta = 0;
+    dec->target = TARGET_NODE;
+    dec->sp = 1; // the message frame: top-level fields are its children
+    dec->stack[0].remaining = 0;
+    dec->stack[0].index = 0;
+    if (settle(dec) != 0)
+        dec->state = ST_ERROR;
+}
+
+int ute_decoder_feed(struct ute_decoder *dec, const uint8_t *chunk, size_t len, size_t *out_used)
+{
+    if (!dec || !dec->plan || (!chunk && len))
+        return UTE_DECODER_ERROR;
+    size_t pos = 0;
+    int rc = 0;
+    while (rc == 0 && dec->state != ST_DONE && dec->state != ST_ERROR && pos < len)
+    {
+        switch (dec->state)
+        {
+        case ST_PREFIX:
+            rc = on_prefix(dec, chunk[pos++]);
+            break;
+        case ST_VARINT:
+        {
+            uint64_t v;
+            size_t var_len;
+            // Whole varint in this chunk: decode it in one go
+            if (dec->shift == 0 && (var_len = ute_decode_varint(chunk + pos, len - pos, &v)) != 0 && var_len <= 10)
+            {
+                pos += var_len;
+                rc = on_varint(dec, v);
+                break;
+            }
+            // Otherwise accumulate byte by byte across chunks
+            uint8_t b = chunk[pos++];
+            if (dec->shift >= 64 || (dec->shift == 63 && (b & 0x7E)))
+            {
+                dec->state = ST_ERROR;
+                rc = UTE_DECODER_ERROR;
+                break;
+            }
+            dec->varint |= (uint64_t)(b & 0x7F) << dec->shift;
+            dec->shift += 7;
+            if (!(b & 0x80))
+                rc = on_varint(dec, dec->varint);
+            break;
+        }
+        case ST_STRING:
+        {
+            size_t n = len - pos;
+            if (n > dec->remaining)
+                n = (size_t)dec->remaining;
+            rc = emit(dec, UTE_EVENT_STRING_DATA, dec->pc, 0, chunk + pos, n);
+            if (rc)
+                break;
+            pos += n;
+            dec->remaining -= n;
+            if (dec->remaining == 0)
+            {
+                rc = emit(dec, UTE_EVENT_STRING_END, dec->pc, 0, NULL, 0);
+                if (!rc)
+                    rc = finish(dec, dec->plan->insns[dec->pc].next);
+            }
+            break;
+        }
+        case ST_SKIP:
+        {
+            size_t n = len - pos;
+            if (n > dec->remaining)
+                n = (size_t)dec->remaining;
+            pos += n;
+            dec->remaining -= n;
+            if (dec->remaining == 0)
+                rc = end_table(dec);
+            break;
+        }
+        case ST_FIXED:
+            dec->varint |= (uint64_t)chunk[pos++] << dec->shift;
+            dec->shift += 8;
+            if (--dec->remaining == 0)
+            {
+                rc = emit(dec, UTE_EVENT_FIXED, dec->pc, dec->varint, NULL, 0);
+                if (!rc)
+                    rc = finish(dec, dec->plan->insns[dec->pc].next);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (out_used)
+        *out_used = pos;
+    if (rc)
+        return rc;
+    if (dec->state == ST_ERROR)
+        return UTE_DECODER_ERROR;
+    return dec->state == ST_DONE ? UTE_DECODER_DONE : UTE_DECODER_MORE;
+}
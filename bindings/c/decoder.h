@@ -0,0 +1,89 @@
+#ifndef UTE_DECODER_H
+#define UTE_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "plan.h"
+#include "varint.h"
+
+// Events emitted by the streaming decoder
+#define UTE_EVENT_NULL 0
+#define UTE_EVENT_BOOL 1         // value: 0 or 1
+#define UTE_EVENT_INT 2          // value: the int (a sint as the bits of its int64_t)
+#define UTE_EVENT_STRING_BEGIN 3 // value: total length in bytes
+#define UTE_EVENT_STRING_DATA 4  // data/len: next fragment (never empty)
+#define UTE_EVENT_STRING_END 5
+#define UTE_EVENT_LIST_BEGIN 6 // value: element count
+#define UTE_EVENT_LIST_END 7
+#define UTE_EVENT_STRUCT_BEGIN 8 // value: field count
+#define UTE_EVENT_STRUCT_END 9
+#define UTE_EVENT_FIXED 10 // value: the raw bits of a float32/64 or fixed32/64 (32-bit types in the low half)
+// Bytes values are reported like strings, with STRING_BEGIN/DATA/END
+
+// Results of ute_decoder_feed
+#define UTE_DECODER_DONE 0     // the message is complete
+#define UTE_DECODER_MORE 1     // all input consumed, the message continues in the next chunk
+#define UTE_DECODER_ERROR -1   // the input does not match the plan
+#define UTE_DECODER_ABORTED -2 // the callback returned non-zero
+
+// One decoding event. Fragment data points into the chunk being fed and is
+// only valid during the callback.
+struct ute_event
+{
+    int type;            // UTE_EVENT_*
+    uint32_t pc;         // plan instruction of the node (identifies its schema field)
+    uint64_t index;      // position in the parent: field index, or list element index
+    uint64_t value;      // see UTE_EVENT_*
+    const uint8_t *data; // STRING_DATA only (also for bytes)
+    size_t len;          // STRING_DATA only
+};
+
+// Event callback; a non-zero return stops decoding with UTE_DECODER_ABORTED
+typedef int (*ute_event_fn)(void *user, const struct ute_event *event);
+
+// Open list or struct (or the message itself at the bottom of the stack)
+struct ute_decoder_frame
+{
+    uint64_t remaining; // list elements left, including the current one
+    uint64_t index;     // index of the current child
+};
+
+// Incremental decoder: a resumable state machine that consumes a message in
+// chunks of any size (down to single bytes) and reports its content through
+// callbacks. It allocates nothing and its memory use does not depend on the
+// message size.
+struct ute_decoder
+{
+    const struct ute_plan *plan;
+    ute_event_fn callback;
+    void *user;
+    uint32_t pc;        // instruction being decoded
+    int state;          // internal state (prefix, varint, string bytes, fixed bytes, chunk table, done, error)
+    int target;         // what the pending varint is (value, count or length of the node, or a chunk size)
+    uint64_t varint;    // partial varint (or fixed-width value)
+    unsigned shift;     // bits of the partial varint (or fixed-width value) read so far
+    uint64_t remaining; // string or fixed-width bytes left
+    struct ute_ints_state ints; // running values of the packed list being read (delta encodings)
+    size_t sp;          // number of open frames (the message frame included)
+    struct ute_decoder_frame stack[UTE_PLAN_MAX_DEPTH + 1];
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Prepare a decoder for one message (returns 0 on success; plans with columnar lists, sparse structs or dictionary strings are not supported)
+    int ute_decoder_init(struct ute_decoder *dec, const struct ute_plan *plan, ute_event_fn callback, void *user);
+    // Start over with the next message, keeping plan and callback
+    void ute_decoder_reset(struct ute_decoder *dec);
+    // Decode the next chunk of the message. Returns UTE_DECODER_*; on DONE,
+    // *out_used (optional) is the number of bytes of this chunk that belonged
+    // to the message, the rest starts the next one.
+    int ute_decoder_feed(struct ute_decoder *dec, const uint8_t *chunk, size_t len, size_t *out_used);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_DECODER_H
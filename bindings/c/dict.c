@@ -0,0 +1,106 @@
+#include "dict.h"
+#include <stdlib.h>
+#include <string.h>
+
+// =========================================================
+// Shared string dictionaries
+// =========================================================
+
+uint64_t ute_string_hash(const char *s, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (uint8_t)s[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+int ute_dictionary_init(struct ute_dictionary *dict, const char *const *values, size_t num_values)
+{
+    if (!dict || (num_values && !values) || num_values >= UINT32_MAX / 2)
+        return -1;
+    memset(dict, 0, sizeof(*dict));
+    // Keep the table at most half full, so that lookups stay short
+    size_t num_buckets = 1;
+    while (num_buckets < 2 * num_values)
+        num_buckets *= 2;
+    size_t data_size = 0;
+    for (size_t i = 0; i < num_values; ++i)
+    {
+        if (!values[i])
+            return -1;
+        data_size += strlen(values[i]) + 1;
+        if (data_size > UINT32_MAX)
+            return -1;
+    }
+    // One block: the offsets, the hash table, then the values
+    size_t tables = (num_values + 1 + num_buckets) * sizeof(uint32_t);
+    uint32_t *offsets = malloc(tables + data_size);
+    if (!offsets)
+        return -1;
+    uint32_t *index = offsets + num_values + 1;
+    char *data = (char *)(index + num_buckets);
+    memset(index, 0, num_buckets * sizeof(uint32_t));
+    dict->data = data;
+    dict->offsets = offsets;
+    dict->index = index;
+    dict->num_buckets = num_buckets;
+    size_t pos = 0;
+    for (size_t i = 0; i < num_values; ++i)
+    {
+        size_t len = strlen(values[i]);
+        if (ute_dictionary_find(dict, values[i], len) != UTE_DICT_MISSING)
+        {
+            free(offsets);
+            memset(dict, 0, sizeof(*dict));
+            return -1;
+        }
+        offsets[i] = (uint32_t)pos;
+        memcpy(data + pos, values[i], len + 1);
+        pos += len + 1;
+        offsets[i + 1] = (uint32_t)pos;
+        size_t b = (size_t)ute_string_hash(values[i], len) & (num_buckets - 1);
+        while (index[b])
+            b = (b + 1) & (num_buckets - 1);
+        index[b] = (uint32_t)(i + 1);
+        dict->num_values = i + 1;
+    }
+    offsets[num_values] = (uint32_t)pos;
+    return 0;
+}
+
+void ute_dictionary_free(struct ute_dictionary *dict)
+{
+    if (!dict)
+        return;
+    free((void *)dict->offsets);
+    memset(dict, 0, sizeof(*dict));
+}
+
+size_t ute_dictionary_find(const struct ute_dictionary *dict, const char *s, size_t len)
+{
+    if (!dict || !dict->num_buckets)
+        return UTE_DICT_MISSING;
+    // Linear probing; the table always has an empty slot
+    size_t mask = dict->num_buckets - 1;
+    for (size_t b = (size_t)ute_string_hash(s, len) & mask; dict->index[b]; b = (b + 1) & mask)
+    {
+        size_t id = dict->index[b] - 1;
+        size_t start = dict->offsets[id];
+        if (dict->offsets[id + 1] - 1 - start == len && memcmp(dict->data + start, s, len) == 0)
+            return id;
+    }
+    return UTE_DICT_MISSING;
+}
+
+const char *ute_dictionary_value(const struct ute_dictionary *dict, uint64_t id, size_t *out_len)
+{
+    if (!dict || id >= dict->num_values)
+        return NULL;
+    size_t start = dict->offsets[id];
+    if (out_len)
+        *out_len = dict->offsets[id + 1] - 1 - start;
+    return dict->data + start;
+}
@@ -0,0 +1,45 @@
+#ifndef UTE_DICT_H
+#define UTE_DICT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Result of ute_dictionary_find for a value that is not in the dictionary
+#define UTE_DICT_MISSING SIZE_MAX
+
+// Shared string dictionary of a schema version: strings fields declared
+// `dict: shared` are encoded as the id (index) of their value when it is
+// listed. The dictionary contains no pointers besides its three arrays, so
+// an image can embed it and point into itself. A zeroed dictionary is empty.
+struct ute_dictionary
+{
+    const char *data;        // the values back to back, each followed by a NUL
+    const uint32_t *offsets; // num_values + 1 offsets into data: value i starts at offsets[i], its NUL is at offsets[i + 1] - 1
+    const uint32_t *index;   // hash table of num_buckets slots (a power of two above num_values): value id + 1, or 0 if empty
+    size_t num_values;
+    size_t num_buckets;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Build a dictionary of num_values distinct NUL-terminated values (ids
+    // follow their order) in one allocation. Returns 0 on success, -1 on
+    // error (e.g. a repeated value).
+    int ute_dictionary_init(struct ute_dictionary *dict, const char *const *values, size_t num_values);
+    // Free a dictionary built by ute_dictionary_init
+    void ute_dictionary_free(struct ute_dictionary *dict);
+    // Id of the value s[0..len), or UTE_DICT_MISSING
+    size_t ute_dictionary_find(const struct ute_dictionary *dict, const char *s, size_t len);
+    // NUL-terminated value of an id (its length in *out_len), or NULL if id is out of range
+    const char *ute_dictionary_value(const struct ute_dictionary *dict, uint64_t id, size_t *out_len);
+    // Hash of a string used by dictionary indexes (64-bit FNV-1a)
+    uint64_t ute_string_hash(const char *s, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_DICT_H
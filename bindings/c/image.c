@@ -0,0 +1,583 @@
+#include "image.h"
+#include "schema.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// =========================================================
+// Binary schema images: precompiled plans, used in place
+// =========================================================
+
+// Image layout (native byte order, checked through ORDER_MARK):
+//   header   32 bytes: magic "UTES", u16 format version, u8 pointer size,
+//            u8 instruction size, u32 order mark, u32 version count,
+//            u32 image size, u32 string table offset and size, u32 reserved
+//   versions 36 bytes each: i32 version, u32 insns offset, u32 insn count,
+//            u32 top-level field count, u32 depth, u32 names offset,
+//            u32 dictionary offset, u32 value count, u32 bucket count
+//   per version: the instructions (16-byte aligned), then one u32 name
+//            offset per instruction (NO_NAME if the node has no name),
+//            then the shared dictionary if it has values: the value
+//            offsets and hash table of struct ute_dictionary (u32 each),
+//            then the values
+//   strings  NUL-terminated field names
+
+#define ORDER_MARK 0x01020304u
+#define NO_NAME UINT32_MAX
+
+static const uint8_t image_magic[4] = {'U', 'T', 'E', 'S'};
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+// -------------------------
+// Builder
+// -------------------------
+
+// Assign the schema names of a field subtree to its instructions, in the
+// order emit_field() lays them out (END and MEMBER instructions stay unnamed)
+static void name_field(const struct ute_field *field, const char **names, size_t *pc)
+{
+    names[(*pc)++] = field->name;
+    if (field->type == UTE_TYPE_LIST)
+    {
+        name_field(field->elem, names, pc);
+        names[(*pc)++] = NULL;
+    }
+    else if (field->type == UTE_TYPE_STRUCT)
+    {
+        for (size_t i = 0; i < field->num_fields; ++i)
+        {
+            if (field->sparse)
+                names[(*pc)++] = NULL;
+            name_field(&field->fields[i], names, pc);
+        }
+        names[(*pc)++] = NULL;
+    }
+}
+
+int ute_image_build(const struct ute_schema *schema, uint8_t *out, size_t cap, size_t *out_size)
+{
+    if (!schema || !out_size || (schema->num_versions && !schema->versions))
+        return -1;
+    size_t num_versions = schema->num_versions;
+    struct ute_plan *plans = calloc(num_versions ? num_versions : 1, sizeof(struct ute_plan));
+    if (!plans)
+        return -1;
+    int rc = 0;
+    size_t pos = UTE_IMAGE_HEADER_SIZE + num_versions * UTE_IMAGE_VERSION_SIZE;
+    size_t strings_size = 0;
+    size_t max_insns = 0;
+    size_t *dicts = calloc(num_versions ? num_versions : 1, sizeof(size_t));
+    if (!dicts)
+        rc = -1;
+    // First pass: compile every version and lay the image out
+    for (size_t v = 0; v < num_versions && rc == 0; ++v)
+    {
+        const struct ute_schema_version *version = &schema->versions[v];
+        if (ute_compile(version, &plans[v]) != 0)
+        {
+            rc = -1;
+            break;
+        }
+        pos = align_up(pos, UTE_IMAGE_ALIGN) + plans[v].num_insns * sizeof(struct ute_insn);
+        pos += plans[v].num_insns * sizeof(uint32_t);
+        const struct ute_dictionary *dict = &version->dictionary;
+        if (dict->num_values)
+        {
+            dicts[v] = pos;
+            pos += (dict->num_values + 1 + dict->num_buckets) * sizeof(uint32_t) + dict->offsets[dict->num_values];
+        }
+        if (plans[v].num_insns > max_insns)
+            max_insns = plans[v].num_insns;
+    }
+    const char **names = rc == 0 ? calloc(max_insns ? max_insns : 1, sizeof(char *)) : NULL;
+    if (!names)
+        rc = -1;
+    for (size_t v = 0; v < num_versions && rc == 0; ++v)
+    {
+        size_t pc = 0;
+        for (size_t i = 0; i < schema->versions[v].num_fields; ++i)
+            name_field(&schema->versions[v].fields[i], names, &pc);
+        for (size_t i = 0; i < pc; ++i)
+            strings_size += names[i] ? strlen(names[i]) + 1 : 0;
+    }
+    size_t strings = pos;
+    size_t size = strings + strings_size;
+    if (rc == 0 && size > UINT32_MAX)
+        rc = -1;
+    if (rc == 0)
+    {
+        *out_size = size;
+        if (out && cap < size)
+            rc = -2;
+    }
+
+    // Second pass: write it
+    if (rc == 0 && out)
+    {
+        memset(out, 0, size);
+        memcpy(out, image_magic, 4);
+        out[4] = (uint8_t)UTE_IMAGE_FORMAT_VERSION;
+        out[5] = (uint8_t)(UTE_IMAGE_FORMAT_VERSION >> 8);
+        out[6] = (uint8_t)sizeof(void *);
+        out[7] = (uint8_t)sizeof(struct ute_insn);
+        put_u32(out + 8, ORDER_MARK);
+        put_u32(out + 12, (uint32_t)num_versions);
+        put_u32(out + 16, (uint32_t)size);
+        put_u32(out + 20, (uint32_t)strings);
+        put_u32(out + 24, (uint32_t)strings_size);
+        pos = UTE_IMAGE_HEADER_SIZE + num_versions * UTE_IMAGE_VERSION_SIZE;
+        size_t str = strings;
+        for (size_t v = 0; v < num_versions; ++v)
+        {
+            const struct ute_plan *plan = &plans[v];
+            uint8_t *entry = out + UTE_IMAGE_HEADER_SIZE + v * UTE_IMAGE_VERSION_SIZE;
+            pos = align_up(pos, UTE_IMAGE_ALIGN);
+            put_u32(entry, (uint32_t)schema->versions[v].version);
+            put_u32(entry + 4, (uint32_t)pos);
+            put_u32(entry + 8, (uint32_t)plan->num_insns);
+            put_u32(entry + 12, (uint32_t)plan->num_fields);
+            put_u32(entry + 16, (uint32_t)plan->depth);
+            memcpy(out + pos, plan->insns, plan->num_insns * sizeof(struct ute_insn));
+            pos += plan->num_insns * sizeof(struct ute_insn);
+            put_u32(entry + 20, (uint32_t)pos);
+            const struct ute_dictionary *dict = &schema->versions[v].dictionary;
+            if (dicts[v])
+            {
+                uint8_t *d = out + dicts[v];
+                size_t tables = (dict->num_values + 1 + dict->num_buckets) * sizeof(uint32_t);
+                memcpy(d, dict->offsets, (dict->num_values + 1) * sizeof(uint32_t));
+                memcpy(d + (dict->num_values + 1) * sizeof(uint32_t), dict->index, dict->num_buckets * sizeof(uint32_t));
+                memcpy(d + tables, dict->data, dict->offsets[dict->num_values]);
+                put_u32(entry + 24, (uint32_t)dicts[v]);
+                put_u32(entry + 28, (uint32_t)dict->num_values);
+                put_u32(entry + 32, (uint32_t)dict->num_buckets);
+            }
+            size_t pc = 0;
+            for (size_t i = 0; i < schema->versions[v].num_fields; ++i)
+                name_field(&schema->versions[v].fields[i], names, &pc);
+            for (size_t i = 0; i < plan->num_insns; ++i, pos += sizeof(uint32_t))
+            {
+                if (i >= pc || !names[i])
+                {
+                    put_u32(out + pos, NO_NAME);
+                    continue;
+                }
+                size_t len = strlen(names[i]) + 1;
+                memcpy(out + str, names[i], len);
+                put_u32(out + pos, (uint32_t)(str - strings));
+                str += len;
+            }
+            if (dicts[v])
+                pos += (dict->num_values + 1 + dict->num_buckets) * sizeof(uint32_t) + dict->offsets[dict->num_values];
+        }
+    }
+
+    for (size_t v = 0; v < num_versions; ++v)
+        ute_plan_free(&plans[v]);
+    free(plans);
+    free(names);
+    free(dicts);
+    return rc;
+}
+
+// Build the image of a schema into a fresh heap buffer
+static uint8_t *build_alloc(const struct ute_schema *schema, size_t *out_size)
+{
+    if (ute_image_build(schema, NULL, 0, out_size) != 0)
+        return NULL;
+    uint8_t *image = malloc(*out_size);
+    if (image && ute_image_build(schema, image, *out_size, out_size) != 0)
+    {
+        free(image);
+        return NULL;
+    }
+    return image;
+}
+
+int ute_image_write(const struct ute_schema *schema, const char *path)
+{
+    if (!path)
+        return -1;
+    size_t size = 0;
+    uint8_t *image = build_alloc(schema, &size);
+    if (!image)
+        return -1;
+    FILE *file = fopen(path, "wb");
+    int rc = file && fwrite(image, 1, size, file) == size ? 0 : -1;
+    if (file && fclose(file) != 0)
+        rc = -1;
+    free(image);
+    return rc;
+}
+
+int ute_image_write_c(const struct ute_schema *schema, const char *path, const char *symbol)
+{
+    if (!path || !symbol)
+        return -1;
+    size_t size = 0;
+    uint8_t *image = build_alloc(schema, &size);
+    if (!image)
+        return -1;
+    FILE *file = fopen(path, "w");
+    int rc = file ? 0 : -1;
+    if (file)
+    {
+        fprintf(file, "// Generated by utec: binary UTE schema image (see image.h)\n");
+        fprintf(file, "#include <stddef.h>\n\n");
+        fprintf(file, "_Alignas(%d) const unsigned char %s[%zu] = {", UTE_IMAGE_ALIGN, symbol, size);
+        for (size_t i = 0; i < size; ++i)
+            fprintf(file, "%s0x%02x,", i % 12 ? " " : "\n    ", image[i]);
+        fprintf(file, "\n};\nconst size_t %s_size = %zu;\n", symbol, size);
+        if (ferror(file))
+            rc = -1;
+        if (fclose(file) != 0)
+            rc = -1;
+    }
+    free(image);
+    return rc;
+}
+
+// -------------------------
+// Loader
+// -------------------------
+
+// Size of the value slot of an instruction inside its parent (0 if it has none)
+static size_t slot_size(const struct ute_insn *insn)
+{
+    if (insn->flags & UTE_INSN_INDIRECT)
+        return sizeof(void *);
+    switch (insn->op)
+    {
+    case UTE_OP_BOOL:
+        return sizeof(uint8_t);
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+        return sizeof(uint64_t);
+    case UTE_OP_STRING:
+    case UTE_OP_STRUCT:
+        return insn->arg;
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
+        return UTE_OP_WIDTH(insn->op);
+    case UTE_OP_BYTES:
+        return align_up(sizeof(size_t) + insn->arg, sizeof(size_t));
+    default:
+        return 0;
+    }
+}
+
+// Check that an image plan is well formed, so that running it cannot jump or
+// write out of bounds: balanced nesting, consistent jump targets and child
+// counts, flags that match the element types and slots inside their parents.
+static int check_plan(const struct ute_insn *insns, size_t n, size_t num_fields, size_t depth)
+{
+    uint32_t stack[UTE_PLAN_MAX_DEPTH];
+    size_t sp = 0;
+    if (n == 0 || n > UINT32_MAX || depth > UTE_PLAN_MAX_DEPTH || insns[n - 1].op != UTE_OP_HALT)
+        return -1;
+    for (uint32_t i = 0; i + 1 < n; ++i)
+    {
+        const struct ute_insn *insn = &insns[i];
+        if (insn->flags & ~(UTE_INSN_INDIRECT | UTE_INSN_FLAT | UTE_INSN_WIRE_FLAGS))
+            return -1;
+        if ((insn->flags & UTE_INSN_SPARSE) && (insn->op != UTE_OP_STRUCT || (insn->flags & UTE_INSN_FLAT)))
+            return -1;
+        if ((insn->flags & (UTE_INSN_FIXED | UTE_INSN_CHUNKED)) && insn->op != UTE_OP_LIST)
+            return -1;
+        // Strings carry a dictionary mode exactly when they are DICT
+        if (insn->op == UTE_OP_STRING && (!(insn->flags & UTE_INSN_DICT) ? insn->nfields != 0 : insn->nfields < UTE_DICT_MESSAGE || insn->nfields > UTE_DICT_SHARED))
+            return -1;
+        if ((insn->flags & UTE_INSN_DICT) && insn->op != UTE_OP_STRING)
+            return -1;
+        // Lists carry a chunk size exactly when they are chunked, packed lists
+        // their int transform (checked against the element at LIST_END)
+        if (insn->op == UTE_OP_LIST && ((insn->flags & UTE_INSN_CHUNKED) ? !insn->nfields : insn->nfields > ((insn->flags & UTE_INSN_PACKED) ? UTE_INTS_DELTA2 : 0)))
+            return -1;
+        // Where the value slot lives: top-level pointer array, list element or struct member
+        const struct ute_insn *parent = sp ? &insns[stack[sp - 1]] : NULL;
+        if (insn->op != UTE_OP_LIST_END && insn->op != UTE_OP_STRUCT_END)
+        {
+            if (!parent && (!(insn->flags & UTE_INSN_INDIRECT) || insn->offset % sizeof(void *) || insn->offset / sizeof(void *) >= num_fields))
+                return -1;
+            if (parent && parent->op == UTE_OP_LIST && (!(insn->flags & UTE_INSN_INDIRECT) || insn->offset != 0))
+                return -1;
+            if (parent && parent->op == UTE_OP_STRUCT && (insn->offset > parent->arg || slot_size(insn) > parent->arg - insn->offset))
+                return -1;
+            if ((insn->op == UTE_OP_STRING || insn->op == UTE_OP_BYTES) && !(insn->flags & UTE_INSN_INDIRECT) && insn->arg == 0)
+                return -1;
+        }
+        switch (insn->op)
+        {
+        case UTE_OP_NULL:
+        case UTE_OP_BOOL:
+        case UTE_OP_INT:
+        case UTE_OP_STRING:
+        case UTE_OP_FLOAT32:
+        case UTE_OP_FLOAT64:
+        case UTE_OP_FIXED32:
+        case UTE_OP_FIXED64:
+        case UTE_OP_BYTES:
+        case UTE_OP_SINT:
+            if (insn->next != i + 1)
+                return -1;
+            break;
+        case UTE_OP_LIST:
+        case UTE_OP_STRUCT:
+            if (sp == UTE_PLAN_MAX_DEPTH || insn->next <= i + 1 || insn->next >= n)
+                return -1;
+            stack[sp++] = i;
+            break;
+        case UTE_OP_MEMBER:
+            // Wraps exactly one member of a sparse struct (checked at STRUCT_END)
+            if (!parent || parent->op != UTE_OP_STRUCT || !(parent->flags & UTE_INSN_SPARSE) || insn->flags || insn->next <= i + 1 || insn->next >= n)
+                return -1;
+            break;
+        case UTE_OP_LIST_END:
+        case UTE_OP_STRUCT_END:
+        {
+            uint8_t open_op = insn->op == UTE_OP_LIST_END ? UTE_OP_LIST : UTE_OP_STRUCT;
+            if (!sp || stack[sp - 1] != insn->next || insns[insn->next].op != open_op || insns[insn->next].next != i + 1)
+                return -1;
+            const struct ute_insn *open = &insns[insn->next];
+            // Count the direct children (their subtrees were checked already).
+            // Sparse structs wrap each member in a MEMBER carrying its index.
+            size_t children = 0, leaves = 0;
+            for (uint32_t c = insn->next + 1; c < i; c = insns[c].next, ++children)
+            {
+                leaves += UTE_INSN_IS_FLAT_LEAF(&insns[c]);
+                int member = insns[c].op == UTE_OP_MEMBER;
+                if (member != !!(open->flags & UTE_INSN_SPARSE) || (member && (insns[c].arg != children || insns[c + 1].next != insns[c].next)))
+                    return -1;
+            }
+            if (open->op == UTE_OP_STRUCT && children != open->nfields)
+                return -1;
+            if (open->op == UTE_OP_LIST)
+            {
+                const struct ute_insn *elem = open + 1;
+                uint32_t arg = UTE_OP_IS_INT(elem->op) ? sizeof(uint64_t) : elem->op == UTE_OP_BOOL ? sizeof(uint8_t) : elem->op == UTE_OP_STRUCT ? elem->arg : 0;
+                if (UTE_OP_IS_FIXED(elem->op))
+                    arg = UTE_OP_WIDTH(elem->op);
+                if (children != 1 || open->arg != arg)
+                    return -1;
+                // Fixed-width elements are always one raw array
+                if (!(open->flags & UTE_INSN_FIXED) != !UTE_OP_IS_FIXED(elem->op))
+                    return -1;
+                int flat_elem = UTE_INSN_IS_FLAT_LEAF(elem) || (elem->op == UTE_OP_STRUCT && (elem->flags & UTE_INSN_FLAT));
+                if (!(open->flags & UTE_INSN_FLAT) != !flat_elem)
+                    return -1;
+                if ((open->flags & UTE_INSN_PACKED) && (!UTE_OP_IS_INT(elem->op) || (open->flags & UTE_INSN_COLUMNAR)))
+                    return -1;
+                // Plain varints are ints, zigzag ones sints; deltas are either
+                if ((open->flags & UTE_INSN_PACKED) && open->nfields < UTE_INTS_DELTA && (open->nfields == UTE_INTS_ZIGZAG) != (elem->op == UTE_OP_SINT))
+                    return -1;
+                if ((open->flags & UTE_INSN_CHUNKED) && (open->flags & (UTE_INSN_PACKED | UTE_INSN_COLUMNAR | UTE_INSN_FIXED)))
+                    return -1;
+                if (open->flags & UTE_INSN_COLUMNAR)
+                {
+                    // A flat struct with at least one member that is not null
+                    size_t data = 0;
+                    for (uint32_t m = 0; elem->op == UTE_OP_STRUCT && m < elem->nfields; ++m)
+                    {
+                        if (elem[1 + m].flags & UTE_INSN_DICT)
+                            return -1;
+                        data += elem[1 + m].op != UTE_OP_NULL;
+                    }
+                    if (elem->op != UTE_OP_STRUCT || !data)
+                        return -1;
+                }
+            }
+            else if ((open->flags & UTE_INSN_COLUMNAR) || !(open->flags & UTE_INSN_FLAT) != ((open->flags & UTE_INSN_SPARSE) || leaves != children))
+                return -1;
+            sp--;
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    if (sp)
+        return -1;
+    size_t top = 0;
+    for (uint32_t c = 0; c + 1 < n; c = insns[c].next)
+        top++;
+    return top == num_fields ? 0 : -1;
+}
+
+// Version table entry of the i-th version
+static const uint8_t *version_entry(const struct ute_image *image, size_t i)
+{
+    return image->data + UTE_IMAGE_HEADER_SIZE + i * UTE_IMAGE_VERSION_SIZE;
+}
+
+// Shared dictionary of a version table entry, pointing into the image data
+// (strings: end of the area it may use). Checks that its offsets and hash
+// table stay inside it and that every value ends with a NUL.
+static int version_dictionary(const uint8_t *p, size_t strings, const uint8_t *entry, struct ute_dictionary *out_dict)
+{
+    size_t at = get_u32(entry + 24), num_values = get_u32(entry + 28), num_buckets = get_u32(entry + 32);
+    memset(out_dict, 0, sizeof(*out_dict));
+    if (!num_values)
+        return at || num_buckets ? -1 : 0;
+    // The hash table needs an empty slot to end lookups
+    if (at % sizeof(uint32_t) || at > strings || num_buckets & (num_buckets - 1) || num_buckets <= num_values ||
+        num_values + 1 + num_buckets > (strings - at) / sizeof(uint32_t))
+        return -1;
+    const uint32_t *offsets = (const uint32_t *)(p + at);
+    const uint32_t *index = offsets + num_values + 1;
+    const char *values = (const char *)(index + num_buckets);
+    size_t data_size = offsets[num_values];
+    if (offsets[0] != 0 || data_size > strings - (size_t)((const uint8_t *)values - p))
+        return -1;
+    for (size_t i = 0; i < num_values; ++i)
+    {
+        if (offsets[i + 1] <= offsets[i] || offsets[i + 1] > data_size || values[offsets[i + 1] - 1] != 0)
+            return -1;
+    }
+    for (size_t b = 0; b < num_buckets; ++b)
+    {
+        if (index[b] > num_values)
+            return -1;
+    }
+    out_dict->data = values;
+    out_dict->offsets = offsets;
+    out_dict->index = index;
+    out_dict->num_values = num_values;
+    out_dict->num_buckets = num_buckets;
+    return 0;
+}
+
+int ute_image_open(struct ute_image *image, const void *data, size_t size)
+{
+    if (!image || !data)
+        return -1;
+    memset(image, 0, sizeof(*image));
+    const uint8_t *p = (const uint8_t *)data;
+    if ((uintptr_t)p % sizeof(uint32_t) || size < UTE_IMAGE_HEADER_SIZE || memcmp(p, image_magic, 4) != 0)
+        return -1;
+    if ((p[4] | (p[5] << 8)) != UTE_IMAGE_FORMAT_VERSION || p[6] != sizeof(void *) || p[7] != sizeof(struct ute_insn) || get_u32(p + 8) != ORDER_MARK)
+        return -1;
+    size_t num_versions = get_u32(p + 12);
+    size_t strings = get_u32(p + 20);
+    size_t strings_size = get_u32(p + 24);
+    if (get_u32(p + 16) != size || num_versions > (size - UTE_IMAGE_HEADER_SIZE) / UTE_IMAGE_VERSION_SIZE ||
+        strings > size || strings_size != size - strings || (strings_size && p[size - 1] != 0))
+        return -1;
+    struct ute_image tmp = {p, size, num_versions, 0};
+    for (size_t v = 0; v < num_versions; ++v)
+    {
+        const uint8_t *entry = version_entry(&tmp, v);
+        size_t insns = get_u32(entry + 4), num_insns = get_u32(entry + 8);
+        size_t names = get_u32(entry + 20);
+        if (insns % sizeof(uint32_t) || insns > strings || num_insns > (strings - insns) / sizeof(struct ute_insn))
+            return -1;
+        if (names % sizeof(uint32_t) || names > strings || num_insns > (strings - names) / sizeof(uint32_t))
+            return -1;
+        if (check_plan((const struct ute_insn *)(p + insns), num_insns, get_u32(entry + 12), get_u32(entry + 16)) != 0)
+            return -1;
+        struct ute_dictionary dict;
+        if (version_dictionary(p, strings, entry, &dict) != 0)
+            return -1;
+        for (size_t i = 0; i < num_insns; ++i)
+        {
+            uint32_t name = get_u32(p + names + i * sizeof(uint32_t));
+            if (name != NO_NAME && name >= strings_size)
+                return -1;
+        }
+    }
+    *image = tmp;
+    return 0;
+}
+
+int ute_image_map(struct ute_image *image, const char *path)
+{
+    if (!image || !path)
+        return -1;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < UTE_IMAGE_HEADER_SIZE)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    if (ute_image_open(image, map, size) != 0)
+    {
+        munmap(map, size);
+        return -1;
+    }
+    image->mapped = 1;
+    return 0;
+}
+
+void ute_image_unmap(struct ute_image *image)
+{
+    if (!image || !image->mapped)
+        return;
+    munmap((void *)image->data, image->size);
+    memset(image, 0, sizeof(*image));
+}
+
+int ute_image_plan(const struct ute_image *image, int version, struct ute_plan *out_plan)
+{
+    if (!image || !image->data || !out_plan)
+        return -1;
+    for (size_t v = 0; v < image->num_versions; ++v)
+    {
+        const uint8_t *entry = version_entry(image, v);
+        if ((int)get_u32(entry) != version)
+            continue;
+        // Plans only read their instructions, so they can point into read-only memory
+        out_plan->insns = (struct ute_insn *)(image->data + get_u32(entry + 4));
+        out_plan->num_insns = get_u32(entry + 8);
+        out_plan->num_fields = get_u32(entry + 12);
+        out_plan->depth = get_u32(entry + 16);
+        out_plan->version = version;
+        out_plan->stats = NULL;
+        return version_dictionary(image->data, get_u32(image->data + 20), entry, &out_plan->dictionary);
+    }
+    return -1;
+}
+
+const char *ute_image_field_name(const struct ute_image *image, const struct ute_plan *plan, uint32_t pc)
+{
+    if (!image || !image->data || !plan || pc >= plan->num_insns)
+        return NULL;
+    size_t insns = (size_t)((const uint8_t *)plan->insns - image->data);
+    for (size_t v = 0; v < image->num_versions; ++v)
+    {
+        const uint8_t *entry = version_entry(image, v);
+        if (get_u32(entry + 4) != insns)
+            continue;
+        uint32_t name = get_u32(image->data + get_u32(entry + 20) + pc * sizeof(uint32_t));
+        return name == NO_NAME ? NULL : (const char *)image->data + get_u32(image->data + 20) + name;
+    }
+    return NULL;
+}
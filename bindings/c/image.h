@@ -0,0 +1,64 @@
+#ifndef UTE_IMAGE_H
+#define UTE_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "plan.h"
+
+struct ute_schema;
+
+// Binary schema image: the compiled plans of all versions of a schema plus
+// the field names and shared dictionaries, in one position-independent block
+// of bytes. An image is
+// produced once by the schema compiler (utec) and used in place, mapped from
+// a file or embedded as a const array, without libyaml, parsing or malloc.
+// Images are tied to the C layout of the machine that built them (pointer
+// size and byte order are checked when opening).
+
+#define UTE_IMAGE_FORMAT_VERSION 2
+#define UTE_IMAGE_HEADER_SIZE 32
+#define UTE_IMAGE_VERSION_SIZE 36
+// Required alignment of image data in memory (mmap and utec's C output satisfy it)
+#define UTE_IMAGE_ALIGN 16
+
+// An opened image (all pointers point into the image data)
+struct ute_image
+{
+    const uint8_t *data;
+    size_t size;
+    size_t num_versions;
+    int mapped; // data was mapped by ute_image_map
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Build the image of a parsed schema into out. With out == NULL only the
+    // size is computed. Returns 0 on success, -1 on error and -2 if cap is too small.
+    int ute_image_build(const struct ute_schema *schema, uint8_t *out, size_t cap, size_t *out_size);
+    // Build the image of a parsed schema and write it to a file
+    int ute_image_write(const struct ute_schema *schema, const char *path);
+    // Build the image of a parsed schema and write it as C source defining
+    // `const unsigned char symbol[]` and `const size_t symbol_size`
+    int ute_image_write_c(const struct ute_schema *schema, const char *path, const char *symbol);
+
+    // Open an image in memory after checking its header and plans (allocates nothing)
+    int ute_image_open(struct ute_image *image, const void *data, size_t size);
+    // Map an image file read-only and open it
+    int ute_image_map(struct ute_image *image, const char *path);
+    // Unmap an image opened with ute_image_map (does nothing for other images)
+    void ute_image_unmap(struct ute_image *image);
+
+    // Plan of a schema version, pointing into the image. It stays valid as
+    // long as the image; do not pass it to ute_plan_free.
+    int ute_image_plan(const struct ute_image *image, int version, struct ute_plan *out_plan);
+    // Schema name of the field encoded by insns[pc] of an image plan (NULL if unnamed)
+    const char *ute_image_field_name(const struct ute_image *image, const struct ute_plan *plan, uint32_t pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_IMAGE_H
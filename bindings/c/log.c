@@ -0,0 +1,350 @@
+#include "log.h"
+#include "codex.h"
+#include "compress.h"
+#include "varint.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// =========================================================
+// Record log: framed UTE messages with an offset index
+// =========================================================
+
+// Frame kinds (low bit of the frame header varint, the rest is the length)
+#define FRAME_RECORD 0
+#define FRAME_INDEX 1
+
+static const uint8_t header_magic[4] = {'U', 'T', 'E', 'L'};
+static const uint8_t trailer_magic[4] = {'U', 'T', 'E', 'X'};
+
+// Little-endian integer helpers
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// -------------------------
+// Writer
+// -------------------------
+
+// Write raw bytes and advance the file offset
+static int write_bytes(struct ute_log_writer *writer, const void *data, size_t len)
+{
+    if (len && fwrite(data, 1, len, writer->file) != len)
+        return -1;
+    writer->offset += len;
+    return 0;
+}
+
+// Write a frame header for a payload of len bytes
+static int write_frame_header(struct ute_log_writer *writer, uint64_t len, int kind)
+{
+    uint8_t hdr[10];
+    if (len > (UINT64_MAX >> 1))
+        return -1;
+    size_t n = ute_encode_varint((len << 1) | (uint64_t)kind, hdr);
+    return write_bytes(writer, hdr, n);
+}
+
+// Write an index block with the offsets of the pending records
+static int flush_index(struct ute_log_writer *writer)
+{
+    if (writer->num_pending == 0)
+        return 0;
+    if (writer->num_blocks == writer->cap_blocks)
+    {
+        size_t cap = writer->cap_blocks ? writer->cap_blocks * 2 : 16;
+        uint64_t *blocks = realloc(writer->blocks, cap * sizeof(uint64_t));
+        if (!blocks)
+            return -1;
+        writer->blocks = blocks;
+        writer->cap_blocks = cap;
+    }
+    writer->blocks[writer->num_blocks++] = writer->offset;
+    if (write_frame_header(writer, (uint64_t)writer->num_pending * 8, FRAME_INDEX) != 0)
+        return -1;
+    for (size_t i = 0; i < writer->num_pending; ++i)
+    {
+        uint8_t entry[8];
+        put_u64(entry, writer->pending[i]);
+        if (write_bytes(writer, entry, sizeof(entry)) != 0)
+            return -1;
+    }
+    writer->num_pending = 0;
+    return 0;
+}
+
+// Release the memory and the file of a writer
+static void writer_release(struct ute_log_writer *writer)
+{
+    if (writer->file)
+        fclose(writer->file);
+    free(writer->pending);
+    free(writer->blocks);
+    free(writer->scratch);
+    memset(writer, 0, sizeof(*writer));
+}
+
+int ute_log_create(struct ute_log_writer *writer, const char *path, uint64_t fingerprint, uint32_t schema_version, uint32_t interval)
+{
+    if (!writer || !path)
+        return -1;
+    memset(writer, 0, sizeof(*writer));
+    writer->interval = interval ? interval : UTE_LOG_DEFAULT_INTERVAL;
+    writer->pending = malloc(writer->interval * sizeof(uint64_t));
+    writer->file = fopen(path, "wb");
+    if (!writer->pending || !writer->file)
+    {
+        writer_release(writer);
+        return -1;
+    }
+    uint8_t header[UTE_LOG_HEADER_SIZE] = {0};
+    memcpy(header, header_magic, 4);
+    put_u16(header + 4, UTE_LOG_FORMAT_VERSION);
+    put_u32(header + 8, schema_version);
+    put_u32(header + 12, writer->interval);
+    put_u64(header + 16, fingerprint);
+    if (write_bytes(writer, header, sizeof(header)) != 0)
+    {
+        writer_release(writer);
+        return -1;
+    }
+    return 0;
+}
+
+int ute_log_append(struct ute_log_writer *writer, const uint8_t *msg, size_t len)
+{
+    if (!writer || !writer->file || (!msg && len))
+        return -1;
+    writer->pending[writer->num_pending++] = writer->offset;
+    if (write_frame_header(writer, len, FRAME_RECORD) != 0 || write_bytes(writer, msg, len) != 0)
+        return -1;
+    writer->count++;
+    if (writer->num_pending == writer->interval)
+        return flush_index(writer);
+    return 0;
+}
+
+int ute_log_append_compressed(struct ute_log_writer *writer, const uint8_t *msg, size_t len, const struct ute_compressor *c, size_t threshold)
+{
+    if (!writer || !writer->file || (!msg && len))
+        return -1;
+    if (!c || len < threshold)
+        return ute_log_append(writer, msg, len);
+    size_t bound = ute_compress_bound(len);
+    if (bound > writer->cap_scratch)
+    {
+        uint8_t *scratch = realloc(writer->scratch, bound);
+        if (!scratch)
+            return -1;
+        writer->scratch = scratch;
+        writer->cap_scratch = bound;
+    }
+    size_t n = ute_compress(msg, len, c, threshold, writer->scratch, writer->cap_scratch);
+    if (n == UTE_BUF_ERROR)
+        return -1;
+    return ute_log_append(writer, writer->scratch, n);
+}
+
+int ute_log_close(struct ute_log_writer *writer)
+{
+    if (!writer || !writer->file)
+        return -1;
+    int rc = flush_index(writer);
+    // Directory of index block offsets, then the fixed-size trailer
+    uint64_t directory = writer->offset;
+    for (size_t i = 0; rc == 0 && i < writer->num_blocks; ++i)
+    {
+        uint8_t entry[8];
+        put_u64(entry, writer->blocks[i]);
+        rc = write_bytes(writer, entry, sizeof(entry));
+    }
+    uint8_t trailer[UTE_LOG_TRAILER_SIZE] = {0};
+    put_u64(trailer, directory);
+    put_u64(trailer + 8, writer->num_blocks);
+    put_u64(trailer + 16, writer->count);
+    memcpy(trailer + 28, trailer_magic, 4);
+    if (rc == 0)
+        rc = write_bytes(writer, trailer, sizeof(trailer));
+    if (fclose(writer->file) != 0)
+        rc = -1;
+    writer->file = NULL;
+    writer_release(writer);
+    return rc;
+}
+
+// -------------------------
+// Reader
+// -------------------------
+
+// Read the frame at pos: returns the payload offset and sets its length and kind (0 on a torn frame)
+static size_t read_frame(const uint8_t *map, size_t limit, size_t pos, uint64_t *out_len, int *out_kind)
+{
+    uint64_t hdr = 0;
+    if (pos >= limit)
+        return 0;
+    size_t n = ute_decode_varint(map + pos, limit - pos, &hdr);
+    if (n == 0)
+        return 0;
+    pos += n;
+    *out_len = hdr >> 1;
+    *out_kind = (int)(hdr & 1);
+    if (*out_len > limit - pos)
+        return 0;
+    return pos;
+}
+
+int ute_log_open(struct ute_log_reader *reader, const char *path)
+{
+    if (!reader || !path)
+        return -1;
+    memset(reader, 0, sizeof(*reader));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < UTE_LOG_HEADER_SIZE)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    const uint8_t *p = (const uint8_t *)map;
+    if (memcmp(p, header_magic, 4) != 0 || get_u16(p + 4) != UTE_LOG_FORMAT_VERSION || get_u32(p + 12) == 0)
+    {
+        munmap(map, size);
+        return -1;
+    }
+    reader->map = p;
+    reader->size = size;
+    reader->schema_version = get_u32(p + 8);
+    reader->interval = get_u32(p + 12);
+    reader->fingerprint = get_u64(p + 16);
+
+    // A closed log ends with the directory and the trailer; an unclosed one
+    // (e.g. after a crash) can still be scanned sequentially
+    if (size >= UTE_LOG_HEADER_SIZE + UTE_LOG_TRAILER_SIZE)
+    {
+        const uint8_t *t = p + size - UTE_LOG_TRAILER_SIZE;
+        uint64_t directory = get_u64(t);
+        uint64_t num_blocks = get_u64(t + 8);
+        uint64_t count = get_u64(t + 16);
+        size_t dir_space = size - UTE_LOG_TRAILER_SIZE;
+        if (memcmp(t + 28, trailer_magic, 4) == 0 && directory >= UTE_LOG_HEADER_SIZE && directory <= dir_space &&
+            num_blocks == (dir_space - directory) / 8 && (dir_space - directory) % 8 == 0 &&
+            num_blocks == (count + reader->interval - 1) / reader->interval)
+        {
+            reader->directory = p + directory;
+            reader->num_blocks = num_blocks;
+            reader->count = count;
+        }
+    }
+    return 0;
+}
+
+int ute_log_get(const struct ute_log_reader *reader, uint64_t n, struct ute_slice *out_record)
+{
+    if (!reader || !reader->map || !reader->directory || !out_record || n >= reader->count)
+        return -1;
+    size_t limit = (size_t)(reader->directory - reader->map);
+    uint64_t block = get_u64(reader->directory + (n / reader->interval) * 8);
+    uint64_t len = 0;
+    int kind = 0;
+    size_t entries = read_frame(reader->map, limit, (size_t)block, &len, &kind);
+    uint64_t slot = n % reader->interval;
+    if (!entries || kind != FRAME_INDEX || slot >= len / 8)
+        return -1;
+    uint64_t offset = get_u64(reader->map + entries + slot * 8);
+    size_t payload = read_frame(reader->map, limit, (size_t)offset, &len, &kind);
+    if (!payload || kind != FRAME_RECORD)
+        return -1;
+    out_record->data = reader->map + payload;
+    out_record->len = (size_t)len;
+    return 0;
+}
+
+void ute_log_unmap(struct ute_log_reader *reader)
+{
+    if (!reader || !reader->map)
+        return;
+    munmap((void *)reader->map, reader->size);
+    memset(reader, 0, sizeof(*reader));
+}
+
+int ute_log_iter_init(struct ute_log_iter *iter, const struct ute_log_reader *reader)
+{
+    if (!iter || !reader || !reader->map)
+        return -1;
+    iter->reader = reader;
+    iter->pos = UTE_LOG_HEADER_SIZE;
+    iter->index = 0;
+    // Aggressive read-ahead; pages behind the cursor may be dropped early
+    madvise((void *)reader->map, reader->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+int ute_log_next(struct ute_log_iter *iter, struct ute_slice *out_record)
+{
+    if (!iter || !iter->reader || !out_record)
+        return -1;
+    const struct ute_log_reader *reader = iter->reader;
+    size_t limit = reader->directory ? (size_t)(reader->directory - reader->map) : reader->size;
+    while (iter->pos < limit)
+    {
+        uint64_t len = 0;
+        int kind = 0;
+        size_t payload = read_frame(reader->map, limit, iter->pos, &len, &kind);
+        if (!payload)
+            return reader->directory ? -1 : 0; // an unclosed log may end in a torn frame
+        iter->pos = payload + (size_t)len;
+        if (kind == FRAME_RECORD)
+        {
+            out_record->data = reader->map + payload;
+            out_record->len = (size_t)len;
+            iter->index++;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef UTE_LOG_H
+#define UTE_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "view.h"
+
+struct ute_compressor;
+
+// Record-log container: many UTE messages in one file (see RFC section 9).
+// A fixed header identifies the schema, every record is prefixed with its
+// length, index blocks with the offsets of the preceding records are written
+// periodically, and a directory of the index blocks closes the file.
+
+#define UTE_LOG_FORMAT_VERSION 1
+#define UTE_LOG_HEADER_SIZE 32
+#define UTE_LOG_TRAILER_SIZE 32
+// Records per index block unless the writer asks for another interval
+#define UTE_LOG_DEFAULT_INTERVAL 4096
+
+// Appends records to a new log file
+struct ute_log_writer
+{
+    FILE *file;
+    uint64_t offset;   // current end of the file
+    uint64_t count;    // records written
+    uint32_t interval; // records per index block
+    uint64_t *pending; // offsets of the records since the last index block
+    size_t num_pending;
+    uint64_t *blocks; // offsets of the index blocks written so far
+    size_t num_blocks;
+    size_t cap_blocks;
+    uint8_t *scratch; // envelope buffer of ute_log_append_compressed
+    size_t cap_scratch;
+};
+
+// Memory-mapped, read-only log file
+struct ute_log_reader
+{
+    const uint8_t *map;
+    size_t size;
+    uint64_t fingerprint;     // schema fingerprint from the header (see ute_plan_fingerprint)
+    uint32_t schema_version;  // schema version from the header
+    uint32_t interval;        // records per index block
+    uint64_t count;           // number of records (0 if the log was not closed)
+    uint64_t num_blocks;      // number of index blocks
+    const uint8_t *directory; // index block offsets, or NULL if the log was not closed
+};
+
+// Sequential cursor over the records of a log
+struct ute_log_iter
+{
+    const struct ute_log_reader *reader;
+    size_t pos;     // offset of the next frame
+    uint64_t index; // number of the next record
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Create a log file for messages of the given schema (interval 0 selects the default)
+    int ute_log_create(struct ute_log_writer *writer, const char *path, uint64_t fingerprint, uint32_t schema_version, uint32_t interval);
+    // Append one encoded message
+    int ute_log_append(struct ute_log_writer *writer, const uint8_t *msg, size_t len);
+    // Append one encoded message in a compressed envelope if it has at least
+    // threshold bytes and shrinks (read it back with ute_decompress)
+    int ute_log_append_compressed(struct ute_log_writer *writer, const uint8_t *msg, size_t len, const struct ute_compressor *c, size_t threshold);
+    // Write the last index block and the directory, then close the file
+    int ute_log_close(struct ute_log_writer *writer);
+
+    // Map a log file and validate its header (returns 0 on success)
+    int ute_log_open(struct ute_log_reader *reader, const char *path);
+    // Get record n in O(1) as a slice into the mapping (requires a closed log)
+    int ute_log_get(const struct ute_log_reader *reader, uint64_t n, struct ute_slice *out_record);
+    // Unmap the file
+    void ute_log_unmap(struct ute_log_reader *reader);
+
+    // Start a sequential scan (advises the kernel to read ahead)
+    int ute_log_iter_init(struct ute_log_iter *iter, const struct ute_log_reader *reader);
+    // Get the next record; returns 1 on a record, 0 at the end and -1 on a corrupt frame
+    int ute_log_next(struct ute_log_iter *iter, struct ute_slice *out_record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_LOG_H
@@ -0,0 +1,620 @@
+#include "plan.h"
+#include "schema.h"
+#include <stdlib.h>
+#include <string.h>
+
+// =========================================================
+// Schema compiler: ute_field tree -> flat instruction array
+// =========================================================
+
+// Number of instructions needed for a field subtree (0 on unsupported type)
+static size_t count_insns(const struct ute_field *field)
+{
+    switch (field->type)
+    {
+    case UTE_TYPE_NULL:
+    case UTE_TYPE_BOOL:
+    case UTE_TYPE_INT:
+    case UTE_TYPE_SINT:
+    case UTE_TYPE_STRING:
+    case UTE_TYPE_FLOAT32:
+    case UTE_TYPE_FLOAT64:
+    case UTE_TYPE_FIXED32:
+    case UTE_TYPE_FIXED64:
+    case UTE_TYPE_BYTES:
+        return 1;
+    case UTE_TYPE_LIST:
+    {
+        if (!field->elem)
+            return 0;
+        size_t sub = count_insns(field->elem);
+        return sub ? 2 + sub : 0;
+    }
+    case UTE_TYPE_STRUCT:
+    {
+        // Sparse structs wrap every member in a MEMBER instruction
+        size_t n = field->sparse ? 2 + field->num_fields : 2;
+        for (size_t i = 0; i < field->num_fields; ++i)
+        {
+            size_t sub = count_insns(&field->fields[i]);
+            if (!sub)
+                return 0;
+            n += sub;
+        }
+        return n;
+    }
+    default:
+        return 0;
+    }
+}
+
+// Number of instructions for a top-level field array including UTE_OP_HALT (0 on error)
+static size_t count_plan(const struct ute_field *fields, size_t num_fields)
+{
+    size_t total = 1;
+    for (size_t i = 0; i < num_fields; ++i)
+    {
+        size_t sub = count_insns(&fields[i]);
+        if (!sub)
+            return 0;
+        total += sub;
+    }
+    return total;
+}
+
+// Set the flags and element size of the LIST instruction at insns[at] once its
+// element has been emitted, and emit the closing LIST_END. The wire flags come
+// from wire, the schema field whose encoding is read or written.
+static int finish_list(const struct ute_field *wire, struct ute_insn *insns, size_t at, size_t *pc)
+{
+    struct ute_insn *insn = &insns[at];
+    const struct ute_insn *elem = &insns[at + 1];
+    if (UTE_INSN_IS_FLAT_LEAF(elem) || (elem->op == UTE_OP_STRUCT && (elem->flags & UTE_INSN_FLAT)))
+        insn->flags |= UTE_INSN_FLAT;
+    if (wire->packed || wire->encoding)
+    {
+        if (!UTE_OP_IS_INT(elem->op) || wire->encoding > UTE_ENCODING_DELTA_OF_DELTA)
+            return -1;
+        insn->flags |= UTE_INSN_PACKED;
+        if (wire->encoding)
+            insn->nfields = (uint16_t)(UTE_INTS_DELTA + wire->encoding - UTE_ENCODING_DELTA);
+        else if (elem->op == UTE_OP_SINT)
+            insn->nfields = UTE_INTS_ZIGZAG;
+    }
+    if (wire->columnar)
+    {
+        if (!ute_is_columnar_elem(wire->elem))
+            return -1;
+        insn->flags |= UTE_INSN_COLUMNAR;
+    }
+    if (wire->chunk)
+    {
+        if (wire->packed || wire->encoding || wire->columnar || UTE_OP_IS_FIXED(elem->op) || wire->chunk > UINT16_MAX)
+            return -1;
+        insn->flags |= UTE_INSN_CHUNKED;
+        insn->nfields = (uint16_t)wire->chunk;
+    }
+    // Fixed-size elements can be allocated in one block when decoding into an
+    // arena; fixed-width ones are always encoded as one raw array
+    if (UTE_OP_IS_FIXED(elem->op))
+    {
+        insn->flags |= UTE_INSN_FIXED;
+        insn->arg = UTE_OP_WIDTH(elem->op);
+    }
+    else if (UTE_OP_IS_INT(elem->op))
+        insn->arg = sizeof(uint64_t);
+    else if (elem->op == UTE_OP_BOOL)
+        insn->arg = sizeof(uint8_t);
+    else if (elem->op == UTE_OP_STRUCT)
+        insn->arg = elem->arg;
+    struct ute_insn *end = &insns[(*pc)++];
+    memset(end, 0, sizeof(*end));
+    end->op = UTE_OP_LIST_END;
+    end->next = (uint32_t)at;
+    return 0;
+}
+
+// Emit the MEMBER instruction in front of member index of a sparse struct.
+// Returns its position; its next is set once the member has been emitted.
+static size_t begin_member(struct ute_insn *insns, size_t *pc, size_t index)
+{
+    size_t at = (*pc)++;
+    memset(&insns[at], 0, sizeof(insns[at]));
+    insns[at].op = UTE_OP_MEMBER;
+    insns[at].arg = (uint32_t)index;
+    return at;
+}
+
+// Emit the instructions for a field subtree at insns[*pc] (recursive over the schema only)
+static int emit_field(const struct ute_field *field, size_t offset, uint8_t flags, size_t depth,
+                      struct ute_insn *insns, size_t *pc, size_t *max_depth)
+{
+    size_t at = (*pc)++;
+    struct ute_insn *insn = &insns[at];
+    memset(insn, 0, sizeof(*insn));
+    insn->offset = (uint32_t)offset;
+    insn->flags = flags;
+    switch (field->type)
+    {
+    case UTE_TYPE_NULL:
+        insn->op = UTE_OP_NULL;
+        break;
+    case UTE_TYPE_BOOL:
+        insn->op = UTE_OP_BOOL;
+        break;
+    case UTE_TYPE_INT:
+        insn->op = UTE_OP_INT;
+        break;
+    case UTE_TYPE_SINT:
+        insn->op = UTE_OP_SINT;
+        break;
+    case UTE_TYPE_STRING:
+        insn->op = UTE_OP_STRING;
+        insn->arg = (uint32_t)field->capacity;
+        if (field->dict)
+        {
+            insn->flags |= UTE_INSN_DICT;
+            insn->nfields = (uint16_t)field->dict;
+        }
+        break;
+    case UTE_TYPE_FLOAT32:
+        insn->op = UTE_OP_FLOAT32;
+        break;
+    case UTE_TYPE_FLOAT64:
+        insn->op = UTE_OP_FLOAT64;
+        break;
+    case UTE_TYPE_FIXED32:
+        insn->op = UTE_OP_FIXED32;
+        break;
+    case UTE_TYPE_FIXED64:
+        insn->op = UTE_OP_FIXED64;
+        break;
+    case UTE_TYPE_BYTES:
+        insn->op = UTE_OP_BYTES;
+        insn->arg = (uint32_t)field->capacity;
+        break;
+    case UTE_TYPE_LIST:
+    {
+        if (++depth > UTE_PLAN_MAX_DEPTH)
+            return -1;
+        if (depth > *max_depth)
+            *max_depth = depth;
+        insn->op = UTE_OP_LIST;
+        // List elements are reached through the [count, ptr, ptr, ...] slots
+        if (emit_field(field->elem, 0, UTE_INSN_INDIRECT, depth, insns, pc, max_depth) != 0)
+            return -1;
+        if (finish_list(field, insns, at, pc) != 0)
+            return -1;
+        break;
+    }
+    case UTE_TYPE_STRUCT:
+    {
+        if (++depth > UTE_PLAN_MAX_DEPTH)
+            return -1;
+        if (depth > *max_depth)
+            *max_depth = depth;
+        if (field->num_fields > UINT16_MAX || field->size > UINT32_MAX)
+            return -1;
+        insn->op = UTE_OP_STRUCT;
+        insn->nfields = (uint16_t)field->num_fields;
+        insn->arg = (uint32_t)field->size;
+        insn->flags |= field->sparse ? UTE_INSN_SPARSE : UTE_INSN_FLAT;
+        for (size_t i = 0; i < field->num_fields; ++i)
+        {
+            const struct ute_field *member = &field->fields[i];
+            if (member->type == UTE_TYPE_LIST || member->type == UTE_TYPE_STRUCT || member->dict)
+                insn->flags &= ~UTE_INSN_FLAT;
+            size_t marker = field->sparse ? begin_member(insns, pc, i) : 0;
+            // Members live at their layout offset, inline or behind a pointer
+            uint8_t member_flags = member->storage == UTE_STORAGE_POINTER ? UTE_INSN_INDIRECT : 0;
+            if (emit_field(member, member->offset, member_flags, depth, insns, pc, max_depth) != 0)
+                return -1;
+            if (field->sparse)
+                insns[marker].next = (uint32_t)*pc;
+        }
+        struct ute_insn *end = &insns[(*pc)++];
+        memset(end, 0, sizeof(*end));
+        end->op = UTE_OP_STRUCT_END;
+        end->next = (uint32_t)at;
+        break;
+    }
+    default:
+        return -1;
+    }
+    insn->next = (uint32_t)*pc;
+    return 0;
+}
+
+// -------------------------
+// Translation plans
+// -------------------------
+
+// Field with the given name in a field array (NULL if there is none)
+static const struct ute_field *find_field(const struct ute_field *fields, size_t num_fields, const char *name)
+{
+    for (size_t i = 0; i < num_fields && name; ++i)
+    {
+        if (fields[i].name && strcmp(fields[i].name, name) == 0)
+            return &fields[i];
+    }
+    return NULL;
+}
+
+// Offset and flags of the value slot of fields[index], a top-level field or a struct member
+static void field_slot(const struct ute_field *fields, size_t index, int top_level, size_t *offset, uint8_t *flags)
+{
+    *offset = top_level ? index * sizeof(void *) : fields[index].offset;
+    *flags = top_level || fields[index].storage == UTE_STORAGE_POINTER ? UTE_INSN_INDIRECT : 0;
+}
+
+static int emit_translation(const struct ute_field *writer, const struct ute_field *reader, size_t offset, uint8_t flags, size_t depth,
+                            struct ute_insn *insns, size_t *pc, size_t *max_depth);
+
+// True if a field subtree contains dict strings
+static int has_dict(const struct ute_field *field)
+{
+    if (field->dict)
+        return 1;
+    if (field->type == UTE_TYPE_LIST && field->elem)
+        return has_dict(field->elem);
+    for (size_t i = 0; field->type == UTE_TYPE_STRUCT && i < field->num_fields; ++i)
+    {
+        if (has_dict(&field->fields[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Emit one level of fields in the writer's wire order: fields both versions
+// have are translated, writer-only fields skipped, and reader-only fields
+// defaulted after them. The members of a sparse writer struct keep their
+// MEMBER instructions. A skipped field with dict strings is followed by its
+// writer instructions and a HALT: the VM checks it with them, recording its
+// strings as targets of later back-references. Returns 1 if any field was
+// skipped or defaulted, 0 if none was and -1 on error.
+static int emit_translated_fields(const struct ute_field *writer, size_t num_writer, const struct ute_field *reader, size_t num_reader,
+                                  int top_level, int sparse, size_t depth, struct ute_insn *insns, size_t *pc, size_t *max_depth)
+{
+    int changed = 0;
+    size_t offset;
+    uint8_t flags;
+    for (size_t i = 0; i < num_writer; ++i)
+    {
+        const struct ute_field *match = find_field(reader, num_reader, writer[i].name);
+        size_t marker = sparse ? begin_member(insns, pc, i) : 0;
+        if (!match)
+        {
+            size_t at = (*pc)++;
+            memset(&insns[at], 0, sizeof(insns[at]));
+            insns[at].op = UTE_OP_SKIP;
+            if (has_dict(&writer[i]))
+            {
+                field_slot(writer, i, top_level, &offset, &flags);
+                if (emit_field(&writer[i], offset, flags, depth, insns, pc, max_depth) != 0)
+                    return -1;
+                memset(&insns[*pc], 0, sizeof(insns[*pc]));
+                insns[(*pc)++].op = UTE_OP_HALT;
+            }
+            insns[at].next = (uint32_t)*pc;
+            changed = 1;
+        }
+        else
+        {
+            field_slot(reader, (size_t)(match - reader), top_level, &offset, &flags);
+            if (emit_translation(&writer[i], match, offset, flags, depth, insns, pc, max_depth) != 0)
+                return -1;
+        }
+        if (sparse)
+            insns[marker].next = (uint32_t)*pc;
+    }
+    for (size_t i = 0; i < num_reader; ++i)
+    {
+        if (find_field(writer, num_writer, reader[i].name))
+            continue;
+        size_t at = (*pc)++;
+        memset(&insns[at], 0, sizeof(insns[at]));
+        insns[at].op = UTE_OP_DEFAULT;
+        field_slot(reader, i, top_level, &offset, &flags);
+        if (emit_field(&reader[i], offset, flags, depth, insns, pc, max_depth) != 0)
+            return -1;
+        insns[at].next = (uint32_t)*pc;
+        changed = 1;
+    }
+    return changed;
+}
+
+// Emit the instructions reading the wire format of writer into the storage of
+// reader (the same field in two schema versions)
+static int emit_translation(const struct ute_field *writer, const struct ute_field *reader, size_t offset, uint8_t flags, size_t depth,
+                            struct ute_insn *insns, size_t *pc, size_t *max_depth)
+{
+    if (writer->type != reader->type)
+        return -1;
+    if (writer->type != UTE_TYPE_LIST && writer->type != UTE_TYPE_STRUCT)
+    {
+        // The reader's storage, but the writer's string encoding
+        struct ute_insn *leaf = &insns[*pc];
+        if (emit_field(reader, offset, flags, depth, insns, pc, max_depth) != 0)
+            return -1;
+        leaf->flags &= ~UTE_INSN_DICT;
+        leaf->nfields = 0;
+        if (writer->dict)
+        {
+            leaf->flags |= UTE_INSN_DICT;
+            leaf->nfields = (uint16_t)writer->dict;
+        }
+        return 0;
+    }
+    if (++depth > UTE_PLAN_MAX_DEPTH)
+        return -1;
+    if (depth > *max_depth)
+        *max_depth = depth;
+    size_t at = (*pc)++;
+    struct ute_insn *insn = &insns[at];
+    memset(insn, 0, sizeof(*insn));
+    insn->offset = (uint32_t)offset;
+    insn->flags = flags;
+    if (writer->type == UTE_TYPE_LIST)
+    {
+        if (!writer->elem || !reader->elem)
+            return -1;
+        insn->op = UTE_OP_LIST;
+        if (emit_translation(writer->elem, reader->elem, 0, UTE_INSN_INDIRECT, depth, insns, pc, max_depth) != 0)
+            return -1;
+        // Columns are decoded member by member, so defaulted members must be leaves too
+        if (writer->columnar && !ute_is_columnar_elem(reader->elem))
+            return -1;
+        if (finish_list(writer, insns, at, pc) != 0)
+            return -1;
+    }
+    else
+    {
+        if (writer->num_fields > UINT16_MAX || reader->size > UINT32_MAX)
+            return -1;
+        insn->op = UTE_OP_STRUCT;
+        insn->nfields = (uint16_t)writer->num_fields; // the field count on the wire
+        insn->arg = (uint32_t)reader->size;
+        int changed = emit_translated_fields(writer->fields, writer->num_fields, reader->fields, reader->num_fields, 0, writer->sparse, depth,
+                                             insns, pc, max_depth);
+        if (changed < 0)
+            return -1;
+        // Flat structs are decoded without the VM, which needs one leaf per wire field
+        if (writer->sparse)
+            insn->flags |= UTE_INSN_SPARSE;
+        else if (!changed)
+            insn->flags |= UTE_INSN_FLAT;
+        for (size_t i = 0; i < writer->num_fields; ++i)
+        {
+            if (writer->fields[i].type == UTE_TYPE_LIST || writer->fields[i].type == UTE_TYPE_STRUCT || writer->fields[i].dict)
+                insn->flags &= ~UTE_INSN_FLAT;
+        }
+        struct ute_insn *end = &insns[(*pc)++];
+        memset(end, 0, sizeof(*end));
+        end->op = UTE_OP_STRUCT_END;
+        end->next = (uint32_t)at;
+    }
+    insn->next = (uint32_t)*pc;
+    return 0;
+}
+
+// =====================
+// Plan API
+// =====================
+
+int ute_is_columnar_elem(const struct ute_field *elem)
+{
+    if (!elem || elem->type != UTE_TYPE_STRUCT || elem->sparse)
+        return 0;
+    int has_data = 0;
+    for (size_t i = 0; i < elem->num_fields; ++i)
+    {
+        int type = elem->fields[i].type;
+        if ((type != UTE_TYPE_NULL && type != UTE_TYPE_BOOL && type != UTE_TYPE_INT && type != UTE_TYPE_STRING) || elem->fields[i].dict)
+            return 0;
+        if (type != UTE_TYPE_NULL)
+            has_data = 1;
+    }
+    return has_data;
+}
+
+int ute_compile_into(const struct ute_field *fields, size_t num_fields, struct ute_insn *insns, size_t cap, struct ute_plan *out_plan)
+{
+    if (!fields || !insns || !out_plan)
+        return -1;
+    size_t total = count_plan(fields, num_fields);
+    if (!total)
+        return -1;
+    if (total > cap)
+        return -2;
+
+    size_t pc = 0, max_depth = 0;
+    for (size_t i = 0; i < num_fields; ++i)
+    {
+        // Top-level data is an array of pointers, one per field
+        if (emit_field(&fields[i], i * sizeof(void *), UTE_INSN_INDIRECT, 0, insns, &pc, &max_depth) != 0)
+            return -1;
+    }
+    memset(&insns[pc], 0, sizeof(insns[pc]));
+    insns[pc].op = UTE_OP_HALT;
+    pc++;
+
+    out_plan->insns = insns;
+    out_plan->num_insns = pc;
+    out_plan->num_fields = num_fields;
+    out_plan->depth = max_depth;
+    out_plan->version = 0;
+    out_plan->stats = NULL;
+    memset(&out_plan->dictionary, 0, sizeof(out_plan->dictionary));
+    return 0;
+}
+
+int ute_compile_fields(const struct ute_field *fields, size_t num_fields, struct ute_plan *out_plan)
+{
+    if (!fields || !out_plan)
+        return -1;
+    size_t total = count_plan(fields, num_fields);
+    if (!total)
+        return -1;
+    struct ute_insn *insns = malloc(total * sizeof(struct ute_insn));
+    if (!insns)
+        return -1;
+    if (ute_compile_into(fields, num_fields, insns, total, out_plan) != 0)
+    {
+        free(insns);
+        return -1;
+    }
+    return 0;
+}
+
+int ute_compile(const struct ute_schema_version *version, struct ute_plan *out_plan)
+{
+    if (!version || !out_plan)
+        return -1;
+    if (ute_compile_fields(version->fields, version->num_fields, out_plan) != 0)
+        return -1;
+    out_plan->version = version->version;
+    out_plan->dictionary = version->dictionary;
+    return 0;
+}
+
+int ute_compile_translation(const struct ute_schema_version *writer, const struct ute_schema_version *reader, struct ute_plan *out_plan)
+{
+    if (!writer || !reader || !out_plan)
+        return -1;
+    size_t writer_insns = count_plan(writer->fields, writer->num_fields);
+    size_t reader_insns = count_plan(reader->fields, reader->num_fields);
+    if (!writer_insns || !reader_insns)
+        return -1;
+    // Every reader node appears at most once plus one DEFAULT, every writer node
+    // (MEMBER instructions included) at most as one SKIP or MEMBER, or once
+    // more behind a SKIP with its HALT
+    size_t cap = 2 * reader_insns + 3 * writer_insns;
+    struct ute_insn *insns = malloc(cap * sizeof(struct ute_insn));
+    if (!insns)
+        return -1;
+    size_t pc = 0, max_depth = 0;
+    if (emit_translated_fields(writer->fields, writer->num_fields, reader->fields, reader->num_fields, 1, 0, 0, insns, &pc, &max_depth) < 0)
+    {
+        free(insns);
+        return -1;
+    }
+    memset(&insns[pc], 0, sizeof(insns[pc]));
+    insns[pc].op = UTE_OP_HALT;
+    pc++;
+
+    out_plan->insns = insns;
+    out_plan->num_insns = pc;
+    out_plan->num_fields = reader->num_fields;
+    out_plan->depth = max_depth;
+    out_plan->version = writer->version;
+    out_plan->stats = NULL;
+    out_plan->dictionary = writer->dictionary;
+    return 0;
+}
+
+uint64_t ute_plan_fingerprint(const struct ute_plan *plan)
+{
+    // FNV-1a over the shape of the plan: opcodes, wire flags and struct sizes,
+    // then the shared dictionary, whose ids readers must resolve alike. The
+    // chunk size of a list is on the wire, so readers do not depend on it,
+    // but they do on the transform of a packed list.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    if (!plan || !plan->insns)
+        return 0;
+    for (size_t i = 0; i < plan->num_insns; ++i)
+    {
+        const struct ute_insn *insn = &plan->insns[i];
+        uint16_t nfields = insn->op == UTE_OP_LIST && (insn->flags & UTE_INSN_CHUNKED) ? 0 : insn->nfields;
+        uint8_t bytes[4] = {insn->op, (uint8_t)(insn->flags & UTE_INSN_WIRE_FLAGS), (uint8_t)nfields, (uint8_t)(nfields >> 8)};
+        for (size_t j = 0; j < sizeof(bytes); ++j)
+        {
+            h ^= bytes[j];
+            h *= 0x100000001b3ULL;
+        }
+    }
+    const struct ute_dictionary *dict = &plan->dictionary;
+    if (dict->num_values)
+    {
+        // Every value with its NUL, so that the boundaries count
+        size_t size = dict->offsets[dict->num_values];
+        for (size_t i = 0; i < size; ++i)
+        {
+            h ^= (uint8_t)dict->data[i];
+            h *= 0x100000001b3ULL;
+        }
+    }
+    return h;
+}
+
+void ute_plan_free(struct ute_plan *plan)
+{
+    if (!plan)
+        return;
+    free(plan->insns);
+    plan->insns = NULL;
+    plan->num_insns = 0;
+    plan->num_fields = 0;
+    plan->depth = 0;
+    plan->stats = NULL;
+    memset(&plan->dictionary, 0, sizeof(plan->dictionary));
+}
+
+int ute_evolution_init(struct ute_evolution *evo, const struct ute_schema *schema, int reader_version)
+{
+    if (!evo || !schema)
+        return -1;
+    memset(evo, 0, sizeof(*evo));
+    const struct ute_schema_version *reader = NULL;
+    for (size_t i = 0; i < schema->num_versions && !reader; ++i)
+    {
+        if (schema->versions[i].version == reader_version)
+            reader = &schema->versions[i];
+    }
+    if (!reader)
+        return -1;
+    evo->plans = calloc(schema->num_versions, sizeof(struct ute_plan));
+    if (!evo->plans)
+        return -1;
+    evo->reader_version = reader_version;
+    evo->untagged_version = reader_version;
+    for (size_t i = 0; i < schema->num_versions; ++i)
+    {
+        const struct ute_schema_version *writer = &schema->versions[i];
+        // The reader's own version needs no translation; versions that cannot
+        // be translated (a field changed its type) get no plan
+        if (writer == reader)
+        {
+            if (ute_compile(reader, &evo->plans[evo->num_plans]) != 0)
+            {
+                ute_evolution_free(evo);
+                return -1;
+            }
+        }
+        else if (ute_compile_translation(writer, reader, &evo->plans[evo->num_plans]) != 0)
+            continue;
+        evo->num_plans++;
+    }
+    return 0;
+}
+
+const struct ute_plan *ute_evolution_plan(const struct ute_evolution *evo, int writer_version)
+{
+    if (!evo)
+        return NULL;
+    for (size_t i = 0; i < evo->num_plans; ++i)
+    {
+        if (evo->plans[i].version == writer_version)
+            return &evo->plans[i];
+    }
+    return NULL;
+}
+
+void ute_evolution_free(struct ute_evolution *evo)
+{
+    if (!evo)
+        return;
+    for (size_t i = 0; i < evo->num_plans; ++i)
+        ute_plan_free(&evo->plans[i]);
+    free(evo->plans);
+    memset(evo, 0, sizeof(*evo));
+}
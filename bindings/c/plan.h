@@ -0,0 +1,151 @@
+#ifndef UTE_PLAN_H
+#define UTE_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dict.h"
+
+struct ute_field;
+struct ute_schema;
+struct ute_schema_version;
+struct ute_stats;
+
+// Plan opcodes. Leaf opcodes encode/decode one value; LIST/STRUCT open a
+// node that is closed by the matching *_END instruction.
+#define UTE_OP_HALT 0
+#define UTE_OP_NULL 1
+#define UTE_OP_BOOL 2
+#define UTE_OP_INT 3
+#define UTE_OP_STRING 4
+#define UTE_OP_LIST 5
+#define UTE_OP_LIST_END 6
+#define UTE_OP_STRUCT 7
+#define UTE_OP_STRUCT_END 8
+// Translation plans only (see ute_compile_translation)
+#define UTE_OP_SKIP 9     // skip one encoded value of a field the reader does not have
+                          // (with dict strings: its writer instructions and a HALT follow, next is past them)
+#define UTE_OP_DEFAULT 10 // store the default of the reader field that follows, reading nothing
+// Sparse structs only: precedes each member, which may be absent from the encoding
+#define UTE_OP_MEMBER 11
+// Fixed-width leaves (raw little-endian values) and bytes
+#define UTE_OP_FLOAT32 12
+#define UTE_OP_FLOAT64 13
+#define UTE_OP_FIXED32 14
+#define UTE_OP_FIXED64 15
+#define UTE_OP_BYTES 16
+// Signed int leaf (int64_t), written as an int holding its zigzag mapping
+#define UTE_OP_SINT 17
+
+// True for opcodes that encode a fixed-width value
+#define UTE_OP_IS_FIXED(op) ((op) >= UTE_OP_FLOAT32 && (op) <= UTE_OP_FIXED64)
+// Width in bytes of a fixed-width value
+#define UTE_OP_WIDTH(op) ((op) == UTE_OP_FLOAT32 || (op) == UTE_OP_FIXED32 ? 4 : 8)
+// True for opcodes that encode a single value without children
+#define UTE_OP_IS_LEAF(op) (((op) >= UTE_OP_NULL && (op) <= UTE_OP_STRING) || ((op) >= UTE_OP_FLOAT32 && (op) <= UTE_OP_SINT))
+// True for int and sint opcodes (the elements a PACKED list may have)
+#define UTE_OP_IS_INT(op) ((op) == UTE_OP_INT || (op) == UTE_OP_SINT)
+// True for leaf instructions that can be part of a FLAT node (dictionary
+// strings depend on the values before them, so only the VM runs them)
+#define UTE_INSN_IS_FLAT_LEAF(insn) (UTE_OP_IS_LEAF((insn)->op) && !((insn)->flags & UTE_INSN_DICT))
+
+// Instruction flags
+#define UTE_INSN_INDIRECT 0x01 // value slot holds a pointer to the value (containers, pointer storage)
+#define UTE_INSN_FLAT 0x02     // STRUCT: all members are leaves; LIST: elements are leaves or flat structs
+#define UTE_INSN_PACKED 0x04   // LIST: int or sint elements are encoded as bare varints after one header (nfields: UTE_INTS_*)
+#define UTE_INSN_COLUMNAR 0x08 // LIST: flat struct elements are encoded as one column per member
+#define UTE_INSN_SPARSE 0x10   // STRUCT: members with their default value may be omitted (never FLAT)
+#define UTE_INSN_FIXED 0x20    // LIST: fixed-width elements are encoded as one raw little-endian array
+#define UTE_INSN_CHUNKED 0x40  // LIST: elements are encoded in chunks of nfields behind a table of chunk sizes
+#define UTE_INSN_DICT 0x80     // STRING: repeated values may be back-references or dictionary ids (nfields: UTE_DICT_*)
+
+// Transforms of the elements of a PACKED list before they are written as
+// varints (the nfields of the list, see ute_ints_encode). Differences wrap
+// around modulo 2^64 and are zigzag-mapped.
+#define UTE_INTS_PLAIN 0  // int elements as they are
+#define UTE_INTS_ZIGZAG 1 // sint elements, zigzag-mapped
+#define UTE_INTS_DELTA 2  // each element minus the previous one (0 before the first)
+#define UTE_INTS_DELTA2 3 // each difference minus the previous one
+
+// Flags that change the encoding (the others only describe the C layout)
+#define UTE_INSN_WIRE_FLAGS (UTE_INSN_PACKED | UTE_INSN_COLUMNAR | UTE_INSN_SPARSE | UTE_INSN_FIXED | UTE_INSN_CHUNKED | UTE_INSN_DICT)
+
+// Maximum nesting depth (lists + structs) supported by a compiled plan
+#define UTE_PLAN_MAX_DEPTH 64
+
+// A single plan instruction. Instructions reference each other by index only,
+// so a plan contains no pointers and can be copied or relocated freely.
+struct ute_insn
+{
+    uint8_t op;      // UTE_OP_*
+    uint8_t flags;    // UTE_INSN_*
+    uint16_t nfields; // STRUCT: number of members, LIST: elements per chunk (CHUNKED only)
+                      // or UTE_INTS_* transform (PACKED only), STRING: UTE_DICT_* mode (DICT only)
+    uint32_t offset;  // byte offset of the value slot relative to the current base
+    uint32_t next;    // index past this node's subtree; for *_END, index of the opening insn
+    uint32_t arg;     // STRUCT: sizeof the struct, STRING/BYTES: buffer capacity (0 = unchecked),
+                      // LIST: storage size of one element if fixed (0 = variable),
+                      // MEMBER: index of the member in its struct
+};
+
+// Compiled schema: a flat, depth-first instruction array terminated by UTE_OP_HALT
+struct ute_plan
+{
+    struct ute_insn *insns;
+    size_t num_insns;
+    size_t num_fields; // number of top-level fields
+    size_t depth;      // maximum nesting depth
+    int version;       // schema version the plan was compiled from (translation plans: the writer version)
+    struct ute_stats *stats; // counters updated by UTE_STATS builds (see stats.h), or NULL
+    struct ute_dictionary dictionary; // shared string dictionary (borrowed from the schema version or image; empty if none)
+};
+
+// Decoding plans of one reader version for messages of every version of a
+// schema: each plan reads one writer version (plan.version) and stores into
+// the reader's C layout
+struct ute_evolution
+{
+    struct ute_plan *plans;
+    size_t num_plans;
+    int reader_version;
+    int untagged_version; // version assumed for messages without a version tag (default: reader_version)
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Compile a parsed schema version into a flat plan (returns 0 on success, -1 on error)
+    int ute_compile(const struct ute_schema_version *version, struct ute_plan *out_plan);
+    // Compile an array of top-level fields into a plan (returns 0 on success, -1 on error).
+    // The plan gets no dictionary; set plan.dictionary to use one.
+    int ute_compile_fields(const struct ute_field *fields, size_t num_fields, struct ute_plan *out_plan);
+    // Compile into caller-provided instruction storage, allocating nothing.
+    // Returns 0 on success, -1 on error and -2 if cap is too small.
+    int ute_compile_into(const struct ute_field *fields, size_t num_fields, struct ute_insn *insns, size_t cap, struct ute_plan *out_plan);
+    // Compile a plan that decodes messages of the writer version into the C
+    // layout of the reader version: fields are matched by name, fields only
+    // the writer has are skipped and fields only the reader has get their
+    // default (0, false, "" or an empty list). Translation plans only decode.
+    // Returns 0 on success and -1 on error (e.g. a field changed its type).
+    int ute_compile_translation(const struct ute_schema_version *writer, const struct ute_schema_version *reader, struct ute_plan *out_plan);
+    // True if a list of elem can be columnar: a dense struct of null, bool, int and string members, not all of them null
+    int ute_is_columnar_elem(const struct ute_field *elem);
+    // 64-bit fingerprint of the wire format a plan reads and writes (C layout details are ignored)
+    uint64_t ute_plan_fingerprint(const struct ute_plan *plan);
+    // Free memory owned by a plan returned from ute_compile/ute_compile_fields
+    void ute_plan_free(struct ute_plan *plan);
+
+    // Compile the plans reading every version of a schema into reader_version.
+    // Versions that cannot be translated get no plan. Returns 0 on success, -1 on error.
+    int ute_evolution_init(struct ute_evolution *evo, const struct ute_schema *schema, int reader_version);
+    // Plan reading messages written with writer_version (NULL if the schema has no such version)
+    const struct ute_plan *ute_evolution_plan(const struct ute_evolution *evo, int writer_version);
+    // Free the plans of an evolution
+    void ute_evolution_free(struct ute_evolution *evo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_PLAN_H
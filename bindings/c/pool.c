@@ -0,0 +1,159 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// =========================================================
+// Thread pool: executor for parallel encoding and decoding
+// =========================================================
+
+struct ute_pool_thread
+{
+    struct ute_pool *pool;
+    size_t worker; // worker index passed to the tasks (1..num_threads - 1)
+    pthread_t thread;
+};
+
+struct ute_pool
+{
+    struct ute_pool_thread *threads;
+    size_t num_threads; // workers, including the caller of run()
+    pthread_mutex_t lock;
+    pthread_cond_t start; // a run started, or the pool is stopping
+    pthread_cond_t done;  // the last pool thread finished its share of a run
+    uint64_t generation;  // number of runs started
+    size_t active;        // pool threads still working on the current run
+    int stop;
+    // Current run
+    void (*fn)(void *arg, size_t task, size_t worker);
+    void *arg;
+    size_t num_tasks;
+    atomic_size_t next; // next task to claim
+};
+
+// Claim and run tasks of the current run until none are left
+static void work(struct ute_pool *pool, size_t worker)
+{
+    for (;;)
+    {
+        size_t task = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed);
+        if (task >= pool->num_tasks)
+            return;
+        pool->fn(pool->arg, task, worker);
+    }
+}
+
+// Pool thread: wait for a run, share its tasks, report back
+static void *thread_main(void *p)
+{
+    struct ute_pool_thread *self = p;
+    struct ute_pool *pool = self->pool;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->stop && pool->generation == seen)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stop)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        work(pool, self->worker);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Executor callback: run num_tasks tasks on the caller and the pool threads
+static void pool_run(void *ctx, size_t num_tasks, void (*fn)(void *arg, size_t task, size_t worker), void *arg)
+{
+    struct ute_pool *pool = ctx;
+    // Not worth waking the pool threads for
+    if (pool->num_threads == 1 || num_tasks < 2)
+    {
+        for (size_t task = 0; task < num_tasks; ++task)
+            fn(arg, task, 0);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->num_tasks = num_tasks;
+    atomic_store_explicit(&pool->next, 0, memory_order_relaxed);
+    pool->active = pool->num_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    work(pool, 0);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Start a pool of num_threads workers
+struct ute_pool *ute_pool_create(size_t num_threads)
+{
+    if (num_threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (size_t)cpus : 1;
+    }
+    struct ute_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->threads = calloc(num_threads, sizeof(*pool->threads));
+    if (!pool->threads || pthread_mutex_init(&pool->lock, NULL) != 0)
+    {
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_init(&pool->next, 0);
+    // The caller of run() is worker 0, so thread i works as worker i
+    pool->num_threads = 1;
+    for (size_t i = 1; i < num_threads; ++i)
+    {
+        pool->threads[i].pool = pool;
+        pool->threads[i].worker = i;
+        if (pthread_create(&pool->threads[i].thread, NULL, thread_main, &pool->threads[i]) != 0)
+        {
+            ute_pool_destroy(pool);
+            return NULL;
+        }
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+// Stop the pool threads and free the pool
+void ute_pool_destroy(struct ute_pool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 1; i < pool->num_threads; ++i)
+        pthread_join(pool->threads[i].thread, NULL);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+// Executor running tasks on the pool
+struct ute_executor ute_pool_executor(struct ute_pool *pool)
+{
+    struct ute_executor exec = {pool_run, pool, pool ? pool->num_threads : 0};
+    return exec;
+}
@@ -0,0 +1,29 @@
+#ifndef UTE_POOL_H
+#define UTE_POOL_H
+
+#include "codex.h"
+#include <stddef.h>
+
+// Fixed-size thread pool running the tasks of the parallel codex entry
+// points. The thread calling run() works as worker 0 next to num_threads - 1
+// pool threads, which claim tasks from a shared counter. One run at a time:
+// tasks must not start another run of the same pool.
+struct ute_pool;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Start a pool of num_threads workers (0: one per online CPU); returns NULL on failure
+    struct ute_pool *ute_pool_create(size_t num_threads);
+    // Stop the pool threads and free the pool
+    void ute_pool_destroy(struct ute_pool *pool);
+    // Executor running tasks on the pool (valid until the pool is destroyed)
+    struct ute_executor ute_pool_executor(struct ute_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_POOL_H
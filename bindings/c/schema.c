@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <yaml.h>
+#include "plan.h"
 #include "schema.h"
 
 // =====================
@@ -39,6 +40,87 @@ static char *ute_strdup(const char *s)
     return out;
 }
 
+// Helper: in-struct alignment of a C type
+#define ALIGNOF(type) offsetof(struct { char c; type v; }, v)
+
+// Helper: round n up to a multiple of align (a power of two)
+static size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+// Compute size/alignment of a field's value slot (struct members must be laid out first)
+static void layout_field(struct ute_field *field)
+{
+    if (field->storage == UTE_STORAGE_POINTER)
+    {
+        field->size = sizeof(void *);
+        field->align = ALIGNOF(void *);
+        return;
+    }
+    switch (field->type)
+    {
+    case UTE_TYPE_BOOL:
+        field->size = sizeof(uint8_t);
+        field->align = ALIGNOF(uint8_t);
+        break;
+    case UTE_TYPE_INT:
+        field->size = sizeof(uint64_t);
+        field->align = ALIGNOF(uint64_t);
+        break;
+    case UTE_TYPE_SINT:
+        field->size = sizeof(int64_t);
+        field->align = ALIGNOF(int64_t);
+        break;
+    case UTE_TYPE_STRING:
+        field->size = field->capacity;
+        field->align = 1;
+        break;
+    case UTE_TYPE_FLOAT32:
+        field->size = sizeof(float);
+        field->align = ALIGNOF(float);
+        break;
+    case UTE_TYPE_FLOAT64:
+        field->size = sizeof(double);
+        field->align = ALIGNOF(double);
+        break;
+    case UTE_TYPE_FIXED32:
+        field->size = sizeof(uint32_t);
+        field->align = ALIGNOF(uint32_t);
+        break;
+    case UTE_TYPE_FIXED64:
+        field->size = sizeof(uint64_t);
+        field->align = ALIGNOF(uint64_t);
+        break;
+    case UTE_TYPE_BYTES:
+        field->align = ALIGNOF(size_t);
+        field->size = align_up(sizeof(size_t) + field->capacity, field->align);
+        break;
+    case UTE_TYPE_STRUCT:
+    {
+        // Natural alignment: each member at the next multiple of its alignment,
+        // total size padded to the strictest member alignment
+        size_t running_offset = 0, max_align = 1;
+        for (size_t i = 0; i < field->num_fields; ++i)
+        {
+            struct ute_field *member = (struct ute_field *)&field->fields[i];
+            running_offset = align_up(running_offset, member->align);
+            member->offset = running_offset;
+            running_offset += member->size;
+            if (member->align > max_align)
+                max_align = member->align;
+        }
+        field->size = align_up(running_offset, max_align);
+        field->align = max_align;
+        break;
+    }
+    default: // null occupies no memory
+        field->size = 0;
+        field->align = 1;
+        break;
+    }
+}
+
 // Helper: get value for a key in a YAML mapping node
 static yaml_node_t *get_mapping_value(yaml_document_t *doc, yaml_node_t *map, const char *key)
 {
@@ -55,6 +137,35 @@ static yaml_node_t *get_mapping_value(yaml_document_t *doc, yaml_node_t *map, co
     return NULL;
 }
 
+// Parse the optional "dictionary" of a schema version (a sequence of
+// distinct strings) into dict, which stays empty without one
+static int parse_dictionary(yaml_document_t *doc, yaml_node_t *map, struct ute_dictionary *dict)
+{
+    memset(dict, 0, sizeof(*dict));
+    yaml_node_t *dict_node = get_mapping_value(doc, map, "dictionary");
+    if (!dict_node)
+        return 0;
+    if (dict_node->type != YAML_SEQUENCE_NODE)
+        return -1;
+    size_t n = dict_node->data.sequence.items.top - dict_node->data.sequence.items.start;
+    const char **values = malloc((n ? n : 1) * sizeof(char *));
+    if (!values)
+        return -1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        yaml_node_t *v = yaml_document_get_node(doc, dict_node->data.sequence.items.start[i]);
+        if (!v || v->type != YAML_SCALAR_NODE)
+        {
+            free(values);
+            return -1;
+        }
+        values[i] = (const char *)v->data.scalar.value;
+    }
+    int rc = ute_dictionary_init(dict, values, n);
+    free(values);
+    return rc;
+}
+
 // =====================
 // Schema Parsing API
 // =====================
@@ -147,6 +258,18 @@ int ParseSchema(const char *filename, struct ute_schema *out_schema)
             versions[i].version = version;
             versions[i].fields = fields;
             versions[i].num_fields = nf;
+            if (parse_dictionary(&doc, ver_map, &versions[i].dictionary) != 0)
+            {
+#ifdef UTE_DEBUG
+                fprintf(stderr, "DEBUG: invalid dictionary in version %d\n", version);
+#endif
+                yaml_document_delete(&doc);
+                yaml_parser_delete(&parser);
+                fclose(f);
+                free(fields);
+                free(versions);
+                return -9;
+            }
         }
         out_schema->versions = versions;
         out_schema->num_versions = n;
@@ -186,6 +309,18 @@ int ParseSchema(const char *filename, struct ute_schema *out_schema)
         versions[0].version = 1;
         versions[0].fields = fields;
         versions[0].num_fields = nf;
+        if (parse_dictionary(&doc, root, &versions[0].dictionary) != 0)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: invalid dictionary (single-version)\n");
+#endif
+            yaml_document_delete(&doc);
+            yaml_parser_delete(&parser);
+            fclose(f);
+            free(fields);
+            free(versions);
+            return -9;
+        }
         out_schema->versions = versions;
         out_schema->num_versions = 1;
     }
@@ -236,18 +371,171 @@ int ParseSchemaField(yaml_document_t *doc, yaml_node_t *node, struct ute_field *
         out_field->type = UTE_TYPE_BOOL;
     else if (strcmp(type_str, "int") == 0)
         out_field->type = UTE_TYPE_INT;
+    else if (strcmp(type_str, "sint") == 0)
+        out_field->type = UTE_TYPE_SINT;
     else if (strcmp(type_str, "string") == 0)
         out_field->type = UTE_TYPE_STRING;
     else if (strcmp(type_str, "list") == 0)
         out_field->type = UTE_TYPE_LIST;
     else if (strcmp(type_str, "struct") == 0)
         out_field->type = UTE_TYPE_STRUCT;
+    else if (strcmp(type_str, "float32") == 0)
+        out_field->type = UTE_TYPE_FLOAT32;
+    else if (strcmp(type_str, "float64") == 0)
+        out_field->type = UTE_TYPE_FLOAT64;
+    else if (strcmp(type_str, "fixed32") == 0)
+        out_field->type = UTE_TYPE_FIXED32;
+    else if (strcmp(type_str, "fixed64") == 0)
+        out_field->type = UTE_TYPE_FIXED64;
+    else if (strcmp(type_str, "bytes") == 0)
+        out_field->type = UTE_TYPE_BYTES;
     else
         return -1;
 
     out_field->elem = NULL;
     out_field->fields = NULL;
     out_field->num_fields = 0;
+    out_field->offset = 0;
+
+    // Optional C layout attributes: "storage" (inline|pointer) and "capacity" (strings, bytes)
+    yaml_node_t *storage_node = get_mapping_value(doc, node, "storage");
+    yaml_node_t *capacity_node = get_mapping_value(doc, node, "capacity");
+    out_field->storage = out_field->type == UTE_TYPE_LIST ? UTE_STORAGE_POINTER : UTE_STORAGE_INLINE;
+    if (storage_node)
+    {
+        const char *storage_str = (char *)storage_node->data.scalar.value;
+        if (strcmp(storage_str, "pointer") == 0)
+            out_field->storage = UTE_STORAGE_POINTER;
+        else if (strcmp(storage_str, "inline") != 0 || out_field->type == UTE_TYPE_LIST)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid storage '%s'\n", storage_str);
+#endif
+            return -1;
+        }
+    }
+    out_field->capacity = 0;
+    if (capacity_node)
+    {
+        long capacity = atol((char *)capacity_node->data.scalar.value);
+        if ((out_field->type != UTE_TYPE_STRING && out_field->type != UTE_TYPE_BYTES) || capacity < 1)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid capacity\n");
+#endif
+            return -1;
+        }
+        out_field->capacity = (size_t)capacity;
+    }
+    else if (out_field->type == UTE_TYPE_STRING && out_field->storage == UTE_STORAGE_INLINE)
+        out_field->capacity = UTE_DEFAULT_STRING_CAPACITY;
+    else if (out_field->type == UTE_TYPE_BYTES && out_field->storage == UTE_STORAGE_INLINE)
+        out_field->capacity = UTE_DEFAULT_BYTES_CAPACITY;
+
+    // Optional wire attribute: "packed" (lists of ints)
+    yaml_node_t *packed_node = get_mapping_value(doc, node, "packed");
+    out_field->packed = 0;
+    if (packed_node)
+    {
+        const char *packed_str = (char *)packed_node->data.scalar.value;
+        if (strcmp(packed_str, "true") == 0)
+            out_field->packed = 1;
+        else if (strcmp(packed_str, "false") != 0 || out_field->type != UTE_TYPE_LIST)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid packed '%s'\n", packed_str);
+#endif
+            return -1;
+        }
+    }
+
+    // Optional wire attribute: "encoding" (lists of ints: plain|delta|delta-of-delta)
+    yaml_node_t *encoding_node = get_mapping_value(doc, node, "encoding");
+    out_field->encoding = UTE_ENCODING_PLAIN;
+    if (encoding_node)
+    {
+        const char *encoding_str = (char *)encoding_node->data.scalar.value;
+        if (strcmp(encoding_str, "delta") == 0)
+            out_field->encoding = UTE_ENCODING_DELTA;
+        else if (strcmp(encoding_str, "delta-of-delta") == 0)
+            out_field->encoding = UTE_ENCODING_DELTA_OF_DELTA;
+        if ((!out_field->encoding && strcmp(encoding_str, "plain") != 0) || out_field->type != UTE_TYPE_LIST)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid encoding '%s'\n", encoding_str);
+#endif
+            return -1;
+        }
+    }
+
+    // Optional wire attribute: "columnar" (lists of structs of leaves)
+    yaml_node_t *columnar_node = get_mapping_value(doc, node, "columnar");
+    out_field->columnar = 0;
+    if (columnar_node)
+    {
+        const char *columnar_str = (char *)columnar_node->data.scalar.value;
+        if (strcmp(columnar_str, "true") == 0)
+            out_field->columnar = 1;
+        else if (strcmp(columnar_str, "false") != 0 || out_field->type != UTE_TYPE_LIST)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid columnar '%s'\n", columnar_str);
+#endif
+            return -1;
+        }
+    }
+
+    // Optional wire attribute: "sparse" (structs)
+    yaml_node_t *sparse_node = get_mapping_value(doc, node, "sparse");
+    out_field->sparse = 0;
+    if (sparse_node)
+    {
+        const char *sparse_str = (char *)sparse_node->data.scalar.value;
+        if (strcmp(sparse_str, "true") == 0)
+            out_field->sparse = 1;
+        else if (strcmp(sparse_str, "false") != 0 || out_field->type != UTE_TYPE_STRUCT)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid sparse '%s'\n", sparse_str);
+#endif
+            return -1;
+        }
+    }
+
+    // Optional wire attribute: "chunk" (lists: elements per chunk)
+    yaml_node_t *chunk_node = get_mapping_value(doc, node, "chunk");
+    out_field->chunk = 0;
+    if (chunk_node)
+    {
+        long chunk = atol((char *)chunk_node->data.scalar.value);
+        if (out_field->type != UTE_TYPE_LIST || out_field->packed || out_field->encoding || out_field->columnar || chunk < 1 || chunk > UINT16_MAX)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid chunk\n");
+#endif
+            return -1;
+        }
+        out_field->chunk = (size_t)chunk;
+    }
+
+    // Optional wire attribute: "dict" (strings: message|shared)
+    yaml_node_t *dict_node = get_mapping_value(doc, node, "dict");
+    out_field->dict = UTE_DICT_NONE;
+    if (dict_node)
+    {
+        const char *dict_str = (char *)dict_node->data.scalar.value;
+        if (strcmp(dict_str, "message") == 0)
+            out_field->dict = UTE_DICT_MESSAGE;
+        else if (strcmp(dict_str, "shared") == 0)
+            out_field->dict = UTE_DICT_SHARED;
+        if ((!out_field->dict && strcmp(dict_str, "none") != 0) || out_field->type != UTE_TYPE_STRING)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: invalid dict '%s'\n", dict_str);
+#endif
+            return -1;
+        }
+    }
 
     // Recursively parse "elem" for lists
     if (out_field->type == UTE_TYPE_LIST)
@@ -262,6 +550,27 @@ int ParseSchemaField(yaml_document_t *doc, yaml_node_t *node, struct ute_field *
             return -1;
         }
         out_field->elem = elem;
+        if ((out_field->packed || out_field->encoding) && elem->type != UTE_TYPE_INT && elem->type != UTE_TYPE_SINT)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: packed list of non-int elements\n");
+#endif
+            return -1;
+        }
+        if (out_field->columnar && !ute_is_columnar_elem(elem))
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: columnar list of unsupported elements\n");
+#endif
+            return -1;
+        }
+        if (out_field->chunk && elem->type >= UTE_TYPE_FLOAT32 && elem->type <= UTE_TYPE_FIXED64)
+        {
+#ifdef UTE_DEBUG
+            fprintf(stderr, "DEBUG: ParseSchemaField: chunked list of fixed-width elements\n");
+#endif
+            return -1;
+        }
     }
 
     // Recursively parse "fields" for structs
@@ -280,23 +589,10 @@ int ParseSchemaField(yaml_document_t *doc, yaml_node_t *node, struct ute_field *
             if (ParseSchemaField(doc, f, &fields[i]) != 0)
                 return -1;
         }
-        // Set offsets for fields in the struct (hardcoded for device struct: id:uint64_t, name[32])
-        size_t running_offset = 0;
-        for (size_t i = 0; i < n; ++i)
-        {
-            if (fields[i].type == UTE_TYPE_INT)
-            {
-                fields[i].offset = running_offset;
-                running_offset += sizeof(uint64_t);
-            }
-            else if (fields[i].type == UTE_TYPE_STRING)
-            {
-                fields[i].offset = running_offset;
-                running_offset += 32; // fixed size for name[32]
-            }
-            // Add more types as needed
-        }
     }
+
+    // Member offsets are assigned when the enclosing struct is laid out
+    layout_field(out_field);
     return 0;
 }
 
@@ -313,8 +609,19 @@ void FreeSchema(struct ute_schema *schema)
                 free_field((struct ute_field *)&ver->fields[j]);
             free((void *)ver->fields);
         }
+        ute_dictionary_free(&ver->dictionary);
     }
     free((void *)schema->versions);
     schema->versions = NULL;
     schema->num_versions = 0;
 }
+
+size_t ute_sizeof(const struct ute_field *field)
+{
+    return field ? field->size : 0;
+}
+
+size_t ute_alignof(const struct ute_field *field)
+{
+    return field ? field->align : 0;
+}
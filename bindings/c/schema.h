@@ -5,6 +5,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "dict.h"
 
 // Forward declare YAML types for header
 typedef struct yaml_document_s yaml_document_t;
@@ -17,6 +18,40 @@ typedef struct yaml_node_s yaml_node_t;
 #define UTE_TYPE_STRING 3
 #define UTE_TYPE_LIST 4
 #define UTE_TYPE_STRUCT 5
+#define UTE_TYPE_FLOAT32 6 // C: float
+#define UTE_TYPE_FLOAT64 7 // C: double
+#define UTE_TYPE_FIXED32 8 // C: uint32_t
+#define UTE_TYPE_FIXED64 9 // C: uint64_t
+#define UTE_TYPE_BYTES 10  // C: struct ute_bytes
+#define UTE_TYPE_SINT 11   // C: int64_t, zigzag-encoded
+
+// Value storage within a C struct
+#define UTE_STORAGE_INLINE 0  // value is embedded (strings: char[capacity], bytes: capacity data bytes)
+#define UTE_STORAGE_POINTER 1 // slot holds a pointer to the value (always used for lists)
+
+// Repeated-value encoding of a string field (see RFC section 4.1)
+#define UTE_DICT_NONE 0    // every value is written in full
+#define UTE_DICT_MESSAGE 1 // repeated values refer back to an earlier occurrence in the message
+#define UTE_DICT_SHARED 2  // values of the version's dictionary are written as their id, others as with UTE_DICT_MESSAGE
+
+// Element encoding of a list of int or sint (see RFC section 4.1)
+#define UTE_ENCODING_PLAIN 0          // every element as it is
+#define UTE_ENCODING_DELTA 1          // each element as its difference from the previous one
+#define UTE_ENCODING_DELTA_OF_DELTA 2 // each difference as its difference from the previous one
+
+// Inline capacity of strings that do not declare one (matches char name[32])
+#define UTE_DEFAULT_STRING_CAPACITY 32
+// Inline capacity of bytes that do not declare one (matches uint8_t data[32])
+#define UTE_DEFAULT_BYTES_CAPACITY 32
+
+// C layout of a bytes value: the length, then the data. Inline values hold
+// capacity data bytes (declare them as struct { size_t len; uint8_t data[N]; }),
+// values behind a pointer as many as they need.
+struct ute_bytes
+{
+    size_t len;
+    uint8_t data[];
+};
 
 // Field definition
 struct ute_field
@@ -26,7 +61,17 @@ struct ute_field
     const struct ute_field *elem;   // for lists
     const struct ute_field *fields; // for structs
     size_t num_fields;
-    size_t offset; // offset within struct (for struct fields)
+    size_t offset;   // offset within struct (for struct fields)
+    size_t size;     // sizeof the value slot in C memory
+    size_t align;    // alignof the value slot in C memory
+    size_t capacity; // strings: buffer size including NUL, bytes: data size (0 = unbounded)
+    int storage;     // UTE_STORAGE_*
+    int packed;      // lists of ints: elements are encoded as bare varints
+    int encoding;    // lists of ints: UTE_ENCODING_* (other than plain implies packed)
+    int columnar;    // lists of structs: members are encoded column by column
+    int sparse;      // structs: members with their default value may be omitted
+    size_t chunk;    // lists: elements per chunk of a chunked list (0 = not chunked)
+    int dict;        // strings: UTE_DICT_*
 };
 
 // Schema version definition
@@ -35,6 +80,7 @@ struct ute_schema_version
     int version;
     const struct ute_field *fields;
     size_t num_fields;
+    struct ute_dictionary dictionary; // shared string dictionary (empty if the version has none)
 };
 
 // Schema definition (multi-version)
@@ -55,6 +101,10 @@ extern "C"
     int ParseSchema(const char *filename, struct ute_schema *out_schema);
     // Free all memory allocated for a ute_schema (recursively)
     void FreeSchema(struct ute_schema *schema);
+    // Size in bytes of a field's value slot (for structs: sizeof the laid-out struct)
+    size_t ute_sizeof(const struct ute_field *field);
+    // Alignment in bytes of a field's value slot
+    size_t ute_alignof(const struct ute_field *field);
 
 #ifdef __cplusplus
 }
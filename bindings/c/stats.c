@@ -0,0 +1,227 @@
+#include "stats.h"
+#include "plan.h"
+#include "schema.h"
+#include <stdlib.h>
+#include <string.h>
+
+// =========================================================
+// Instrumentation counters (updated by codex.c in UTE_STATS builds)
+// =========================================================
+
+// Maximum length of a field path; longer paths are cut
+#define UTE_STATS_PATH_MAX 256
+
+int ute_stats_enabled(void)
+{
+#ifdef UTE_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// Name the instruction of field (at *pc) after its path, then its subtree,
+// in the instruction order of the plan compiler (see emit_field in plan.c).
+// path holds len bytes of the field's own path. Without stats->names only
+// the bytes the names need are added to *used.
+static int name_field(struct ute_stats *stats, const struct ute_field *field, char *path, size_t len, size_t *pc, size_t *used)
+{
+    if (*pc >= stats->num_fields)
+        return -1;
+    if (stats->names)
+    {
+        memcpy(stats->names + *used, path, len);
+        stats->names[*used + len] = 0;
+        stats->fields[*pc].name = stats->names + *used;
+    }
+    *used += len + 1;
+    (*pc)++;
+    if (field->type == UTE_TYPE_LIST)
+    {
+        // The element, then LIST_END
+        size_t sub = len + 2 < UTE_STATS_PATH_MAX ? len + 2 : len;
+        memcpy(path + len, "[]", sub - len);
+        if (!field->elem || name_field(stats, field->elem, path, sub, pc, used) != 0)
+            return -1;
+        (*pc)++;
+    }
+    else if (field->type == UTE_TYPE_STRUCT)
+    {
+        // Each member (behind a MEMBER instruction in sparse structs), then STRUCT_END
+        for (size_t i = 0; i < field->num_fields; ++i)
+        {
+            const char *name = field->fields[i].name ? field->fields[i].name : "?";
+            size_t sub = len;
+            if (sub < UTE_STATS_PATH_MAX - 1)
+                path[sub++] = '.';
+            for (size_t k = 0; name[k] && sub < UTE_STATS_PATH_MAX - 1; ++k)
+                path[sub++] = name[k];
+            if (field->sparse)
+                (*pc)++;
+            if (name_field(stats, &field->fields[i], path, sub, pc, used) != 0)
+                return -1;
+        }
+        (*pc)++;
+    }
+    return 0;
+}
+
+// Name all instructions of a plan after the fields of version
+static int name_fields(struct ute_stats *stats, const struct ute_schema_version *version, size_t *used)
+{
+    char path[UTE_STATS_PATH_MAX];
+    size_t pc = 0;
+    for (size_t i = 0; i < version->num_fields; ++i)
+    {
+        const char *name = version->fields[i].name ? version->fields[i].name : "?";
+        size_t len = strlen(name) < UTE_STATS_PATH_MAX - 1 ? strlen(name) : UTE_STATS_PATH_MAX - 1;
+        memcpy(path, name, len);
+        if (name_field(stats, &version->fields[i], path, len, &pc, used) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int ute_stats_init(struct ute_stats *stats, const struct ute_plan *plan, const struct ute_schema_version *version, int flags)
+{
+    if (!stats || !plan || !plan->insns)
+        return -1;
+    memset(stats, 0, sizeof(*stats));
+    stats->num_fields = plan->num_insns;
+    stats->flags = flags;
+    stats->fields = calloc(plan->num_insns ? plan->num_insns : 1, sizeof(struct ute_field_stats));
+    if (!stats->fields)
+        return -1;
+    if (version)
+    {
+        // One pass to size the names, one to store them
+        size_t used = 0;
+        if (name_fields(stats, version, &used) == 0 && (stats->names = malloc(used ? used : 1)) != NULL)
+        {
+            used = 0;
+            if (name_fields(stats, version, &used) == 0)
+                return 0;
+        }
+        ute_stats_free(stats);
+        return -1;
+    }
+    return 0;
+}
+
+void ute_stats_attach(struct ute_plan *plan, struct ute_stats *stats)
+{
+    if (plan)
+        plan->stats = stats;
+}
+
+// Read a counter that other threads may be adding to
+static inline uint64_t load(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void load_call(const struct ute_call_stats *src, struct ute_call_stats *dst)
+{
+    dst->calls = load(&src->calls);
+    dst->errors = load(&src->errors);
+    dst->bytes = load(&src->bytes);
+    dst->cycles = load(&src->cycles);
+}
+
+void ute_stats_snapshot(const struct ute_stats *stats, struct ute_field_stats *out_fields, struct ute_call_stats *out_encode, struct ute_call_stats *out_decode)
+{
+    if (!stats)
+        return;
+    for (size_t i = 0; out_fields && i < stats->num_fields; ++i)
+    {
+        const struct ute_field_stats *src = &stats->fields[i];
+        struct ute_field_stats *dst = &out_fields[i];
+        dst->name = src->name;
+        dst->encoded = load(&src->encoded);
+        dst->decoded = load(&src->decoded);
+        dst->bytes_written = load(&src->bytes_written);
+        dst->bytes_read = load(&src->bytes_read);
+        for (int e = 0; e < UTE_NUM_ERRORS; ++e)
+            dst->errors[e] = load(&src->errors[e]);
+    }
+    if (out_encode)
+        load_call(&stats->encode, out_encode);
+    if (out_decode)
+        load_call(&stats->decode, out_decode);
+}
+
+void ute_stats_reset(struct ute_stats *stats)
+{
+    if (!stats)
+        return;
+    for (size_t i = 0; i < stats->num_fields; ++i)
+    {
+        struct ute_field_stats *f = &stats->fields[i];
+        __atomic_store_n(&f->encoded, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&f->decoded, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&f->bytes_written, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&f->bytes_read, 0, __ATOMIC_RELAXED);
+        for (int e = 0; e < UTE_NUM_ERRORS; ++e)
+            __atomic_store_n(&f->errors[e], 0, __ATOMIC_RELAXED);
+    }
+    struct ute_call_stats *calls[2] = {&stats->encode, &stats->decode};
+    for (int d = 0; d < 2; ++d)
+    {
+        __atomic_store_n(&calls[d]->calls, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&calls[d]->errors, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&calls[d]->bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&calls[d]->cycles, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void ute_stats_print(const struct ute_stats *stats, FILE *out)
+{
+    static const char *const causes[UTE_NUM_ERRORS] = {"other", "space", "type", "varint"};
+    if (!stats || !out)
+        return;
+    struct ute_field_stats *fields = calloc(stats->num_fields ? stats->num_fields : 1, sizeof(*fields));
+    struct ute_call_stats calls[2];
+    if (!fields)
+        return;
+    ute_stats_snapshot(stats, fields, &calls[0], &calls[1]);
+    for (int d = 0; d < 2; ++d)
+    {
+        fprintf(out, "%s: %llu calls, %llu errors, %llu bytes", d ? "decode" : "encode", (unsigned long long)calls[d].calls,
+                (unsigned long long)calls[d].errors, (unsigned long long)calls[d].bytes);
+        if ((stats->flags & UTE_STATS_TIMING) && calls[d].calls)
+            fprintf(out, ", %.0f cycles/call", (double)calls[d].cycles / (double)calls[d].calls);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "%-32s %12s %14s %12s %14s  %s\n", "field", "encoded", "bytes_written", "decoded", "bytes_read", "errors");
+    for (size_t i = 0; i < stats->num_fields; ++i)
+    {
+        const struct ute_field_stats *f = &fields[i];
+        uint64_t errors = 0;
+        for (int e = 0; e < UTE_NUM_ERRORS; ++e)
+            errors += f->errors[e];
+        if (!f->encoded && !f->decoded && !errors)
+            continue;
+        char pc[24];
+        snprintf(pc, sizeof(pc), "#%zu", i);
+        fprintf(out, "%-32s %12llu %14llu %12llu %14llu ", f->name ? f->name : pc, (unsigned long long)f->encoded, (unsigned long long)f->bytes_written,
+                (unsigned long long)f->decoded, (unsigned long long)f->bytes_read);
+        for (int e = 0; e < UTE_NUM_ERRORS; ++e)
+        {
+            if (f->errors[e])
+                fprintf(out, " %s=%llu", causes[e], (unsigned long long)f->errors[e]);
+        }
+        fprintf(out, "\n");
+    }
+    free(fields);
+}
+
+void ute_stats_free(struct ute_stats *stats)
+{
+    if (!stats)
+        return;
+    free(stats->fields);
+    free(stats->names);
+    stats->fields = NULL;
+    stats->names = NULL;
+    stats->num_fields = 0;
+}
@@ -0,0 +1,106 @@
+#ifndef UTE_STATS_H
+#define UTE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct ute_plan;
+struct ute_schema_version;
+
+// Instrumentation of the codex. The hooks are compiled in only with
+// -DUTE_STATS (make stats); other builds keep this API, but counters stay
+// zero and the tracer is never called.
+
+// Causes of failed calls, counted at the field where the call stopped
+#define UTE_ERROR_OTHER 0  // lengths, counts, indices, capacities, missing values or storage
+#define UTE_ERROR_SPACE 1  // output buffer too small, or input truncated
+#define UTE_ERROR_TYPE 2   // type prefix or flags do not match the schema
+#define UTE_ERROR_VARINT 3 // malformed or truncated varint
+#define UTE_NUM_ERRORS 4
+
+// ute_stats_init flag: also time every top-level call
+#define UTE_STATS_TIMING 0x01
+
+// Kinds of tracer spans
+#define UTE_TRACE_ENCODE 0
+#define UTE_TRACE_DECODE 1
+
+// Counters of one plan instruction: a schema field or the element of a list.
+// Elements of packed, columnar and fixed lists are counted at the list. Values
+// written or read by a call before it failed stay counted.
+struct ute_field_stats
+{
+    const char *name;               // path of the field, e.g. "devices[].name" (NULL without a schema)
+    uint64_t encoded;               // values encoded
+    uint64_t decoded;               // values decoded
+    uint64_t bytes_written;         // encoded size of those values (lists and structs include their contents)
+    uint64_t bytes_read;            // likewise for decoded values
+    uint64_t errors[UTE_NUM_ERRORS]; // failed calls that stopped at this field, by cause
+};
+
+// Counters of the top-level calls in one direction. Sizing passes
+// (ute_serialized_size*, the first pass of a writer encode) are not counted.
+struct ute_call_stats
+{
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t bytes;  // bytes written or read by successful calls
+    uint64_t cycles; // with UTE_STATS_TIMING: time spent in all calls (TSC cycles on x86, ns elsewhere)
+};
+
+// Counters of one plan (attach with ute_stats_attach). The codex updates them
+// with atomic adds, so several threads may use the plan at once, and
+// ute_stats_snapshot may read them from any thread.
+struct ute_stats
+{
+    struct ute_field_stats *fields; // one per plan instruction
+    size_t num_fields;
+    struct ute_call_stats encode;
+    struct ute_call_stats decode;
+    int flags;   // UTE_STATS_*
+    char *names; // storage of the field names
+};
+
+// User tracer: begin() and end() wrap every top-level encode or decode of a
+// plan (kind: UTE_TRACE_*); end() receives the call's result
+struct ute_tracer
+{
+    void (*begin)(void *ctx, int kind, const struct ute_plan *plan);
+    void (*end)(void *ctx, int kind, const struct ute_plan *plan, size_t result);
+    void *ctx;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // 1 if the codex was built with UTE_STATS, 0 otherwise
+    int ute_stats_enabled(void);
+    // Allocate zeroed counters for the instructions of plan. With version (the
+    // schema the plan was compiled from) the fields are named by their path.
+    // Returns 0 on success, -1 on error.
+    int ute_stats_init(struct ute_stats *stats, const struct ute_plan *plan, const struct ute_schema_version *version, int flags);
+    // Make the codex count the calls of plan in stats (NULL detaches). Attach
+    // before the plan is shared between threads.
+    void ute_stats_attach(struct ute_plan *plan, struct ute_stats *stats);
+    // Copy the counters (each read atomically) into out_fields (num_fields
+    // entries) and the call counters; either may be NULL
+    void ute_stats_snapshot(const struct ute_stats *stats, struct ute_field_stats *out_fields, struct ute_call_stats *out_encode, struct ute_call_stats *out_decode);
+    // Zero all counters
+    void ute_stats_reset(struct ute_stats *stats);
+    // Print a snapshot: the call counters, then every field that was used
+    void ute_stats_print(const struct ute_stats *stats, FILE *out);
+    // Free the counters (detach them from their plan first)
+    void ute_stats_free(struct ute_stats *stats);
+
+    // Install a tracer for all plans (NULL removes it). The tracer must stay
+    // valid while installed.
+    void ute_set_tracer(const struct ute_tracer *tracer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_STATS_H
@@ -0,0 +1,887 @@
+// Behaviour tests of the C binding on test/rich.yaml, one test_* function per
+// codex feature. Prints every failed check and exits with 1 if there was one.
+
+#include "../arena.h"
+#include "../codex.h"
+#include "../compress.h"
+#include "../decoder.h"
+#include "../image.h"
+#include "../log.h"
+#include "../plan.h"
+#include "../pool.h"
+#include "../schema.h"
+#include "../view.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures;
+
+#define CHECK(cond)                                                                      \
+    do                                                                                   \
+    {                                                                                    \
+        if (!(cond))                                                                     \
+        {                                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);     \
+            failures++;                                                                  \
+        }                                                                                \
+    } while (0)
+
+// Top-level fields of rich.yaml
+enum
+{
+    FIELD_ID,
+    FIELD_OFFSET,
+    FIELD_RATIO,
+    FIELD_BLOB,
+    FIELD_SAMPLES,
+    FIELD_EVENTS,
+    FIELD_DEVICES,
+    FIELD_TAGS,
+    FIELD_SETTINGS,
+    NUM_FIELDS
+};
+
+// The streaming decoder supports the fields before devices
+#define NUM_STREAM_FIELDS FIELD_DEVICES
+
+// C layout of the structs of rich.yaml
+struct blob
+{
+    size_t len;
+    uint8_t data[32];
+};
+
+struct event
+{
+    uint64_t ts;
+    char name[32];
+};
+
+struct device
+{
+    uint64_t id;
+    uint8_t online;
+    char name[32];
+};
+
+struct settings
+{
+    uint64_t timeout;
+    char label[32];
+    uint8_t enabled;
+};
+
+// A message of rich.yaml with n elements in every list
+struct message
+{
+    uint64_t id;
+    int64_t offset;
+    double ratio;
+    struct blob blob;
+    uint64_t *samples;
+    struct event *events;
+    struct device *devices;
+    char (*tags)[32];
+    struct settings settings;
+    void **lists[4]; // samples, events, devices, tags as [count, ptr, ...]
+    void *top[NUM_FIELDS];
+};
+
+// Point the [count, ptr, ...] array of a list at n elements of size bytes
+static void **make_list(void *elems, size_t n, size_t size)
+{
+    void **list = malloc((1 + n) * sizeof(void *));
+    list[0] = (void *)(uintptr_t)n;
+    for (size_t i = 0; i < n; ++i)
+        list[1 + i] = (uint8_t *)elems + i * size;
+    return list;
+}
+
+// Fill m with n elements in every list and tag in every tag; with tag NULL,
+// only allocate the storage and leave every value zero
+static void message_init(struct message *m, size_t n, const char *tag)
+{
+    memset(m, 0, sizeof(*m));
+    m->samples = calloc(n + 1, sizeof(uint64_t));
+    m->events = calloc(n + 1, sizeof(struct event));
+    m->devices = calloc(n + 1, sizeof(struct device));
+    m->tags = calloc(n + 1, sizeof(*m->tags));
+    m->lists[0] = make_list(m->samples, n, sizeof(uint64_t));
+    m->lists[1] = make_list(m->events, n, sizeof(struct event));
+    m->lists[2] = make_list(m->devices, n, sizeof(struct device));
+    m->lists[3] = make_list(m->tags, n, sizeof(*m->tags));
+    m->top[FIELD_ID] = &m->id;
+    m->top[FIELD_OFFSET] = &m->offset;
+    m->top[FIELD_RATIO] = &m->ratio;
+    m->top[FIELD_BLOB] = &m->blob;
+    m->top[FIELD_SAMPLES] = m->lists[0];
+    m->top[FIELD_EVENTS] = m->lists[1];
+    m->top[FIELD_DEVICES] = m->lists[2];
+    m->top[FIELD_TAGS] = m->lists[3];
+    m->top[FIELD_SETTINGS] = &m->settings;
+    if (!tag)
+        return;
+
+    m->id = 123456789;
+    m->offset = -4200;
+    m->ratio = 0.75;
+    m->blob.len = 5;
+    memcpy(m->blob.data, "\x00\x01\x02\xfe\xff", 5);
+    for (size_t i = 0; i < n; ++i)
+    {
+        m->samples[i] = 1700000000 + i * 15;
+        m->events[i].ts = 1000 + i;
+        snprintf(m->events[i].name, sizeof(m->events[i].name), "event-%zu", i % 17);
+        m->devices[i].id = i;
+        m->devices[i].online = i % 3 == 0;
+        snprintf(m->devices[i].name, sizeof(m->devices[i].name), "device-%zu", i);
+        snprintf(m->tags[i], sizeof(m->tags[i]), "%s", tag);
+    }
+    m->settings.timeout = 30; // label and enabled keep their defaults
+}
+
+static void message_free(struct message *m)
+{
+    for (size_t i = 0; i < 4; ++i)
+        free(m->lists[i]);
+    free(m->samples);
+    free(m->events);
+    free(m->devices);
+    free(m->tags);
+}
+
+// Encode data with a plan into a new buffer (NULL on failure)
+static uint8_t *encode(const void *data, const struct ute_plan *plan, size_t *out_len)
+{
+    size_t size = ute_serialized_size_plan(data, plan);
+    if (size == UTE_BUF_ERROR)
+        return NULL;
+    uint8_t *buf = malloc(size ? size : 1);
+    *out_len = ute_serialize_plan(data, plan, buf, size);
+    if (*out_len != size)
+    {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// Check that decoded data encodes to exactly buf again
+static void check_reencodes(const void *data, const struct ute_plan *plan, const uint8_t *buf, size_t len)
+{
+    size_t len2 = 0;
+    uint8_t *buf2 = encode(data, plan, &len2);
+    CHECK(buf2 && len2 == len && memcmp(buf2, buf, len) == 0);
+    free(buf2);
+}
+
+// A message decodes into caller-provided storage and encodes to the same
+// bytes again; the sizing pass is exact, so every shorter buffer fails, and
+// the schema forms cover every field like the plan
+static void test_roundtrip(const struct ute_schema_version *version, const struct ute_plan *plan)
+{
+    struct message m, back;
+    message_init(&m, 10, "online");
+    message_init(&back, 10, NULL);
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    CHECK(buf != NULL);
+    if (!buf)
+    {
+        message_free(&m);
+        message_free(&back);
+        return;
+    }
+
+    CHECK(ute_deserialize_plan(buf, len, plan, back.top) == len);
+    CHECK(back.id == m.id);
+    CHECK(back.offset == m.offset);
+    CHECK(back.ratio == m.ratio);
+    CHECK(back.blob.len == m.blob.len && memcmp(back.blob.data, m.blob.data, back.blob.len) == 0);
+    CHECK(back.samples[9] == m.samples[9]);
+    CHECK(back.events[7].ts == m.events[7].ts && strcmp(back.events[7].name, "event-7") == 0);
+    CHECK(back.devices[3].online == 1 && strcmp(back.devices[3].name, "device-3") == 0);
+    CHECK(strcmp(back.tags[3], "online") == 0);
+    CHECK(back.settings.timeout == 30 && back.settings.label[0] == 0 && back.settings.enabled == 0);
+    check_reencodes(back.top, plan, buf, len);
+
+    for (size_t cut = 0; cut < len; ++cut)
+        CHECK(ute_serialize_plan(m.top, plan, buf, cut) == UTE_BUF_ERROR);
+    CHECK(ute_serialize_plan(m.top, plan, buf, len) == len);
+
+    struct ute_buffer out = {0};
+    struct ute_writer writer = ute_buffer_writer(&out);
+    CHECK(ute_serialized_size(m.top, version) == len);
+    CHECK(ute_serialize_writer(m.top, version, &writer) == len && out.len == len && memcmp(out.data, buf, len) == 0);
+    ute_buffer_free(&out);
+    free(buf);
+    message_free(&back);
+    message_free(&m);
+}
+
+// Decoding into an arena allocates the storage, and reuses it after a reset
+static void test_arena(const struct ute_schema_version *version, const struct ute_plan *plan)
+{
+    struct message m;
+    message_init(&m, 10, "online");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    CHECK(buf != NULL);
+
+    struct ute_arena arena = {0};
+    void *out[NUM_FIELDS] = {0};
+    CHECK(ute_deserialize_arena_plan(buf, len, plan, &arena, out) == len);
+    CHECK(*(uint64_t *)out[FIELD_ID] == m.id);
+    CHECK(*(int64_t *)out[FIELD_OFFSET] == m.offset);
+    CHECK(*(double *)out[FIELD_RATIO] == m.ratio);
+    const struct blob *blob = out[FIELD_BLOB];
+    CHECK(blob->len == m.blob.len && memcmp(blob->data, m.blob.data, blob->len) == 0);
+    void **samples = out[FIELD_SAMPLES];
+    CHECK((uintptr_t)samples[0] == 10 && *(uint64_t *)samples[10] == m.samples[9]);
+    void **events = out[FIELD_EVENTS];
+    CHECK(strcmp(((struct event *)events[1 + 7])->name, "event-7") == 0);
+    void **tags = out[FIELD_TAGS];
+    CHECK(strcmp((const char *)tags[1 + 3], "online") == 0);
+    const struct settings *settings = out[FIELD_SETTINGS];
+    CHECK(settings->timeout == 30 && settings->label[0] == 0 && settings->enabled == 0);
+    check_reencodes(out, plan, buf, len);
+
+    ute_arena_reset(&arena);
+    void *again[NUM_FIELDS] = {0};
+    CHECK(ute_deserialize_arena_plan(buf, len, plan, &arena, again) == len);
+    CHECK(again[FIELD_ID] == out[FIELD_ID]);
+
+    // The schema form decodes every field like the plan
+    ute_arena_reset(&arena);
+    void *schema_out[NUM_FIELDS] = {0};
+    CHECK(ute_deserialize_arena(buf, len, version, &arena, schema_out) == len);
+    CHECK(schema_out[FIELD_SETTINGS] && ((struct settings *)schema_out[FIELD_SETTINGS])->timeout == 30);
+    check_reencodes(schema_out, plan, buf, len);
+    ute_arena_free(&arena);
+    free(buf);
+    message_free(&m);
+}
+
+// Scatter-gather output joins to the bytes of the contiguous encoding,
+// with the longer strings referenced in place
+static void test_iov(const struct ute_schema_version *version, const struct ute_plan *plan)
+{
+    struct message m;
+    message_init(&m, 10, "online");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    struct ute_iov out = {0};
+    out.threshold = 8;
+    CHECK(ute_serialize_iov(m.top, version, &out) == len);
+    out.iov = malloc(out.iov_count * sizeof(struct iovec));
+    out.iov_cap = out.iov_count;
+    out.scratch = malloc(out.scratch_len);
+    out.scratch_cap = out.scratch_len;
+    CHECK(ute_serialize_iov(m.top, version, &out) == len && out.referenced > 0);
+
+    uint8_t *joined = malloc(len);
+    size_t pos = 0;
+    for (size_t i = 0; i < out.iov_count && pos + out.iov[i].iov_len <= len; ++i)
+    {
+        memcpy(joined + pos, out.iov[i].iov_base, out.iov[i].iov_len);
+        pos += out.iov[i].iov_len;
+    }
+    CHECK(buf && pos == len && memcmp(joined, buf, len) == 0);
+    free(joined);
+    free(out.iov);
+    free(out.scratch);
+    free(buf);
+    message_free(&m);
+}
+
+// Lists of flat structs (events) have their own encode and decode loops:
+// strings of every length up to the slot size survive a round trip, and
+// every buffer shorter than the message fails
+static void test_flat_lists(const struct ute_plan *plan)
+{
+    for (size_t len = 0; len < sizeof(((struct event *)0)->name); ++len)
+    {
+        struct message m;
+        message_init(&m, 10, "online");
+        for (size_t i = 0; i < 10; ++i)
+        {
+            memset(m.events[i].name, 'a' + (int)i, len);
+            m.events[i].name[len] = 0;
+        }
+        size_t size = 0;
+        uint8_t *buf = encode(m.top, plan, &size);
+        CHECK(buf != NULL);
+        if (!buf)
+        {
+            message_free(&m);
+            continue;
+        }
+        for (size_t cut = 0; cut < size; ++cut)
+            CHECK(ute_serialize_plan(m.top, plan, buf, cut) == UTE_BUF_ERROR);
+        CHECK(ute_serialize_plan(m.top, plan, buf, size) == size);
+
+        struct ute_arena arena = {0};
+        void *out[NUM_FIELDS] = {0};
+        CHECK(ute_deserialize_arena_plan(buf, size, plan, &arena, out) == size);
+        void **events = out[FIELD_EVENTS];
+        for (size_t i = 0; events && i < 10; ++i)
+        {
+            const struct event *e = events[1 + i];
+            CHECK(e->ts == m.events[i].ts && strcmp(e->name, m.events[i].name) == 0);
+        }
+        ute_arena_free(&arena);
+        free(buf);
+        message_free(&m);
+    }
+}
+
+// Absent members of a sparse struct keep their defaults; with all members
+// set, the struct is written dense
+static void test_sparse(const struct ute_plan *plan)
+{
+    struct message m;
+    message_init(&m, 10, "online");
+    size_t sparse_len = 0, dense_len = 0;
+    uint8_t *sparse = encode(m.top, plan, &sparse_len);
+    m.settings.enabled = 1;
+    snprintf(m.settings.label, sizeof(m.settings.label), "fast");
+    uint8_t *dense = encode(m.top, plan, &dense_len);
+    CHECK(sparse && dense && sparse_len < dense_len);
+
+    struct ute_arena arena = {0};
+    void *out[NUM_FIELDS] = {0};
+    CHECK(dense && ute_deserialize_arena_plan(dense, dense_len, plan, &arena, out) == dense_len);
+    const struct settings *settings = out[FIELD_SETTINGS];
+    CHECK(settings && settings->enabled == 1 && strcmp(settings->label, "fast") == 0);
+    ute_arena_free(&arena);
+    free(sparse);
+    free(dense);
+    message_free(&m);
+}
+
+// Values of the shared dictionary are written as ids, others in full
+static void test_dict(const struct ute_plan *plan)
+{
+    struct message known, plain;
+    message_init(&known, 10, "online");
+    message_init(&plain, 10, "onlinx");
+    size_t known_len = 0, plain_len = 0;
+    uint8_t *known_buf = encode(known.top, plan, &known_len);
+    uint8_t *plain_buf = encode(plain.top, plan, &plain_len);
+    CHECK(known_buf && plain_buf && plain_len > known_len);
+    free(known_buf);
+    free(plain_buf);
+    message_free(&known);
+    message_free(&plain);
+}
+
+// Repeated tags outside the dictionary are back-references, whose target must
+// be a string of a dict field decoded before them, among the latest 256
+static void test_refs(const struct ute_plan *plan)
+{
+    // The first tag holds the bytes of a plain string "x" ('`' is its prefix)
+    struct message m;
+    message_init(&m, 3, "`\x01x");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    struct ute_arena arena = {0};
+    void *out[NUM_FIELDS] = {0};
+    // ... settings (a2 03 01 40 1e), after the tags: 60 03 60 01 78, 61 05, 61 07
+    CHECK(buf && len > 14 && buf[len - 9] == 0x61 && buf[len - 8] == 0x05);
+    CHECK(ute_validate_plan(buf, len, plan, 0) == len);
+    CHECK(ute_deserialize_arena_plan(buf, len, plan, &arena, out) == len);
+    char(*const *tags)[32] = out[FIELD_TAGS];
+    CHECK(tags && strcmp(*tags[1], "`\x01x") == 0 && strcmp(*tags[3], "`\x01x") == 0);
+    ute_arena_free(&arena);
+    // A reference into the data of the first tag fails
+    memset(out, 0, sizeof(out));
+    buf[len - 8] = 0x03;
+    CHECK(ute_validate_plan(buf, len, plan, 0) == UTE_BUF_ERROR);
+    CHECK(ute_deserialize_arena_plan(buf, len, plan, &arena, out) == UTE_BUF_ERROR);
+    ute_arena_free(&arena);
+    free(buf);
+    message_free(&m);
+
+    // A value 257 strings back is written again rather than referred to
+    message_init(&m, 300, "t");
+    for (size_t i = 0; i < 300; ++i)
+        snprintf(m.tags[i], sizeof(m.tags[i]), "t%zu", i);
+    snprintf(m.tags[299], sizeof(m.tags[299]), "t42");
+    buf = encode(m.top, plan, &len);
+    CHECK(buf && memcmp(buf + len - 10, "\x60\x03t42", 5) == 0);
+    CHECK(ute_validate_plan(buf, len, plan, 0) == len);
+    free(buf);
+    message_free(&m);
+}
+
+// A translation plan that skips a dict field of the writer resolves
+// back-references to its strings
+static void test_translation_refs(void)
+{
+    struct ute_field writer_fields[] = {
+        {.name = "note", .type = UTE_TYPE_STRING, .size = 32, .align = 1, .capacity = 32, .dict = UTE_DICT_MESSAGE},
+        {.name = "label", .type = UTE_TYPE_STRING, .size = 32, .align = 1, .capacity = 32, .dict = UTE_DICT_MESSAGE},
+    };
+    struct ute_schema_version writer = {.version = 1, .fields = writer_fields, .num_fields = 2};
+    struct ute_schema_version reader = {.version = 2, .fields = writer_fields + 1, .num_fields = 1};
+    struct ute_plan writer_plan, translation;
+    CHECK(ute_compile(&writer, &writer_plan) == 0);
+    CHECK(ute_compile_translation(&writer, &reader, &translation) == 0);
+    char note[32] = "repeated value", label[32] = "repeated value";
+    void *in[2] = {note, label};
+    size_t len = 0;
+    uint8_t *buf = encode(in, &writer_plan, &len);
+    // note in full, then label as a back-reference to it
+    CHECK(buf && len == 18 && buf[16] == 0x61 && buf[17] == 16);
+    char decoded[32] = "";
+    void *out[1] = {decoded};
+    CHECK(ute_deserialize_plan(buf, len, &translation, out) == len && strcmp(decoded, label) == 0);
+    CHECK(ute_validate_plan(buf, len, &translation, 0) == len);
+    free(buf);
+    ute_plan_free(&translation);
+    ute_plan_free(&writer_plan);
+}
+
+static void test_validate(const struct ute_schema_version *version, const struct ute_plan *plan)
+{
+    struct message m;
+    message_init(&m, 10, "acme");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    CHECK(ute_validate_plan(buf, len, plan, UTE_VALIDATE_UTF8) == len);
+    // Validation returns the size of the message, whatever follows it
+    uint8_t *longer = malloc(len + 1);
+    memcpy(longer, buf, len);
+    longer[len] = 0;
+    CHECK(ute_validate_plan(longer, len + 1, plan, 0) == len);
+    free(longer);
+    for (size_t cut = 0; cut < len; ++cut)
+        CHECK(ute_validate_plan(buf, cut, plan, 0) == UTE_BUF_ERROR);
+    // Wrong type prefix of the first field
+    buf[0] = 0x20;
+    CHECK(ute_validate_plan(buf, len, plan, 0) == UTE_BUF_ERROR);
+    free(buf);
+
+    // Strings must be UTF-8 only when asked to
+    snprintf(m.events[2].name, sizeof(m.events[2].name), "bad\xff");
+    buf = encode(m.top, plan, &len);
+    CHECK(ute_validate_plan(buf, len, plan, 0) == len);
+    CHECK(ute_validate_plan(buf, len, plan, UTE_VALIDATE_UTF8) == UTE_BUF_ERROR);
+    free(buf);
+
+    // Varints hold at most 64 bits in at most 10 bytes: the id is written
+    // as 0x40 and a 10-byte varint ending in 0x01
+    m.id = UINT64_MAX;
+    buf = encode(m.top, plan, &len);
+    CHECK(buf && len > 11 && buf[10] == 0x01);
+    CHECK(ute_validate(buf, len, version, 0) == len);
+    buf[10] = 0x02;
+    CHECK(ute_validate(buf, len, version, 0) == UTE_BUF_ERROR);
+    buf[10] = 0x01;
+    uint8_t *overlong = malloc(len + 1);
+    overlong[0] = 0x40;
+    memset(overlong + 1, 0x80, 10);
+    overlong[11] = 0x00;
+    memcpy(overlong + 12, buf + 11, len - 11);
+    CHECK(ute_validate(overlong, len + 1, version, 0) == UTE_BUF_ERROR);
+    free(overlong);
+
+    // The schema form checks every field, not only the first
+    buf[11] = 0x20;
+    CHECK(ute_validate(buf, len, version, 0) == UTE_BUF_ERROR);
+    free(buf);
+    message_free(&m);
+}
+
+// Events of the streaming decoder, folded into a hash. String data is hashed
+// byte by byte, so the way a string is split into fragments does not matter.
+struct trace
+{
+    uint64_t hash;
+    size_t events;
+};
+
+static void mix(uint64_t *hash, uint64_t v)
+{
+    *hash = (*hash ^ v) * 0x100000001b3ULL;
+}
+
+static int on_event(void *user, const struct ute_event *ev)
+{
+    struct trace *t = user;
+    if (ev->type == UTE_EVENT_STRING_DATA)
+    {
+        for (size_t i = 0; i < ev->len; ++i)
+            mix(&t->hash, ev->data[i]);
+        return 0;
+    }
+    mix(&t->hash, (uint64_t)ev->type);
+    mix(&t->hash, ev->pc);
+    mix(&t->hash, ev->index);
+    mix(&t->hash, ev->value);
+    t->events++;
+    return 0;
+}
+
+// Feed buf to a new decoder byte by byte, or in chunks of random sizes from
+// 1 to 16 bytes with rng; returns the last result
+static int feed_split(const struct ute_plan *plan, const uint8_t *buf, size_t len, uint64_t *rng, struct trace *t)
+{
+    struct ute_decoder dec;
+    *t = (struct trace){0xcbf29ce484222325ULL, 0};
+    if (ute_decoder_init(&dec, plan, on_event, t) != 0)
+        return UTE_DECODER_ERROR;
+    int rc = UTE_DECODER_MORE;
+    size_t pos = 0, used = 0;
+    while (rc == UTE_DECODER_MORE && pos < len)
+    {
+        size_t n = 1;
+        if (rng)
+        {
+            *rng = *rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            n = 1 + (size_t)(*rng >> 33) % 16;
+        }
+        if (n > len - pos)
+            n = len - pos;
+        rc = ute_decoder_feed(&dec, buf + pos, n, &used);
+        pos += n;
+    }
+    // The message must end with the input
+    return rc == UTE_DECODER_DONE && pos != len ? UTE_DECODER_ERROR : rc;
+}
+
+static void test_decoder(const struct ute_plan *plan, const struct ute_plan *stream_plan)
+{
+    struct ute_decoder dec;
+    struct trace whole;
+    CHECK(ute_decoder_init(&dec, plan, on_event, &whole) != 0); // fields the decoder does not stream
+
+    struct message m;
+    message_init(&m, 10, "acme");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, stream_plan, &len);
+    whole = (struct trace){0xcbf29ce484222325ULL, 0};
+    size_t used = 0;
+    CHECK(ute_decoder_init(&dec, stream_plan, on_event, &whole) == 0);
+    CHECK(ute_decoder_feed(&dec, buf, len, &used) == UTE_DECODER_DONE && used == len);
+    CHECK(whole.events > 4 * 10);
+
+    struct trace t;
+    CHECK(feed_split(stream_plan, buf, len, NULL, &t) == UTE_DECODER_DONE);
+    CHECK(t.hash == whole.hash && t.events == whole.events);
+    uint64_t rng = 1;
+    for (int round = 0; round < 50; ++round)
+    {
+        CHECK(feed_split(stream_plan, buf, len, &rng, &t) == UTE_DECODER_DONE);
+        CHECK(t.hash == whole.hash && t.events == whole.events);
+    }
+
+    // A truncated message wants more, a corrupt one fails
+    CHECK(ute_decoder_init(&dec, stream_plan, on_event, &t) == 0);
+    CHECK(ute_decoder_feed(&dec, buf, len - 1, &used) == UTE_DECODER_MORE);
+    buf[0] = 0xff;
+    ute_decoder_reset(&dec);
+    CHECK(ute_decoder_feed(&dec, buf, len, &used) == UTE_DECODER_ERROR);
+    free(buf);
+    message_free(&m);
+}
+
+static void test_view(const struct ute_plan *plan)
+{
+    struct message m;
+    message_init(&m, 10, "online");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    struct ute_view msg, v, elem;
+    size_t count = 0;
+    CHECK(ute_view_init(&msg, buf, len, plan) == 0);
+    CHECK(ute_view_count(&msg, &count) == 0 && count == NUM_FIELDS);
+
+    uint64_t u = 0;
+    int64_t s = 0;
+    double d = 0;
+    struct ute_slice slice;
+    CHECK(ute_view_field(&msg, FIELD_ID, &v) == 0 && ute_view_int(&v, &u) == 0 && u == m.id);
+    CHECK(ute_view_next(&v) == 0 && ute_view_sint(&v, &s) == 0 && s == m.offset);
+    CHECK(ute_view_next(&v) == 0 && ute_view_float64(&v, &d) == 0 && d == m.ratio);
+    CHECK(ute_view_next(&v) == 0 && ute_view_bytes(&v, &slice) == 0 && slice.len == m.blob.len && memcmp(slice.data, m.blob.data, slice.len) == 0);
+
+    // Elements of a chunked list, reached by the chunk table
+    CHECK(ute_view_field(&msg, FIELD_EVENTS, &v) == 0 && ute_view_count(&v, &count) == 0 && count == 10);
+    struct ute_view name;
+    CHECK(ute_view_elem(&v, 9, &elem) == 0 && ute_view_field(&elem, 1, &name) == 0);
+    CHECK(ute_view_string(&name, &slice) == 0 && slice.len == 7 && memcmp(slice.data, "event-9", 7) == 0);
+
+    // Columns of a columnar list
+    struct ute_column col;
+    uint64_t ids[10];
+    uint8_t online[10];
+    struct ute_slice names[10];
+    CHECK(ute_view_field(&msg, FIELD_DEVICES, &v) == 0);
+    CHECK(ute_view_column(&v, 0, &col) == 0 && col.count == 10 && ute_column_ints(&col, ids) == 0 && ids[4] == 4);
+    CHECK(ute_view_column(&v, 1, &col) == 0 && ute_column_bools(&col, online) == 0 && online[3] == 1 && online[4] == 0);
+    CHECK(ute_view_column(&v, 2, &col) == 0 && ute_column_strings(&col, names) == 0 && names[8].len == 8 && memcmp(names[8].data, "device-8", 8) == 0);
+    CHECK(ute_view_elem(&v, 0, &elem) != 0);
+
+    // A dictionary id resolves to the dictionary value
+    CHECK(ute_view_field(&msg, FIELD_TAGS, &v) == 0 && ute_view_elem(&v, 2, &elem) == 0);
+    CHECK(ute_view_string(&elem, &slice) == 0 && slice.len == 6 && memcmp(slice.data, "online", 6) == 0);
+
+    // Absent members of a sparse struct have no view
+    CHECK(ute_view_field(&msg, FIELD_SETTINGS, &v) == 0);
+    CHECK(ute_view_field(&v, 0, &elem) == 0 && ute_view_int(&elem, &u) == 0 && u == 30);
+    CHECK(ute_view_field(&v, 1, &elem) != 0);
+
+    // The raw encoding of a node is the bytes it was written as (id: prefix and 4-byte varint)
+    CHECK(ute_view_field(&msg, FIELD_ID, &v) == 0 && ute_view_raw(&v, &slice) == 0 && slice.data == buf && slice.len == 5);
+    // Fields past the end of a truncated buffer cannot be reached
+    CHECK(ute_view_init(&msg, buf, 8, plan) == 0 && ute_view_field(&msg, FIELD_SETTINGS, &v) != 0);
+    free(buf);
+    message_free(&m);
+}
+
+static void test_log(const struct ute_plan *plan, const char *path)
+{
+    enum
+    {
+        NUM_RECORDS = 40
+    };
+    uint8_t *msgs[NUM_RECORDS];
+    size_t lens[NUM_RECORDS];
+    struct ute_log_writer w;
+    CHECK(ute_log_create(&w, path, ute_plan_fingerprint(plan), 1, 8) == 0);
+    for (size_t i = 0; i < NUM_RECORDS; ++i)
+    {
+        // Every fifth record is large enough to be compressed
+        struct message m;
+        message_init(&m, i % 5 == 0 ? 500 : i, "offline");
+        m.id = i;
+        msgs[i] = encode(m.top, plan, &lens[i]);
+        message_free(&m);
+        if (i % 5 == 0)
+            CHECK(ute_log_append_compressed(&w, msgs[i], lens[i], ute_compressor_lz(), UTE_COMPRESS_THRESHOLD) == 0);
+        else
+            CHECK(ute_log_append(&w, msgs[i], lens[i]) == 0);
+    }
+    CHECK(ute_log_close(&w) == 0);
+
+    struct ute_log_reader r;
+    CHECK(ute_log_open(&r, path) == 0);
+    CHECK(r.fingerprint == ute_plan_fingerprint(plan) && r.schema_version == 1 && r.count == NUM_RECORDS);
+    struct ute_slice rec;
+    uint8_t *plain = malloc(lens[0]);
+    for (size_t i = 0; i < NUM_RECORDS; ++i)
+    {
+        CHECK(ute_log_get(&r, i, &rec) == 0);
+        if (i % 5 == 0)
+            CHECK(rec.len < lens[i] && ute_decompressed_size(rec.data, rec.len) == lens[i] &&
+                  ute_decompress(rec.data, rec.len, NULL, plain, lens[i]) == lens[i] && memcmp(plain, msgs[i], lens[i]) == 0);
+        else
+            CHECK(rec.len == lens[i] && memcmp(rec.data, msgs[i], lens[i]) == 0);
+    }
+    CHECK(ute_log_get(&r, NUM_RECORDS, &rec) != 0);
+
+    struct ute_log_iter it;
+    size_t n = 0;
+    CHECK(ute_log_iter_init(&it, &r) == 0);
+    while (ute_log_next(&it, &rec) == 1)
+    {
+        CHECK(n < NUM_RECORDS && (n % 5 == 0 || (rec.len == lens[n] && memcmp(rec.data, msgs[n], lens[n]) == 0)));
+        n++;
+    }
+    CHECK(n == NUM_RECORDS);
+    ute_log_unmap(&r);
+    free(plain);
+    for (size_t i = 0; i < NUM_RECORDS; ++i)
+        free(msgs[i]);
+}
+
+static void test_image(const struct ute_schema *schema, const struct ute_plan *plan, const char *path)
+{
+    size_t size = 0;
+    CHECK(ute_image_build(schema, NULL, 0, &size) == 0 && size > 0);
+    uint8_t *data = aligned_alloc(UTE_IMAGE_ALIGN, (size + UTE_IMAGE_ALIGN - 1) / UTE_IMAGE_ALIGN * UTE_IMAGE_ALIGN);
+    CHECK(ute_image_build(schema, data, size, &size) == 0);
+
+    struct ute_image image;
+    struct ute_plan iplan;
+    CHECK(ute_image_open(&image, data, size) == 0 && image.num_versions == 1);
+    CHECK(ute_image_plan(&image, 1, &iplan) == 0);
+    CHECK(ute_plan_fingerprint(&iplan) == ute_plan_fingerprint(plan));
+    const char *name = ute_image_field_name(&image, &iplan, 0);
+    CHECK(name && strcmp(name, "id") == 0);
+    CHECK(ute_image_plan(&image, 2, &iplan) != 0);
+
+    // An image plan encodes like the plan compiled from YAML
+    struct message m;
+    message_init(&m, 10, "globex");
+    size_t len = 0, ilen = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    CHECK(ute_image_plan(&image, 1, &iplan) == 0);
+    uint8_t *ibuf = encode(m.top, &iplan, &ilen);
+    CHECK(buf && ibuf && len == ilen && memcmp(buf, ibuf, len) == 0);
+    free(buf);
+    free(ibuf);
+    message_free(&m);
+
+    // A damaged or truncated image does not open
+    data[0] ^= 0xff;
+    CHECK(ute_image_open(&image, data, size) != 0);
+    data[0] ^= 0xff;
+    CHECK(ute_image_open(&image, data, size / 2) != 0);
+    free(data);
+
+    CHECK(ute_image_write(schema, path) == 0);
+    CHECK(ute_image_map(&image, path) == 0);
+    CHECK(ute_image_plan(&image, 1, &iplan) == 0 && ute_plan_fingerprint(&iplan) == ute_plan_fingerprint(plan));
+    ute_image_unmap(&image);
+}
+
+static void test_compress(const struct ute_plan *plan, const struct ute_plan *stream_plan)
+{
+    const struct ute_compressor *lz = ute_compressor_lz();
+    struct message m;
+    message_init(&m, 2000, "acme");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    size_t bound = ute_compress_bound(len);
+    uint8_t *env = malloc(bound);
+    uint8_t *out = malloc(len);
+    size_t clen = ute_compress(buf, len, lz, UTE_COMPRESS_THRESHOLD, env, bound);
+    CHECK(clen != UTE_BUF_ERROR && clen < len / 2 && env[0] == 0xe1);
+    CHECK(ute_decompressed_size(env, clen) == len);
+    CHECK(ute_decompress(env, clen, NULL, out, len) == len && memcmp(out, buf, len) == 0);
+    // (an empty input is a plain, empty message)
+    for (size_t cut = 1; cut < clen; cut += 1 + cut / 8)
+        CHECK(ute_decompress(env, cut, NULL, out, len) == UTE_BUF_ERROR);
+
+    // In place: the same envelope without a second buffer
+    uint8_t *inplace = malloc(bound);
+    CHECK(ute_serialize_compressed_plan(m.top, plan, lz, UTE_COMPRESS_THRESHOLD, inplace, bound) == clen && memcmp(inplace, env, clen) == 0);
+    free(inplace);
+
+    struct ute_arena arena = {0}, plain_arena = {0};
+    void *decoded[NUM_FIELDS] = {0}, *plain_decoded[NUM_FIELDS] = {0};
+    CHECK(ute_deserialize_arena_compressed_plan(env, clen, plan, NULL, &arena, decoded) == clen);
+    check_reencodes(decoded, plan, buf, len);
+    // The decompressed message does not stay in the arena
+    CHECK(ute_deserialize_arena_plan(buf, len, plan, &plain_arena, plain_decoded) == len && arena.peak == plain_arena.peak);
+    ute_arena_free(&arena);
+    ute_arena_free(&plain_arena);
+
+    // Small messages stay plain
+    CHECK(ute_compress(buf, 100, lz, UTE_COMPRESS_THRESHOLD, env, bound) == 100 && memcmp(env, buf, 100) == 0);
+    free(buf);
+
+    // Streaming through the envelope gives the events of the plain message
+    size_t slen = 0;
+    uint8_t *sbuf = encode(m.top, stream_plan, &slen);
+    struct trace plain, streamed;
+    CHECK(feed_split(stream_plan, sbuf, slen, NULL, &plain) == UTE_DECODER_DONE);
+    size_t sclen = ute_compress(sbuf, slen, lz, UTE_COMPRESS_THRESHOLD, env, bound);
+    CHECK(sclen < slen);
+    struct ute_decoder dec;
+    streamed = (struct trace){0xcbf29ce484222325ULL, 0};
+    CHECK(ute_decoder_init(&dec, stream_plan, on_event, &streamed) == 0);
+    CHECK(ute_decompress_feed(env, sclen, NULL, &dec) == UTE_DECODER_DONE);
+    CHECK(streamed.hash == plain.hash && streamed.events == plain.events);
+    free(sbuf);
+    free(env);
+    free(out);
+    message_free(&m);
+}
+
+static void test_parallel(const struct ute_plan *plan)
+{
+    struct ute_pool *pool = ute_pool_create(4);
+    CHECK(pool != NULL);
+    if (!pool)
+        return;
+    struct ute_executor exec = ute_pool_executor(pool);
+    struct message m;
+    message_init(&m, 1001, "globex");
+    size_t len = 0;
+    uint8_t *buf = encode(m.top, plan, &len);
+    uint8_t *par = malloc(len);
+    CHECK(ute_serialize_parallel(m.top, plan, par, len, &exec) == len && memcmp(par, buf, len) == 0);
+    CHECK(ute_serialize_parallel(m.top, plan, par, len - 1, &exec) == UTE_BUF_ERROR);
+
+    struct ute_arena *arenas = calloc(exec.num_workers, sizeof(struct ute_arena));
+    void *out[NUM_FIELDS] = {0};
+    CHECK(ute_deserialize_arena_parallel(buf, len, plan, arenas, &exec, out) == len);
+    check_reencodes(out, plan, buf, len);
+    for (size_t i = 0; i < exec.num_workers; ++i)
+        ute_arena_free(&arenas[i]);
+    free(arenas);
+    free(par);
+    free(buf);
+    message_free(&m);
+    ute_pool_destroy(pool);
+}
+
+int main(void)
+{
+    struct ute_schema schema = {0};
+    if (ParseSchema("rich.yaml", &schema) != 0)
+    {
+        fprintf(stderr, "Failed to load schema from YAML\n");
+        return 1;
+    }
+    const struct ute_schema_version *version = &schema.versions[0];
+    struct ute_plan plan;
+    struct ute_plan stream_plan;
+    if (version->num_fields != NUM_FIELDS || ute_compile(version, &plan) != 0)
+    {
+        fprintf(stderr, "Failed to compile rich.yaml\n");
+        FreeSchema(&schema);
+        return 1;
+    }
+    if (ute_compile_fields(version->fields, NUM_STREAM_FIELDS, &stream_plan) != 0)
+    {
+        fprintf(stderr, "Failed to compile the streamed fields of rich.yaml\n");
+        ute_plan_free(&plan);
+        FreeSchema(&schema);
+        return 1;
+    }
+
+    char log_path[] = "/tmp/ute_test_log_XXXXXX";
+    int log_fd = mkstemp(log_path);
+    CHECK(log_fd >= 0);
+    close(log_fd);
+    char image_path[] = "/tmp/ute_test_image_XXXXXX";
+    int image_fd = mkstemp(image_path);
+    CHECK(image_fd >= 0);
+    close(image_fd);
+
+    test_roundtrip(version, &plan);
+    test_arena(version, &plan);
+    test_iov(version, &plan);
+    test_flat_lists(&plan);
+    test_sparse(&plan);
+    test_dict(&plan);
+    test_refs(&plan);
+    test_translation_refs();
+    test_validate(version, &plan);
+    test_decoder(&plan, &stream_plan);
+    test_view(&plan);
+    test_log(&plan, log_path);
+    test_image(&schema, &plan, image_path);
+    test_compress(&plan, &stream_plan);
+    test_parallel(&plan);
+
+    unlink(log_path);
+    unlink(image_path);
+    ute_plan_free(&stream_plan);
+    ute_plan_free(&plan);
+    FreeSchema(&schema);
+    if (failures)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("codex_test: all checks passed\n");
+    return 0;
+}
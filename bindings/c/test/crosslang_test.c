@@ -1,3 +1,4 @@
+#include "../arena.h"
 #include "../codex.h"
 #include "../schema.h"
 #include <stdio.h>
@@ -36,11 +37,12 @@ int main(int argc, char **argv)
         for (size_t i = 0; i < device_count; ++i)
             devices_list[1 + i] = &devices[i];
         void *top_data[1] = {devices_list};
-        uint8_t buf[256];
-        size_t written = ute_serialize(top_data, loaded_schema.versions[0].fields, buf, sizeof(buf));
+        struct ute_buffer buf = {0};
+        struct ute_writer writer = ute_buffer_writer(&buf);
+        size_t written = ute_serialize_writer(top_data, &loaded_schema.versions[0], &writer);
         if (written == UTE_BUF_ERROR)
         {
-            fprintf(stderr, "Serialization failed due to buffer size\n");
+            fprintf(stderr, "Serialization failed\n");
             FreeSchema(&loaded_schema);
             return 3;
         }
@@ -48,11 +50,13 @@ int main(int argc, char **argv)
         if (!fout)
         {
             fprintf(stderr, "Failed to open %s for writing\n", filename);
+            ute_buffer_free(&buf);
             FreeSchema(&loaded_schema);
             return 3;
         }
-        fwrite(buf, 1, written, fout);
+        fwrite(buf.data, 1, buf.len, fout);
         fclose(fout);
+        ute_buffer_free(&buf);
         printf("[crosslang] Wrote %zu bytes to %s\n", written, filename);
     }
     else if (strcmp(mode, "read") == 0)
@@ -64,30 +68,38 @@ int main(int argc, char **argv)
         }
         else
         {
-            uint8_t buf2[256];
-            size_t n = fread(buf2, 1, sizeof(buf2), fin);
+            fseek(fin, 0, SEEK_END);
+            long file_size = ftell(fin);
+            fseek(fin, 0, SEEK_SET);
+            uint8_t *buf2 = malloc(file_size > 0 ? (size_t)file_size : 1);
+            size_t n = buf2 ? fread(buf2, 1, (size_t)(file_size > 0 ? file_size : 0), fin) : 0;
             fclose(fin);
-            struct
+            // The device count is unknown up front: let the decoder allocate the list
+            struct device
             {
                 uint64_t id;
                 char name[32];
-            } out_devices[2];
-            void *out_devices_list[1 + 2];
-            out_devices_list[0] = 0;
-            for (size_t i = 0; i < 2; ++i)
-                out_devices_list[1 + i] = &out_devices[i];
-            void *out_top_data[1] = {out_devices_list};
-            size_t read = ute_deserialize(buf2, n, loaded_schema.versions[0].fields, out_top_data);
+            };
+            struct ute_arena arena = {0};
+            void *out_top_data[1] = {NULL};
+            size_t read = buf2 ? ute_deserialize_arena(buf2, n, &loaded_schema.versions[0], &arena, out_top_data) : UTE_BUF_ERROR;
+            free(buf2);
             if (read == UTE_BUF_ERROR)
             {
                 fprintf(stderr, "Deserialization failed due to buffer size\n");
+                ute_arena_free(&arena);
                 FreeSchema(&loaded_schema);
                 return 4;
             }
+            void **out_devices_list = (void **)out_top_data[0];
             size_t out_count = (size_t)(uintptr_t)out_devices_list[0];
             printf("[crosslang] Read %zu bytes from %s, got %zu devices:\n", read, filename, out_count);
             for (size_t i = 0; i < out_count; ++i)
-                printf("  Device %zu: id=%llu, name=%s\n", i + 1, (unsigned long long)out_devices[i].id, out_devices[i].name);
+            {
+                const struct device *d = (const struct device *)out_devices_list[1 + i];
+                printf("  Device %zu: id=%llu, name=%s\n", i + 1, (unsigned long long)d->id, d->name);
+            }
+            ute_arena_free(&arena);
         }
     }
     else
@@ -44,18 +44,25 @@ int main(void)
     // Top-level data: array of pointers to top-level fields (here: only "devices")
     void *top_data[1] = {devices_list};
 
-    // Serialize
-    uint8_t buf[256];
+    // Serialize into a growable buffer: one sizing pass, one allocation
+    struct ute_buffer buf = {0};
+    struct ute_writer writer = ute_buffer_writer(&buf);
 #ifdef UTE_DEBUG
-    printf("Calling ute_serialize...\n");
+    printf("Calling ute_serialize_writer...\n");
 #endif
-    size_t written = ute_serialize(top_data, loaded_schema.versions[0].fields, buf, sizeof(buf));
+    size_t written = ute_serialize_writer(top_data, &loaded_schema.versions[0], &writer);
 #ifdef UTE_DEBUG
-    printf("ute_serialize returned, written=%zu\n", written);
+    printf("ute_serialize_writer returned, written=%zu\n", written);
 #endif
+    if (written == UTE_BUF_ERROR)
+    {
+        fprintf(stderr, "Serialization failed\n");
+        FreeSchema(&loaded_schema);
+        return 1;
+    }
     printf("Serialized %zu bytes:\n", written);
     for (size_t i = 0; i < written; ++i)
-        printf("%02x ", buf[i]);
+        printf("%02x ", buf.data[i]);
     printf("\n");
 
     // Prepare output for deserialization
@@ -75,11 +82,12 @@ int main(void)
 #endif
 
     // Deserialize
-    size_t read = ute_deserialize(buf, written, loaded_schema.versions[0].fields, out_top_data);
+    size_t read = ute_deserialize(buf.data, buf.len, loaded_schema.versions[0].fields, out_top_data);
     size_t out_count = (size_t)(uintptr_t)out_devices_list[0];
     printf("Deserialized %zu bytes, got %zu devices:\n", read, out_count);
     print_devices(out_devices, out_count, "After deserialization");
 
+    ute_buffer_free(&buf);
     FreeSchema(&loaded_schema);
     return 0;
 }
@@ -0,0 +1,45 @@
+#include "image.h"
+#include "schema.h"
+#include <stdio.h>
+#include <string.h>
+
+// Schema compiler: turns a YAML schema into a binary schema image that
+// programs load with ute_image_map/ute_image_open instead of ParseSchema.
+//
+//   utec schema.yaml schema.utes          binary image file
+//   utec -c symbol schema.yaml schema.c   C source embedding the image
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: utec [-c symbol] <schema.yaml> <output>\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *symbol = NULL;
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "-c") == 0)
+    {
+        symbol = argv[arg + 1];
+        arg += 2;
+    }
+    if (argc - arg != 2)
+    {
+        usage();
+        return 2;
+    }
+    const char *input = argv[arg];
+    const char *output = argv[arg + 1];
+
+    struct ute_schema schema = {0};
+    if (ParseSchema(input, &schema) != 0)
+    {
+        fprintf(stderr, "utec: failed to load schema from %s\n", input);
+        return 1;
+    }
+    int rc = symbol ? ute_image_write_c(&schema, output, symbol) : ute_image_write(&schema, output);
+    if (rc != 0)
+        fprintf(stderr, "utec: failed to write %s\n", output);
+    FreeSchema(&schema);
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+#include "utf8.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(UTE_NO_SIMD)
+#define UTE_UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+// =========================================================
+// UTF-8 validation: scalar, SSE4.1 and AVX2
+// =========================================================
+
+// Strings shorter than this are always checked by the scalar code
+#define UTF8_SIMD_MIN 16
+
+static int utf8_valid_scalar(const uint8_t *s, size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        // Skip ASCII eight bytes at a time
+        uint64_t w;
+        if (len - i >= 8 && (memcpy(&w, s + i, sizeof(w)), !(w & 0x8080808080808080ULL)))
+        {
+            i += 8;
+            continue;
+        }
+        uint8_t c = s[i];
+        if (c < 0x80)
+        {
+            i++;
+            continue;
+        }
+        // Number of continuation bytes and the range of the first one, which
+        // excludes overlong forms, surrogates and code points past U+10FFFF
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF)
+            n = 1;
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            n = 2;
+            if (c == 0xE0)
+                lo = 0xA0;
+            else if (c == 0xED)
+                hi = 0x9F;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            n = 3;
+            if (c == 0xF0)
+                lo = 0x90;
+            else if (c == 0xF4)
+                hi = 0x8F;
+        }
+        else
+            return 0;
+        if (len - i - 1 < n || s[i + 1] < lo || s[i + 1] > hi)
+            return 0;
+        for (size_t k = 2; k <= n; ++k)
+        {
+            if ((s[i + k] & 0xC0) != 0x80)
+                return 0;
+        }
+        i += n + 1;
+    }
+    return 1;
+}
+
+#ifdef UTE_UTF8_X86
+
+// Table lookup validation (Keiser and Lemire, "Validating UTF-8 In Less Than
+// One Instruction Per Byte"): every error in a pair of adjacent bytes sets a
+// bit in all three tables, indexed by the high and low nibble of the first
+// byte and the high nibble of the second. Missing or extra continuation
+// bytes of 3 and 4 byte sequences are found by comparing the TWO_CONTS bit
+// with the lead bytes two and three positions back.
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uint8_t byte1_high[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, // ASCII
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,                                     // continuation
+    TOO_SHORT | OVERLONG_2,                                                         // 1100____
+    TOO_SHORT,                                                                      // 1101____
+    TOO_SHORT | OVERLONG_3 | SURROGATE,                                             // 1110____
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,                            // 1111____
+};
+
+static const uint8_t byte1_low[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+static const uint8_t byte2_high[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, // ASCII
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,           // 1000____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,                             // 1001____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,                              // 101_____
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, // lead bytes
+};
+
+// Largest byte allowed in each of the last three positions of a block when
+// no sequence is left unfinished
+static const uint8_t incomplete_max[32] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+// Errors of a 16-byte block given the block before it
+__attribute__((target("sse4.1"))) static inline __m128i check_block_sse(__m128i in, __m128i prev)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+    __m128i sc = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)byte1_high), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                      _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)byte1_low), _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)byte2_high), _mm_and_si128(_mm_srli_epi16(in, 4), nibble)));
+    // Only 111_____ two back and 1111____ three back need a continuation here
+    __m128i third = _mm_subs_epu8(_mm_alignr_epi8(in, prev, 14), _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(in, prev, 13), _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must, sc);
+}
+
+// The tail of the input is checked as a zero-padded block; zeros are ASCII,
+// so they end the checks of a sequence still open
+__attribute__((target("sse4.1"))) static int utf8_valid_sse(const uint8_t *s, size_t len)
+{
+    __m128i prev = _mm_setzero_si128(), error = _mm_setzero_si128(), incomplete = _mm_setzero_si128();
+    const __m128i max = _mm_loadu_si128((const __m128i *)(incomplete_max + 16));
+    uint8_t tail[16];
+    for (size_t pos = 0;; pos += 16)
+    {
+        __m128i in;
+        if (len - pos >= 16)
+            in = _mm_loadu_si128((const __m128i *)(s + pos));
+        else
+        {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, s + pos, len - pos);
+            in = _mm_loadu_si128((const __m128i *)tail);
+        }
+        if (!_mm_movemask_epi8(in))
+            error = _mm_or_si128(error, incomplete);
+        else
+        {
+            error = _mm_or_si128(error, check_block_sse(in, prev));
+            incomplete = _mm_subs_epu8(in, max);
+        }
+        prev = in;
+        if (len - pos < 16)
+            break;
+    }
+    return _mm_testz_si128(error, error);
+}
+
+// Errors of a 32-byte block given the block before it
+__attribute__((target("avx2"))) static inline __m256i check_block_avx2(__m256i in, __m256i prev)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    // The last 16 bytes of prev followed by the first 16 of in
+    __m256i shifted = _mm256_permute2x128_si256(prev, in, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(in, shifted, 15);
+    __m256i sc = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)byte1_high)), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                         _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)byte1_low)), _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)byte2_high)), _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+    __m256i third = _mm256_subs_epu8(_mm256_alignr_epi8(in, shifted, 14), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(_mm256_alignr_epi8(in, shifted, 13), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must, sc);
+}
+
+__attribute__((target("avx2"))) static int utf8_valid_avx2(const uint8_t *s, size_t len)
+{
+    __m256i prev = _mm256_setzero_si256(), error = _mm256_setzero_si256(), incomplete = _mm256_setzero_si256();
+    const __m256i max = _mm256_loadu_si256((const __m256i *)incomplete_max);
+    uint8_t tail[32];
+    for (size_t pos = 0;; pos += 32)
+    {
+        __m256i in;
+        if (len - pos >= 32)
+            in = _mm256_loadu_si256((const __m256i *)(s + pos));
+        else
+        {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, s + pos, len - pos);
+            in = _mm256_loadu_si256((const __m256i *)tail);
+        }
+        if (!_mm256_movemask_epi8(in))
+            error = _mm256_or_si256(error, incomplete);
+        else
+        {
+            error = _mm256_or_si256(error, check_block_avx2(in, prev));
+            incomplete = _mm256_subs_epu8(in, max);
+        }
+        prev = in;
+        if (len - pos < 32)
+            break;
+    }
+    return _mm256_testz_si256(error, error);
+}
+
+#endif // UTE_UTF8_X86
+
+// -------------------------
+// Runtime dispatch
+// -------------------------
+
+// Pick the widest implementation the CPU supports (selection is idempotent,
+// so a race between first callers is harmless)
+static int (*utf8_kernel(void))(const uint8_t *, size_t)
+{
+    static int (*selected)(const uint8_t *, size_t);
+    if (!selected)
+    {
+        int (*k)(const uint8_t *, size_t) = utf8_valid_scalar;
+#ifdef UTE_UTF8_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            k = utf8_valid_avx2;
+        else if (__builtin_cpu_supports("sse4.1"))
+            k = utf8_valid_sse;
+#endif
+        selected = k;
+    }
+    return selected;
+}
+
+int ute_utf8_valid(const uint8_t *s, size_t len)
+{
+    if (len < UTF8_SIMD_MIN)
+        return utf8_valid_scalar(s, len);
+    return utf8_kernel()(s, len);
+}
@@ -0,0 +1,15 @@
+#ifndef UTE_UTF8_H
+#define UTE_UTF8_H
+
+// Internal header: UTF-8 validation used by ute_validate
+
+#include <stddef.h>
+#include <stdint.h>
+
+// True if s[0..len) is well-formed UTF-8 (RFC 3629: no overlong forms,
+// surrogates or code points above U+10FFFF). Like the bulk varint kernels,
+// the implementation (scalar, SSE4.1 or AVX2) is picked once at runtime;
+// build with -DUTE_NO_SIMD to always use the scalar code.
+int ute_utf8_valid(const uint8_t *s, size_t len);
+
+#endif // UTE_UTF8_H
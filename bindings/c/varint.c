@@ -0,0 +1,511 @@
+#include "varint.h"
+#include "plan.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(UTE_NO_SIMD)
+#define UTE_VARINT_X86 1
+#include <immintrin.h>
+#endif
+
+// =========================================================
+// Bulk varint kernels: scalar, SSE4.1 and AVX2
+// =========================================================
+
+// Mask of the continuation bits of eight varint bytes read as one word
+#define CONT_BITS 0x8080808080808080ULL
+
+// Load eight bytes as a little-endian word
+static inline uint64_t load_word(const uint8_t *in)
+{
+    uint64_t w;
+    memcpy(&w, in, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+// Decode one varint from in[0..8) without a per-byte loop. Returns its length,
+// or 0 if it is longer than eight bytes (the caller falls back to the loop).
+static inline size_t decode_word(const uint8_t *in, uint64_t *out)
+{
+    uint64_t w = load_word(in);
+    uint64_t stops = ~w & CONT_BITS;
+    if (!stops)
+        return 0;
+    uint64_t last = stops & (0 - stops); // terminator byte of the first varint
+    w &= (last << 1) - 1;                // drop the bytes after it (all of them if it is byte 7)
+    w &= ~CONT_BITS;
+    // Fold the 7-bit groups together: 8x7 -> 4x14 -> 2x28 -> 1x56 bits
+    w = (w & 0x00FF00FF00FF00FFULL) | ((w & 0xFF00FF00FF00FF00ULL) >> 1);
+    w = (w & 0x0000FFFF0000FFFFULL) | ((w & 0xFFFF0000FFFF0000ULL) >> 2);
+    w = (w & 0x00000000FFFFFFFFULL) | ((w & 0xFFFFFFFF00000000ULL) >> 4);
+    *out = w;
+    return (size_t)(__builtin_ctzll(stops) >> 3) + 1;
+}
+
+// Decode one varint at in + *pos. Lengths of one and two bytes are resolved
+// by predictable branches (which keeps the position off the dependency chain),
+// longer ones by the word path when 8 bytes are readable.
+static inline int decode_one(const uint8_t *in, size_t in_size, size_t *pos, uint64_t *out)
+{
+    size_t p = *pos;
+    if (in_size - p >= 2)
+    {
+        if (in[p] < 0x80)
+        {
+            *out = in[p];
+            *pos = p + 1;
+            return 1;
+        }
+        if (in[p + 1] < 0x80)
+        {
+            *out = (uint64_t)(in[p] & 0x7F) | ((uint64_t)in[p + 1] << 7);
+            *pos = p + 2;
+            return 1;
+        }
+    }
+    size_t len = 0;
+    if (in_size - *pos >= 8)
+        len = decode_word(in + *pos, out);
+    if (!len)
+        len = ute_decode_varint(in + *pos, in_size - *pos, out);
+    *pos += len;
+    return len != 0;
+}
+
+size_t ute_varints_len(const uint64_t *values, size_t count)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i)
+        len += ute_varint_len(values[i]);
+    return len;
+}
+
+static size_t encode_varints_scalar(const uint64_t *values, size_t count, uint8_t *out)
+{
+    size_t written = 0;
+    for (size_t i = 0; i < count; ++i)
+        written += ute_encode_varint(values[i], out + written);
+    return written;
+}
+
+static size_t decode_varints_scalar(const uint8_t *in, size_t in_size, uint64_t *values, size_t count)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!decode_one(in, in_size, &pos, &values[i]))
+            return 0;
+    }
+    return pos;
+}
+
+// Skip the rest of count varints byte by byte from pos
+static size_t skip_tail(const uint8_t *in, size_t in_size, size_t pos, size_t count)
+{
+    while (count)
+    {
+        if (pos == in_size)
+            return 0;
+        if (!(in[pos++] & 0x80))
+            count--;
+    }
+    return pos;
+}
+
+static size_t skip_varints_scalar(const uint8_t *in, size_t in_size, size_t count)
+{
+    size_t pos = 0;
+    // Count terminator bytes eight at a time while the whole word belongs to the run
+    while (in_size - pos >= 8)
+    {
+        size_t stops = (size_t)__builtin_popcountll(~load_word(in + pos) & CONT_BITS);
+        if (stops >= count)
+            break;
+        count -= stops;
+        pos += 8;
+    }
+    return skip_tail(in, in_size, pos, count);
+}
+
+#ifdef UTE_VARINT_X86
+
+// Pack sixteen values below 128 into sixteen bytes
+__attribute__((target("sse4.1"))) static inline void pack16_sse(const uint64_t *values, uint8_t *out)
+{
+    const __m128i *v = (const __m128i *)values;
+    __m128i a = _mm_packus_epi32(_mm_packus_epi32(_mm_loadu_si128(v + 0), _mm_loadu_si128(v + 1)),
+                                 _mm_packus_epi32(_mm_loadu_si128(v + 2), _mm_loadu_si128(v + 3)));
+    __m128i b = _mm_packus_epi32(_mm_packus_epi32(_mm_loadu_si128(v + 4), _mm_loadu_si128(v + 5)),
+                                 _mm_packus_epi32(_mm_loadu_si128(v + 6), _mm_loadu_si128(v + 7)));
+    _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(a, b));
+}
+
+// Widen sixteen single-byte varints to sixteen values
+__attribute__((target("sse4.1"))) static inline void widen16_sse(__m128i bytes, uint64_t *values)
+{
+    __m128i *v = (__m128i *)values;
+    for (int i = 0; i < 8; ++i)
+    {
+        _mm_storeu_si128(v + i, _mm_cvtepu8_epi64(bytes));
+        bytes = _mm_srli_si128(bytes, 2);
+    }
+}
+
+// Decode eight two-byte varints to eight values
+__attribute__((target("sse4.1"))) static inline void fold8_sse(__m128i words, uint64_t *values)
+{
+    __m128i lo = _mm_and_si128(words, _mm_set1_epi16(0x007F));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(words, 1), _mm_set1_epi16(0x3F80));
+    __m128i folded = _mm_or_si128(lo, hi);
+    __m128i *v = (__m128i *)values;
+    for (int i = 0; i < 4; ++i)
+    {
+        _mm_storeu_si128(v + i, _mm_cvtepu16_epi64(folded));
+        folded = _mm_srli_si128(folded, 4);
+    }
+}
+
+__attribute__((target("sse4.1"))) static size_t encode_varints_sse(const uint64_t *values, size_t count, uint8_t *out)
+{
+    const __m128i high = _mm_set1_epi64x((long long)~0x7FULL);
+    size_t written = 0, i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i *v = (const __m128i *)(values + i);
+        __m128i any = _mm_loadu_si128(v);
+        for (int j = 1; j < 8; ++j)
+            any = _mm_or_si128(any, _mm_loadu_si128(v + j));
+        if (_mm_testz_si128(any, high))
+        {
+            pack16_sse(values + i, out + written);
+            written += 16;
+        }
+        else
+            written += encode_varints_scalar(values + i, 16, out + written);
+    }
+    return written + encode_varints_scalar(values + i, count - i, out + written);
+}
+
+__attribute__((target("sse4.1"))) static size_t decode_varints_sse(const uint8_t *in, size_t in_size, uint64_t *values, size_t count)
+{
+    size_t pos = 0, i = 0;
+    while (count - i >= 16 && in_size - pos >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(in + pos));
+        unsigned mask = (unsigned)_mm_movemask_epi8(bytes);
+        if (mask == 0)
+        {
+            widen16_sse(bytes, values + i);
+            pos += 16;
+            i += 16;
+        }
+        else if (mask == 0x5555)
+        {
+            fold8_sse(bytes, values + i);
+            pos += 16;
+            i += 8;
+        }
+        else
+        {
+            // Mixed lengths: decode the varints starting in this block one by one
+            size_t end = pos + 16;
+            while (pos < end && i < count)
+            {
+                if (!decode_one(in, in_size, &pos, &values[i++]))
+                    return 0;
+            }
+        }
+    }
+    for (; i < count; ++i)
+    {
+        if (!decode_one(in, in_size, &pos, &values[i]))
+            return 0;
+    }
+    return pos;
+}
+
+__attribute__((target("sse4.1"))) static size_t skip_varints_sse(const uint8_t *in, size_t in_size, size_t count)
+{
+    size_t pos = 0;
+    while (in_size - pos >= 16)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(in + pos)));
+        size_t stops = 16 - (size_t)__builtin_popcount(mask);
+        if (stops >= count)
+            break;
+        count -= stops;
+        pos += 16;
+    }
+    return skip_tail(in, in_size, pos, count);
+}
+
+__attribute__((target("avx2"))) static size_t encode_varints_avx2(const uint64_t *values, size_t count, uint8_t *out)
+{
+    const __m256i high = _mm256_set1_epi64x((long long)~0x7FULL);
+    size_t written = 0, i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        const __m256i *v = (const __m256i *)(values + i);
+        __m256i lo = _mm256_loadu_si256(v);
+        __m256i hi = _mm256_loadu_si256(v + 4);
+        for (int j = 1; j < 4; ++j)
+        {
+            lo = _mm256_or_si256(lo, _mm256_loadu_si256(v + j));
+            hi = _mm256_or_si256(hi, _mm256_loadu_si256(v + 4 + j));
+        }
+        if (_mm256_testz_si256(_mm256_or_si256(lo, hi), high))
+        {
+            pack16_sse(values + i, out + written);
+            pack16_sse(values + i + 16, out + written + 16);
+            written += 32;
+            continue;
+        }
+        for (int half = 0; half < 2; ++half)
+        {
+            const uint64_t *src = values + i + 16 * half;
+            if (_mm256_testz_si256(half ? hi : lo, high))
+            {
+                pack16_sse(src, out + written);
+                written += 16;
+            }
+            else
+                written += encode_varints_scalar(src, 16, out + written);
+        }
+    }
+    return written + encode_varints_sse(values + i, count - i, out + written);
+}
+
+__attribute__((target("avx2"))) static size_t decode_varints_avx2(const uint8_t *in, size_t in_size, uint64_t *values, size_t count)
+{
+    size_t pos = 0, i = 0;
+    while (count - i >= 32 && in_size - pos >= 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(in + pos));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(bytes);
+        if (mask == 0)
+        {
+            __m256i *v = (__m256i *)(values + i);
+            __m128i lo = _mm256_castsi256_si128(bytes);
+            __m128i hi = _mm256_extracti128_si256(bytes, 1);
+            for (int j = 0; j < 4; ++j)
+            {
+                _mm256_storeu_si256(v + j, _mm256_cvtepu8_epi64(lo));
+                _mm256_storeu_si256(v + 4 + j, _mm256_cvtepu8_epi64(hi));
+                lo = _mm_srli_si128(lo, 4);
+                hi = _mm_srli_si128(hi, 4);
+            }
+            pos += 32;
+            i += 32;
+        }
+        else if (mask == 0x55555555u)
+        {
+            fold8_sse(_mm256_castsi256_si128(bytes), values + i);
+            fold8_sse(_mm256_extracti128_si256(bytes, 1), values + i + 8);
+            pos += 32;
+            i += 16;
+        }
+        else
+        {
+            size_t end = pos + 32;
+            while (pos < end && i < count)
+            {
+                if (!decode_one(in, in_size, &pos, &values[i++]))
+                    return 0;
+            }
+        }
+    }
+    size_t tail = decode_varints_sse(in + pos, in_size - pos, values + i, count - i);
+    if (count - i && !tail)
+        return 0;
+    return pos + tail;
+}
+
+__attribute__((target("avx2"))) static size_t skip_varints_avx2(const uint8_t *in, size_t in_size, size_t count)
+{
+    size_t pos = 0;
+    while (in_size - pos >= 32)
+    {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(in + pos)));
+        size_t stops = 32 - (size_t)__builtin_popcount(mask);
+        if (stops >= count)
+            break;
+        count -= stops;
+        pos += 32;
+    }
+    return skip_tail(in, in_size, pos, count);
+}
+
+#endif // UTE_VARINT_X86
+
+// -------------------------
+// Runtime dispatch
+// -------------------------
+
+struct ute_varint_kernels
+{
+    size_t (*encode)(const uint64_t *values, size_t count, uint8_t *out);
+    size_t (*decode)(const uint8_t *in, size_t in_size, uint64_t *values, size_t count);
+    size_t (*skip)(const uint8_t *in, size_t in_size, size_t count);
+};
+
+static const struct ute_varint_kernels scalar_kernels = {encode_varints_scalar, decode_varints_scalar, skip_varints_scalar};
+#ifdef UTE_VARINT_X86
+static const struct ute_varint_kernels sse_kernels = {encode_varints_sse, decode_varints_sse, skip_varints_sse};
+static const struct ute_varint_kernels avx2_kernels = {encode_varints_avx2, decode_varints_avx2, skip_varints_avx2};
+#endif
+
+// Pick the widest kernels the CPU supports (selection is idempotent, so a
+// race between first callers is harmless)
+static const struct ute_varint_kernels *kernels(void)
+{
+    static const struct ute_varint_kernels *selected;
+    if (!selected)
+    {
+        const struct ute_varint_kernels *k = &scalar_kernels;
+#ifdef UTE_VARINT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            k = &avx2_kernels;
+        else if (__builtin_cpu_supports("sse4.1"))
+            k = &sse_kernels;
+#endif
+        selected = k;
+    }
+    return selected;
+}
+
+size_t ute_encode_varints(const uint64_t *values, size_t count, uint8_t *out)
+{
+    return kernels()->encode(values, count, out);
+}
+
+size_t ute_decode_varints(const uint8_t *in, size_t in_size, uint64_t *values, size_t count)
+{
+    return count ? kernels()->decode(in, in_size, values, count) : 0;
+}
+
+size_t ute_skip_varints(const uint8_t *in, size_t in_size, size_t count)
+{
+    return count ? kernels()->skip(in, in_size, count) : 0;
+}
+
+// True if a run of whole varints contains one that does not fit in 64 bits:
+// more than nine continuation bytes in a row, or nine followed by a
+// terminator above 1. Varints that start and end inside one word are at
+// most seven bytes long, so each word only extends or ends the run carried
+// over from the previous one.
+static int has_overflow(const uint8_t *in, size_t len)
+{
+    size_t pos = 0, run = 0;
+    while (len - pos >= 8)
+    {
+        uint64_t stops = ~load_word(in + pos) & CONT_BITS;
+        if (!stops)
+        {
+            run += 8;
+            if (run > 9)
+                return 1;
+            pos += 8;
+            continue;
+        }
+        size_t first = (size_t)__builtin_ctzll(stops) >> 3;
+        run += first;
+        if (run >= 9 && (run > 9 || in[pos + first] > 1))
+            return 1;
+        run = 7 - ((size_t)(63 - __builtin_clzll(stops)) >> 3);
+        pos += 8;
+    }
+    for (; pos < len; ++pos)
+    {
+        if (in[pos] & 0x80)
+        {
+            if (++run > 9)
+                return 1;
+        }
+        else
+        {
+            if (run == 9 && in[pos] > 1)
+                return 1;
+            run = 0;
+        }
+    }
+    return 0;
+}
+
+size_t ute_check_varints(const uint8_t *in, size_t in_size, size_t count)
+{
+    size_t len = ute_skip_varints(in, in_size, count);
+    return len && !has_overflow(in, len) ? len : 0;
+}
+
+// -------------------------
+// Int transforms
+// -------------------------
+
+void ute_ints_encode(uint64_t *values, size_t count, int mode, struct ute_ints_state *state)
+{
+    uint64_t prev = state->prev, delta = state->delta;
+    switch (mode)
+    {
+    case UTE_INTS_ZIGZAG:
+        for (size_t i = 0; i < count; ++i)
+            values[i] = ute_zigzag_encode(values[i]);
+        break;
+    case UTE_INTS_DELTA:
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t v = values[i];
+            values[i] = ute_zigzag_encode(v - prev);
+            prev = v;
+        }
+        break;
+    case UTE_INTS_DELTA2:
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t v = values[i], d = v - prev;
+            values[i] = ute_zigzag_encode(d - delta);
+            prev = v;
+            delta = d;
+        }
+        break;
+    default:
+        break;
+    }
+    state->prev = prev;
+    state->delta = delta;
+}
+
+void ute_ints_decode(uint64_t *values, size_t count, int mode, struct ute_ints_state *state)
+{
+    uint64_t prev = state->prev, delta = state->delta;
+    switch (mode)
+    {
+    case UTE_INTS_ZIGZAG:
+        for (size_t i = 0; i < count; ++i)
+            values[i] = ute_zigzag_decode(values[i]);
+        break;
+    case UTE_INTS_DELTA:
+        // Prefix sum of the differences
+        for (size_t i = 0; i < count; ++i)
+        {
+            prev += ute_zigzag_decode(values[i]);
+            values[i] = prev;
+        }
+        break;
+    case UTE_INTS_DELTA2:
+        // Two prefix sums: differences, then values
+        for (size_t i = 0; i < count; ++i)
+        {
+            delta += ute_zigzag_decode(values[i]);
+            prev += delta;
+            values[i] = prev;
+        }
+        break;
+    default:
+        break;
+    }
+    state->prev = prev;
+    state->delta = delta;
+}
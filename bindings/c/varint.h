@@ -0,0 +1,144 @@
+#ifndef UTE_VARINT_H
+#define UTE_VARINT_H
+
+// Internal header: unsigned LEB128 varint helpers shared by the C codex sources
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Encode varint (returns bytes written, at most 10)
+static inline size_t ute_encode_varint(uint64_t n, uint8_t *out)
+{
+    // Values below 2^14 (one or two bytes) take no loop
+    if (n < 0x80)
+    {
+        out[0] = (uint8_t)n;
+        return 1;
+    }
+    if (n < 0x4000)
+    {
+        out[0] = (uint8_t)(n | 0x80);
+        out[1] = (uint8_t)(n >> 7);
+        return 2;
+    }
+    size_t i = 0;
+    while (n >= 0x80)
+    {
+        out[i++] = (uint8_t)(n | 0x80);
+        n >>= 7;
+    }
+    out[i++] = (uint8_t)n;
+    return i;
+}
+
+// Number of bytes ute_encode_varint writes for n
+static inline size_t ute_varint_len(uint64_t n)
+{
+#if defined(__GNUC__)
+    // Branch-free: one byte per started group of 7 significant bits
+    return 1 + (size_t)(63 - __builtin_clzll(n | 1)) / 7;
+#else
+    size_t len = 1;
+    while (n >= 0x80)
+    {
+        n >>= 7;
+        len++;
+    }
+    return len;
+#endif
+}
+
+// Decode varint (returns bytes read, or 0 if the input ends inside the varint
+// or the varint does not fit in 64 bits: more than 10 bytes, or a tenth byte
+// above 1)
+static inline size_t ute_decode_varint(const uint8_t *in, size_t in_size, uint64_t *out)
+{
+    // Values below 2^14 (one or two bytes) take no loop
+    if (in_size >= 2 && !(in[0] & in[1] & 0x80))
+    {
+        if (!(in[0] & 0x80))
+        {
+            *out = in[0];
+            return 1;
+        }
+        *out = (uint64_t)(in[0] & 0x7F) | ((uint64_t)in[1] << 7);
+        return 2;
+    }
+    size_t limit = in_size < 10 ? in_size : 10;
+    uint64_t result = 0;
+    if (limit == 10)
+    {
+        // Room for the longest varint: the loop only tests the continuation bit
+        size_t i = 0;
+        uint8_t b;
+        do
+        {
+            b = in[i];
+            result |= (uint64_t)(b & 0x7F) << (7 * i);
+            i++;
+        } while ((b & 0x80) && i < 10);
+        // The tenth byte only holds bit 63
+        if ((b & 0x80) || (i == 10 && b > 1))
+            return 0;
+        *out = result;
+        return i;
+    }
+    for (size_t i = 0; i < limit; ++i)
+    {
+        uint8_t b = in[i];
+        result |= (uint64_t)(b & 0x7F) << (7 * i);
+        if (!(b & 0x80))
+        {
+            // The tenth byte only holds bit 63
+            if (i == 9 && b > 1)
+                return 0;
+            *out = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Zigzag mapping of a signed value (its two's complement bits) to an
+// unsigned one, so that small magnitudes stay short: 0, -1, 1, -2 -> 0, 1, 2, 3
+static inline uint64_t ute_zigzag_encode(uint64_t v)
+{
+    return (v << 1) ^ (0 - (v >> 63));
+}
+
+// Inverse of ute_zigzag_encode
+static inline uint64_t ute_zigzag_decode(uint64_t z)
+{
+    return (z >> 1) ^ (0 - (z & 1));
+}
+
+// Running state of a transform across the blocks of one list: the previous
+// value and the previous difference. Zero it before the first block.
+struct ute_ints_state
+{
+    uint64_t prev;
+    uint64_t delta;
+};
+
+// Transform count values in place for writing (mode: UTE_INTS_*, see plan.h)
+void ute_ints_encode(uint64_t *values, size_t count, int mode, struct ute_ints_state *state);
+// Undo ute_ints_encode in place on count decoded values
+void ute_ints_decode(uint64_t *values, size_t count, int mode, struct ute_ints_state *state);
+
+// Bulk kernels (varint.c). The implementation (scalar, SSE4.1 or AVX2) is
+// picked once at runtime from the CPU features; build with -DUTE_NO_SIMD to
+// always use the scalar code.
+
+// Total encoded size of count values
+size_t ute_varints_len(const uint64_t *values, size_t count);
+// Encode count values back to back; out must have room for ute_varints_len bytes
+size_t ute_encode_varints(const uint64_t *values, size_t count, uint8_t *out);
+// Decode exactly count back-to-back varints (returns bytes read, or 0 on truncation)
+size_t ute_decode_varints(const uint8_t *in, size_t in_size, uint64_t *values, size_t count);
+// Skip exactly count back-to-back varints (returns bytes skipped, or 0 on truncation)
+size_t ute_skip_varints(const uint8_t *in, size_t in_size, size_t count);
+// Skip exactly count back-to-back varints like ute_skip_varints, also failing
+// (returning 0) if any of them does not fit in 64 bits
+size_t ute_check_varints(const uint8_t *in, size_t in_size, size_t count);
+
+#endif // UTE_VARINT_H
@@ -0,0 +1,816 @@
+#include "view.h"
+#include "plan.h"
+#include "schema.h"
+#include "varint.h"
+#include "wire.h"
+#include <string.h>
+
+// Sentinel for failed skips/header reads
+#define ERR ((size_t)-1)
+
+// =========================================================
+// Lazy views: navigate an encoded buffer without decoding it
+// =========================================================
+
+// Read the type prefix of the node at pos and the varint that follows it (if any).
+// Returns the offset just past the header, or ERR on a type mismatch/truncation.
+static inline size_t read_header(const uint8_t *in, size_t in_size, size_t pos, int prefix, int has_varint, uint64_t *out_arg)
+{
+    if (pos >= in_size || (in[pos] >> 5) != prefix)
+        return ERR;
+    pos++;
+    if (!has_varint)
+        return pos;
+    if (pos < in_size && in[pos] < 0x80)
+    {
+        *out_arg = in[pos];
+        return pos + 1;
+    }
+    size_t var_len = ute_decode_varint(in + pos, in_size - pos, out_arg);
+    if (var_len == 0)
+        return ERR;
+    return pos + var_len;
+}
+
+// Read a list header at pos, checking that its flags match the plan
+static inline size_t read_list_header(const struct ute_insn *insn, const uint8_t *in, size_t in_size, size_t pos, uint64_t *out_count)
+{
+    if (pos < in_size && (in[pos] & UTE_PREFIX_FLAGS) != UTE_LIST_FLAGS(insn))
+        return ERR;
+    return read_header(in, in_size, pos, 4, 1, out_count);
+}
+
+// Read a struct header at pos: the prefix flags (UTE_STRUCT_*, only allowed
+// for sparse structs) and the count that follows
+static inline size_t read_struct_header(const struct ute_insn *insn, const uint8_t *in, size_t in_size, size_t pos, uint8_t *out_form, uint64_t *out_count)
+{
+    uint8_t form = pos < in_size ? in[pos] & UTE_PREFIX_FLAGS : 0;
+    if (form && (!(insn->flags & UTE_INSN_SPARSE) || (form != UTE_STRUCT_SPARSE && form != UTE_STRUCT_BITMAP)))
+        return ERR;
+    pos = read_header(in, in_size, pos, 5, 1, out_count);
+    if (pos == ERR || (form == UTE_STRUCT_SPARSE ? *out_count > insn->nfields : *out_count != insn->nfields))
+        return ERR;
+    *out_form = form;
+    return pos;
+}
+
+// Skip a leaf value at pos (returns the offset past it, or ERR)
+static inline size_t skip_leaf(uint8_t op, const uint8_t *in, size_t in_size, size_t pos)
+{
+    uint64_t arg = 0;
+    switch (op)
+    {
+    case UTE_OP_NULL:
+        return read_header(in, in_size, pos, 0, 0, &arg);
+    case UTE_OP_BOOL:
+        return read_header(in, in_size, pos, 1, 0, &arg);
+    case UTE_OP_INT:
+    case UTE_OP_SINT:
+        return read_header(in, in_size, pos, 2, 1, &arg);
+    case UTE_OP_STRING:
+    {
+        // Back-references and dictionary ids end with their varint
+        uint8_t flags = pos < in_size ? in[pos] & UTE_PREFIX_FLAGS : 0;
+        pos = read_header(in, in_size, pos, 3, 1, &arg);
+        if (pos == ERR || (flags && flags != UTE_STRING_REF && flags != UTE_STRING_DICT))
+            return ERR;
+        if (flags)
+            return pos;
+        if (arg > in_size - pos)
+            return ERR;
+        return pos + (size_t)arg;
+    }
+    case UTE_OP_FLOAT32:
+    case UTE_OP_FLOAT64:
+    case UTE_OP_FIXED32:
+    case UTE_OP_FIXED64:
+        if (pos >= in_size || in[pos] != UTE_FIXED_PREFIX(UTE_OP_WIDTH(op)) || UTE_OP_WIDTH(op) > in_size - pos - 1)
+            return ERR;
+        return pos + 1 + UTE_OP_WIDTH(op);
+    case UTE_OP_BYTES:
+        if (pos < in_size && (in[pos] & UTE_PREFIX_FLAGS))
+            return ERR;
+        pos = read_header(in, in_size, pos, 6, 1, &arg);
+        if (pos == ERR || arg > in_size - pos)
+            return ERR;
+        return pos + (size_t)arg;
+    default:
+        return ERR;
+    }
+}
+
+// Skip a flat node (leaf, or struct of leaves) at pos
+static inline size_t skip_flat(const struct ute_insn *insn, const uint8_t *in, size_t in_size, size_t pos)
+{
+    if (insn->op != UTE_OP_STRUCT)
+        return skip_leaf(insn->op, in, in_size, pos);
+    uint64_t nfields = 0;
+    uint8_t form = 0;
+    pos = read_struct_header(insn, in, in_size, pos, &form, &nfields);
+    if (pos == ERR)
+        return ERR;
+    const struct ute_insn *member = insn + 1;
+    for (uint32_t i = 0; i < insn->nfields && pos != ERR; ++i, ++member)
+        pos = skip_leaf(member->op, in, in_size, pos);
+    return pos;
+}
+
+// True if insns[pc] is the element of a packed list (a bare varint without prefix)
+static inline int is_packed_elem(const struct ute_insn *insns, uint32_t pc)
+{
+    return pc > 0 && insns[pc - 1].op == UTE_OP_LIST && (insns[pc - 1].flags & UTE_INSN_PACKED);
+}
+
+// True if insns[pc] is the element of a fixed list (a bare value without prefix)
+static inline int is_fixed_elem(const struct ute_insn *insns, uint32_t pc)
+{
+    return pc > 0 && insns[pc - 1].op == UTE_OP_LIST && (insns[pc - 1].flags & UTE_INSN_FIXED);
+}
+
+// Skip count bare values of width bytes of a fixed list at pos
+static inline size_t skip_fixed(size_t in_size, size_t pos, uint64_t count, size_t width)
+{
+    if (pos > in_size || count > (in_size - pos) / width)
+        return ERR;
+    return pos + (size_t)count * width;
+}
+
+// Skip count bare varints of a packed list at pos
+static inline size_t skip_packed(const uint8_t *in, size_t in_size, size_t pos, uint64_t count)
+{
+    if (count == 0)
+        return pos;
+    if (pos > in_size || count > in_size - pos)
+        return ERR;
+    size_t len = ute_skip_varints(in + pos, in_size - pos, (size_t)count);
+    return len ? pos + len : ERR;
+}
+
+// Read the member count of a columnar list body at pos, checking it against the plan
+static inline size_t read_columns(const struct ute_insn *insn, const uint8_t *in, size_t in_size, size_t pos)
+{
+    uint64_t nfields = 0;
+    if (pos >= in_size)
+        return ERR;
+    size_t var_len = ute_decode_varint(in + pos, in_size - pos, &nfields);
+    if (var_len == 0 || nfields != insn[1].nfields)
+        return ERR;
+    return pos + var_len;
+}
+
+// Skip one column of a columnar list at pos (a size varint and the column)
+static inline size_t skip_column(const uint8_t *in, size_t in_size, size_t pos, struct ute_slice *out_column)
+{
+    uint64_t size = 0;
+    if (pos >= in_size)
+        return ERR;
+    size_t var_len = ute_decode_varint(in + pos, in_size - pos, &size);
+    if (var_len == 0 || size > in_size - pos - var_len)
+        return ERR;
+    pos += var_len;
+    if (out_column)
+    {
+        out_column->data = in + pos;
+        out_column->len = (size_t)size;
+    }
+    return pos + (size_t)size;
+}
+
+// Skip the chunks of a chunked list of count elements by the sizes in their table
+static inline size_t skip_chunks(const uint8_t *in, size_t in_size, size_t pos, uint64_t count)
+{
+    uint64_t per = 0;
+    size_t end = 0;
+    return ute_read_chunks(in, pos, in_size, count, &per, &end) == ERR ? ERR : end;
+}
+
+// Skip a flat list (packed, columnar, fixed, chunked, or with flat elements) at pos
+static size_t skip_flat_list(const struct ute_insn *insn, const uint8_t *in, size_t in_size, size_t pos)
+{
+    uint64_t count = 0;
+    pos = read_list_header(insn, in, in_size, pos, &count);
+    if (pos == ERR)
+        return ERR;
+    if (insn->flags & UTE_INSN_PACKED)
+        return skip_packed(in, in_size, pos, count);
+    if (insn->flags & UTE_INSN_FIXED)
+        return skip_fixed(in_size, pos, count, insn->arg);
+    if (insn->flags & UTE_INSN_CHUNKED)
+        return skip_chunks(in, in_size, pos, count);
+    if (insn->flags & UTE_INSN_COLUMNAR)
+    {
+        // Columns are skipped by their size, whatever the element count
+        pos = read_columns(insn, in, in_size, pos);
+        for (uint32_t i = 0; i < insn[1].nfields && pos != ERR; ++i)
+            pos = skip_column(in, in_size, pos, NULL);
+        return pos;
+    }
+    for (uint64_t i = 0; i < count && pos != ERR; ++i)
+        pos = skip_flat(insn + 1, in, in_size, pos);
+    return pos;
+}
+
+// Skip the encoded node described by insns[pc] that starts at pos (non-recursive).
+// Returns the offset just past the node, or ERR if it does not match the plan.
+static size_t skip_node(const struct ute_insn *insns, uint32_t pc, const uint8_t *in, size_t in_size, size_t pos)
+{
+    if (is_packed_elem(insns, pc))
+        return skip_packed(in, in_size, pos, 1);
+    if (is_fixed_elem(insns, pc))
+        return skip_fixed(in_size, pos, 1, UTE_OP_WIDTH(insns[pc].op));
+    if (UTE_OP_IS_LEAF(insns[pc].op) || (insns[pc].flags & UTE_INSN_FLAT))
+    {
+        if (insns[pc].op != UTE_OP_LIST)
+            return skip_flat(&insns[pc], in, in_size, pos);
+        return skip_flat_list(&insns[pc], in, in_size, pos);
+    }
+    uint64_t stack[UTE_PLAN_MAX_DEPTH];
+    size_t sp = 0;
+    uint32_t end = insns[pc].next;
+    uint64_t arg = 0;
+    while (pc != end)
+    {
+        const struct ute_insn *insn = &insns[pc];
+        switch (insn->op)
+        {
+        case UTE_OP_NULL:
+            pos = read_header(in, in_size, pos, 0, 0, &arg);
+            pc++;
+            break;
+        case UTE_OP_BOOL:
+            pos = read_header(in, in_size, pos, 1, 0, &arg);
+            pc++;
+            break;
+        case UTE_OP_INT:
+            pos = read_header(in, in_size, pos, 2, 1, &arg);
+            pc++;
+            break;
+        case UTE_OP_STRING:
+        case UTE_OP_FLOAT32:
+        case UTE_OP_FLOAT64:
+        case UTE_OP_FIXED32:
+        case UTE_OP_FIXED64:
+        case UTE_OP_BYTES:
+        case UTE_OP_SINT:
+            pos = skip_leaf(insn->op, in, in_size, pos);
+            pc++;
+            break;
+        case UTE_OP_LIST:
+            if (insn->flags & UTE_INSN_FLAT)
+            {
+                pos = skip_flat_list(insn, in, in_size, pos);
+                pc = insn->next;
+                break;
+            }
+            pos = read_list_header(insn, in, in_size, pos, &arg);
+            if (pos == ERR)
+                return ERR;
+            if (insn->flags & UTE_INSN_CHUNKED)
+            {
+                pos = skip_chunks(in, in_size, pos, arg);
+                pc = insn->next;
+                break;
+            }
+            if (arg == 0)
+            {
+                pc = insn->next;
+                break;
+            }
+            if (sp == UTE_PLAN_MAX_DEPTH)
+                return ERR;
+            stack[sp++] = arg;
+            pc++;
+            break;
+        case UTE_OP_LIST_END:
+            if (--stack[sp - 1])
+                pc = insn->next + 1;
+            else
+            {
+                sp--;
+                pc++;
+            }
+            break;
+        case UTE_OP_STRUCT:
+        {
+            uint8_t form = 0;
+            if (insn->flags & UTE_INSN_SPARSE)
+            {
+                // Which members follow depends on the instance: skip it without the plan
+                if (read_struct_header(insn, in, in_size, pos, &form, &arg) == ERR)
+                    return ERR;
+                pos = ute_skip_value(in, pos, in_size);
+                pc = insn->next;
+                break;
+            }
+            pos = read_struct_header(insn, in, in_size, pos, &form, &arg);
+            pc++;
+            break;
+        }
+        case UTE_OP_STRUCT_END:
+            pc++;
+            break;
+        default:
+            return ERR;
+        }
+        if (pos == ERR)
+            return ERR;
+    }
+    return pos;
+}
+
+// Map a plan opcode to the schema field type it encodes
+static int op_type(uint8_t op)
+{
+    switch (op)
+    {
+    case UTE_OP_NULL:
+        return UTE_TYPE_NULL;
+    case UTE_OP_BOOL:
+        return UTE_TYPE_BOOL;
+    case UTE_OP_INT:
+        return UTE_TYPE_INT;
+    case UTE_OP_STRING:
+        return UTE_TYPE_STRING;
+    case UTE_OP_LIST:
+        return UTE_TYPE_LIST;
+    case UTE_OP_STRUCT:
+        return UTE_TYPE_STRUCT;
+    case UTE_OP_FLOAT32:
+        return UTE_TYPE_FLOAT32;
+    case UTE_OP_FLOAT64:
+        return UTE_TYPE_FLOAT64;
+    case UTE_OP_FIXED32:
+        return UTE_TYPE_FIXED32;
+    case UTE_OP_FIXED64:
+        return UTE_TYPE_FIXED64;
+    case UTE_OP_BYTES:
+        return UTE_TYPE_BYTES;
+    case UTE_OP_SINT:
+        return UTE_TYPE_SINT;
+    default:
+        return -1;
+    }
+}
+
+// Skip count sibling nodes starting at (pc, pos); list elements share one pc
+static int skip_siblings(struct ute_view *view, size_t count, int same_pc)
+{
+    const struct ute_insn *insns = view->plan->insns;
+    if (same_pc && is_packed_elem(insns, view->pc))
+    {
+        // Packed elements are skipped in bulk
+        view->pos = skip_packed(view->buf, view->len, view->pos, count);
+        return view->pos == ERR ? -1 : 0;
+    }
+    if (same_pc && is_fixed_elem(insns, view->pc))
+    {
+        view->pos = skip_fixed(view->len, view->pos, count, UTE_OP_WIDTH(insns[view->pc].op));
+        return view->pos == ERR ? -1 : 0;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        view->pos = skip_node(insns, view->pc, view->buf, view->len, view->pos);
+        if (view->pos == ERR)
+            return -1;
+        if (!same_pc)
+            view->pc = insns[view->pc].next;
+    }
+    return 0;
+}
+
+// Find member index of the sparse struct viewed by view, whose header
+// (form, count) ends at child->pos. Only present members are encoded, so the
+// preceding ones are skipped as the form dictates; an absent member has no
+// view (returns -1).
+static int sparse_field(const struct ute_view *view, uint8_t form, uint64_t count, size_t index, struct ute_view *child, struct ute_view *out_view)
+{
+    const struct ute_insn *insns = view->plan->insns;
+    const uint8_t *bitmap = view->buf + child->pos;
+    if (form == UTE_STRUCT_BITMAP)
+    {
+        size_t nbytes = (size_t)(count / 8 + (count % 8 != 0));
+        if (nbytes > view->len - child->pos || !((bitmap[index / 8] >> (index % 8)) & 1))
+            return -1;
+        child->pos += nbytes;
+    }
+    uint32_t marker = view->pc + 1;
+    for (size_t i = 0; i < index || form == UTE_STRUCT_SPARSE; ++i, marker = insns[marker].next)
+    {
+        int present = 1;
+        if (form == UTE_STRUCT_BITMAP)
+            present = (bitmap[i / 8] >> (i % 8)) & 1;
+        else if (form == UTE_STRUCT_SPARSE)
+        {
+            // (index, value) pairs in ascending order
+            uint64_t at = 0;
+            if (count == 0 || child->pos >= view->len)
+                return -1;
+            size_t var_len = ute_decode_varint(view->buf + child->pos, view->len - child->pos, &at);
+            if (var_len == 0 || at < i || at > index)
+                return -1;
+            present = at == i;
+            if (present)
+            {
+                count--;
+                child->pos += var_len;
+                if (i == index)
+                    break;
+            }
+        }
+        if (present)
+        {
+            child->pos = skip_node(insns, marker + 1, view->buf, view->len, child->pos);
+            if (child->pos == ERR)
+                return -1;
+        }
+    }
+    child->pc = marker + 1;
+    *out_view = *child;
+    return 0;
+}
+
+// Read the fixed-width value of a view whose plan opcode must be op (host byte order)
+static int view_fixed(const struct ute_view *view, uint8_t op, void *out_value)
+{
+    if (!view || !out_value || view->pc == UTE_VIEW_ROOT || view->plan->insns[view->pc].op != op)
+        return -1;
+    size_t width = UTE_OP_WIDTH(op);
+    size_t pos = view->pos;
+    // The elements of a fixed list are bare values without a prefix
+    if (!is_fixed_elem(view->plan->insns, view->pc))
+    {
+        if (pos >= view->len || view->buf[pos] != UTE_FIXED_PREFIX(width))
+            return -1;
+        pos++;
+    }
+    if (pos > view->len || width > view->len - pos)
+        return -1;
+    ute_copy_le(out_value, view->buf + pos, 1, width);
+    return 0;
+}
+
+// =====================
+// View API
+// =====================
+
+int ute_view_init(struct ute_view *out_view, const uint8_t *buf, size_t len, const struct ute_plan *plan)
+{
+    if (!out_view || !buf || !plan || !plan->insns)
+        return -1;
+    out_view->plan = plan;
+    out_view->buf = buf;
+    out_view->len = len;
+    out_view->pos = 0;
+    out_view->pc = UTE_VIEW_ROOT;
+    return 0;
+}
+
+int ute_view_type(const struct ute_view *view)
+{
+    if (!view || view->pc == UTE_VIEW_ROOT)
+        return -1;
+    return op_type(view->plan->insns[view->pc].op);
+}
+
+int ute_view_count(const struct ute_view *view, size_t *out_count)
+{
+    if (!view || !out_count)
+        return -1;
+    if (view->pc == UTE_VIEW_ROOT)
+    {
+        *out_count = view->plan->num_fields;
+        return 0;
+    }
+    const struct ute_insn *insn = &view->plan->insns[view->pc];
+    uint64_t count = 0;
+    if (insn->op == UTE_OP_LIST)
+    {
+        if (read_list_header(insn, view->buf, view->len, view->pos, &count) == ERR)
+            return -1;
+    }
+    else if (insn->op == UTE_OP_STRUCT)
+    {
+        // Sparse structs count all their members, present or not
+        uint8_t form = 0;
+        if (read_struct_header(insn, view->buf, view->len, view->pos, &form, &count) == ERR)
+            return -1;
+        count = insn->nfields;
+    }
+    else
+        return -1;
+    *out_count = (size_t)count;
+    return 0;
+}
+
+int ute_view_field(const struct ute_view *view, size_t index, struct ute_view *out_view)
+{
+    if (!view || !out_view)
+        return -1;
+    struct ute_view child = *view;
+    if (view->pc == UTE_VIEW_ROOT)
+    {
+        if (index >= view->plan->num_fields)
+            return -1;
+        child.pos = 0;
+        child.pc = 0;
+    }
+    else
+    {
+        const struct ute_insn *insn = &view->plan->insns[view->pc];
+        uint64_t nfields = 0;
+        uint8_t form = 0;
+        if (insn->op != UTE_OP_STRUCT || index >= insn->nfields)
+            return -1;
+        child.pos = read_struct_header(insn, view->buf, view->len, view->pos, &form, &nfields);
+        if (child.pos == ERR)
+            return -1;
+        if (insn->flags & UTE_INSN_SPARSE)
+            return sparse_field(view, form, nfields, index, &child, out_view);
+        child.pc = view->pc + 1;
+    }
+    if (skip_siblings(&child, index, 0) != 0)
+        return -1;
+    *out_view = child;
+    return 0;
+}
+
+int ute_view_elem(const struct ute_view *view, size_t index, struct ute_view *out_view)
+{
+    if (!view || !out_view || view->pc == UTE_VIEW_ROOT)
+        return -1;
+    const struct ute_insn *insn = &view->plan->insns[view->pc];
+    uint64_t count = 0;
+    // The elements of a columnar list are only reachable column by column
+    if (insn->op != UTE_OP_LIST || (insn->flags & UTE_INSN_COLUMNAR))
+        return -1;
+    struct ute_view child = *view;
+    child.pos = read_list_header(insn, view->buf, view->len, view->pos, &count);
+    if (child.pos == ERR || index >= count)
+        return -1;
+    if (insn->flags & UTE_INSN_CHUNKED)
+    {
+        // Jump over the chunks before the one holding the element
+        uint64_t per = 0;
+        size_t pos = ute_read_chunks(view->buf, child.pos, view->len, count, &per, NULL);
+        if (pos == ERR)
+            return -1;
+        uint64_t nchunks = count / per + (count % per != 0);
+        const uint8_t *table = view->buf + pos - (size_t)nchunks * UTE_CHUNK_ENTRY;
+        for (size_t c = 0; c < (size_t)(index / per); ++c)
+            pos += ute_chunk_size(table, c);
+        child.pos = pos;
+        index = (size_t)(index % per);
+    }
+    child.pc = view->pc + 1;
+    if (skip_siblings(&child, index, 1) != 0)
+        return -1;
+    *out_view = child;
+    return 0;
+}
+
+int ute_view_next(struct ute_view *view)
+{
+    if (!view || view->pc == UTE_VIEW_ROOT)
+        return -1;
+    const struct ute_insn *insns = view->plan->insns;
+    const struct ute_insn *after = &insns[insns[view->pc].next];
+    // A list element is the only instruction between its LIST and LIST_END
+    int is_elem = after->op == UTE_OP_LIST_END && after->next + 1 == view->pc;
+    // The next member of a sparse struct may be absent: use ute_view_field
+    if (!is_elem && (after->op == UTE_OP_STRUCT_END || after->op == UTE_OP_HALT || after->op == UTE_OP_MEMBER))
+        return -1;
+    struct ute_view next = *view;
+    if (skip_siblings(&next, 1, is_elem) != 0)
+        return -1;
+    *view = next;
+    return 0;
+}
+
+// Read the varint of an int or sint node, undoing the zigzag mapping of a sint
+static int view_varint(const struct ute_view *view, uint8_t op, uint64_t *out_value)
+{
+    if (!view || !out_value || view->pc == UTE_VIEW_ROOT || view->plan->insns[view->pc].op != op)
+        return -1;
+    if (is_packed_elem(view->plan->insns, view->pc))
+    {
+        // A delta of the previous element is no value on its own
+        uint32_t mode = view->plan->insns[view->pc - 1].nfields;
+        if (mode == UTE_INTS_DELTA || mode == UTE_INTS_DELTA2 || view->pos >= view->len)
+            return -1;
+        if (!ute_decode_varint(view->buf + view->pos, view->len - view->pos, out_value))
+            return -1;
+    }
+    else if (read_header(view->buf, view->len, view->pos, 2, 1, out_value) == ERR)
+        return -1;
+    if (op == UTE_OP_SINT)
+        *out_value = ute_zigzag_decode(*out_value);
+    return 0;
+}
+
+int ute_view_int(const struct ute_view *view, uint64_t *out_value)
+{
+    return view_varint(view, UTE_OP_INT, out_value);
+}
+
+int ute_view_sint(const struct ute_view *view, int64_t *out_value)
+{
+    uint64_t v = 0;
+    if (!out_value || view_varint(view, UTE_OP_SINT, &v) != 0)
+        return -1;
+    *out_value = (int64_t)v;
+    return 0;
+}
+
+int ute_view_bool(const struct ute_view *view, int *out_value)
+{
+    if (!view || !out_value || view->pc == UTE_VIEW_ROOT || view->plan->insns[view->pc].op != UTE_OP_BOOL)
+        return -1;
+    if (view->pos >= view->len || (view->buf[view->pos] >> 5) != 1)
+        return -1;
+    *out_value = (view->buf[view->pos] & 0x10) != 0;
+    return 0;
+}
+
+int ute_view_string(const struct ute_view *view, struct ute_slice *out_slice)
+{
+    if (!view || !out_slice || view->pc == UTE_VIEW_ROOT || view->plan->insns[view->pc].op != UTE_OP_STRING)
+        return -1;
+    uint64_t len = 0;
+    uint8_t flags = view->pos < view->len ? view->buf[view->pos] & UTE_PREFIX_FLAGS : 0;
+    size_t pos = read_header(view->buf, view->len, view->pos, 3, 1, &len);
+    if (pos == ERR)
+        return -1;
+    if (flags == UTE_STRING_REF)
+    {
+        // The slice of the string referred to, anywhere earlier in the message.
+        // A view reads no other value, so it cannot tell a target that is a
+        // string from bytes that look like one: ute_validate_plan can.
+        size_t size = 0;
+        pos = ute_resolve_ref(view->buf, view->pos, len, &size);
+        if (pos == ERR)
+            return -1;
+        len = size;
+    }
+    else if (flags == UTE_STRING_DICT)
+    {
+        size_t size = 0;
+        const char *value = ute_dictionary_value(&view->plan->dictionary, len, &size);
+        if (!value)
+            return -1;
+        out_slice->data = (const uint8_t *)value;
+        out_slice->len = size;
+        return 0;
+    }
+    else if (flags || len > view->len - pos)
+        return -1;
+    out_slice->data = view->buf + pos;
+    out_slice->len = (size_t)len;
+    return 0;
+}
+
+int ute_view_float32(const struct ute_view *view, float *out_value)
+{
+    return view_fixed(view, UTE_OP_FLOAT32, out_value);
+}
+
+int ute_view_float64(const struct ute_view *view, double *out_value)
+{
+    return view_fixed(view, UTE_OP_FLOAT64, out_value);
+}
+
+int ute_view_fixed32(const struct ute_view *view, uint32_t *out_value)
+{
+    return view_fixed(view, UTE_OP_FIXED32, out_value);
+}
+
+int ute_view_fixed64(const struct ute_view *view, uint64_t *out_value)
+{
+    return view_fixed(view, UTE_OP_FIXED64, out_value);
+}
+
+int ute_view_bytes(const struct ute_view *view, struct ute_slice *out_slice)
+{
+    if (!view || !out_slice || view->pc == UTE_VIEW_ROOT || view->plan->insns[view->pc].op != UTE_OP_BYTES)
+        return -1;
+    uint64_t len = 0;
+    if (view->pos < view->len && (view->buf[view->pos] & UTE_PREFIX_FLAGS))
+        return -1;
+    size_t pos = read_header(view->buf, view->len, view->pos, 6, 1, &len);
+    if (pos == ERR || len > view->len - pos)
+        return -1;
+    out_slice->data = view->buf + pos;
+    out_slice->len = (size_t)len;
+    return 0;
+}
+
+int ute_view_array(const struct ute_view *view, struct ute_slice *out_slice)
+{
+    if (!view || !out_slice || view->pc == UTE_VIEW_ROOT)
+        return -1;
+    const struct ute_insn *insn = &view->plan->insns[view->pc];
+    uint64_t count = 0;
+    if (insn->op != UTE_OP_LIST || !(insn->flags & UTE_INSN_FIXED))
+        return -1;
+    size_t pos = read_list_header(insn, view->buf, view->len, view->pos, &count);
+    if (pos == ERR || skip_fixed(view->len, pos, count, insn->arg) == ERR)
+        return -1;
+    out_slice->data = view->buf + pos;
+    out_slice->len = (size_t)count * insn->arg;
+    return 0;
+}
+
+int ute_view_raw(const struct ute_view *view, struct ute_slice *out_slice)
+{
+    if (!view || !out_slice)
+        return -1;
+    size_t end;
+    if (view->pc == UTE_VIEW_ROOT)
+    {
+        struct ute_view child = *view;
+        child.pos = 0;
+        child.pc = 0;
+        if (skip_siblings(&child, view->plan->num_fields, 0) != 0)
+            return -1;
+        end = child.pos;
+    }
+    else
+    {
+        end = skip_node(view->plan->insns, view->pc, view->buf, view->len, view->pos);
+        if (end == ERR)
+            return -1;
+    }
+    out_slice->data = view->buf + view->pos;
+    out_slice->len = end - view->pos;
+    return 0;
+}
+
+int ute_view_column(const struct ute_view *view, size_t index, struct ute_column *out_column)
+{
+    if (!view || !out_column || view->pc == UTE_VIEW_ROOT)
+        return -1;
+    const struct ute_insn *insn = &view->plan->insns[view->pc];
+    uint64_t count = 0;
+    if (insn->op != UTE_OP_LIST || !(insn->flags & UTE_INSN_COLUMNAR) || index >= insn[1].nfields)
+        return -1;
+    size_t pos = read_list_header(insn, view->buf, view->len, view->pos, &count);
+    if (pos != ERR)
+        pos = read_columns(insn, view->buf, view->len, pos);
+    // Skip the preceding columns without looking at them
+    for (size_t i = 0; i < index && pos != ERR; ++i)
+        pos = skip_column(view->buf, view->len, pos, NULL);
+    if (pos == ERR || skip_column(view->buf, view->len, pos, &out_column->data) == ERR)
+        return -1;
+    // The members of a flat struct are single instructions after the STRUCT
+    out_column->type = op_type(insn[2 + index].op);
+    out_column->count = (size_t)count;
+    return 0;
+}
+
+int ute_column_ints(const struct ute_column *column, uint64_t *out_values)
+{
+    if (!column || column->type != UTE_TYPE_INT || (!out_values && column->count))
+        return -1;
+    if (column->count == 0)
+        return column->data.len == 0 ? 0 : -1;
+    size_t len = ute_decode_varints(column->data.data, column->data.len, out_values, column->count);
+    return len && len == column->data.len ? 0 : -1;
+}
+
+int ute_column_bools(const struct ute_column *column, uint8_t *out_values)
+{
+    if (!column || column->type != UTE_TYPE_BOOL || (!out_values && column->count))
+        return -1;
+    size_t count = column->count;
+    if (column->data.len != count / 8 + (count % 8 != 0) || (count % 8 && (column->data.data[count / 8] >> (count % 8))))
+        return -1;
+    for (size_t i = 0; i < count; ++i)
+        out_values[i] = (column->data.data[i / 8] >> (i % 8)) & 1;
+    return 0;
+}
+
+int ute_column_strings(const struct ute_column *column, struct ute_slice *out_values)
+{
+    if (!column || column->type != UTE_TYPE_STRING || (!out_values && column->count))
+        return -1;
+    const uint8_t *in = column->data.data;
+    size_t in_size = column->data.len;
+    if (column->count == 0)
+        return in_size == 0 ? 0 : -1;
+    // All lengths first, then all bytes
+    size_t pos = ute_skip_varints(in, in_size, column->count);
+    if (pos == 0)
+        return -1;
+    size_t bytes = pos;
+    pos = 0;
+    for (size_t i = 0; i < column->count; ++i)
+    {
+        uint64_t len = 0;
+        pos += ute_decode_varint(in + pos, in_size - pos, &len);
+        if (len > in_size - bytes)
+            return -1;
+        out_values[i].data = in + bytes;
+        out_values[i].len = (size_t)len;
+        bytes += (size_t)len;
+    }
+    return bytes == in_size ? 0 : -1;
+}
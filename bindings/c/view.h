@@ -0,0 +1,97 @@
+#ifndef UTE_VIEW_H
+#define UTE_VIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ute_plan;
+
+// Plan index of a view over a whole message (its top-level fields)
+#define UTE_VIEW_ROOT UINT32_MAX
+
+// Read-only byte range inside the viewed buffer (not NUL-terminated)
+struct ute_slice
+{
+    const uint8_t *data;
+    size_t len;
+};
+
+// One member column of a columnar list: the values of that member for all
+// elements, still encoded (see ute_view_column)
+struct ute_column
+{
+    int type;              // UTE_TYPE_* of the member
+    size_t count;          // number of elements
+    struct ute_slice data; // encoded column
+};
+
+// Lazy, read-only cursor over one encoded node of a UTE buffer. A view only
+// records where the node starts; nothing is decoded until it is accessed,
+// and strings are returned as slices into the original buffer.
+struct ute_view
+{
+    const struct ute_plan *plan;
+    const uint8_t *buf; // whole message
+    size_t len;         // size of the whole message
+    size_t pos;         // offset of this node's type prefix
+    uint32_t pc;        // plan instruction of this node, or UTE_VIEW_ROOT
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Create a view over a whole message; its fields are the top-level fields (returns 0 on success)
+    int ute_view_init(struct ute_view *out_view, const uint8_t *buf, size_t len, const struct ute_plan *plan);
+    // Field type of the viewed node (UTE_TYPE_*), or -1 for a message view
+    int ute_view_type(const struct ute_view *view);
+    // Number of list elements, struct fields or top-level fields (returns 0 on success)
+    int ute_view_count(const struct ute_view *view, size_t *out_count);
+    // View of the index-th field of a struct or message (skips the preceding fields).
+    // Fails for a member of a sparse struct that the instance does not encode.
+    int ute_view_field(const struct ute_view *view, size_t index, struct ute_view *out_view);
+    // View of the index-th element of a list (skips the preceding elements; not for columnar lists)
+    int ute_view_elem(const struct ute_view *view, size_t index, struct ute_view *out_view);
+    // Advance a field or element view to its next sibling (the caller tracks the
+    // count; not for the members of sparse structs)
+    int ute_view_next(struct ute_view *view);
+    // Decode an int or sint node. Fails for an element of a delta-encoded list,
+    // which only holds the difference to the element before it.
+    int ute_view_int(const struct ute_view *view, uint64_t *out_value);
+    int ute_view_sint(const struct ute_view *view, int64_t *out_value);
+    // Decode a bool node
+    int ute_view_bool(const struct ute_view *view, int *out_value);
+    // Get a string node as a slice into the buffer (no copy). A back-reference
+    // gives the slice of the string it repeats, a dictionary id the value in
+    // the plan's dictionary.
+    int ute_view_string(const struct ute_view *view, struct ute_slice *out_slice);
+    // Decode a float32, float64, fixed32 or fixed64 node (also an element of a fixed list)
+    int ute_view_float32(const struct ute_view *view, float *out_value);
+    int ute_view_float64(const struct ute_view *view, double *out_value);
+    int ute_view_fixed32(const struct ute_view *view, uint32_t *out_value);
+    int ute_view_fixed64(const struct ute_view *view, uint64_t *out_value);
+    // Get a bytes node as a slice into the buffer (no copy)
+    int ute_view_bytes(const struct ute_view *view, struct ute_slice *out_slice);
+    // Get the elements of a list of fixed-width values as their raw little-endian
+    // array in the buffer (no copy; count * width bytes). On little-endian hosts
+    // an array at a suitably aligned address can be read in place.
+    int ute_view_array(const struct ute_view *view, struct ute_slice *out_slice);
+    // Get the complete encoding of a node (prefix included), e.g. to forward it
+    // unchanged. Back-references in it only resolve within the original message.
+    int ute_view_raw(const struct ute_view *view, struct ute_slice *out_slice);
+
+    // Column of the index-th member of a columnar list (the other columns are skipped, not read)
+    int ute_view_column(const struct ute_view *view, size_t index, struct ute_column *out_column);
+    // Decode an int column into count values
+    int ute_column_ints(const struct ute_column *column, uint64_t *out_values);
+    // Decode a bool column into count bytes (0 or 1)
+    int ute_column_bools(const struct ute_column *column, uint8_t *out_values);
+    // Get the count strings of a string column as slices into the buffer
+    int ute_column_strings(const struct ute_column *column, struct ute_slice *out_values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTE_VIEW_H
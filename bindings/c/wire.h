@@ -0,0 +1,121 @@
+#ifndef UTE_WIRE_H
+#define UTE_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Internal header: flag bits carried in the low five bits of a type prefix.
+// Plain encodings leave them zero; decoders reject flags they do not expect.
+// Also declares the plan-free value skipper shared by the codex and views.
+
+// Type 6 (fixed): the value is 4 or 8 raw little-endian bytes (float32 and
+// fixed32, float64 and fixed64); without either flag it is a bytes value,
+// a varint length followed by the data
+#define UTE_FIXED_32 0x04
+#define UTE_FIXED_64 0x08
+
+// Type prefix of a fixed-width value of width (4 or 8) bytes
+#define UTE_FIXED_PREFIX(width) ((6 << 5) | ((width) == 8 ? UTE_FIXED_64 : UTE_FIXED_32))
+
+// List: elements are ints encoded as bare varints (no per-element prefix)
+#define UTE_LIST_PACKED 0x01
+// List: struct elements are encoded column by column (see RFC section 4.1)
+#define UTE_LIST_COLUMNAR 0x02
+// List: elements are 4 or 8 byte fixed-width values, encoded as one raw
+// little-endian array (see RFC section 4.1)
+#define UTE_LIST_FIXED32 0x04
+#define UTE_LIST_FIXED64 0x08
+// List: the elements are split into chunks, preceded by the number of
+// elements per chunk and a table with the size of every chunk (see RFC
+// section 4.1)
+#define UTE_LIST_CHUNKED 0x10
+
+// Size of one entry of the chunk table (u32 little-endian)
+#define UTE_CHUNK_ENTRY 4
+
+// Struct: only the members that are present follow, each preceded by its
+// index; the count is the number of members present (see RFC section 4.1)
+#define UTE_STRUCT_SPARSE 0x01
+// Struct: the member count is followed by a bitmap of the members present,
+// then by their values
+#define UTE_STRUCT_BITMAP 0x02
+
+// List prefix flags of a LIST instruction (see plan.h; fixed lists: arg is the element width)
+#define UTE_LIST_FLAGS(insn)                                                                                  \
+    ((((insn)->flags & UTE_INSN_PACKED) ? UTE_LIST_PACKED : 0) | (((insn)->flags & UTE_INSN_COLUMNAR) ? UTE_LIST_COLUMNAR : 0) | \
+     (((insn)->flags & UTE_INSN_FIXED) ? ((insn)->arg == 8 ? UTE_LIST_FIXED64 : UTE_LIST_FIXED32) : 0) |                         \
+     (((insn)->flags & UTE_INSN_CHUNKED) ? UTE_LIST_CHUNKED : 0))
+
+// String: the varint is not a length but the distance in bytes back from
+// this prefix to the prefix of one of the latest 256 plain strings of dict
+// fields of the same message (or chunk of a chunked list), whose value is
+// repeated (see RFC section 4.1)
+#define UTE_STRING_REF 0x01
+// String: the varint is the id of a value of the shared dictionary of the
+// schema version (see RFC section 4.1)
+#define UTE_STRING_DICT 0x02
+
+// Mask of the flag bits of a type prefix
+#define UTE_PREFIX_FLAGS 0x1F
+
+// Optional message header: this prefix (type 7, no flags), then the schema
+// version as a varint (see RFC section 4.6)
+#define UTE_VERSION_TAG 0xE0
+
+// Compressed envelope around a whole message: this prefix (type 7, flags 1),
+// the codec id, the message size and the blocks (see RFC section 10)
+#define UTE_ENVELOPE 0xE1
+
+// Skip one encoded value of any type at in + read, without a plan (returns
+// the offset past it, or (size_t)-1 if it is malformed or truncated)
+size_t ute_skip_value(const uint8_t *in, size_t read, size_t in_size);
+
+// Resolve the back-reference whose prefix is at in + at: the plain string
+// distance bytes before it, which must end before the reference. Returns the
+// offset of its data (its length in *out_len), or (size_t)-1 if the
+// reference is invalid. Only decoders that read the whole message check that
+// the target is a string a decoder has read, and not bytes inside another
+// value that look like one.
+size_t ute_resolve_ref(const uint8_t *in, size_t at, uint64_t distance, size_t *out_len);
+
+// Read the chunk header of a chunked list of count elements at in + read: the
+// number of elements per chunk (stored to *out_per) and the chunk table.
+// Returns the offset of the first chunk, or (size_t)-1 if the header is
+// malformed or the chunks do not fit in in_size; *out_end (optional)
+// receives the offset past the last chunk.
+size_t ute_read_chunks(const uint8_t *in, size_t read, size_t in_size, uint64_t count, uint64_t *out_per, size_t *out_end);
+
+// Size of chunk i of a chunk table
+static inline size_t ute_chunk_size(const uint8_t *table, size_t i)
+{
+    const uint8_t *p = table + i * UTE_CHUNK_ENTRY;
+    return (size_t)p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16 | (size_t)p[3] << 24;
+}
+
+// True if fixed-width values are stored in wire (little-endian) order in memory
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define UTE_NATIVE_LE 0
+#else
+#define UTE_NATIVE_LE 1
+#endif
+
+// Copy count fixed-width values of width bytes between host byte order and
+// the little-endian wire order (the conversion is its own inverse). On
+// little-endian hosts this is a single memcpy.
+static inline void ute_copy_le(void *dst, const void *src, size_t count, size_t width)
+{
+#if !UTE_NATIVE_LE
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    for (size_t i = 0; i < count; ++i, d += width, s += width)
+    {
+        for (size_t j = 0; j < width; ++j)
+            d[j] = s[width - 1 - j];
+    }
+#else
+    memcpy(dst, src, count * width);
+#endif
+}
+
+#endif // UTE_WIRE_H
@@ -0,0 +1,195 @@
+// Benchmark and wire-compatibility check of the C++ binding against the C
+// codex, on the schema of schemas/complex.yaml (a list of devices).
+//
+//   ./bench [devices] [iterations]
+
+#include "ute.hpp"
+
+extern "C"
+{
+#include "codex.h"
+#include "plan.h"
+#include "schema.h"
+}
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The same message with different member types; all encode identically
+struct device
+{
+    std::uint64_t id;
+    std::string name;
+};
+struct fleet
+{
+    std::vector<device> devices;
+};
+
+struct pmr_device
+{
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    pmr_device(const allocator_type &alloc = {}) : name(alloc) {}
+    pmr_device(const pmr_device &other, const allocator_type &alloc = {}) : id(other.id), name(other.name, alloc) {}
+    std::uint64_t id = 0;
+    std::pmr::string name;
+};
+struct pmr_fleet
+{
+    std::pmr::vector<pmr_device> devices;
+};
+
+struct view_device
+{
+    std::uint64_t id;
+    std::string_view name;
+};
+struct view_fleet
+{
+    std::vector<view_device> devices;
+};
+
+// C layout, as used by the C codex (string capacity 32)
+struct c_device
+{
+    std::uint64_t id;
+    char name[32];
+};
+struct c_fleet
+{
+    std::vector<c_device> devices;
+};
+
+UTE_SCHEMA(device, UTE_FIELD(id), UTE_FIELD(name));
+UTE_SCHEMA(fleet, UTE_FIELD(devices));
+UTE_SCHEMA(pmr_device, UTE_FIELD(id), UTE_FIELD(name));
+UTE_SCHEMA(pmr_fleet, UTE_FIELD(devices));
+UTE_SCHEMA(view_device, UTE_FIELD(id), UTE_FIELD(name));
+UTE_SCHEMA(view_fleet, UTE_FIELD(devices));
+UTE_SCHEMA(c_device, UTE_FIELD(id), UTE_FIELD(name));
+UTE_SCHEMA(c_fleet, UTE_FIELD(devices));
+
+using bench_clock = std::chrono::steady_clock;
+
+// Keeps the optimizer from dropping benchmarked work
+static volatile std::size_t sink;
+
+template <class F>
+static double time_ns(std::size_t iterations, F &&f)
+{
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        sink = sink + f();
+    std::chrono::duration<double, std::nano> elapsed = bench_clock::now() - start;
+    return elapsed.count() / static_cast<double>(iterations);
+}
+
+static void report(const char *label, double ns, std::size_t bytes)
+{
+    std::printf("  %-28s %10.0f ns/msg %8.1f MB/s\n", label, ns, static_cast<double>(bytes) * 1e3 / ns);
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    std::size_t iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+    if (n == 0 || iterations == 0)
+    {
+        std::fprintf(stderr, "usage: bench [devices] [iterations]\n");
+        return 2;
+    }
+
+    struct ute_schema schema = {};
+    struct ute_plan plan;
+    if (ParseSchema("../../schemas/complex.yaml", &schema) != 0 || ute_compile(&schema.versions[0], &plan) != 0)
+    {
+        std::fprintf(stderr, "Failed to load schema from YAML\n");
+        return 1;
+    }
+
+    // Same data in C and C++ form
+    std::vector<c_device> c_devices(n);
+    fleet msg;
+    c_fleet c_msg;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        c_devices[i].id = i * 7919;
+        std::snprintf(c_devices[i].name, sizeof(c_devices[i].name), "device-%zu", i);
+        msg.devices.push_back({c_devices[i].id, c_devices[i].name});
+    }
+    c_msg.devices = c_devices;
+    std::vector<void *> c_list(1 + n), c_out_list(1 + n);
+    std::vector<c_device> c_out(n);
+    c_list[0] = reinterpret_cast<void *>(static_cast<std::uintptr_t>(n));
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        c_list[1 + i] = &c_devices[i];
+        c_out_list[1 + i] = &c_out[i];
+    }
+    void *c_top[1] = {c_list.data()};
+    void *c_out_top[1] = {c_out_list.data()};
+
+    // Wire compatibility: identical bytes, and each side reads the other's output
+    std::size_t size = ute::encoded_size(msg);
+    std::vector<std::uint8_t> c_buf(size), buf(size), c_layout_buf(size);
+    std::size_t c_written = ute_serialize_plan(c_top, &plan, c_buf.data(), c_buf.size());
+    std::size_t written = ute::encode(msg, buf.data(), buf.size());
+    std::size_t c_layout_written = ute::encode(c_msg, c_layout_buf.data(), c_layout_buf.size());
+    if (c_written != size || written != size || c_layout_written != size || buf != c_buf || c_layout_buf != c_buf)
+    {
+        std::fprintf(stderr, "FAIL: C++ encoding differs from the C codex\n");
+        return 1;
+    }
+    fleet decoded;
+    view_fleet views;
+    if (ute::decode(c_buf.data(), c_buf.size(), decoded) != size || ute::decode(c_buf.data(), c_buf.size(), views) != size ||
+        ute_deserialize_plan(buf.data(), buf.size(), &plan, c_out_top) != size)
+    {
+        std::fprintf(stderr, "FAIL: decoding the other side's output failed\n");
+        return 1;
+    }
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (decoded.devices[i].id != c_devices[i].id || decoded.devices[i].name != c_devices[i].name ||
+            views.devices[i].name != c_devices[i].name || c_out[i].id != c_devices[i].id || std::strcmp(c_out[i].name, c_devices[i].name) != 0)
+        {
+            std::fprintf(stderr, "FAIL: device %zu differs after decoding\n", i);
+            return 1;
+        }
+    }
+    if (ute::encode(msg, buf.data(), size - 1) != ute::error || ute::decode(c_buf.data(), size - 1, decoded) != ute::error)
+    {
+        std::fprintf(stderr, "FAIL: short buffers must be rejected\n");
+        return 1;
+    }
+    std::printf("C and C++ encodings identical (%zu devices, %zu bytes)\n", n, size);
+
+    // Timings
+    std::printf("Encode:\n");
+    report("C ute_serialize_plan", time_ns(iterations, [&] { return ute_serialize_plan(c_top, &plan, c_buf.data(), c_buf.size()); }), size);
+    report("C++ std::string", time_ns(iterations, [&] { return ute::encode(msg, buf.data(), buf.size()); }), size);
+    report("C++ char[32]", time_ns(iterations, [&] { return ute::encode(c_msg, buf.data(), buf.size()); }), size);
+
+    std::printf("Decode:\n");
+    report("C ute_deserialize_plan", time_ns(iterations, [&] { return ute_deserialize_plan(c_buf.data(), size, &plan, c_out_top); }), size);
+    report("C++ std::string", time_ns(iterations, [&] { return ute::decode(c_buf.data(), size, decoded); }), size);
+    report("C++ char[32]", time_ns(iterations, [&] { return ute::decode(c_buf.data(), size, c_msg); }), size);
+    report("C++ std::string_view", time_ns(iterations, [&] { return ute::decode(c_buf.data(), size, views); }), size);
+    std::vector<std::byte> arena(size * 4 + 64 * n);
+    report("C++ std::pmr (monotonic)", time_ns(iterations, [&] {
+               std::pmr::monotonic_buffer_resource resource(arena.data(), arena.size());
+               pmr_fleet pmr_msg{std::pmr::vector<pmr_device>(&resource)};
+               return ute::decode(c_buf.data(), size, pmr_msg);
+           }),
+           size);
+
+    ute_plan_free(&plan);
+    FreeSchema(&schema);
+    return 0;
+}
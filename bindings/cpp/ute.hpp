@@ -0,0 +1,694 @@
+#ifndef UTE_HPP
+#define UTE_HPP
+
+// Header-only C++17 binding for Ultra Tiny Encoding (UTE).
+//
+// A schema is attached to a struct at compile time, and encode/decode are
+// templates specialized for it: every field is handled by code generated for
+// its exact C++ type, with no schema interpretation at runtime. The wire
+// format is the one of the C codex (see RFC.md).
+//
+//   struct device { std::uint64_t id; std::string name; };
+//   struct fleet { std::vector<device> devices; };
+//   UTE_SCHEMA(device, UTE_FIELD(id), UTE_FIELD(name));
+//   UTE_SCHEMA(fleet, UTE_FIELD(devices));
+//
+// Supported member types: bool, unsigned integers, ute::null_t,
+// std::basic_string (std::string, std::pmr::string), std::string_view,
+// char[N] (C layout), std::vector (std::pmr::vector) of any of these,
+// std::span (encode only, C++20) and nested structs with a schema.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define UTE_HPP_SPAN 1
+#endif
+
+namespace ute
+{
+
+// Returned by encode/decode on failure (same value as UTE_BUF_ERROR)
+inline constexpr std::size_t error = static_cast<std::size_t>(-1);
+
+// Member type of a null field
+struct null_t
+{
+};
+
+// Member flags (the schema attributes `packed` and `columnar`)
+inline constexpr unsigned packed_flag = 0x01;
+inline constexpr unsigned columnar_flag = 0x02;
+
+// One schema field: a pointer to a data member plus flags
+template <auto Member, unsigned Flags = 0>
+struct member
+{
+    static constexpr auto ptr = Member;
+    static constexpr unsigned flags = Flags;
+};
+
+// The fields of a struct, in schema order
+template <class... Members>
+struct field_list
+{
+    static constexpr std::size_t size = sizeof...(Members);
+};
+
+// Schema of a struct: specialize with `using fields = field_list<...>` (see UTE_SCHEMA)
+template <class T>
+struct schema
+{
+};
+
+namespace detail
+{
+
+// Type prefixes (high three bits) and list flags (low five bits)
+inline constexpr std::uint8_t t_null = 0 << 5;
+inline constexpr std::uint8_t t_bool = 1 << 5;
+inline constexpr std::uint8_t t_int = 2 << 5;
+inline constexpr std::uint8_t t_bytes = 3 << 5;
+inline constexpr std::uint8_t t_list = 4 << 5;
+inline constexpr std::uint8_t t_struct = 5 << 5;
+inline constexpr std::uint8_t list_packed = 0x01;
+inline constexpr std::uint8_t list_columnar = 0x02;
+
+// -------------------------
+// Varints
+// -------------------------
+
+inline std::size_t varint_size(std::uint64_t v)
+{
+    std::size_t n = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+inline std::uint8_t *put_varint(std::uint64_t v, std::uint8_t *p)
+{
+    while (v >= 0x80)
+    {
+        *p++ = static_cast<std::uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<std::uint8_t>(v);
+    return p;
+}
+
+// Read a varint; returns the position past it, or nullptr on truncation/overflow
+inline const std::uint8_t *get_varint(const std::uint8_t *p, const std::uint8_t *end, std::uint64_t &v)
+{
+    if (p < end && *p < 0x80)
+    {
+        v = *p;
+        return p + 1;
+    }
+    std::uint64_t result = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7)
+    {
+        std::uint8_t b = *p++;
+        if (shift == 63 && b > 1)
+            return nullptr;
+        result |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            v = result;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// Read a type prefix and check its type and flags
+inline const std::uint8_t *get_prefix(const std::uint8_t *p, const std::uint8_t *end, std::uint8_t prefix)
+{
+    return p < end && *p == prefix ? p + 1 : nullptr;
+}
+
+// -------------------------
+// Type traits
+// -------------------------
+
+template <class T, class = void>
+struct has_schema : std::false_type
+{
+};
+template <class T>
+struct has_schema<T, std::void_t<typename schema<T>::fields>> : std::true_type
+{
+};
+
+template <class T>
+struct is_uint : std::bool_constant<std::is_integral_v<T> && std::is_unsigned_v<T> && !std::is_same_v<T, bool>>
+{
+};
+
+// Value type of a pointer to data member
+template <class P>
+struct member_value;
+template <class C, class V>
+struct member_value<V C::*>
+{
+    using type = V;
+};
+template <class M>
+using member_t = typename member_value<std::remove_cv_t<decltype(M::ptr)>>::type;
+
+// String-like types: a view for encoding, and assignment from decoded bytes
+template <class T>
+struct string_traits : std::false_type
+{
+};
+template <class Tr, class A>
+struct string_traits<std::basic_string<char, Tr, A>> : std::true_type
+{
+    static std::string_view view(const std::basic_string<char, Tr, A> &s) { return {s.data(), s.size()}; }
+    static bool assign(std::basic_string<char, Tr, A> &s, const char *data, std::size_t len)
+    {
+        s.assign(data, len);
+        return true;
+    }
+};
+template <>
+struct string_traits<std::string_view> : std::true_type
+{
+    static std::string_view view(std::string_view s) { return s; }
+    // Decoded views point into the input buffer
+    static bool assign(std::string_view &s, const char *data, std::size_t len)
+    {
+        s = std::string_view(data, len);
+        return true;
+    }
+};
+template <std::size_t N>
+struct string_traits<char[N]> : std::true_type
+{
+    static std::string_view view(const char (&s)[N]) { return {s, strnlen(s, N)}; }
+    // C layout: NUL-terminated within the array, like an inline string of capacity N
+    static bool assign(char (&s)[N], const char *data, std::size_t len)
+    {
+        if (len >= N)
+            return false;
+        std::memcpy(s, data, len);
+        s[len] = 0;
+        return true;
+    }
+};
+
+// List-like types
+template <class T>
+struct list_traits : std::false_type
+{
+};
+template <class E, class A>
+struct list_traits<std::vector<E, A>> : std::true_type
+{
+    using elem = E;
+    static constexpr bool decodable = true;
+};
+#ifdef UTE_HPP_SPAN
+template <class E, std::size_t X>
+struct list_traits<std::span<E, X>> : std::true_type
+{
+    using elem = std::remove_cv_t<E>;
+    static constexpr bool decodable = false;
+};
+#endif
+
+template <class>
+inline constexpr bool always_false = false;
+
+// -------------------------
+// Value codecs
+// -------------------------
+
+template <class T>
+struct codec;
+
+template <class Fields>
+struct fields_codec;
+
+// Size, write and read of one value of type T (prefix included)
+template <class T>
+struct codec
+{
+    static std::size_t size(const T &v)
+    {
+        if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, null_t>)
+            return (void)v, 1;
+        else if constexpr (is_uint<T>::value)
+            return 1 + varint_size(v);
+        else if constexpr (string_traits<T>::value)
+        {
+            std::size_t len = string_traits<T>::view(v).size();
+            return 1 + varint_size(len) + len;
+        }
+        else if constexpr (list_traits<T>::value)
+        {
+            std::size_t n = 1 + varint_size(v.size());
+            for (const auto &e : v)
+                n += codec<typename list_traits<T>::elem>::size(e);
+            return n;
+        }
+        else if constexpr (has_schema<T>::value)
+            return 1 + varint_size(schema<T>::fields::size) + fields_codec<typename schema<T>::fields>::size(v);
+        else
+            static_assert(always_false<T>, "type not supported by UTE");
+    }
+
+    static std::uint8_t *put(const T &v, std::uint8_t *p)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+            *p++ = t_bool | (v ? 0x10 : 0);
+        else if constexpr (std::is_same_v<T, null_t>)
+            *p++ = t_null;
+        else if constexpr (is_uint<T>::value)
+        {
+            *p++ = t_int;
+            p = put_varint(v, p);
+        }
+        else if constexpr (string_traits<T>::value)
+        {
+            std::string_view s = string_traits<T>::view(v);
+            *p++ = t_bytes;
+            p = put_varint(s.size(), p);
+            std::memcpy(p, s.data(), s.size());
+            p += s.size();
+        }
+        else if constexpr (list_traits<T>::value)
+        {
+            *p++ = t_list;
+            p = put_varint(v.size(), p);
+            for (const auto &e : v)
+                p = codec<typename list_traits<T>::elem>::put(e, p);
+        }
+        else
+        {
+            *p++ = t_struct;
+            p = put_varint(schema<T>::fields::size, p);
+            p = fields_codec<typename schema<T>::fields>::put(v, p);
+        }
+        return p;
+    }
+
+    static const std::uint8_t *get(T &v, const std::uint8_t *p, const std::uint8_t *end)
+    {
+        if (p >= end)
+            return nullptr;
+        std::uint8_t h = *p++;
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            if ((h >> 5) != 1)
+                return nullptr;
+            v = (h & 0x10) != 0;
+            return p;
+        }
+        else if constexpr (std::is_same_v<T, null_t>)
+            return (h >> 5) == 0 ? p : nullptr;
+        else if constexpr (is_uint<T>::value)
+        {
+            std::uint64_t x = 0;
+            if ((h >> 5) != 2 || !(p = get_varint(p, end, x)) || x > std::numeric_limits<T>::max())
+                return nullptr;
+            v = static_cast<T>(x);
+            return p;
+        }
+        else if constexpr (string_traits<T>::value)
+        {
+            std::uint64_t len = 0;
+            // Back-references and dictionary ids (string flags) are not supported
+            if (h != t_bytes || !(p = get_varint(p, end, len)) || len > static_cast<std::uint64_t>(end - p))
+                return nullptr;
+            if (!string_traits<T>::assign(v, reinterpret_cast<const char *>(p), static_cast<std::size_t>(len)))
+                return nullptr;
+            return p + len;
+        }
+        else if constexpr (list_traits<T>::value)
+        {
+            static_assert(list_traits<T>::decodable, "cannot decode into a span");
+            std::uint64_t count = 0;
+            // Every element takes at least one byte
+            if (h != t_list || !(p = get_varint(p, end, count)) || count > static_cast<std::uint64_t>(end - p))
+                return nullptr;
+            v.resize(static_cast<std::size_t>(count));
+            for (auto &e : v)
+            {
+                if (!(p = codec<typename list_traits<T>::elem>::get(e, p, end)))
+                    return nullptr;
+            }
+            return p;
+        }
+        else
+        {
+            std::uint64_t nfields = 0;
+            if ((h >> 5) != 5 || !(p = get_varint(p, end, nfields)) || nfields != schema<T>::fields::size)
+                return nullptr;
+            return fields_codec<typename schema<T>::fields>::get(v, p, end);
+        }
+    }
+};
+
+// -------------------------
+// Packed lists
+// -------------------------
+
+// A list of unsigned ints written as bare varints after one header
+template <class L>
+struct packed_codec
+{
+    static_assert(list_traits<L>::value && is_uint<typename list_traits<L>::elem>::value, "packed requires a list of unsigned ints");
+
+    static std::size_t size(const L &v)
+    {
+        std::size_t n = 1 + varint_size(v.size());
+        for (auto x : v)
+            n += varint_size(x);
+        return n;
+    }
+
+    static std::uint8_t *put(const L &v, std::uint8_t *p)
+    {
+        *p++ = t_list | list_packed;
+        p = put_varint(v.size(), p);
+        for (auto x : v)
+            p = put_varint(x, p);
+        return p;
+    }
+
+    static const std::uint8_t *get(L &v, const std::uint8_t *p, const std::uint8_t *end)
+    {
+        static_assert(list_traits<L>::decodable, "cannot decode into a span");
+        using E = typename list_traits<L>::elem;
+        std::uint64_t count = 0;
+        if (!(p = get_prefix(p, end, t_list | list_packed)) || !(p = get_varint(p, end, count)) || count > static_cast<std::uint64_t>(end - p))
+            return nullptr;
+        v.resize(static_cast<std::size_t>(count));
+        for (auto &e : v)
+        {
+            std::uint64_t x = 0;
+            if (!(p = get_varint(p, end, x)) || x > std::numeric_limits<E>::max())
+                return nullptr;
+            e = static_cast<E>(x);
+        }
+        return p;
+    }
+};
+
+// -------------------------
+// Columnar lists
+// -------------------------
+
+// One column: the values of member M over all elements of a list
+template <class M>
+struct column
+{
+    using V = member_t<M>;
+
+    template <class L>
+    static std::size_t size(const L &list)
+    {
+        if constexpr (std::is_same_v<V, null_t>)
+            return 0;
+        else if constexpr (std::is_same_v<V, bool>)
+            return (list.size() + 7) / 8;
+        else
+        {
+            std::size_t n = 0;
+            for (const auto &e : list)
+            {
+                if constexpr (is_uint<V>::value)
+                    n += varint_size(e.*M::ptr);
+                else
+                {
+                    std::size_t len = string_traits<V>::view(e.*M::ptr).size();
+                    n += varint_size(len) + len;
+                }
+            }
+            return n;
+        }
+    }
+
+    template <class L>
+    static std::uint8_t *put(const L &list, std::uint8_t *p)
+    {
+        p = put_varint(size(list), p);
+        if constexpr (std::is_same_v<V, bool>)
+        {
+            std::size_t i = 0;
+            std::uint8_t bits = 0;
+            for (const auto &e : list)
+            {
+                bits |= static_cast<std::uint8_t>((e.*M::ptr ? 1 : 0) << (i % 8));
+                if (++i % 8 == 0)
+                {
+                    *p++ = bits;
+                    bits = 0;
+                }
+            }
+            if (i % 8)
+                *p++ = bits;
+        }
+        else if constexpr (is_uint<V>::value)
+        {
+            for (const auto &e : list)
+                p = put_varint(e.*M::ptr, p);
+        }
+        else if constexpr (string_traits<V>::value)
+        {
+            for (const auto &e : list)
+                p = put_varint(string_traits<V>::view(e.*M::ptr).size(), p);
+            for (const auto &e : list)
+            {
+                std::string_view s = string_traits<V>::view(e.*M::ptr);
+                std::memcpy(p, s.data(), s.size());
+                p += s.size();
+            }
+        }
+        return p;
+    }
+
+    template <class L>
+    static const std::uint8_t *get(L &list, const std::uint8_t *p, const std::uint8_t *end)
+    {
+        std::uint64_t col_size = 0;
+        if (!(p = get_varint(p, end, col_size)) || col_size > static_cast<std::uint64_t>(end - p))
+            return nullptr;
+        const std::uint8_t *col_end = p + col_size;
+        std::size_t count = list.size();
+        if constexpr (std::is_same_v<V, bool>)
+        {
+            // Bits past the last element must be clear
+            if (col_size != (count + 7) / 8 || (count % 8 && (p[count / 8] >> (count % 8))))
+                return nullptr;
+            std::size_t i = 0;
+            for (auto &e : list)
+            {
+                e.*M::ptr = (p[i / 8] >> (i % 8)) & 1;
+                i++;
+            }
+            p = col_end;
+        }
+        else if constexpr (is_uint<V>::value)
+        {
+            for (auto &e : list)
+            {
+                std::uint64_t x = 0;
+                if (!(p = get_varint(p, col_end, x)) || x > std::numeric_limits<V>::max())
+                    return nullptr;
+                e.*M::ptr = static_cast<V>(x);
+            }
+        }
+        else if constexpr (string_traits<V>::value)
+        {
+            // Lengths first: the bytes start after the last of them
+            const std::uint8_t *bytes = p;
+            std::uint64_t len = 0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (!(bytes = get_varint(bytes, col_end, len)))
+                    return nullptr;
+            }
+            for (auto &e : list)
+            {
+                p = get_varint(p, col_end, len);
+                if (len > static_cast<std::uint64_t>(col_end - bytes) ||
+                    !string_traits<V>::assign(e.*M::ptr, reinterpret_cast<const char *>(bytes), static_cast<std::size_t>(len)))
+                    return nullptr;
+                bytes += len;
+            }
+            p = bytes;
+        }
+        return p == col_end ? p : nullptr;
+    }
+};
+
+// A list of structs written one column per member
+template <class L>
+struct columnar_codec;
+
+template <class L, class... Members>
+struct columnar_body
+{
+    static_assert(((std::is_same_v<member_t<Members>, bool> || std::is_same_v<member_t<Members>, null_t> || is_uint<member_t<Members>>::value ||
+                    string_traits<member_t<Members>>::value) &&
+                   ...),
+                  "columnar requires struct members of scalar types");
+
+    static std::size_t size(const L &v)
+    {
+        std::size_t n = 1 + varint_size(v.size()) + varint_size(sizeof...(Members));
+        ((n += varint_size(column<Members>::size(v)) + column<Members>::size(v)), ...);
+        return n;
+    }
+
+    static std::uint8_t *put(const L &v, std::uint8_t *p)
+    {
+        *p++ = t_list | list_columnar;
+        p = put_varint(v.size(), p);
+        p = put_varint(sizeof...(Members), p);
+        ((p = column<Members>::put(v, p)), ...);
+        return p;
+    }
+
+    static const std::uint8_t *get(L &v, const std::uint8_t *p, const std::uint8_t *end)
+    {
+        static_assert(list_traits<L>::decodable, "cannot decode into a span");
+        std::uint64_t count = 0, nfields = 0;
+        // Every element takes at least one bit
+        if (!(p = get_prefix(p, end, t_list | list_columnar)) || !(p = get_varint(p, end, count)) || count / 8 > static_cast<std::uint64_t>(end - p))
+            return nullptr;
+        if (!(p = get_varint(p, end, nfields)) || nfields != sizeof...(Members))
+            return nullptr;
+        v.resize(static_cast<std::size_t>(count));
+        ((p = p ? column<Members>::get(v, p, end) : nullptr), ...);
+        return p;
+    }
+};
+
+template <class L, class Fields>
+struct columnar_fields;
+template <class L, class... Members>
+struct columnar_fields<L, field_list<Members...>>
+{
+    using type = columnar_body<L, Members...>;
+};
+
+template <class L>
+struct columnar_codec : columnar_fields<L, typename schema<typename list_traits<L>::elem>::fields>::type
+{
+};
+
+// -------------------------
+// Struct fields
+// -------------------------
+
+// Codec of one member according to its flags
+template <class M>
+using member_codec = std::conditional_t<(M::flags & packed_flag) != 0, packed_codec<member_t<M>>,
+                                        std::conditional_t<(M::flags & columnar_flag) != 0, columnar_codec<member_t<M>>, codec<member_t<M>>>>;
+
+// The fields of a struct back to back (without the struct header)
+template <class... Members>
+struct fields_codec<field_list<Members...>>
+{
+    template <class T>
+    static std::size_t size(const T &v)
+    {
+        return (std::size_t{0} + ... + member_codec<Members>::size(v.*Members::ptr));
+    }
+
+    template <class T>
+    static std::uint8_t *put(const T &v, std::uint8_t *p)
+    {
+        ((p = member_codec<Members>::put(v.*Members::ptr, p)), ...);
+        return p;
+    }
+
+    template <class T>
+    static const std::uint8_t *get(T &v, const std::uint8_t *p, const std::uint8_t *end)
+    {
+        ((p = p ? member_codec<Members>::get(v.*Members::ptr, p, end) : nullptr), ...);
+        return p;
+    }
+};
+
+template <class T>
+using message_codec = fields_codec<typename schema<T>::fields>;
+
+} // namespace detail
+
+// =====================
+// API
+// =====================
+
+// Exact encoded size of a message; its fields are the top-level fields
+template <class T>
+std::size_t encoded_size(const T &msg)
+{
+    static_assert(detail::has_schema<T>::value, "message type has no UTE schema");
+    return detail::message_codec<T>::size(msg);
+}
+
+// Encode a message into out (returns the number of bytes written, or ute::error if it does not fit)
+template <class T>
+std::size_t encode(const T &msg, std::uint8_t *out, std::size_t out_size)
+{
+    std::size_t size = encoded_size(msg);
+    if (size > out_size)
+        return error;
+    detail::message_codec<T>::put(msg, out);
+    return size;
+}
+
+// Append the encoding of a message to a byte vector (any allocator, e.g. std::pmr)
+template <class T, class A>
+std::size_t encode(const T &msg, std::vector<std::uint8_t, A> &out)
+{
+    std::size_t size = encoded_size(msg);
+    std::size_t at = out.size();
+    out.resize(at + size);
+    detail::message_codec<T>::put(msg, out.data() + at);
+    return size;
+}
+
+// Decode a message (returns the number of bytes read, or ute::error). Lists
+// and strings reuse the capacity of msg, pmr containers allocate from their
+// own memory resource, and string_view members point into in.
+template <class T>
+std::size_t decode(const std::uint8_t *in, std::size_t in_size, T &msg)
+{
+    static_assert(detail::has_schema<T>::value, "message type has no UTE schema");
+    const std::uint8_t *end = detail::message_codec<T>::get(msg, in, in + in_size);
+    return end ? static_cast<std::size_t>(end - in) : error;
+}
+
+} // namespace ute
+
+// Attach a schema to a struct (at global scope): UTE_SCHEMA(device, UTE_FIELD(id), UTE_FIELD(name));
+#define UTE_SCHEMA(Type, ...)                               \
+    template <>                                             \
+    struct ute::schema<Type>                                \
+    {                                                       \
+        using self = Type;                                  \
+        using fields = ::ute::field_list<__VA_ARGS__>;      \
+    }
+// A field of the struct named in UTE_SCHEMA
+#define UTE_FIELD(name) ::ute::member<&self::name>
+// A list of unsigned ints declared `packed: true`
+#define UTE_PACKED(name) ::ute::member<&self::name, ::ute::packed_flag>
+// A list of structs declared `columnar: true`
+#define UTE_COLUMNAR(name) ::ute::member<&self::name, ::ute::columnar_flag>
+
+#endif // UTE_HPP
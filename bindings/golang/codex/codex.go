@@ -3,8 +3,11 @@ package codex
 
 import (
 	"bytes"
+	"encoding/binary"
 	"fmt"
 	"io"
+	"math"
+	"sort"
 
 	"github.com/amallek/ute/bindings/golang/types"
 )
@@ -31,6 +34,10 @@ func decodeVarint(r *bytes.Reader) (uint64, error) {
 		if err != nil {
 			return 0, err
 		}
+		// The tenth byte only holds bit 63
+		if shift == 63 && b > 1 {
+			return 0, fmt.Errorf("varint overflows 64 bits")
+		}
 		result |= uint64(b&0x7F) << shift
 		if b&0x80 == 0 {
 			break
@@ -40,6 +47,145 @@ func decodeVarint(r *bytes.Reader) (uint64, error) {
 	return result, nil
 }
 
+// zigzag maps a signed value to an unsigned one so that small magnitudes of
+// either sign stay short: 0, -1, 1, -2 become 0, 1, 2, 3.
+func zigzag(v int64) uint64 {
+	return uint64(v<<1) ^ uint64(v>>63)
+}
+
+// unzigzag is the inverse of zigzag.
+func unzigzag(z uint64) int64 {
+	return int64(z>>1) ^ -int64(z&1)
+}
+
+// intsWriter holds the running state of the transform of a packed list.
+type intsWriter struct {
+	encoding    int  // types.EncodingPlain, EncodingDelta or EncodingDeltaOfDelta
+	sint        bool // the elements are sints
+	prev, delta uint64
+}
+
+// next returns the varint value of the next element, given its uint64 bits.
+func (w *intsWriter) next(v uint64) uint64 {
+	switch {
+	case w.encoding == types.EncodingDelta:
+		v, w.prev = zigzag(int64(v-w.prev)), v
+	case w.encoding == types.EncodingDeltaOfDelta:
+		d := v - w.prev
+		v, w.prev, w.delta = zigzag(int64(d-w.delta)), v, d
+	case w.sint:
+		v = zigzag(int64(v))
+	}
+	return v
+}
+
+// encodeInts writes the elements of a packed list as bare varints, transformed
+// by its encoding. Differences are taken on the uint64 bits of the elements.
+func encodeInts(buf *bytes.Buffer, list []any, field types.ParsedField) {
+	w := intsWriter{encoding: field.Encoding, sint: field.Elem.Type == types.SintType}
+	for _, item := range list {
+		var v uint64
+		if w.sint {
+			v = uint64(item.(int64))
+		} else {
+			v = item.(uint64)
+		}
+		encodeVarint(buf, w.next(v))
+	}
+}
+
+// intsReader holds the running state of the inverse transform of a packed list.
+type intsReader struct {
+	encoding    int  // types.EncodingPlain, EncodingDelta or EncodingDeltaOfDelta
+	sint        bool // the elements are sints
+	prev, delta uint64
+}
+
+// next returns the uint64 bits of the next element, given its varint value.
+func (r *intsReader) next(v uint64) uint64 {
+	switch {
+	case r.encoding == types.EncodingDelta:
+		r.prev += uint64(unzigzag(v))
+		v = r.prev
+	case r.encoding == types.EncodingDeltaOfDelta:
+		r.delta += uint64(unzigzag(v))
+		r.prev += r.delta
+		v = r.prev
+	case r.sint:
+		v = uint64(unzigzag(v))
+	}
+	return v
+}
+
+// decodeInts reads the count elements of a packed list (see encodeInts).
+func decodeInts(r *bytes.Reader, count uint64, field types.ParsedField) ([]any, error) {
+	list := make([]any, 0, count)
+	ir := intsReader{encoding: field.Encoding, sint: field.Elem.Type == types.SintType}
+	for i := uint64(0); i < count; i++ {
+		v, err := decodeVarint(r)
+		if err != nil {
+			return nil, err
+		}
+		v = ir.next(v)
+		if ir.sint {
+			list = append(list, int64(v))
+		} else {
+			list = append(list, v)
+		}
+	}
+	return list, nil
+}
+
+// fixedWidth returns the encoded size of a fixed-width type, or 0 for other types.
+func fixedWidth(t types.FieldType) int {
+	switch t {
+	case types.Float32Type, types.Fixed32Type:
+		return 4
+	case types.Float64Type, types.Fixed64Type:
+		return 8
+	}
+	return 0
+}
+
+// fixedFlag returns the prefix flag (and list flag) of a fixed-width type.
+func fixedFlag(t types.FieldType) byte {
+	switch fixedWidth(t) {
+	case 4:
+		return types.Fixed32
+	case 8:
+		return types.Fixed64
+	}
+	return 0
+}
+
+// appendFixed appends a fixed-width value (float32, float64, uint32 or uint64) in little-endian byte order.
+func appendFixed(b []byte, t types.FieldType, val any) []byte {
+	switch t {
+	case types.Float32Type:
+		return binary.LittleEndian.AppendUint32(b, math.Float32bits(val.(float32)))
+	case types.Float64Type:
+		return binary.LittleEndian.AppendUint64(b, math.Float64bits(val.(float64)))
+	case types.Fixed32Type:
+		return binary.LittleEndian.AppendUint32(b, val.(uint32))
+	default:
+		return binary.LittleEndian.AppendUint64(b, val.(uint64))
+	}
+}
+
+// readFixed decodes a fixed-width value from its little-endian bytes (see appendFixed).
+func readFixed(b []byte, t types.FieldType) any {
+	switch t {
+	case types.Float32Type:
+		return math.Float32frombits(binary.LittleEndian.Uint32(b))
+	case types.Float64Type:
+		return math.Float64frombits(binary.LittleEndian.Uint64(b))
+	case types.Fixed32Type:
+		return binary.LittleEndian.Uint32(b)
+	default:
+		return binary.LittleEndian.Uint64(b)
+	}
+}
+
 // Serialize encodes a map[string]any according to the provided schema and returns the serialized bytes.
 //
 // Takes a data map and a parsed schema, and returns a UTE-encoded byte slice or an error.
@@ -59,13 +205,62 @@ func Serialize(data map[string]any, schema []types.ParsedField) ([]byte, error)
 		case types.IntType:
 			buf.WriteByte(types.TInt)
 			encodeVarint(buf, val.(uint64))
+		case types.SintType:
+			buf.WriteByte(types.TInt)
+			encodeVarint(buf, zigzag(val.(int64)))
 		case types.StringType:
 			s := val.(string)
+			if field.Shared != nil {
+				if id, ok := field.Shared.ID(s); ok {
+					buf.WriteByte(types.TBytes | types.StringDict)
+					encodeVarint(buf, id)
+					continue
+				}
+			}
 			buf.WriteByte(types.TBytes)
 			encodeVarint(buf, uint64(len(s)))
 			buf.WriteString(s)
+		case types.Float32Type, types.Float64Type, types.Fixed32Type, types.Fixed64Type:
+			buf.WriteByte(types.TFixed | fixedFlag(field.Type))
+			buf.Write(appendFixed(nil, field.Type, val))
+		case types.BytesType:
+			b := val.([]byte)
+			buf.WriteByte(types.TFixed)
+			encodeVarint(buf, uint64(len(b)))
+			buf.Write(b)
 		case types.ListType:
 			list := val.([]any)
+			if width := fixedWidth(field.Elem.Type); width != 0 {
+				// Fixed-width elements form one little-endian array
+				buf.WriteByte(types.TList | fixedFlag(field.Elem.Type))
+				encodeVarint(buf, uint64(len(list)))
+				arr := make([]byte, 0, len(list)*width)
+				for _, item := range list {
+					arr = appendFixed(arr, field.Elem.Type, item)
+				}
+				buf.Write(arr)
+				continue
+			}
+			if field.Chunk > 0 {
+				buf.WriteByte(types.TList | types.ListChunked)
+				encodeVarint(buf, uint64(len(list)))
+				if err := serializeChunks(buf, list, field); err != nil {
+					return nil, err
+				}
+				continue
+			}
+			if field.Columnar {
+				buf.WriteByte(types.TList | types.ListColumnar)
+				encodeVarint(buf, uint64(len(list)))
+				serializeColumns(buf, list, field.Elem.Fields)
+				continue
+			}
+			if field.Packed {
+				buf.WriteByte(types.TList | types.ListPacked)
+				encodeVarint(buf, uint64(len(list)))
+				encodeInts(buf, list, field)
+				continue
+			}
 			buf.WriteByte(types.TList)
 			encodeVarint(buf, uint64(len(list)))
 			for _, item := range list {
@@ -77,6 +272,12 @@ func Serialize(data map[string]any, schema []types.ParsedField) ([]byte, error)
 			}
 		case types.StructType:
 			child := val.(map[string]any)
+			if field.Sparse {
+				if err := serializeSparse(buf, child, field.Fields); err != nil {
+					return nil, err
+				}
+				continue
+			}
 			buf.WriteByte(types.TStruct)
 			encodeVarint(buf, uint64(len(field.Fields)))
 			nested, err := Serialize(child, field.Fields)
@@ -93,6 +294,35 @@ func Serialize(data map[string]any, schema []types.ParsedField) ([]byte, error)
 //
 // Takes a bytes.Reader and a parsed schema, and returns a map of field names to values or an error.
 func Deserialize(r *bytes.Reader, schema []types.ParsedField) (map[string]any, error) {
+	return deserialize(r, schema, new(refTargets))
+}
+
+// offset returns the position of a reader in its input.
+func offset(r *bytes.Reader) int64 {
+	return r.Size() - int64(r.Len())
+}
+
+// refWindow is the number of the latest plain strings of dict fields of a
+// scope that a back-reference may point at (see RFC section 4.1).
+const refWindow = 256
+
+// refTargets records where the plain strings of dict fields decoded in one
+// scope (the message, or a chunk of a chunked list) start: the only bytes a
+// back-reference may point at.
+type refTargets struct {
+	starts []int64
+}
+
+// has reports whether a string recorded among the latest refWindow starts at.
+func (t *refTargets) has(at int64) bool {
+	window := t.starts[max(0, len(t.starts)-refWindow):]
+	i := sort.Search(len(window), func(i int) bool { return window[i] >= at })
+	return i < len(window) && window[i] == at
+}
+
+// deserialize decodes fields like Deserialize. String back-references may
+// only point at the strings recorded in refs.
+func deserialize(r *bytes.Reader, schema []types.ParsedField, refs *refTargets) (map[string]any, error) {
 	out := make(map[string]any)
 	for _, field := range schema {
 		h, err := r.ReadByte()
@@ -120,31 +350,128 @@ func Deserialize(r *bytes.Reader, schema []types.ParsedField) (map[string]any, e
 				return nil, err
 			}
 			out[field.Name] = val
+		case types.SintType:
+			if typ != 2 {
+				return nil, fmt.Errorf("expected int")
+			}
+			val, err := decodeVarint(r)
+			if err != nil {
+				return nil, err
+			}
+			out[field.Name] = unzigzag(val)
 		case types.StringType:
 			if typ != 3 {
 				return nil, fmt.Errorf("expected string")
 			}
+			at := offset(r) - 1
 			slen, err := decodeVarint(r)
 			if err != nil {
 				return nil, err
 			}
+			if flags := h & 0x1F; flags != 0 {
+				s, err := dictString(r, field, flags, at, slen, refs)
+				if err != nil {
+					return nil, err
+				}
+				out[field.Name] = s
+				continue
+			}
+			if field.Dict != types.DictNone {
+				refs.starts = append(refs.starts, at)
+			}
+			if slen > uint64(r.Len()) {
+				return nil, fmt.Errorf("string exceeds input")
+			}
 			buf := make([]byte, slen)
 			_, err = io.ReadFull(r, buf)
 			if err != nil {
 				return nil, err
 			}
 			out[field.Name] = string(buf)
+		case types.Float32Type, types.Float64Type, types.Fixed32Type, types.Fixed64Type:
+			if h != types.TFixed|fixedFlag(field.Type) {
+				return nil, fmt.Errorf("expected fixed-width value")
+			}
+			b := make([]byte, fixedWidth(field.Type))
+			if _, err := io.ReadFull(r, b); err != nil {
+				return nil, err
+			}
+			out[field.Name] = readFixed(b, field.Type)
+		case types.BytesType:
+			if h != types.TFixed {
+				return nil, fmt.Errorf("expected bytes")
+			}
+			blen, err := decodeVarint(r)
+			if err != nil {
+				return nil, err
+			}
+			if blen > uint64(r.Len()) {
+				return nil, fmt.Errorf("bytes exceed input")
+			}
+			b := make([]byte, blen)
+			if _, err := io.ReadFull(r, b); err != nil {
+				return nil, err
+			}
+			out[field.Name] = b
 		case types.ListType:
 			if typ != 4 {
 				return nil, fmt.Errorf("expected list")
 			}
+			fixed := h & (types.ListFixed32 | types.ListFixed64)
+			if (h&types.ListPacked != 0) != field.Packed || (h&types.ListColumnar != 0) != field.Columnar || fixed != fixedFlag(field.Elem.Type) || (h&types.ListChunked != 0) != (field.Chunk > 0) {
+				return nil, fmt.Errorf("list flags do not match schema")
+			}
 			count, err := decodeVarint(r)
 			if err != nil {
 				return nil, err
 			}
+			// Every element takes at least one byte, or one bit of a columnar list
+			if count > uint64(r.Len()) && (!field.Columnar || count/8 > uint64(r.Len())) {
+				return nil, fmt.Errorf("list count exceeds input")
+			}
+			if field.Chunk > 0 {
+				list, err := deserializeChunks(r, count, field.Elem)
+				if err != nil {
+					return nil, err
+				}
+				out[field.Name] = list
+				continue
+			}
+			if field.Columnar {
+				list, err := deserializeColumns(r, int(count), field.Elem.Fields)
+				if err != nil {
+					return nil, err
+				}
+				out[field.Name] = list
+				continue
+			}
+			if width := uint64(fixedWidth(field.Elem.Type)); width != 0 {
+				// One read for the whole array
+				if count > uint64(r.Len())/width {
+					return nil, fmt.Errorf("list count exceeds input")
+				}
+				arr := make([]byte, count*width)
+				if _, err := io.ReadFull(r, arr); err != nil {
+					return nil, err
+				}
+				list := make([]any, count)
+				for i := range list {
+					list[i] = readFixed(arr[uint64(i)*width:], field.Elem.Type)
+				}
+				out[field.Name] = list
+				continue
+			}
+			if field.Packed {
+				list, err := decodeInts(r, count, field)
+				if err != nil {
+					return nil, err
+				}
+				out[field.Name] = list
+				continue
+			}
 			list := make([]any, 0, count)
 			for i := 0; i < int(count); i++ {
-				itemMap, err := Deserialize(r, []types.ParsedField{*field.Elem})
+				itemMap, err := deserialize(r, []types.ParsedField{*field.Elem}, refs)
 				if err != nil {
 					return nil, err
 				}
@@ -155,11 +482,22 @@ func Deserialize(r *bytes.Reader, schema []types.ParsedField) (map[string]any, e
 			if typ != 5 {
 				return nil, fmt.Errorf("expected struct")
 			}
+			if field.Sparse {
+				child, err := deserializeSparse(r, h, field.Fields, refs)
+				if err != nil {
+					return nil, err
+				}
+				out[field.Name] = child
+				continue
+			}
+			if h&0x1F != 0 {
+				return nil, fmt.Errorf("struct flags do not match schema")
+			}
 			_, err := decodeVarint(r)
 			if err != nil {
 				return nil, err
 			}
-			child, err := Deserialize(r, field.Fields)
+			child, err := deserialize(r, field.Fields, refs)
 			if err != nil {
 				return nil, err
 			}
@@ -170,3 +508,478 @@ func Deserialize(r *bytes.Reader, schema []types.ParsedField) (map[string]any, e
 	}
 	return out, nil
 }
+
+// dictString resolves a string written with flags (see types.StringRef and
+// types.StringDict): n is the varint after its prefix, which is at offset at.
+// A back-reference must point at a plain string recorded in refs that ends
+// before the prefix.
+func dictString(r *bytes.Reader, field types.ParsedField, flags byte, at int64, n uint64, refs *refTargets) (string, error) {
+	switch {
+	case flags == types.StringDict && field.Dict == types.DictShared:
+		if field.Shared == nil || n >= uint64(len(field.Shared.Values)) {
+			return "", fmt.Errorf("dictionary id out of range")
+		}
+		return field.Shared.Values[n], nil
+	case flags != types.StringRef || field.Dict == types.DictNone:
+		return "", fmt.Errorf("string flags do not match schema")
+	}
+	if n == 0 || n > uint64(at) || !refs.has(at-int64(n)) {
+		return "", fmt.Errorf("string reference does not point at a recent dict string of its scope")
+	}
+	target := at - int64(n)
+	head := make([]byte, min(at-target, 11))
+	if _, err := r.ReadAt(head, target); err != nil {
+		return "", err
+	}
+	if head[0] != types.TBytes {
+		return "", fmt.Errorf("string reference does not point at a plain string")
+	}
+	hr := bytes.NewReader(head[1:])
+	slen, err := decodeVarint(hr)
+	if err != nil {
+		return "", err
+	}
+	start := target + 1 + int64(len(head)-1-hr.Len())
+	if slen > uint64(at-start) {
+		return "", fmt.Errorf("string reference overlaps its target")
+	}
+	buf := make([]byte, slen)
+	if _, err := r.ReadAt(buf, start); err != nil {
+		return "", err
+	}
+	return string(buf), nil
+}
+
+// serializeChunks writes the elements of a chunked list: the number of
+// elements per chunk, a table with the size of every chunk (u32 little-endian),
+// then the chunks, each holding that many elements encoded as in a plain list.
+func serializeChunks(buf *bytes.Buffer, list []any, field types.ParsedField) error {
+	per := field.Chunk
+	encodeVarint(buf, uint64(per))
+	table := make([]byte, 0, (len(list)+per-1)/per*4)
+	chunks := new(bytes.Buffer)
+	for first := 0; first < len(list); first += per {
+		start := chunks.Len()
+		for _, item := range list[first:min(first+per, len(list))] {
+			serialized, err := Serialize(map[string]any{"": item}, []types.ParsedField{*field.Elem})
+			if err != nil {
+				return err
+			}
+			chunks.Write(serialized)
+		}
+		if chunks.Len()-start > math.MaxUint32 {
+			return fmt.Errorf("chunk exceeds 4 GiB")
+		}
+		table = binary.LittleEndian.AppendUint32(table, uint32(chunks.Len()-start))
+	}
+	buf.Write(table)
+	buf.Write(chunks.Bytes())
+	return nil
+}
+
+// deserializeChunks reads the elements of a chunked list (see serializeChunks).
+// Every chunk must end exactly where its size in the table says.
+func deserializeChunks(r *bytes.Reader, count uint64, elem *types.ParsedField) ([]any, error) {
+	per, err := decodeVarint(r)
+	if err != nil {
+		return nil, err
+	}
+	if per == 0 {
+		return nil, fmt.Errorf("chunk size is zero")
+	}
+	nchunks := count / per
+	if count%per != 0 {
+		nchunks++
+	}
+	if nchunks > uint64(r.Len())/4 {
+		return nil, fmt.Errorf("chunk table exceeds input")
+	}
+	table := make([]byte, nchunks*4)
+	if _, err := io.ReadFull(r, table); err != nil {
+		return nil, err
+	}
+	list := make([]any, 0, count)
+	for c := uint64(0); c < nchunks; c++ {
+		size := uint64(binary.LittleEndian.Uint32(table[c*4:]))
+		if size > uint64(r.Len()) {
+			return nil, fmt.Errorf("chunk exceeds input")
+		}
+		// Chunks are independent: references stay inside their chunk
+		end, refs := r.Len()-int(size), new(refTargets)
+		for i := c * per; i < count && i < (c+1)*per; i++ {
+			itemMap, err := deserialize(r, []types.ParsedField{*elem}, refs)
+			if err != nil {
+				return nil, err
+			}
+			list = append(list, itemMap[""])
+		}
+		if r.Len() != end {
+			return nil, fmt.Errorf("chunk size does not match its elements")
+		}
+	}
+	return list, nil
+}
+
+// serializeColumns writes the elements of a columnar list: the field count,
+// then for each struct field the size of its column and the column itself
+// (bools as a bitmap, ints as varints, strings as all lengths followed by all bytes).
+func serializeColumns(buf *bytes.Buffer, list []any, fields []types.ParsedField) {
+	encodeVarint(buf, uint64(len(fields)))
+	col := new(bytes.Buffer)
+	for _, field := range fields {
+		col.Reset()
+		switch field.Type {
+		case types.BoolType:
+			for i := 0; i < len(list); i += 8 {
+				var bits byte
+				for j := 0; j < 8 && i+j < len(list); j++ {
+					if list[i+j].(map[string]any)[field.Name].(bool) {
+						bits |= 1 << j
+					}
+				}
+				col.WriteByte(bits)
+			}
+		case types.IntType:
+			for _, item := range list {
+				encodeVarint(col, item.(map[string]any)[field.Name].(uint64))
+			}
+		case types.StringType:
+			for _, item := range list {
+				encodeVarint(col, uint64(len(item.(map[string]any)[field.Name].(string))))
+			}
+			for _, item := range list {
+				col.WriteString(item.(map[string]any)[field.Name].(string))
+			}
+		}
+		encodeVarint(buf, uint64(col.Len()))
+		buf.Write(col.Bytes())
+	}
+}
+
+// deserializeColumns reads the elements of a columnar list (see serializeColumns).
+func deserializeColumns(r *bytes.Reader, count int, fields []types.ParsedField) ([]any, error) {
+	nfields, err := decodeVarint(r)
+	if err != nil {
+		return nil, err
+	}
+	if nfields != uint64(len(fields)) {
+		return nil, fmt.Errorf("columnar field count does not match schema")
+	}
+	items := make([]map[string]any, count)
+	for i := range items {
+		items[i] = make(map[string]any, len(fields))
+	}
+	for _, field := range fields {
+		size, err := decodeVarint(r)
+		if err != nil {
+			return nil, err
+		}
+		if size > uint64(r.Len()) {
+			return nil, fmt.Errorf("column exceeds input")
+		}
+		data := make([]byte, size)
+		if _, err := io.ReadFull(r, data); err != nil {
+			return nil, err
+		}
+		col := bytes.NewReader(data)
+		switch field.Type {
+		case types.NullType:
+			for _, item := range items {
+				item[field.Name] = nil
+			}
+		case types.BoolType:
+			if len(data) != (count+7)/8 || (count%8 != 0 && data[len(data)-1]>>(count%8) != 0) {
+				return nil, fmt.Errorf("bool column does not match count")
+			}
+			for i, item := range items {
+				item[field.Name] = data[i/8]&(1<<(i%8)) != 0
+			}
+			col.Reset(nil)
+		case types.IntType:
+			for _, item := range items {
+				val, err := decodeVarint(col)
+				if err != nil {
+					return nil, err
+				}
+				item[field.Name] = val
+			}
+		case types.StringType:
+			lens := make([]uint64, count)
+			for i := range lens {
+				if lens[i], err = decodeVarint(col); err != nil {
+					return nil, err
+				}
+			}
+			for i, item := range items {
+				if lens[i] > uint64(col.Len()) {
+					return nil, fmt.Errorf("string exceeds column")
+				}
+				s := make([]byte, lens[i])
+				io.ReadFull(col, s)
+				item[field.Name] = string(s)
+			}
+		}
+		if col.Len() != 0 {
+			return nil, fmt.Errorf("column size does not match its values")
+		}
+	}
+	list := make([]any, count)
+	for i, item := range items {
+		list[i] = item
+	}
+	return list, nil
+}
+
+// Presence of a member of a sparse struct when serializing.
+const (
+	memberPresent = iota
+	memberDefault // has its default value and may be omitted
+	memberMissing // has no value and must be omitted
+)
+
+// presence classifies the value of a sparse struct member. Structs count as
+// present unless they are missing.
+func presence(field types.ParsedField, val any) int {
+	if field.Type == types.NullType {
+		return memberDefault
+	}
+	if val == nil {
+		return memberMissing
+	}
+	switch field.Type {
+	case types.BoolType:
+		if !val.(bool) {
+			return memberDefault
+		}
+	case types.IntType:
+		if val.(uint64) == 0 {
+			return memberDefault
+		}
+	case types.SintType:
+		if val.(int64) == 0 {
+			return memberDefault
+		}
+	case types.StringType:
+		if val.(string) == "" {
+			return memberDefault
+		}
+	case types.ListType:
+		if len(val.([]any)) == 0 {
+			return memberDefault
+		}
+	case types.Float32Type, types.Float64Type, types.Fixed32Type, types.Fixed64Type:
+		// All bits zero: a float -0.0 is present
+		if bytes.Equal(appendFixed(nil, field.Type, val), make([]byte, fixedWidth(field.Type))) {
+			return memberDefault
+		}
+	case types.BytesType:
+		if len(val.([]byte)) == 0 {
+			return memberDefault
+		}
+	}
+	return memberPresent
+}
+
+// varintLen returns the number of bytes of n encoded as a varint.
+func varintLen(n uint64) int {
+	l := 1
+	for n >= 0x80 {
+		n >>= 7
+		l++
+	}
+	return l
+}
+
+// defaultSize returns the size of the dense encoding of a member with its default value.
+func defaultSize(field types.ParsedField) int {
+	switch {
+	case field.Type == types.NullType || field.Type == types.BoolType:
+		return 1
+	case fixedWidth(field.Type) != 0:
+		return 1 + fixedWidth(field.Type)
+	case field.Chunk > 0:
+		// An empty chunked list still has its chunk size, and no chunks
+		return 2 + varintLen(uint64(field.Chunk))
+	case field.Columnar:
+		// An empty columnar list still lists its columns, all of size 0
+		n := len(field.Elem.Fields)
+		return 2 + varintLen(uint64(n)) + n
+	}
+	return 2
+}
+
+// serializeSparse writes a struct declared sparse in the smallest of three forms:
+// dense, the present members preceded by their index (StructSparse), or a
+// presence bitmap followed by the present members (StructBitmap). Ties
+// prefer them in this order. Present values cost the same in every form, so
+// only the counts, the indices or the bitmap and the defaults the dense form
+// writes for absent members are compared.
+func serializeSparse(buf *bytes.Buffer, data map[string]any, fields []types.ParsedField) error {
+	present := make([]bool, len(fields))
+	count, indices, defaults, missing := 0, 0, 0, false
+	for i, f := range fields {
+		switch presence(f, data[f.Name]) {
+		case memberPresent:
+			present[i] = true
+			count++
+			indices += varintLen(uint64(i))
+		case memberMissing:
+			missing = true
+			defaults += defaultSize(f)
+		default:
+			defaults += defaultSize(f)
+		}
+	}
+	n := len(fields)
+	sparse := varintLen(uint64(count)) + indices
+	bitmap := varintLen(uint64(n)) + (n+7)/8
+	if dense := varintLen(uint64(n)) + defaults; !missing && dense <= sparse && dense <= bitmap {
+		buf.WriteByte(types.TStruct)
+		encodeVarint(buf, uint64(n))
+		nested, err := Serialize(data, fields)
+		if err != nil {
+			return err
+		}
+		buf.Write(nested)
+		return nil
+	}
+	if bitmap <= sparse {
+		buf.WriteByte(types.TStruct | types.StructBitmap)
+		encodeVarint(buf, uint64(n))
+		bits := make([]byte, (n+7)/8)
+		for i := range fields {
+			if present[i] {
+				bits[i/8] |= 1 << (i % 8)
+			}
+		}
+		buf.Write(bits)
+	} else {
+		buf.WriteByte(types.TStruct | types.StructSparse)
+		encodeVarint(buf, uint64(count))
+	}
+	for i := range fields {
+		if !present[i] {
+			continue
+		}
+		if bitmap > sparse {
+			encodeVarint(buf, uint64(i))
+		}
+		nested, err := Serialize(data, fields[i:i+1])
+		if err != nil {
+			return err
+		}
+		buf.Write(nested)
+	}
+	return nil
+}
+
+// deserializeSparse reads a struct declared sparse in any of its three forms
+// (see serializeSparse); absent members get their default value.
+func deserializeSparse(r *bytes.Reader, h byte, fields []types.ParsedField, refs *refTargets) (map[string]any, error) {
+	form := h & 0x1F
+	count, err := decodeVarint(r)
+	if err != nil {
+		return nil, err
+	}
+	n := uint64(len(fields))
+	switch {
+	case form == types.StructSparse && count > n:
+		return nil, fmt.Errorf("sparse struct has more members than the schema")
+	case form != types.StructSparse && form != types.StructBitmap && form != 0:
+		return nil, fmt.Errorf("struct flags do not match schema")
+	case form != types.StructSparse && count != n:
+		return nil, fmt.Errorf("struct field count does not match schema")
+	}
+	present := make([]bool, len(fields))
+	switch form {
+	case 0:
+		for i := range present {
+			present[i] = true
+		}
+	case types.StructBitmap:
+		bits := make([]byte, (n+7)/8)
+		if _, err := io.ReadFull(r, bits); err != nil {
+			return nil, err
+		}
+		if n%8 != 0 && bits[len(bits)-1]>>(n%8) != 0 {
+			return nil, fmt.Errorf("struct bitmap has bits past the last member")
+		}
+		for i := range present {
+			present[i] = bits[i/8]&(1<<(i%8)) != 0
+		}
+	}
+	out := make(map[string]any, len(fields))
+	read := func(i int) error {
+		value, err := deserialize(r, fields[i:i+1], refs)
+		if err != nil {
+			return err
+		}
+		out[fields[i].Name] = value[fields[i].Name]
+		return nil
+	}
+	if form == types.StructSparse {
+		next := uint64(0)
+		for j := uint64(0); j < count; j++ {
+			index, err := decodeVarint(r)
+			if err != nil {
+				return nil, err
+			}
+			if index < next || index >= n {
+				return nil, fmt.Errorf("struct member indices must ascend within the schema")
+			}
+			if err := read(int(index)); err != nil {
+				return nil, err
+			}
+			present[index] = true
+			next = index + 1
+		}
+	} else {
+		for i := range fields {
+			if present[i] {
+				if err := read(i); err != nil {
+					return nil, err
+				}
+			}
+		}
+	}
+	for i, f := range fields {
+		if !present[i] {
+			out[f.Name] = defaultValue(f)
+		}
+	}
+	return out, nil
+}
+
+// defaultValue returns the value of an absent member: null, false, 0, "",
+// an empty list, no bytes, or a struct of defaults.
+func defaultValue(field types.ParsedField) any {
+	switch field.Type {
+	case types.BoolType:
+		return false
+	case types.IntType:
+		return uint64(0)
+	case types.SintType:
+		return int64(0)
+	case types.StringType:
+		return ""
+	case types.Float32Type:
+		return float32(0)
+	case types.Float64Type:
+		return float64(0)
+	case types.Fixed32Type:
+		return uint32(0)
+	case types.Fixed64Type:
+		return uint64(0)
+	case types.BytesType:
+		return []byte{}
+	case types.ListType:
+		return []any{}
+	case types.StructType:
+		child := make(map[string]any, len(field.Fields))
+		for _, f := range field.Fields {
+			child[f.Name] = defaultValue(f)
+		}
+		return child
+	}
+	return nil
+}
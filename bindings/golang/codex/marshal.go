@@ -0,0 +1,356 @@
+package codex
+
+import (
+	"encoding/binary"
+	"fmt"
+	"math"
+	"reflect"
+	"strings"
+	"sync"
+	"unsafe"
+
+	"github.com/amallek/ute/bindings/golang/types"
+)
+
+// Typed codec: Go structs bound to a schema through struct tags.
+//
+//	type Device struct {
+//		ID      uint64  `ute:"id"`
+//		Name    string  `ute:"name"`
+//		Samples []int64 `ute:"samples,delta"`
+//	}
+//
+// Exported fields are encoded in declaration order under the name of their
+// tag (the Go name if it has none); fields tagged "-" are skipped. Go types map
+// to schema types: bool to bool, unsigned integers to int, signed integers to
+// sint, string to string, []byte to bytes, float32 and float64 to the float
+// types, other slices to lists and structs to structs. Tag options:
+//
+//	packed          lists of integers: elements as bare varints
+//	delta           lists of integers: packed, as differences
+//	delta-of-delta  lists of integers: packed, as differences of differences
+//	fixed           uint32 and uint64 (or lists of them): fixed32 and fixed64
+//
+// SchemaOf returns the schema a type stands for; the bytes are those Serialize
+// writes for the same values under that schema.
+
+// fieldPlan is the compiled encoding of a Go value.
+type fieldPlan struct {
+	typ      types.FieldType
+	offset   uintptr      // offset of the field in its struct
+	width    uintptr      // size of the Go value (integers)
+	packed   bool         // lists of integers: bare varints
+	encoding int          // packed lists: types.EncodingPlain, EncodingDelta or EncodingDeltaOfDelta
+	elem     *fieldPlan   // list element
+	slice    reflect.Type // list: the Go slice type
+	fields   []fieldPlan  // struct members
+}
+
+// typePlan is the compiled encoding of a struct type, cached per reflect.Type.
+type typePlan struct {
+	fields []fieldPlan
+	schema []types.ParsedField
+	err    error
+}
+
+// plans caches a *typePlan per struct type.
+var plans sync.Map
+
+// sliceHeader is the memory layout of any Go slice.
+type sliceHeader struct {
+	data unsafe.Pointer
+	len  int
+	cap  int
+}
+
+// tagOptions are the options of a ute struct tag.
+type tagOptions struct {
+	packed   bool
+	encoding int
+	fixed    bool
+}
+
+// parseTag splits a ute struct tag into the field name and its options.
+func parseTag(f reflect.StructField) (string, tagOptions, error) {
+	var opts tagOptions
+	name, rest, _ := strings.Cut(f.Tag.Get("ute"), ",")
+	if name == "" {
+		name = f.Name
+	}
+	for rest != "" {
+		var opt string
+		opt, rest, _ = strings.Cut(rest, ",")
+		switch opt {
+		case "packed":
+			opts.packed = true
+		case "delta":
+			opts.packed, opts.encoding = true, types.EncodingDelta
+		case "delta-of-delta":
+			opts.packed, opts.encoding = true, types.EncodingDeltaOfDelta
+		case "fixed":
+			opts.fixed = true
+		default:
+			return "", opts, fmt.Errorf("field %s: unknown ute tag option %q", f.Name, opt)
+		}
+	}
+	return name, opts, nil
+}
+
+// planOf returns the cached plan of a struct type, compiling it on first use.
+func planOf(t reflect.Type) *typePlan {
+	if p, ok := plans.Load(t); ok {
+		return p.(*typePlan)
+	}
+	p := &typePlan{}
+	p.fields, p.schema, p.err = compileStruct(t, map[reflect.Type]bool{})
+	actual, _ := plans.LoadOrStore(t, p)
+	return actual.(*typePlan)
+}
+
+// compileStruct compiles the members of a struct type. visiting holds the
+// struct types being compiled, since a schema cannot nest a struct in itself.
+func compileStruct(t reflect.Type, visiting map[reflect.Type]bool) ([]fieldPlan, []types.ParsedField, error) {
+	if visiting[t] {
+		return nil, nil, fmt.Errorf("recursive type %s", t)
+	}
+	visiting[t] = true
+	defer delete(visiting, t)
+	var fields []fieldPlan
+	var schema []types.ParsedField
+	for i := 0; i < t.NumField(); i++ {
+		f := t.Field(i)
+		if !f.IsExported() || f.Tag.Get("ute") == "-" {
+			continue
+		}
+		name, opts, err := parseTag(f)
+		if err != nil {
+			return nil, nil, err
+		}
+		plan, parsed, err := compileValue(f.Type, opts, visiting)
+		if err != nil {
+			return nil, nil, fmt.Errorf("field %s: %w", f.Name, err)
+		}
+		plan.offset = f.Offset
+		parsed.Name = name
+		fields = append(fields, plan)
+		schema = append(schema, parsed)
+	}
+	return fields, schema, nil
+}
+
+// compileValue compiles a value of type t.
+func compileValue(t reflect.Type, opts tagOptions, visiting map[reflect.Type]bool) (fieldPlan, types.ParsedField, error) {
+	plan := fieldPlan{width: t.Size()}
+	switch t.Kind() {
+	case reflect.Bool:
+		plan.typ = types.BoolType
+	case reflect.Uint8, reflect.Uint16, reflect.Uint32, reflect.Uint64, reflect.Uint, reflect.Uintptr:
+		plan.typ = types.IntType
+		if opts.fixed {
+			switch t.Size() {
+			case 4:
+				plan.typ = types.Fixed32Type
+			case 8:
+				plan.typ = types.Fixed64Type
+			default:
+				return plan, types.ParsedField{}, fmt.Errorf("fixed needs uint32 or uint64, not %s", t)
+			}
+		}
+	case reflect.Int8, reflect.Int16, reflect.Int32, reflect.Int64, reflect.Int:
+		plan.typ = types.SintType
+	case reflect.Float32:
+		plan.typ = types.Float32Type
+	case reflect.Float64:
+		plan.typ = types.Float64Type
+	case reflect.String:
+		plan.typ = types.StringType
+	case reflect.Slice:
+		if t.Elem().Kind() == reflect.Uint8 {
+			plan.typ = types.BytesType
+			break
+		}
+		elem, parsed, err := compileValue(t.Elem(), tagOptions{fixed: opts.fixed}, visiting)
+		if err != nil {
+			return plan, types.ParsedField{}, err
+		}
+		if opts.packed && elem.typ != types.IntType && elem.typ != types.SintType {
+			return plan, types.ParsedField{}, fmt.Errorf("packed lists need integer elements, not %s", t.Elem())
+		}
+		plan.typ, plan.elem, plan.slice, plan.width = types.ListType, &elem, t, t.Elem().Size()
+		plan.packed, plan.encoding = opts.packed, opts.encoding
+		return plan, types.ParsedField{Type: types.ListType, Elem: &parsed, Packed: opts.packed, Encoding: opts.encoding}, nil
+	case reflect.Struct:
+		fields, schema, err := compileStruct(t, visiting)
+		if err != nil {
+			return plan, types.ParsedField{}, err
+		}
+		plan.typ, plan.fields = types.StructType, fields
+		return plan, types.ParsedField{Type: types.StructType, Fields: schema}, nil
+	default:
+		return plan, types.ParsedField{}, fmt.Errorf("unsupported type %s", t)
+	}
+	if opts.packed && plan.typ != types.ListType {
+		return plan, types.ParsedField{}, fmt.Errorf("packed and delta apply to lists only")
+	}
+	return plan, types.ParsedField{Type: plan.typ}, nil
+}
+
+// structPointer returns the type and address of the struct v holds or points
+// to. A struct passed by value is copied, which allocates.
+func structPointer(v any) (reflect.Type, unsafe.Pointer, error) {
+	rv := reflect.ValueOf(v)
+	switch {
+	case rv.Kind() == reflect.Pointer && rv.Type().Elem().Kind() == reflect.Struct && !rv.IsNil():
+		return rv.Type().Elem(), rv.UnsafePointer(), nil
+	case rv.Kind() == reflect.Struct:
+		p := reflect.New(rv.Type())
+		p.Elem().Set(rv)
+		return rv.Type(), p.UnsafePointer(), nil
+	}
+	return nil, nil, fmt.Errorf("expected a struct or a non-nil pointer to one, got %T", v)
+}
+
+// SchemaOf returns the schema fields the struct type of v (a struct or a
+// pointer to one) is encoded with.
+func SchemaOf(v any) ([]types.ParsedField, error) {
+	t := reflect.TypeOf(v)
+	if t != nil && t.Kind() == reflect.Pointer {
+		t = t.Elem()
+	}
+	if t == nil || t.Kind() != reflect.Struct {
+		return nil, fmt.Errorf("expected a struct or a pointer to one, got %T", v)
+	}
+	p := planOf(t)
+	return p.schema, p.err
+}
+
+// Marshal encodes the struct v (or the struct v points to) as a UTE message.
+func Marshal(v any) ([]byte, error) {
+	return AppendMarshal(nil, v)
+}
+
+// AppendMarshal appends the encoding of the struct v (or the struct v points
+// to) to dst and returns the extended slice. Passing a pointer into a dst with
+// enough capacity allocates nothing once the plan of the type is cached.
+func AppendMarshal(dst []byte, v any) ([]byte, error) {
+	t, p, err := structPointer(v)
+	if err != nil {
+		return dst, err
+	}
+	plan := planOf(t)
+	if plan.err != nil {
+		return dst, plan.err
+	}
+	return appendFields(dst, p, plan.fields), nil
+}
+
+// appendFields appends the members of the struct at p.
+func appendFields(b []byte, p unsafe.Pointer, fields []fieldPlan) []byte {
+	for i := range fields {
+		b = appendValue(b, unsafe.Add(p, fields[i].offset), &fields[i])
+	}
+	return b
+}
+
+// loadUint reads an unsigned integer of width bytes at p.
+func loadUint(p unsafe.Pointer, width uintptr) uint64 {
+	switch width {
+	case 1:
+		return uint64(*(*uint8)(p))
+	case 2:
+		return uint64(*(*uint16)(p))
+	case 4:
+		return uint64(*(*uint32)(p))
+	}
+	return *(*uint64)(p)
+}
+
+// loadInt reads a signed integer of width bytes at p.
+func loadInt(p unsafe.Pointer, width uintptr) int64 {
+	switch width {
+	case 1:
+		return int64(*(*int8)(p))
+	case 2:
+		return int64(*(*int16)(p))
+	case 4:
+		return int64(*(*int32)(p))
+	}
+	return *(*int64)(p)
+}
+
+// appendFixedAt appends the fixed-width value at p in little-endian byte order.
+func appendFixedAt(b []byte, t types.FieldType, p unsafe.Pointer) []byte {
+	switch t {
+	case types.Float32Type:
+		return binary.LittleEndian.AppendUint32(b, math.Float32bits(*(*float32)(p)))
+	case types.Float64Type:
+		return binary.LittleEndian.AppendUint64(b, math.Float64bits(*(*float64)(p)))
+	case types.Fixed32Type:
+		return binary.LittleEndian.AppendUint32(b, *(*uint32)(p))
+	default:
+		return binary.LittleEndian.AppendUint64(b, *(*uint64)(p))
+	}
+}
+
+// appendValue appends the value at p, with its type prefix.
+func appendValue(b []byte, p unsafe.Pointer, f *fieldPlan) []byte {
+	switch f.typ {
+	case types.BoolType:
+		if *(*bool)(p) {
+			return append(b, types.TBool|0x10)
+		}
+		return append(b, types.TBool)
+	case types.IntType:
+		return binary.AppendUvarint(append(b, types.TInt), loadUint(p, f.width))
+	case types.SintType:
+		return binary.AppendUvarint(append(b, types.TInt), zigzag(loadInt(p, f.width)))
+	case types.StringType:
+		s := *(*string)(p)
+		b = binary.AppendUvarint(append(b, types.TBytes), uint64(len(s)))
+		return append(b, s...)
+	case types.BytesType:
+		s := *(*[]byte)(p)
+		b = binary.AppendUvarint(append(b, types.TFixed), uint64(len(s)))
+		return append(b, s...)
+	case types.Float32Type, types.Float64Type, types.Fixed32Type, types.Fixed64Type:
+		return appendFixedAt(append(b, types.TFixed|fixedFlag(f.typ)), f.typ, p)
+	case types.ListType:
+		return appendList(b, (*sliceHeader)(p), f)
+	case types.StructType:
+		b = binary.AppendUvarint(append(b, types.TStruct), uint64(len(f.fields)))
+		return appendFields(b, p, f.fields)
+	}
+	return b
+}
+
+// appendList appends the slice s as a list: fixed-width elements as one
+// array, packed integers as bare varints, and other elements with their prefix.
+func appendList(b []byte, s *sliceHeader, f *fieldPlan) []byte {
+	elem := f.elem
+	switch {
+	case fixedWidth(elem.typ) != 0:
+		b = binary.AppendUvarint(append(b, types.TList|fixedFlag(elem.typ)), uint64(s.len))
+		for i := 0; i < s.len; i++ {
+			b = appendFixedAt(b, elem.typ, unsafe.Add(s.data, uintptr(i)*f.width))
+		}
+	case f.packed:
+		b = binary.AppendUvarint(append(b, types.TList|types.ListPacked), uint64(s.len))
+		w := intsWriter{encoding: f.encoding, sint: elem.typ == types.SintType}
+		for i := 0; i < s.len; i++ {
+			p := unsafe.Add(s.data, uintptr(i)*f.width)
+			var v uint64
+			if w.sint {
+				v = uint64(loadInt(p, elem.width))
+			} else {
+				v = loadUint(p, elem.width)
+			}
+			b = binary.AppendUvarint(b, w.next(v))
+		}
+	default:
+		b = binary.AppendUvarint(append(b, types.TList), uint64(s.len))
+		for i := 0; i < s.len; i++ {
+			b = appendValue(b, unsafe.Add(s.data, uintptr(i)*f.width), elem)
+		}
+	}
+	return b
+}
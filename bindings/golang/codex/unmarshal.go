@@ -0,0 +1,311 @@
+package codex
+
+import (
+	"encoding/binary"
+	"fmt"
+	"io"
+	"math"
+	"reflect"
+	"unsafe"
+
+	"github.com/amallek/ute/bindings/golang/types"
+)
+
+// UnmarshalOptions configures Unmarshal.
+type UnmarshalOptions struct {
+	// ZeroCopy makes decoded strings and byte slices alias the input through
+	// unsafe.String and subslicing instead of copying it. The input must then
+	// stay unchanged for as long as the decoded values are used.
+	ZeroCopy bool
+}
+
+// Unmarshal decodes a UTE message into the struct v points to, which is bound
+// to its schema through struct tags (see Marshal). Slices of v are reused
+// where their capacity suffices, so decoding into the same value again
+// allocates only for the strings and byte slices.
+func Unmarshal(data []byte, v any) error {
+	return UnmarshalOptions{}.Unmarshal(data, v)
+}
+
+// Unmarshal decodes like the package-level Unmarshal with the given options.
+func (o UnmarshalOptions) Unmarshal(data []byte, v any) error {
+	rv := reflect.ValueOf(v)
+	if rv.Kind() != reflect.Pointer || rv.Type().Elem().Kind() != reflect.Struct || rv.IsNil() {
+		return fmt.Errorf("expected a non-nil pointer to a struct, got %T", v)
+	}
+	plan := planOf(rv.Type().Elem())
+	if plan.err != nil {
+		return plan.err
+	}
+	d := decodeState{data: data, zeroCopy: o.ZeroCopy}
+	if err := d.fields(rv.UnsafePointer(), plan.fields); err != nil {
+		return err
+	}
+	if d.pos != len(data) {
+		return fmt.Errorf("trailing bytes after message")
+	}
+	return nil
+}
+
+// decodeState is the position of Unmarshal in its input.
+type decodeState struct {
+	data     []byte
+	pos      int
+	zeroCopy bool
+}
+
+// byte reads one byte.
+func (d *decodeState) byte() (byte, error) {
+	if d.pos >= len(d.data) {
+		return 0, io.ErrUnexpectedEOF
+	}
+	b := d.data[d.pos]
+	d.pos++
+	return b, nil
+}
+
+// uvarint reads a varint (see decodeVarint).
+func (d *decodeState) uvarint() (uint64, error) {
+	// Most counts, lengths and values take one byte
+	if d.pos < len(d.data) && d.data[d.pos] < 0x80 {
+		d.pos++
+		return uint64(d.data[d.pos-1]), nil
+	}
+	var result uint64
+	for shift := uint(0); ; shift += 7 {
+		if d.pos >= len(d.data) {
+			return 0, io.ErrUnexpectedEOF
+		}
+		b := d.data[d.pos]
+		d.pos++
+		// The tenth byte only holds bit 63
+		if shift == 63 && b > 1 {
+			return 0, fmt.Errorf("varint overflows 64 bits")
+		}
+		result |= uint64(b&0x7F) << shift
+		if b < 0x80 {
+			return result, nil
+		}
+	}
+}
+
+// take returns the next n bytes.
+func (d *decodeState) take(n uint64) ([]byte, error) {
+	if n > uint64(len(d.data)-d.pos) {
+		return nil, io.ErrUnexpectedEOF
+	}
+	b := d.data[d.pos : d.pos+int(n) : d.pos+int(n)]
+	d.pos += int(n)
+	return b, nil
+}
+
+// storeUint stores v as an unsigned integer of width bytes at p, unless it does not fit.
+func storeUint(p unsafe.Pointer, width uintptr, v uint64) error {
+	switch width {
+	case 1:
+		*(*uint8)(p) = uint8(v)
+	case 2:
+		*(*uint16)(p) = uint16(v)
+	case 4:
+		*(*uint32)(p) = uint32(v)
+	default:
+		*(*uint64)(p) = v
+		return nil
+	}
+	if v>>(8*width) != 0 {
+		return fmt.Errorf("int %d overflows a %d-byte field", v, width)
+	}
+	return nil
+}
+
+// storeInt stores v as a signed integer of width bytes at p, unless it does not fit.
+func storeInt(p unsafe.Pointer, width uintptr, v int64) error {
+	switch width {
+	case 1:
+		*(*int8)(p) = int8(v)
+	case 2:
+		*(*int16)(p) = int16(v)
+	case 4:
+		*(*int32)(p) = int32(v)
+	default:
+		*(*int64)(p) = v
+		return nil
+	}
+	if bits := 64 - 8*width; v<<bits>>bits != v {
+		return fmt.Errorf("sint %d overflows a %d-byte field", v, width)
+	}
+	return nil
+}
+
+// storeFixed stores the little-endian fixed-width value b at p.
+func storeFixed(p unsafe.Pointer, t types.FieldType, b []byte) {
+	switch t {
+	case types.Float32Type:
+		*(*float32)(p) = math.Float32frombits(binary.LittleEndian.Uint32(b))
+	case types.Float64Type:
+		*(*float64)(p) = math.Float64frombits(binary.LittleEndian.Uint64(b))
+	case types.Fixed32Type:
+		*(*uint32)(p) = binary.LittleEndian.Uint32(b)
+	default:
+		*(*uint64)(p) = binary.LittleEndian.Uint64(b)
+	}
+}
+
+// fields decodes the members of the struct at p.
+func (d *decodeState) fields(p unsafe.Pointer, fields []fieldPlan) error {
+	for i := range fields {
+		if err := d.value(unsafe.Add(p, fields[i].offset), &fields[i]); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// value decodes a value with its type prefix into p.
+func (d *decodeState) value(p unsafe.Pointer, f *fieldPlan) error {
+	h, err := d.byte()
+	if err != nil {
+		return err
+	}
+	switch f.typ {
+	case types.BoolType:
+		if h>>5 != 1 {
+			return fmt.Errorf("expected bool")
+		}
+		*(*bool)(p) = h&0x10 != 0
+	case types.IntType, types.SintType:
+		if h>>5 != 2 {
+			return fmt.Errorf("expected int")
+		}
+		v, err := d.uvarint()
+		if err != nil {
+			return err
+		}
+		if f.typ == types.SintType {
+			return storeInt(p, f.width, unzigzag(v))
+		}
+		return storeUint(p, f.width, v)
+	case types.StringType:
+		if h != types.TBytes {
+			if h>>5 == 3 {
+				return fmt.Errorf("string flags do not match schema")
+			}
+			return fmt.Errorf("expected string")
+		}
+		n, err := d.uvarint()
+		if err != nil {
+			return err
+		}
+		b, err := d.take(n)
+		if err != nil {
+			return err
+		}
+		if d.zeroCopy {
+			*(*string)(p) = unsafe.String(unsafe.SliceData(b), len(b))
+		} else {
+			*(*string)(p) = string(b)
+		}
+	case types.BytesType:
+		if h != types.TFixed {
+			return fmt.Errorf("expected bytes")
+		}
+		n, err := d.uvarint()
+		if err != nil {
+			return err
+		}
+		b, err := d.take(n)
+		if err != nil {
+			return err
+		}
+		if dst := (*[]byte)(p); d.zeroCopy {
+			*dst = b
+		} else {
+			*dst = append((*dst)[:0], b...)
+		}
+	case types.Float32Type, types.Float64Type, types.Fixed32Type, types.Fixed64Type:
+		if h != types.TFixed|fixedFlag(f.typ) {
+			return fmt.Errorf("expected fixed-width value")
+		}
+		b, err := d.take(uint64(fixedWidth(f.typ)))
+		if err != nil {
+			return err
+		}
+		storeFixed(p, f.typ, b)
+	case types.ListType:
+		return d.list(h, (*sliceHeader)(p), f)
+	case types.StructType:
+		if h != types.TStruct {
+			return fmt.Errorf("expected struct")
+		}
+		n, err := d.uvarint()
+		if err != nil {
+			return err
+		}
+		if n != uint64(len(f.fields)) {
+			return fmt.Errorf("struct field count does not match schema")
+		}
+		return d.fields(p, f.fields)
+	}
+	return nil
+}
+
+// list decodes a list with prefix h into the slice s, reusing its backing
+// array if it holds enough elements.
+func (d *decodeState) list(h byte, s *sliceHeader, f *fieldPlan) error {
+	elem := f.elem
+	flags := fixedFlag(elem.typ)
+	if f.packed {
+		flags |= types.ListPacked
+	}
+	if h != types.TList|flags {
+		if h>>5 == 4 {
+			return fmt.Errorf("list flags do not match schema")
+		}
+		return fmt.Errorf("expected list")
+	}
+	count, err := d.uvarint()
+	if err != nil {
+		return err
+	}
+	// Every element takes at least one byte
+	width := uint64(fixedWidth(elem.typ))
+	if count > uint64(len(d.data)-d.pos)/max(width, 1) {
+		return fmt.Errorf("list count exceeds input")
+	}
+	if int(count) > s.cap {
+		s.data, s.cap = reflect.MakeSlice(f.slice, int(count), int(count)).UnsafePointer(), int(count)
+	}
+	s.len = int(count)
+	at := func(i int) unsafe.Pointer { return unsafe.Add(s.data, uintptr(i)*f.width) }
+	switch {
+	case width != 0:
+		arr, _ := d.take(count * width)
+		for i := 0; i < s.len; i++ {
+			storeFixed(at(i), elem.typ, arr[uint64(i)*width:])
+		}
+	case f.packed:
+		ir := intsReader{encoding: f.encoding, sint: elem.typ == types.SintType}
+		for i := 0; i < s.len; i++ {
+			v, err := d.uvarint()
+			if err != nil {
+				return err
+			}
+			v = ir.next(v)
+			if ir.sint {
+				err = storeInt(at(i), elem.width, int64(v))
+			} else {
+				err = storeUint(at(i), elem.width, v)
+			}
+			if err != nil {
+				return err
+			}
+		}
+	default:
+		for i := 0; i < s.len; i++ {
+			if err := d.value(at(i), elem); err != nil {
+				return err
+			}
+		}
+	}
+	return nil
+}
@@ -20,16 +20,65 @@ func ParseSchemaField(sf types.SchemaField) (types.ParsedField, error) {
 		ft = types.BoolType
 	case "int":
 		ft = types.IntType
+	case "sint":
+		ft = types.SintType
 	case "string":
 		ft = types.StringType
 	case "list":
 		ft = types.ListType
 	case "struct":
 		ft = types.StructType
+	case "float32":
+		ft = types.Float32Type
+	case "float64":
+		ft = types.Float64Type
+	case "fixed32":
+		ft = types.Fixed32Type
+	case "fixed64":
+		ft = types.Fixed64Type
+	case "bytes":
+		ft = types.BytesType
 	default:
 		return types.ParsedField{}, fmt.Errorf("unknown type: %s", sf.Type)
 	}
-	pf := types.ParsedField{Name: sf.Name, Type: ft}
+	pf := types.ParsedField{Name: sf.Name, Type: ft, Packed: sf.Packed, Columnar: sf.Columnar, Sparse: sf.Sparse, Chunk: sf.Chunk}
+	switch sf.Encoding {
+	case "", "plain":
+	case "delta":
+		pf.Encoding = types.EncodingDelta
+	case "delta-of-delta":
+		pf.Encoding = types.EncodingDeltaOfDelta
+	default:
+		return types.ParsedField{}, fmt.Errorf("unknown encoding %q: %s", sf.Encoding, sf.Name)
+	}
+	// Deltas are written like a packed list
+	if pf.Encoding != types.EncodingPlain {
+		pf.Packed = true
+	}
+	if (pf.Packed || sf.Encoding != "") && (ft != types.ListType || sf.Elem == nil || (sf.Elem.Type != "int" && sf.Elem.Type != "sint")) {
+		return types.ParsedField{}, fmt.Errorf("packed and encoding require a list of int or sint: %s", sf.Name)
+	}
+	if sf.Columnar && (ft != types.ListType || !columnarElem(sf.Elem)) {
+		return types.ParsedField{}, fmt.Errorf("columnar requires a list of structs of scalar fields: %s", sf.Name)
+	}
+	if sf.Chunk != 0 && (ft != types.ListType || sf.Chunk < 0 || sf.Chunk > 65535 || pf.Packed || sf.Columnar || sf.Elem == nil || fixedType(sf.Elem.Type)) {
+		return types.ParsedField{}, fmt.Errorf("chunk requires a list of at most 65535 non-fixed-width elements per chunk, not packed or columnar: %s", sf.Name)
+	}
+	if sf.Sparse && ft != types.StructType {
+		return types.ParsedField{}, fmt.Errorf("sparse requires a struct: %s", sf.Name)
+	}
+	switch sf.Dict {
+	case "", "none":
+	case "message":
+		pf.Dict = types.DictMessage
+	case "shared":
+		pf.Dict = types.DictShared
+	default:
+		return types.ParsedField{}, fmt.Errorf("unknown dict mode %q: %s", sf.Dict, sf.Name)
+	}
+	if pf.Dict != types.DictNone && ft != types.StringType {
+		return types.ParsedField{}, fmt.Errorf("dict requires a string: %s", sf.Name)
+	}
 	if ft == types.ListType && sf.Elem != nil {
 		elem, err := ParseSchemaField(*sf.Elem)
 		if err != nil {
@@ -49,6 +98,34 @@ func ParseSchemaField(sf types.SchemaField) (types.ParsedField, error) {
 	return pf, nil
 }
 
+// fixedType reports whether a schema type is fixed-width (always written as a raw array in lists).
+func fixedType(t string) bool {
+	return t == "float32" || t == "float64" || t == "fixed32" || t == "fixed64"
+}
+
+// columnarElem reports whether a list element can be encoded column by column:
+// a dense struct whose fields are all scalars, not all of them null.
+func columnarElem(elem *types.SchemaField) bool {
+	if elem == nil || elem.Type != "struct" || elem.Sparse {
+		return false
+	}
+	hasData := false
+	for _, f := range elem.Fields {
+		switch f.Type {
+		case "bool", "int", "string":
+			// Columns hold plain strings only
+			if f.Dict != "" && f.Dict != "none" {
+				return false
+			}
+			hasData = true
+		case "null":
+		default:
+			return false
+		}
+	}
+	return hasData
+}
+
 // LoadSchema loads a schema YAML file and returns all available schema versions.
 //
 // Supports both multi-version and single-version schema files.
@@ -68,7 +145,7 @@ func LoadSchema(filename string) ([]types.SchemaVersion, error) {
 	if err != nil {
 		return nil, err
 	}
-	return []types.SchemaVersion{{Version: 1, Fields: single.Fields}}, nil
+	return []types.SchemaVersion{{Version: 1, Dictionary: single.Dictionary, Fields: single.Fields}}, nil
 }
 
 // FindSchemaVersion returns the SchemaVersion for a given version number.
@@ -97,3 +174,36 @@ func ParseSchemaFields(fields []types.SchemaField) ([]types.ParsedField, error)
 	}
 	return parsed, nil
 }
+
+// ParseSchemaVersion parses the fields of a schema version and attaches its
+// dictionary to the string fields declared shared.
+//
+// Fields parsed with ParseSchemaFields have no dictionary: their values are
+// written plain, and dictionary ids fail to decode.
+func ParseSchemaVersion(v *types.SchemaVersion) ([]types.ParsedField, error) {
+	dict, err := types.NewDictionary(v.Dictionary)
+	if err != nil {
+		return nil, err
+	}
+	parsed, err := ParseSchemaFields(v.Fields)
+	if err != nil {
+		return nil, err
+	}
+	for i := range parsed {
+		attachDictionary(&parsed[i], dict)
+	}
+	return parsed, nil
+}
+
+// attachDictionary sets the dictionary of a shared string field, and of those nested in it.
+func attachDictionary(f *types.ParsedField, dict *types.Dictionary) {
+	if f.Dict == types.DictShared {
+		f.Shared = dict
+	}
+	if f.Elem != nil {
+		attachDictionary(f.Elem, dict)
+	}
+	for i := range f.Fields {
+		attachDictionary(&f.Fields[i], dict)
+	}
+}
@@ -0,0 +1,111 @@
+package main
+
+// Tests and decoding benchmarks of the typed codec against the map API and
+// encoding/json, on a message of ../../schemas/complex.yaml:
+//
+//	go test -bench . -benchmem
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"testing"
+
+	"github.com/amallek/ute/bindings/golang/codex"
+)
+
+// benchDevices returns a message of 100 devices.
+func benchDevices() *Devices {
+	d := &Devices{}
+	for i := 0; i < 100; i++ {
+		d.Devices = append(d.Devices, Device{ID: uint64(1000 + i), Name: fmt.Sprintf("device-%d", i)})
+	}
+	return d
+}
+
+// TestAppendMarshalAllocs checks that encoding into a buffer with enough
+// capacity does not allocate.
+func TestAppendMarshalAllocs(t *testing.T) {
+	input := benchDevices()
+	want, err := codex.Marshal(input)
+	if err != nil {
+		t.Fatal(err)
+	}
+	buf := make([]byte, 0, len(want))
+	allocs := testing.AllocsPerRun(100, func() {
+		buf, err = codex.AppendMarshal(buf[:0], input)
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(buf, want) {
+		t.Fatalf("AppendMarshal wrote %x, Marshal %x", buf, want)
+	}
+	if allocs != 0 {
+		t.Errorf("AppendMarshal: %v allocations per message, want 0", allocs)
+	}
+}
+
+func BenchmarkUnmarshal(b *testing.B) {
+	data, err := codex.Marshal(benchDevices())
+	if err != nil {
+		b.Fatal(err)
+	}
+	var out Devices
+	b.SetBytes(int64(len(data)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if err := codex.Unmarshal(data, &out); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkUnmarshalZeroCopy(b *testing.B) {
+	data, err := codex.Marshal(benchDevices())
+	if err != nil {
+		b.Fatal(err)
+	}
+	var out Devices
+	opts := codex.UnmarshalOptions{ZeroCopy: true}
+	b.SetBytes(int64(len(data)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if err := opts.Unmarshal(data, &out); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkDeserializeMap(b *testing.B) {
+	data, err := codex.Marshal(benchDevices())
+	if err != nil {
+		b.Fatal(err)
+	}
+	schema, err := codex.SchemaOf(&Devices{})
+	if err != nil {
+		b.Fatal(err)
+	}
+	b.SetBytes(int64(len(data)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := codex.Deserialize(bytes.NewReader(data), schema); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkUnmarshalJSON(b *testing.B) {
+	data, err := json.Marshal(benchDevices())
+	if err != nil {
+		b.Fatal(err)
+	}
+	b.SetBytes(int64(len(data)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		var out Devices
+		if err := json.Unmarshal(data, &out); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
@@ -0,0 +1,66 @@
+package main
+
+// Tests of the back-references Deserialize resolves for dict fields: only
+// recent plain dict strings of the same scope are valid targets.
+
+import (
+	"bytes"
+	"strings"
+	"testing"
+
+	"github.com/amallek/ute/bindings/golang/codex"
+	"github.com/amallek/ute/bindings/golang/types"
+)
+
+func TestDeserializeRefs(t *testing.T) {
+	tag := types.ParsedField{Type: types.StringType, Dict: types.DictMessage}
+	tags := []types.ParsedField{{Name: "tags", Type: types.ListType, Elem: &tag}}
+	// A list of n plain tags "t0", "t1", ... followed by raw
+	list := func(n int, raw ...byte) []byte {
+		buf := []byte{types.TList, byte(n + 1)}
+		if n+1 >= 0x80 {
+			buf = []byte{types.TList, byte(n+1) | 0x80, byte((n + 1) >> 7)}
+		}
+		for i := 0; i < n; i++ {
+			s := "t" + string(rune('a'+i%26)) + string(rune('a'+i/26))
+			buf = append(buf, types.TBytes, byte(len(s)))
+			buf = append(buf, s...)
+		}
+		return append(buf, raw...)
+	}
+	ref := byte(types.TBytes | types.StringRef)
+	tests := []struct {
+		name   string
+		data   []byte
+		schema []types.ParsedField
+		want   string // the last tag; "" if decoding fails
+		err    string
+	}{
+		{"previous tag", list(2, ref, 5), tags, "tba", ""},
+		{"oldest of 256", list(256, ref, 0x80, 0x0a), tags, "taa", ""},
+		{"257 strings back", list(257, ref, 0x85, 0x0a), tags, "", "does not point at a recent dict string"},
+		// "`\x01x" holds the bytes of a plain string "x"
+		{"inside a string", []byte{types.TList, 2, types.TBytes, 3, '`', 1, 'x', ref, 3}, tags, "", "does not point at a recent dict string"},
+		{"into a plain field", []byte{types.TBytes, 1, 'x', types.TList, 1, ref, 5},
+			[]types.ParsedField{{Name: "name", Type: types.StringType}, tags[0]}, "", "does not point at a recent dict string"},
+		{"zero distance", list(1, ref, 0), tags, "", "does not point at a recent dict string"},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			out, err := codex.Deserialize(bytes.NewReader(tt.data), tt.schema)
+			switch {
+			case tt.err == "" && err != nil:
+				t.Fatalf("Deserialize: %v", err)
+			case tt.err != "":
+				if err == nil || !strings.Contains(err.Error(), tt.err) {
+					t.Fatalf("Deserialize: error %v, want one containing %q", err, tt.err)
+				}
+				return
+			}
+			got := out["tags"].([]any)
+			if last := got[len(got)-1]; last != tt.want {
+				t.Errorf("last tag %q, want %q", last, tt.want)
+			}
+		})
+	}
+}
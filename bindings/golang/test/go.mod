@@ -5,3 +5,5 @@ go 1.23.3
 require github.com/amallek/ute/bindings/golang v0.0.0-20250607180338-debb6baca474
 
 require gopkg.in/yaml.v2 v2.4.0 // indirect
+
+replace github.com/amallek/ute/bindings/golang => ../
@@ -1,8 +1,9 @@
 // Usage:
-//   go run test.go <read|write> <filename>
+//   go run test.go <read|write|marshal> <filename>
 //
-//   write:  Serialize Go data and write UTE binary to file (for C to read)
-//   read:   Read UTE binary from file (produced by C) and deserialize in Go
+//   write:    Serialize Go data and write UTE binary to file (for C to read)
+//   read:     Read UTE binary from file (produced by C) and deserialize in Go
+//   marshal:  Like write, through the typed codec
 
 package main
 
@@ -15,11 +16,21 @@ import (
 	"github.com/amallek/ute/bindings/golang/schema"
 )
 
+// Device and Devices are the records of ../../schemas/complex.yaml for the typed codec.
+type Device struct {
+	ID   uint64 `ute:"id"`
+	Name string `ute:"name"`
+}
+
+type Devices struct {
+	Devices []Device `ute:"devices"`
+}
+
 // main is the entry point for the cross-language UTE test. It parses arguments, loads the schema,
 // and either serializes Go data to a file (write) or deserializes a file produced by C (read).
 func main() {
 	if len(os.Args) != 3 {
-		fmt.Fprintf(os.Stderr, "Usage: %s <read|write> <filename>\n", os.Args[0])
+		fmt.Fprintf(os.Stderr, "Usage: %s <read|write|marshal> <filename>\n", os.Args[0])
 		os.Exit(2)
 	}
 	mode := os.Args[1]
@@ -56,6 +67,18 @@ func main() {
 			os.Exit(4)
 		}
 		fmt.Printf("[crosslang] Wrote %d bytes to %s\n", len(binaryData), filename)
+	} else if mode == "marshal" {
+		input := &Devices{Devices: []Device{{ID: 1, Name: "device1"}, {ID: 2, Name: "device2"}}}
+		binaryData, err := codex.Marshal(input)
+		if err != nil {
+			panic(err)
+		}
+		err = os.WriteFile(filename, binaryData, 0644)
+		if err != nil {
+			fmt.Fprintf(os.Stderr, "Failed to write %s: %v\n", filename, err)
+			os.Exit(4)
+		}
+		fmt.Printf("[crosslang] Marshaled %d bytes to %s\n", len(binaryData), filename)
 	} else if mode == "read" {
 		bin2, err := os.ReadFile(filename)
 		if err != nil {
@@ -69,7 +92,7 @@ func main() {
 		}
 		fmt.Printf("[crosslang] Read %d bytes from %s, parsed: %#v\n", len(bin2), filename, parsed)
 	} else {
-		fmt.Fprintf(os.Stderr, "Unknown mode: %s (expected 'read' or 'write')\n", mode)
+		fmt.Fprintf(os.Stderr, "Unknown mode: %s (expected 'read', 'write' or 'marshal')\n", mode)
 		os.Exit(3)
 	}
 }
@@ -0,0 +1,226 @@
+package main
+
+// Table tests of the typed decoder: round trips, slice reuse, zero-copy
+// strings and the errors Unmarshal reports.
+
+import (
+	"bytes"
+	"math"
+	"reflect"
+	"strings"
+	"testing"
+	"unsafe"
+
+	"github.com/amallek/ute/bindings/golang/codex"
+)
+
+// Inner is a nested struct of Mixed.
+type Inner struct {
+	On    bool   `ute:"on"`
+	Label string `ute:"label"`
+}
+
+// Mixed has a field of every kind the typed codec encodes.
+type Mixed struct {
+	ID      uint64    `ute:"id"`
+	Small   uint8     `ute:"small"`
+	Offset  int32     `ute:"offset"`
+	Ratio   float64   `ute:"ratio"`
+	Scale   float32   `ute:"scale"`
+	Serial  uint32    `ute:"serial,fixed"`
+	Blob    []byte    `ute:"blob"`
+	Name    string    `ute:"name"`
+	Samples []int64   `ute:"samples,delta"`
+	Times   []uint64  `ute:"times,delta-of-delta"`
+	Counts  []uint16  `ute:"counts,packed"`
+	Floats  []float32 `ute:"floats"`
+	Tags    []string  `ute:"tags"`
+	Inner   Inner     `ute:"inner"`
+	Devices []Device  `ute:"devices"`
+	Skipped int       `ute:"-"`
+}
+
+func TestUnmarshalRoundTrip(t *testing.T) {
+	tests := []struct {
+		name string
+		in   Mixed
+	}{
+		{"zero", Mixed{}},
+		{"typical", Mixed{
+			ID: 42, Small: 7, Offset: -4200, Ratio: 0.75, Scale: 1.5, Serial: 0xdeadbeef,
+			Blob: []byte{0, 1, 0xfe, 0xff}, Name: "sensor",
+			Samples: []int64{1700000000, 1700000015, 1700000010},
+			Times:   []uint64{1000, 2000, 3000, 4100},
+			Counts:  []uint16{1, 300, 65535},
+			Floats:  []float32{-1, 0.25},
+			Tags:    []string{"a", "", "ü"},
+			Inner:   Inner{On: true, Label: "x"},
+			Devices: []Device{{ID: 1, Name: "device1"}, {ID: 2, Name: "device2"}},
+		}},
+		{"extremes", Mixed{
+			ID: math.MaxUint64, Small: math.MaxUint8, Offset: math.MinInt32, Ratio: math.Inf(-1),
+			Serial: math.MaxUint32, Name: strings.Repeat("n", 300),
+			Samples: []int64{math.MaxInt64, math.MinInt64, 0},
+			Times:   []uint64{math.MaxUint64, 0, math.MaxUint64},
+		}},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			data, err := codex.Marshal(&tt.in)
+			if err != nil {
+				t.Fatal(err)
+			}
+			var out Mixed
+			if err := codex.Unmarshal(data, &out); err != nil {
+				t.Fatal(err)
+			}
+			if !reflect.DeepEqual(out, tt.in) {
+				t.Errorf("Unmarshal(Marshal(v)) = %+v, want %+v", out, tt.in)
+			}
+		})
+	}
+}
+
+// TestUnmarshalReusesSlices checks that a second decode into the same value
+// keeps the backing arrays of its slices when they are large enough.
+func TestUnmarshalReusesSlices(t *testing.T) {
+	large, err := codex.Marshal(benchDevices())
+	if err != nil {
+		t.Fatal(err)
+	}
+	small, err := codex.Marshal(&Devices{Devices: []Device{{ID: 1, Name: "one"}}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	var out Devices
+	if err := codex.Unmarshal(large, &out); err != nil {
+		t.Fatal(err)
+	}
+	first := unsafe.SliceData(out.Devices)
+	tests := []struct {
+		name string
+		data []byte
+		len  int
+	}{
+		{"same size", large, 100},
+		{"smaller", small, 1},
+		{"same size again", large, 100},
+	}
+	for _, tt := range tests {
+		if err := codex.Unmarshal(tt.data, &out); err != nil {
+			t.Fatalf("%s: %v", tt.name, err)
+		}
+		if len(out.Devices) != tt.len || unsafe.SliceData(out.Devices) != first {
+			t.Errorf("%s: got %d devices at %p, want %d at %p", tt.name, len(out.Devices), unsafe.SliceData(out.Devices), tt.len, first)
+		}
+	}
+	allocs := testing.AllocsPerRun(10, func() {
+		_ = codex.UnmarshalOptions{ZeroCopy: true}.Unmarshal(large, &out)
+	})
+	if allocs != 0 {
+		t.Errorf("zero-copy Unmarshal into a large enough value: %v allocations, want 0", allocs)
+	}
+}
+
+// TestUnmarshalZeroCopy checks that ZeroCopy strings and byte slices alias
+// the input and that copies do not.
+func TestUnmarshalZeroCopy(t *testing.T) {
+	data, err := codex.Marshal(&Mixed{Name: "sensor", Blob: []byte("blob")})
+	if err != nil {
+		t.Fatal(err)
+	}
+	within := func(p *byte) bool {
+		start := uintptr(unsafe.Pointer(unsafe.SliceData(data)))
+		return uintptr(unsafe.Pointer(p)) >= start && uintptr(unsafe.Pointer(p)) < start+uintptr(len(data))
+	}
+	tests := []struct {
+		opts  codex.UnmarshalOptions
+		alias bool
+	}{
+		{codex.UnmarshalOptions{}, false},
+		{codex.UnmarshalOptions{ZeroCopy: true}, true},
+	}
+	for _, tt := range tests {
+		var out Mixed
+		if err := tt.opts.Unmarshal(data, &out); err != nil {
+			t.Fatal(err)
+		}
+		if out.Name != "sensor" || !bytes.Equal(out.Blob, []byte("blob")) {
+			t.Fatalf("ZeroCopy=%v: decoded %q and %q", tt.opts.ZeroCopy, out.Name, out.Blob)
+		}
+		if within(unsafe.StringData(out.Name)) != tt.alias || within(unsafe.SliceData(out.Blob)) != tt.alias {
+			t.Errorf("ZeroCopy=%v: strings alias the input: %v, want %v", tt.opts.ZeroCopy, !tt.alias, tt.alias)
+		}
+	}
+}
+
+// Wide and narrow integer fields of the same name, to decode values that do
+// not fit.
+type (
+	uintWide struct {
+		V uint64 `ute:"v"`
+	}
+	uint8Field struct {
+		V uint8 `ute:"v"`
+	}
+	uint16Field struct {
+		V uint16 `ute:"v"`
+	}
+	uint32Field struct {
+		V uint32 `ute:"v"`
+	}
+	intWide struct {
+		V int64 `ute:"v"`
+	}
+	int8Field struct {
+		V int8 `ute:"v"`
+	}
+	int16Field struct {
+		V int16 `ute:"v"`
+	}
+	int32Field struct {
+		V int32 `ute:"v"`
+	}
+)
+
+func TestUnmarshalErrors(t *testing.T) {
+	mustMarshal := func(v any) []byte {
+		data, err := codex.Marshal(v)
+		if err != nil {
+			t.Fatal(err)
+		}
+		return data
+	}
+	valid := mustMarshal(&Devices{Devices: []Device{{ID: 1, Name: "one"}}})
+	tests := []struct {
+		name string
+		data []byte
+		into any
+		err  string // substring of the error; "" for success
+	}{
+		{"uint8 fits", mustMarshal(&uintWide{255}), &uint8Field{}, ""},
+		{"uint8 overflow", mustMarshal(&uintWide{256}), &uint8Field{}, "overflows a 1-byte field"},
+		{"uint16 overflow", mustMarshal(&uintWide{1 << 16}), &uint16Field{}, "overflows a 2-byte field"},
+		{"uint32 overflow", mustMarshal(&uintWide{1 << 32}), &uint32Field{}, "overflows a 4-byte field"},
+		{"int8 fits", mustMarshal(&intWide{-128}), &int8Field{}, ""},
+		{"int8 overflow", mustMarshal(&intWide{128}), &int8Field{}, "overflows a 1-byte field"},
+		{"int8 underflow", mustMarshal(&intWide{-129}), &int8Field{}, "overflows a 1-byte field"},
+		{"int16 overflow", mustMarshal(&intWide{1 << 15}), &int16Field{}, "overflows a 2-byte field"},
+		{"int32 underflow", mustMarshal(&intWide{-1<<31 - 1}), &int32Field{}, "overflows a 4-byte field"},
+		{"trailing byte", append(append([]byte{}, valid...), 0), &Devices{}, "trailing bytes"},
+		{"truncated", valid[:len(valid)-1], &Devices{}, "unexpected EOF"},
+		{"wrong type", mustMarshal(&intWide{1}), &Devices{}, "expected list"},
+		{"not a pointer", valid, Devices{}, "non-nil pointer"},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			err := codex.Unmarshal(tt.data, tt.into)
+			switch {
+			case tt.err == "" && err != nil:
+				t.Errorf("Unmarshal: %v", err)
+			case tt.err != "" && (err == nil || !strings.Contains(err.Error(), tt.err)):
+				t.Errorf("Unmarshal: error %v, want one containing %q", err, tt.err)
+			}
+		})
+	}
+}
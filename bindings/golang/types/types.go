@@ -1,16 +1,24 @@
 package types
 
+import "fmt"
+
 // FieldType represents the type of a field in a schema or parsed structure.
 type FieldType int
 
 // Supported field types for schema and parsed fields.
 const (
-	NullType   FieldType = iota // Null value
-	BoolType                    // Boolean value
-	IntType                     // Integer value
-	StringType                  // String value
-	ListType                    // List value
-	StructType                  // Struct/object value
+	NullType    FieldType = iota // Null value
+	BoolType                     // Boolean value
+	IntType                      // Integer value
+	StringType                   // String value
+	ListType                     // List value
+	StructType                   // Struct/object value
+	Float32Type                  // 32-bit IEEE 754 float
+	Float64Type                  // 64-bit IEEE 754 float
+	Fixed32Type                  // Unsigned 32-bit integer stored in fixed width
+	Fixed64Type                  // Unsigned 64-bit integer stored in fixed width
+	BytesType                    // Raw byte string
+	SintType                     // Signed integer value, encoded as an int holding its zigzag mapping
 )
 
 // Type prefix constants for UTE serialization format.
@@ -21,33 +29,103 @@ const (
 	TBytes  = 0b011 << 5 // String/bytes value
 	TList   = 0b100 << 5 // List value
 	TStruct = 0b101 << 5 // Struct/object value
+	TFixed  = 0b110 << 5 // Fixed-width value, or raw bytes without width flag
+)
+
+// Flag bits carried in the low bits of a type prefix.
+const (
+	ListPacked   = 0x01 // List of ints encoded as bare varints after the header
+	ListColumnar = 0x02 // List of structs encoded as one column per member
+	ListFixed32  = 0x04 // List of 4-byte values encoded as one little-endian array
+	ListFixed64  = 0x08 // List of 8-byte values encoded as one little-endian array
+	ListChunked  = 0x10 // List encoded in chunks behind a table of chunk sizes
+	Fixed32      = 0x04 // Fixed-width value of 4 little-endian bytes
+	Fixed64      = 0x08 // Fixed-width value of 8 little-endian bytes
+	StructSparse = 0x01 // Struct with only the present members, each preceded by its index
+	StructBitmap = 0x02 // Struct with a presence bitmap, followed by the present members
+	StringRef    = 0x01 // String whose varint is the distance back to an earlier plain string
+	StringDict   = 0x02 // String whose varint is an id into the shared dictionary
+)
+
+// Encodings of packed lists of ints and sints: what their varints hold.
+// Differences wrap around modulo 2^64 and are zigzag-mapped.
+const (
+	EncodingPlain        = iota // The elements (zigzag-mapped for sints)
+	EncodingDelta               // Each element minus the previous one (0 before the first)
+	EncodingDeltaOfDelta        // Each difference minus the previous one
+)
+
+// Dictionary modes of string fields.
+const (
+	DictNone    = iota // Always written plain
+	DictMessage        // Repeated values may refer back to an earlier one in the message
+	DictShared         // Values of the shared dictionary may be written as their id
 )
 
+// Dictionary is the shared string dictionary of a schema version.
+type Dictionary struct {
+	Values []string          // Values in id order
+	ids    map[string]uint64 // Id of every value
+}
+
+// NewDictionary builds a dictionary of distinct values, numbered in order.
+func NewDictionary(values []string) (*Dictionary, error) {
+	d := &Dictionary{Values: values, ids: make(map[string]uint64, len(values))}
+	for i, v := range values {
+		if _, ok := d.ids[v]; ok {
+			return nil, fmt.Errorf("repeated dictionary value: %q", v)
+		}
+		d.ids[v] = uint64(i)
+	}
+	return d, nil
+}
+
+// ID returns the id of a value, and whether the dictionary has it.
+func (d *Dictionary) ID(s string) (uint64, bool) {
+	id, ok := d.ids[s]
+	return id, ok
+}
+
 // SchemaField represents a field as defined in a YAML schema file.
 type SchemaField struct {
-	Name   string        `yaml:"name"`             // Field name
-	Type   string        `yaml:"type"`             // Field type as string
-	Elem   *SchemaField  `yaml:"elem,omitempty"`   // Element type for lists
-	Fields []SchemaField `yaml:"fields,omitempty"` // Nested fields for structs
+	Name     string        `yaml:"name"`               // Field name
+	Type     string        `yaml:"type"`               // Field type as string
+	Elem     *SchemaField  `yaml:"elem,omitempty"`     // Element type for lists
+	Fields   []SchemaField `yaml:"fields,omitempty"`   // Nested fields for structs
+	Packed   bool          `yaml:"packed,omitempty"`   // Lists of ints: encode elements as bare varints
+	Encoding string        `yaml:"encoding,omitempty"` // Lists of ints: plain, delta or delta-of-delta (other than plain implies packed)
+	Columnar bool          `yaml:"columnar,omitempty"` // Lists of structs: encode members column by column
+	Sparse   bool          `yaml:"sparse,omitempty"`   // Structs: members with their default value may be omitted
+	Chunk    int           `yaml:"chunk,omitempty"`    // Lists: elements per chunk of a chunked list
+	Dict     string        `yaml:"dict,omitempty"`     // Strings: none, message or shared
 }
 
 // ParsedField represents a field with resolved types and nested structure after parsing.
 type ParsedField struct {
-	Name   string        // Field name
-	Type   FieldType     // Field type
-	Elem   *ParsedField  // Element type for lists
-	Fields []ParsedField // Nested fields for structs
+	Name     string        // Field name
+	Type     FieldType     // Field type
+	Elem     *ParsedField  // Element type for lists
+	Fields   []ParsedField // Nested fields for structs
+	Packed   bool          // Lists of ints: encode elements as bare varints
+	Encoding int           // Packed lists: EncodingPlain, EncodingDelta or EncodingDeltaOfDelta
+	Columnar bool          // Lists of structs: encode members column by column
+	Sparse   bool          // Structs: members with their default value may be omitted
+	Chunk    int           // Lists: elements per chunk of a chunked list (0 = not chunked)
+	Dict     int           // Strings: dictionary mode (DictNone, DictMessage or DictShared)
+	Shared   *Dictionary   // Strings declared shared: the dictionary of the schema version (nil if not attached)
 }
 
 // Schema represents the root of a YAML schema file (single-version fallback).
 type Schema struct {
-	Fields []SchemaField `yaml:"fields"`
+	Dictionary []string      `yaml:"dictionary,omitempty"`
+	Fields     []SchemaField `yaml:"fields"`
 }
 
 // SchemaVersion represents a single version of a schema (for multi-version support).
 type SchemaVersion struct {
-	Version int           `yaml:"version"`
-	Fields  []SchemaField `yaml:"fields"`
+	Version    int           `yaml:"version"`
+	Dictionary []string      `yaml:"dictionary,omitempty"` // Shared string dictionary, ids in order
+	Fields     []SchemaField `yaml:"fields"`
 }
 
 // MultiVersionSchema allows multiple schema versions in one YAML file.
@@ -0,0 +1,361 @@
+// Byte-level writer and reader of the UTE wire format over Uint8Arrays
+
+const encoder = new TextEncoder();
+const decoder = new TextDecoder();
+
+const MAX_SAFE = Number.MAX_SAFE_INTEGER;
+
+// Number of bytes of the varint of n (a non-negative integer up to 2^53)
+export function varintLength(n: number): number {
+    let len = 1;
+    while (n >= 0x80) {
+        n = Math.floor(n / 128);
+        len++;
+    }
+    return len;
+}
+
+// Zigzag mapping of a safe integer, so that small magnitudes of either sign
+// stay short: 0, -1, 1, -2 become 0, 1, 2, 3 (may exceed 2^53 for large ones)
+export function zigzagNumber(v: number): number {
+    return v >= 0 ? v * 2 : -v * 2 - 1;
+}
+
+// Inverse of zigzagNumber for values up to 2^53
+export function unzigzagNumber(z: number): number {
+    return z % 2 === 0 ? z / 2 : -(z + 1) / 2;
+}
+
+// Zigzag mapping of the two's complement bits of a signed 64-bit value
+export function zigzag(v: bigint): bigint {
+    const s = BigInt.asIntN(64, v);
+    return BigInt.asUintN(64, (s << 1n) ^ (s >> 63n));
+}
+
+// Inverse of zigzag
+export function unzigzag(z: bigint): bigint {
+    return BigInt.asIntN(64, (z >> 1n) ^ -(z & 1n));
+}
+
+// A bigint as a number when that is exact, otherwise unchanged
+export function toSafeNumber(v: bigint): number | bigint {
+    return v >= -MAX_SAFE && v <= MAX_SAFE ? Number(v) : v;
+}
+
+// Appends encoded values to a growable buffer. Reuse one writer (reset it
+// between messages) so that its buffer is only allocated while it grows.
+export class UteWriter {
+    buf: Uint8Array;
+    view: DataView;
+    pos = 0;
+
+    constructor(capacity = 1024) {
+        this.buf = new Uint8Array(Math.max(capacity, 16));
+        this.view = new DataView(this.buf.buffer);
+    }
+
+    // Forget the bytes written so far, keeping the buffer
+    reset(): void {
+        this.pos = 0;
+    }
+
+    // Make room for n more bytes
+    ensure(n: number): void {
+        if (this.pos + n > this.buf.length) this.grow(n);
+    }
+
+    private grow(n: number): void {
+        let cap = this.buf.length * 2;
+        while (cap < this.pos + n) cap *= 2;
+        const buf = new Uint8Array(cap);
+        buf.set(this.buf.subarray(0, this.pos));
+        this.buf = buf;
+        this.view = new DataView(buf.buffer);
+    }
+
+    // The bytes written so far, as a copy
+    finish(): Uint8Array {
+        return this.buf.slice(0, this.pos);
+    }
+
+    // The bytes written so far, as a view that the next write may change
+    bytesView(): Uint8Array {
+        return this.buf.subarray(0, this.pos);
+    }
+
+    byte(b: number): void {
+        if (this.pos >= this.buf.length) this.grow(1);
+        this.buf[this.pos++] = b;
+    }
+
+    // Varint of an unsigned integer; numbers are exact up to 2^53, larger
+    // values and negative ones go through their 64-bit two's complement bits
+    varint(n: number): void {
+        if (n >= 0 && n < 0x80) {
+            this.byte(n);
+            return;
+        }
+        if (!(n >= 0 && n <= MAX_SAFE)) {
+            this.bigVarint(BigInt(n));
+            return;
+        }
+        this.ensure(8);
+        const buf = this.buf;
+        let i = this.pos;
+        while (n >= 0x80000000) {
+            buf[i++] = (n % 128) | 0x80;
+            n = Math.floor(n / 128);
+        }
+        while (n >= 0x80) {
+            buf[i++] = (n & 0x7f) | 0x80;
+            n >>>= 7;
+        }
+        buf[i++] = n;
+        this.pos = i;
+    }
+
+    // Varint of the low 64 bits of a bigint
+    bigVarint(v: bigint): void {
+        this.ensure(10);
+        v = BigInt.asUintN(64, v);
+        while (v >= 0x80n) {
+            this.buf[this.pos++] = Number(v & 0x7fn) | 0x80;
+            v >>= 7n;
+        }
+        this.buf[this.pos++] = Number(v);
+    }
+
+    // Varint of an int given as a number or a bigint
+    uint(v: number | bigint): void {
+        if (typeof v === 'bigint') this.bigVarint(v);
+        else this.varint(v);
+    }
+
+    // Zigzag varint of a sint given as a number or a bigint
+    sint(v: number | bigint): void {
+        if (typeof v === 'number' && Number.isSafeInteger(v)) {
+            const z = zigzagNumber(v);
+            if (z <= MAX_SAFE) {
+                this.varint(z);
+                return;
+            }
+        }
+        this.bigVarint(zigzag(BigInt(v)));
+    }
+
+    // Length-prefixed UTF-8 string, encoded in place with TextEncoder.encodeInto
+    string(s: string): void {
+        const n = s.length;
+        if (n < 43) {
+            // At most 127 bytes: the length takes one byte
+            this.ensure(1 + n * 3);
+            const buf = this.buf;
+            const start = this.pos + 1;
+            let j = 0;
+            for (; j < n; ++j) {
+                const c = s.charCodeAt(j);
+                if (c >= 0x80) break;
+                buf[start + j] = c;
+            }
+            const len = j === n ? n : encoder.encodeInto(s, buf.subarray(start)).written!;
+            buf[this.pos] = len;
+            this.pos = start + len;
+            return;
+        }
+        // Reserve the varint of the largest size, then close the gap
+        const reserved = varintLength(n * 3);
+        this.ensure(reserved + n * 3);
+        const start = this.pos + reserved;
+        const len = encoder.encodeInto(s, this.buf.subarray(start)).written!;
+        const used = varintLength(len);
+        if (used < reserved) this.buf.copyWithin(this.pos + used, start, start + len);
+        this.varint(len);
+        this.pos += len;
+    }
+
+    // Length-prefixed bytes
+    bytes(b: Uint8Array): void {
+        this.varint(b.length);
+        this.raw(b);
+    }
+
+    // Bytes as they are
+    raw(b: Uint8Array): void {
+        this.ensure(b.length);
+        this.buf.set(b, this.pos);
+        this.pos += b.length;
+    }
+
+    float32(v: number): void {
+        this.ensure(4);
+        this.view.setFloat32(this.pos, v, true);
+        this.pos += 4;
+    }
+
+    float64(v: number): void {
+        this.ensure(8);
+        this.view.setFloat64(this.pos, v, true);
+        this.pos += 8;
+    }
+
+    uint32(v: number): void {
+        this.ensure(4);
+        this.view.setUint32(this.pos, v, true);
+        this.pos += 4;
+    }
+
+    uint64(v: number | bigint): void {
+        this.ensure(8);
+        this.view.setBigUint64(this.pos, BigInt(v), true);
+        this.pos += 8;
+    }
+
+    // Start a value preceded by its varint size (see endSized)
+    beginSized(): number {
+        this.byte(0);
+        return this.pos;
+    }
+
+    // Write the size of the bytes since start in front of them
+    endSized(start: number): void {
+        const len = this.pos - start;
+        const extra = varintLength(len) - 1;
+        if (extra) {
+            this.ensure(extra);
+            this.buf.copyWithin(start + extra, start, this.pos);
+        }
+        this.pos = start - 1;
+        this.varint(len);
+        this.pos += len;
+    }
+}
+
+// Reads encoded values from a Uint8Array
+export class UteReader {
+    buf: Uint8Array;
+    pos: number;
+    private dataView: DataView | undefined;
+
+    constructor(buf: Uint8Array, pos = 0) {
+        this.buf = buf;
+        this.pos = pos;
+    }
+
+    get view(): DataView {
+        return (this.dataView ??= new DataView(this.buf.buffer, this.buf.byteOffset, this.buf.byteLength));
+    }
+
+    // Bytes left after pos
+    get remaining(): number {
+        return this.buf.length - this.pos;
+    }
+
+    byte(): number {
+        if (this.pos >= this.buf.length) throw new Error('Unexpected end of input');
+        return this.buf[this.pos++];
+    }
+
+    // Varint as a number, or as a bigint if it exceeds 2^53
+    uint(): number | bigint {
+        const buf = this.buf;
+        let i = this.pos;
+        if (i < buf.length && buf[i] < 0x80) {
+            this.pos = i + 1;
+            return buf[i];
+        }
+        // Up to 7 bytes (49 bits) are exact as numbers
+        let result = 0, scale = 1;
+        for (let k = 0; k < 7; ++k) {
+            if (i >= buf.length) throw new Error('Unexpected end of input');
+            const b = buf[i++];
+            result += (b & 0x7f) * scale;
+            if (b < 0x80) {
+                this.pos = i;
+                return result;
+            }
+            scale *= 128;
+        }
+        return toSafeNumber(this.bigUint());
+    }
+
+    // Varint that must be a length or count
+    length(): number {
+        const v = this.uint();
+        if (typeof v !== 'number') throw new Error('Length exceeds input');
+        return v;
+    }
+
+    // Varint as a bigint; fails if it does not fit in 64 bits
+    bigUint(): bigint {
+        const buf = this.buf;
+        let result = 0n, shift = 0n;
+        for (;;) {
+            if (this.pos >= buf.length) throw new Error('Unexpected end of input');
+            const b = buf[this.pos++];
+            // The tenth byte only holds bit 63
+            if (shift === 63n && b > 1) throw new Error('Varint overflows 64 bits');
+            result |= BigInt(b & 0x7f) << shift;
+            if (b < 0x80) return result;
+            shift += 7n;
+        }
+    }
+
+    // Zigzag varint as a number, or as a bigint if it exceeds 2^53
+    sint(): number | bigint {
+        const z = this.uint();
+        return typeof z === 'number' ? unzigzagNumber(z) : toSafeNumber(unzigzag(z));
+    }
+
+    // The next n bytes, as a view into the input
+    take(n: number): Uint8Array {
+        if (n > this.buf.length - this.pos) throw new Error('Value exceeds input');
+        const b = this.buf.subarray(this.pos, this.pos + n);
+        this.pos += n;
+        return b;
+    }
+
+    // UTF-8 string of n bytes, decoded with TextDecoder unless it is short ASCII
+    string(n: number): string {
+        if (n > this.buf.length - this.pos) throw new Error('String exceeds input');
+        const buf = this.buf;
+        const start = this.pos;
+        this.pos += n;
+        if (n < 32) {
+            let s = '';
+            for (let i = start; i < start + n; ++i) {
+                if (buf[i] >= 0x80) return decoder.decode(buf.subarray(start, start + n));
+                s += String.fromCharCode(buf[i]);
+            }
+            return s;
+        }
+        return decoder.decode(buf.subarray(start, start + n));
+    }
+
+    float32(): number {
+        if (this.pos + 4 > this.buf.length) throw new Error('Value exceeds input');
+        const v = this.view.getFloat32(this.pos, true);
+        this.pos += 4;
+        return v;
+    }
+
+    float64(): number {
+        if (this.pos + 8 > this.buf.length) throw new Error('Value exceeds input');
+        const v = this.view.getFloat64(this.pos, true);
+        this.pos += 8;
+        return v;
+    }
+
+    uint32(): number {
+        if (this.pos + 4 > this.buf.length) throw new Error('Value exceeds input');
+        const v = this.view.getUint32(this.pos, true);
+        this.pos += 4;
+        return v;
+    }
+
+    uint64(): bigint {
+        if (this.pos + 8 > this.buf.length) throw new Error('Value exceeds input');
+        const v = this.view.getBigUint64(this.pos, true);
+        this.pos += 8;
+        return v;
+    }
+}
@@ -1,5 +1,6 @@
 // UTE serialization/deserialization core logic for TypeScript
 import { UteSchemaField, UteData } from './types';
+import { UteReader, UteWriter, toSafeNumber, unzigzag, unzigzagNumber, varintLength, zigzag, zigzagNumber } from './buffer';
 
 // Type prefix constants (same as Go/C)
 const T_NULL = 0b000 << 5;
@@ -8,123 +9,788 @@ const T_INT = 0b010 << 5;
 const T_BYTES = 0b011 << 5;
 const T_LIST = 0b100 << 5;
 const T_STRUCT = 0b101 << 5;
+const T_FIXED = 0b110 << 5;
 
-// Encode a varint (unsigned)
-function encodeVarint(n: number): Uint8Array {
-    const out: number[] = [];
-    let v = n >>> 0;
-    while (v >= 0x80) {
-        out.push((v | 0x80) & 0xff);
-        v >>>= 7;
+// Flag bits in the low bits of a type prefix
+const LIST_PACKED = 0x01; // list of ints encoded as bare varints
+const LIST_COLUMNAR = 0x02; // list of structs encoded as one column per member
+const LIST_FIXED32 = 0x04; // list of 4-byte values encoded as one little-endian array
+const LIST_FIXED64 = 0x08; // list of 8-byte values encoded as one little-endian array
+const LIST_CHUNKED = 0x10; // list encoded in chunks behind a table of chunk sizes
+const FIXED_32 = 0x04; // fixed-width value of 4 little-endian bytes
+const FIXED_64 = 0x08; // fixed-width value of 8 little-endian bytes
+const STRUCT_SPARSE = 0x01; // struct with only the present members, each preceded by its index
+const STRUCT_BITMAP = 0x02; // struct with a presence bitmap, followed by the present members
+const STRING_REF = 0x01; // string whose varint is the distance back to an earlier plain string
+const STRING_DICT = 0x02; // string whose varint is an id into the shared dictionary
+
+const MAX_SAFE = Number.MAX_SAFE_INTEGER;
+
+const textEncoder = new TextEncoder();
+
+// Appends one value, with its type prefix
+type Encoder = (w: UteWriter, v: any) => void;
+// Reads one value, with its type prefix; string back-references may only
+// point at the strings recorded in refs
+type Decoder = (r: UteReader, refs: RefTargets) => any;
+
+// Offsets of the plain strings of dict fields decoded in one scope (the
+// message, or a chunk of a chunked list), in ascending order: a
+// back-reference may only point at one of the latest REF_WINDOW of them
+// (see RFC section 4.1)
+type RefTargets = number[];
+const REF_WINDOW = 256;
+
+// Codec compiled for one schema (see compileCodec)
+export interface UteCodec {
+    // Encode into a new Uint8Array
+    encode(data: UteData): Uint8Array;
+    // Append the encoding to a writer
+    encodeInto(data: UteData, w: UteWriter): void;
+    // Decode a message at offset (returns [data, bytesRead])
+    decode(buf: Uint8Array, offset?: number): [UteData, number];
+}
+
+// Ids of the values of every shared dictionary, built on first use
+const dictionaryIds = new WeakMap<string[], Map<string, number>>();
+
+// Id of a string in the dictionary of a shared field, or undefined
+function dictionaryId(field: UteSchemaField, v: string): number | undefined {
+    if (!field.dictionary) return undefined;
+    let ids = dictionaryIds.get(field.dictionary);
+    if (!ids) {
+        ids = new Map(field.dictionary.map((s, id) => [s, id]));
+        dictionaryIds.set(field.dictionary, ids);
     }
-    out.push(v);
-    return Uint8Array.from(out);
+    return ids.get(v);
 }
 
-// Decode a varint (returns [value, bytesRead])
-function decodeVarint(buf: Uint8Array, offset: number): [number, number] {
-    let result = 0, shift = 0, i = offset;
-    while (i < buf.length) {
-        const b = buf[i++];
-        result |= (b & 0x7f) << shift;
-        if (!(b & 0x80)) break;
-        shift += 7;
+// True if target is one of the latest REF_WINDOW offsets of refs
+function isRefTarget(refs: RefTargets, target: number): boolean {
+    let lo = Math.max(0, refs.length - REF_WINDOW);
+    let hi = refs.length;
+    while (lo < hi) {
+        const mid = (lo + hi) >>> 1;
+        if (refs[mid] === target) return true;
+        if (refs[mid] < target) lo = mid + 1;
+        else hi = mid;
     }
-    return [result, i - offset];
+    return false;
 }
 
-// Serialize a value according to schema
-export function serialize(data: any, schema: UteSchemaField[]): Uint8Array {
-    const out: number[] = [];
-    for (const field of schema) {
-        const v = data[field.name];
-        switch (field.type) {
-            case 'int':
-                out.push(T_INT);
-                out.push(...encodeVarint(v));
-                break;
-            case 'string':
-                out.push(T_BYTES);
-                const strBytes = Buffer.from(v, 'utf8');
-                out.push(...encodeVarint(strBytes.length));
-                out.push(...strBytes);
+// Resolve a string written with flags, whose prefix is at buf[at] and whose
+// varint is n. A back-reference must point at a plain string recorded in refs
+// that ends before the prefix.
+function dictString(buf: Uint8Array, field: UteSchemaField, flags: number, at: number, n: number, refs: RefTargets): string {
+    if (flags === STRING_DICT && field.dict === 'shared') {
+        if (!field.dictionary || n >= field.dictionary.length) throw new Error('Dictionary id out of range');
+        return field.dictionary[n];
+    }
+    if (flags !== STRING_REF || !field.dict) throw new Error('String flags do not match schema');
+    if (n < 1 || n > at || !isRefTarget(refs, at - n)) throw new Error('String reference does not point at a recent dict string of its scope');
+    const target = at - n;
+    if (buf[target] !== T_BYTES) throw new Error('String reference does not point at a plain string');
+    const r = new UteReader(buf.subarray(0, at), target + 1);
+    const len = r.length();
+    if (len > r.remaining) throw new Error('String reference overlaps its target');
+    return r.string(len);
+}
+
+// Encoded size of a fixed-width type, or 0 for other types
+function fixedWidth(type: string): number {
+    switch (type) {
+        case 'float32':
+        case 'fixed32':
+            return 4;
+        case 'float64':
+        case 'fixed64':
+            return 8;
+    }
+    return 0;
+}
+
+// Writer of a fixed-width value in little-endian byte order (fixed64 as a bigint or number)
+function fixedWriter(type: string): (w: UteWriter, v: any) => void {
+    switch (type) {
+        case 'float32':
+            return (w, v) => w.float32(v);
+        case 'float64':
+            return (w, v) => w.float64(v);
+        case 'fixed32':
+            return (w, v) => w.uint32(v);
+        default:
+            return (w, v) => w.uint64(v);
+    }
+}
+
+// Reader of a fixed-width value (fixed64 as a bigint)
+function fixedReader(type: string): (r: UteReader) => any {
+    switch (type) {
+        case 'float32':
+            return (r) => r.float32();
+        case 'float64':
+            return (r) => r.float64();
+        case 'fixed32':
+            return (r) => r.uint32();
+        default:
+            return (r) => r.uint64();
+    }
+}
+
+// Typed array constructors of the fixed-width types
+const FIXED_ARRAYS: { [type: string]: any } = {
+    float32: Float32Array,
+    float64: Float64Array,
+    fixed32: Uint32Array,
+    fixed64: BigUint64Array,
+};
+
+const LITTLE_ENDIAN = new Uint8Array(new Uint16Array([1]).buffer)[0] === 1;
+
+// Encode the values of a list of fixed-width elements as one little-endian
+// array: typed arrays of the element type are copied as they are on
+// little-endian hosts
+function encodeFixedArray(w: UteWriter, items: ArrayLike<any>, type: string, put: (w: UteWriter, v: any) => void) {
+    if (LITTLE_ENDIAN && items instanceof FIXED_ARRAYS[type]) {
+        const arr = items as unknown as ArrayBufferView;
+        w.raw(new Uint8Array(arr.buffer, arr.byteOffset, arr.byteLength));
+        return;
+    }
+    w.ensure(items.length * fixedWidth(type));
+    for (let j = 0; j < items.length; ++j) put(w, items[j]);
+}
+
+// Decode the raw array of a fixed list into a typed array: one copy into an
+// aligned buffer, read in place on little-endian hosts
+function decodeFixedArray(r: UteReader, count: number, type: string, get: (r: UteReader) => any): any {
+    const width = fixedWidth(type);
+    if (count > r.remaining / width) throw new Error('List exceeds input');
+    const bytes = r.take(count * width).slice();
+    const Arr = FIXED_ARRAYS[type];
+    if (LITTLE_ENDIAN) return new Arr(bytes.buffer, 0, count);
+    const out = new Arr(count);
+    const br = new UteReader(bytes);
+    for (let j = 0; j < count; ++j) out[j] = get(br);
+    return out;
+}
+
+// Encode the elements of a packed list as bare varints, transformed by its
+// encoding; differences are taken modulo 2^64 on the bits of the elements.
+// Safe integers are handled as numbers; the first element that is not (or
+// whose difference is not) switches the rest of the list to bigints.
+function encodeInts(w: UteWriter, items: ArrayLike<any>, sint: boolean, encoding: string | undefined) {
+    let prev = 0, delta = 0, j = 0;
+    for (; j < items.length; ++j) {
+        const v = items[j];
+        if (typeof v !== 'number' || !Number.isSafeInteger(v) || (!sint && v < 0)) break;
+        let z: number;
+        if (encoding === 'delta' || encoding === 'delta-of-delta') {
+            const d = v - prev;
+            const x = encoding === 'delta' ? d : d - delta;
+            if (!Number.isSafeInteger(d) || !Number.isSafeInteger(x)) break;
+            z = zigzagNumber(x);
+            if (z > MAX_SAFE) break;
+            prev = v;
+            delta = d;
+        } else {
+            z = sint ? zigzagNumber(v) : v;
+            if (z > MAX_SAFE) break;
+        }
+        w.varint(z);
+    }
+    let bprev = BigInt(prev), bdelta = BigInt(delta);
+    for (; j < items.length; ++j) {
+        let v = BigInt.asUintN(64, BigInt(items[j]));
+        if (encoding === 'delta') {
+            [v, bprev] = [zigzag(v - bprev), v];
+        } else if (encoding === 'delta-of-delta') {
+            const d = BigInt.asUintN(64, v - bprev);
+            [v, bprev, bdelta] = [zigzag(d - bdelta), v, d];
+        } else if (sint) {
+            v = zigzag(v);
+        }
+        w.bigVarint(v);
+    }
+}
+
+// Decode the count elements of a packed list, as numbers where they are
+// exact and as bigints otherwise (see encodeInts)
+function decodeInts(r: UteReader, count: number, sint: boolean, encoding: string | undefined): (number | bigint)[] {
+    const items: (number | bigint)[] = new Array(count);
+    let prev = 0, delta = 0, j = 0;
+    for (; j < count; ++j) {
+        const start = r.pos;
+        const z = r.uint();
+        if (typeof z !== 'number') {
+            r.pos = start;
+            break;
+        }
+        if (encoding === 'delta' || encoding === 'delta-of-delta') {
+            const x = unzigzagNumber(z);
+            const d = encoding === 'delta' ? x : delta + x;
+            const v = prev + d;
+            if (!Number.isSafeInteger(d) || !Number.isSafeInteger(v) || (!sint && v < 0)) {
+                r.pos = start;
                 break;
-            case 'list':
-                out.push(T_LIST);
-                out.push(...encodeVarint(v.length));
-                for (const item of v) {
-                    if (field.elem!.type === 'struct') {
-                        out.push(...serialize(item, field.elem!.fields!));
-                    } else {
-                        out.push(...serialize({ '': item }, [field.elem!]));
+            }
+            items[j] = prev = v;
+            delta = d;
+        } else {
+            items[j] = sint ? unzigzagNumber(z) : z;
+        }
+    }
+    let bprev = BigInt(prev), bdelta = BigInt(delta);
+    for (; j < count; ++j) {
+        let v = r.bigUint();
+        if (encoding === 'delta') {
+            v = bprev = BigInt.asUintN(64, bprev + unzigzag(v));
+        } else if (encoding === 'delta-of-delta') {
+            bdelta = BigInt.asUintN(64, bdelta + unzigzag(v));
+            v = bprev = BigInt.asUintN(64, bprev + bdelta);
+        } else if (sint) {
+            v = unzigzag(v);
+        }
+        items[j] = toSafeNumber(sint ? BigInt.asIntN(64, v) : v);
+    }
+    return items;
+}
+
+// Prefix check of a decoder: fails with the message of a wrong type or,
+// when only the flags differ, with the message about the flags
+function checkPrefix(h: number, expected: number, typeError: string, flagsError: string) {
+    if (h !== expected) throw new Error(h >> 5 === expected >> 5 ? flagsError : typeError);
+}
+
+// -------------------------
+// Compiling a schema
+// -------------------------
+
+// Compile the encoder and decoder of the value of a field
+function compileField(field: UteSchemaField): [Encoder, Decoder] {
+    switch (field.type) {
+        case 'null':
+            return [
+                (w) => w.byte(T_NULL),
+                (r) => {
+                    if (r.byte() >> 5 !== 0) throw new Error('Expected null');
+                    return null;
+                },
+            ];
+        case 'bool':
+            return [
+                (w, v) => w.byte(v ? T_BOOL | 0x10 : T_BOOL),
+                (r) => {
+                    const h = r.byte();
+                    if (h >> 5 !== 1) throw new Error('Expected bool');
+                    return (h & 0x10) !== 0;
+                },
+            ];
+        case 'int':
+            return [
+                (w, v) => {
+                    w.byte(T_INT);
+                    w.uint(v);
+                },
+                (r) => {
+                    if (r.byte() >> 5 !== 2) throw new Error('Expected int');
+                    return r.uint();
+                },
+            ];
+        case 'sint':
+            return [
+                (w, v) => {
+                    w.byte(T_INT);
+                    w.sint(v);
+                },
+                (r) => {
+                    if (r.byte() >> 5 !== 2) throw new Error('Expected int');
+                    return r.sint();
+                },
+            ];
+        case 'string':
+            return [
+                field.dict === 'shared'
+                    ? (w, v) => {
+                        const id = dictionaryId(field, v);
+                        if (id === undefined) {
+                            w.byte(T_BYTES);
+                            w.string(v);
+                        } else {
+                            w.byte(T_BYTES | STRING_DICT);
+                            w.varint(id);
+                        }
                     }
-                }
-                break;
-            case 'struct':
-                out.push(T_STRUCT);
-                out.push(...encodeVarint(field.fields!.length));
-                out.push(...serialize(v, field.fields!));
-                break;
-            default:
-                throw new Error('Unsupported type: ' + field.type);
+                    : (w, v) => {
+                        w.byte(T_BYTES);
+                        w.string(v);
+                    },
+                (r, refs) => {
+                    const at = r.pos;
+                    const h = r.byte();
+                    if (h >> 5 !== 3) throw new Error('Expected string');
+                    const len = r.length();
+                    if (h & 0x1f) return dictString(r.buf, field, h & 0x1f, at, len, refs);
+                    if (field.dict) refs.push(at);
+                    return r.string(len);
+                },
+            ];
+        case 'float32':
+        case 'float64':
+        case 'fixed32':
+        case 'fixed64': {
+            const prefix = T_FIXED | (fixedWidth(field.type) === 8 ? FIXED_64 : FIXED_32);
+            const put = fixedWriter(field.type);
+            const get = fixedReader(field.type);
+            return [
+                (w, v) => {
+                    w.byte(prefix);
+                    put(w, v);
+                },
+                (r) => {
+                    if (r.byte() !== prefix) throw new Error('Expected fixed-width value');
+                    return get(r);
+                },
+            ];
         }
+        case 'bytes':
+            return [
+                (w, v) => {
+                    w.byte(T_FIXED);
+                    w.bytes(v);
+                },
+                (r) => {
+                    if (r.byte() !== T_FIXED) throw new Error('Expected bytes');
+                    const len = r.length();
+                    if (len > r.remaining) throw new Error('Bytes exceed input');
+                    return r.take(len).slice();
+                },
+            ];
+        case 'list':
+            return compileList(field);
+        case 'struct':
+            return field.sparse ? compileSparse(field.fields!) : compileDense(field.fields!);
     }
-    return Uint8Array.from(out);
+    throw new Error('Unsupported type: ' + field.type);
 }
 
-// Deserialize a value according to schema
-export function deserialize(buf: Uint8Array, schema: UteSchemaField[], offset = 0): [any, number] {
-    const out: any = {};
-    let i = offset;
-    for (const field of schema) {
-        const h = buf[i++];
-        switch (field.type) {
-            case 'int': {
-                if ((h >> 5) !== 2) throw new Error('Expected int');
-                const [v, n] = decodeVarint(buf, i);
-                out[field.name] = v;
-                i += n;
-                break;
+// Compile the members of a struct, written one after the other without a header
+function compileMembers(fields: UteSchemaField[]): [(w: UteWriter, obj: any) => void, (r: UteReader, refs: RefTargets) => any] {
+    const names = fields.map((f) => f.name);
+    const compiled = fields.map(compileField);
+    const encs = compiled.map((c) => c[0]);
+    const decs = compiled.map((c) => c[1]);
+    const n = fields.length;
+    return [
+        (w, obj) => {
+            for (let k = 0; k < n; ++k) encs[k](w, obj[names[k]]);
+        },
+        (r, refs) => {
+            const obj: any = {};
+            for (let k = 0; k < n; ++k) obj[names[k]] = decs[k](r, refs);
+            return obj;
+        },
+    ];
+}
+
+// Compile a struct written with all its members
+function compileDense(fields: UteSchemaField[]): [Encoder, Decoder] {
+    const [encMembers, decMembers] = compileMembers(fields);
+    const n = fields.length;
+    return [
+        (w, v) => {
+            w.byte(T_STRUCT);
+            w.varint(n);
+            encMembers(w, v);
+        },
+        (r, refs) => {
+            checkPrefix(r.byte(), T_STRUCT, 'Expected struct', 'Struct flags do not match schema');
+            r.length();
+            return decMembers(r, refs);
+        },
+    ];
+}
+
+// Compile a list in the form its schema selects
+function compileList(field: UteSchemaField): [Encoder, Decoder] {
+    const elem = field.elem!;
+    const width = fixedWidth(elem.type);
+    if (width) {
+        // Fixed-width elements (an array or typed array) form one little-endian array
+        const prefix = T_LIST | (width === 8 ? LIST_FIXED64 : LIST_FIXED32);
+        const put = fixedWriter(elem.type);
+        const get = fixedReader(elem.type);
+        return [
+            (w, v) => {
+                w.byte(prefix);
+                w.varint(v.length);
+                encodeFixedArray(w, v, elem.type, put);
+            },
+            (r) => {
+                checkPrefix(r.byte(), prefix, 'Expected list', 'List flags do not match schema');
+                return decodeFixedArray(r, r.length(), elem.type, get);
+            },
+        ];
+    }
+    if (field.chunk) return compileChunked(field.chunk, elem);
+    if (field.columnar) return compileColumnar(elem.fields!);
+    if (field.packed) {
+        const sint = elem.type === 'sint';
+        return [
+            (w, v) => {
+                w.byte(T_LIST | LIST_PACKED);
+                w.varint(v.length);
+                encodeInts(w, v, sint, field.encoding);
+            },
+            (r) => {
+                checkPrefix(r.byte(), T_LIST | LIST_PACKED, 'Expected list', 'List flags do not match schema');
+                const count = r.length();
+                if (count > r.remaining) throw new Error('List count exceeds input');
+                return decodeInts(r, count, sint, field.encoding);
+            },
+        ];
+    }
+    const [encElem, decElem] = compileField(elem);
+    return [
+        (w, v) => {
+            w.byte(T_LIST);
+            w.varint(v.length);
+            for (let j = 0; j < v.length; ++j) encElem(w, v[j]);
+        },
+        (r, refs) => {
+            checkPrefix(r.byte(), T_LIST, 'Expected list', 'List flags do not match schema');
+            const count = r.length();
+            // Every element takes at least one byte
+            if (count > r.remaining) throw new Error('List count exceeds input');
+            const items = new Array(count);
+            for (let j = 0; j < count; ++j) items[j] = decElem(r, refs);
+            return items;
+        },
+    ];
+}
+
+// Compile a chunked list: the number of elements per chunk, a table with the
+// size of every chunk (u32 little-endian), then the chunks, each holding that
+// many elements encoded as in a plain list. Every chunk must end exactly
+// where its size in the table says.
+function compileChunked(per: number, elem: UteSchemaField): [Encoder, Decoder] {
+    const [encElem, decElem] = compileField(elem);
+    return [
+        (w, v) => {
+            w.byte(T_LIST | LIST_CHUNKED);
+            w.varint(v.length);
+            w.varint(per);
+            const nchunks = Math.ceil(v.length / per);
+            w.ensure(nchunks * 4);
+            let table = w.pos;
+            w.pos += nchunks * 4;
+            for (let first = 0; first < v.length; first += per) {
+                const start = w.pos;
+                for (let j = first; j < v.length && j < first + per; ++j) encElem(w, v[j]);
+                w.view.setUint32(table, w.pos - start, true);
+                table += 4;
             }
-            case 'string': {
-                if ((h >> 5) !== 3) throw new Error('Expected string');
-                const [len, n] = decodeVarint(buf, i);
-                i += n;
-                out[field.name] = Buffer.from(buf.slice(i, i + len)).toString('utf8');
-                i += len;
-                break;
+        },
+        (r) => {
+            checkPrefix(r.byte(), T_LIST | LIST_CHUNKED, 'Expected list', 'List flags do not match schema');
+            const count = r.length();
+            if (count > r.remaining) throw new Error('List count exceeds input');
+            const chunk = r.length();
+            if (chunk === 0) throw new Error('Chunk size is zero');
+            const nchunks = Math.ceil(count / chunk);
+            if (nchunks * 4 > r.remaining) throw new Error('Chunk table exceeds input');
+            const table = r.pos;
+            r.pos += nchunks * 4;
+            const items = new Array(count);
+            for (let c = 0; c < nchunks; ++c) {
+                const end = r.pos + r.view.getUint32(table + c * 4, true);
+                if (end > r.buf.length) throw new Error('Chunk exceeds input');
+                // Chunks are independent: references stay inside their chunk
+                const refs: RefTargets = [];
+                for (let j = c * chunk; j < count && j < (c + 1) * chunk; ++j) items[j] = decElem(r, refs);
+                if (r.pos !== end) throw new Error('Chunk size does not match its elements');
             }
-            case 'list': {
-                if ((h >> 5) !== 4) throw new Error('Expected list');
-                const [count, n] = decodeVarint(buf, i);
-                i += n;
-                const arr = [];
-                for (let j = 0; j < count; ++j) {
-                    if (field.elem!.type === 'struct') {
-                        const [item, used] = deserialize(buf, field.elem!.fields!, i);
-                        arr.push(item);
-                        i += used;
-                    } else {
-                        const [item, used] = deserialize(buf, [field.elem!], i);
-                        arr.push(item['']);
-                        i += used;
+            return items;
+        },
+    ];
+}
+
+// Compile a columnar list: the field count, then for each struct field the
+// size of its column and the column itself (bools as a bitmap, ints as
+// varints, strings as all lengths followed by all bytes)
+function compileColumnar(fields: UteSchemaField[]): [Encoder, Decoder] {
+    return [
+        (w, items) => {
+            w.byte(T_LIST | LIST_COLUMNAR);
+            w.varint(items.length);
+            w.varint(fields.length);
+            for (const field of fields) {
+                const name = field.name;
+                const start = w.beginSized();
+                switch (field.type) {
+                    case 'bool':
+                        for (let i = 0; i < items.length; i += 8) {
+                            let bits = 0;
+                            for (let j = 0; j < 8 && i + j < items.length; ++j) {
+                                if (items[i + j][name]) bits |= 1 << j;
+                            }
+                            w.byte(bits);
+                        }
+                        break;
+                    case 'int':
+                        for (const item of items) w.uint(item[name]);
+                        break;
+                    case 'string': {
+                        const strs = items.map((item: any) => textEncoder.encode(item[name]));
+                        for (const s of strs) w.varint(s.length);
+                        for (const s of strs) w.raw(s);
+                        break;
                     }
                 }
-                out[field.name] = arr;
-                break;
+                w.endSized(start);
             }
-            case 'struct': {
-                if ((h >> 5) !== 5) throw new Error('Expected struct');
-                const [nfields, n] = decodeVarint(buf, i);
-                i += n;
-                const [obj, used] = deserialize(buf, field.fields!, i);
-                out[field.name] = obj;
-                i += used;
-                break;
+        },
+        (r) => {
+            checkPrefix(r.byte(), T_LIST | LIST_COLUMNAR, 'Expected list', 'List flags do not match schema');
+            const count = r.length();
+            // Every element takes at least one bit
+            if (count / 8 > r.remaining) throw new Error('List count exceeds input');
+            const items: any[] = new Array(count);
+            for (let j = 0; j < count; ++j) items[j] = {};
+            if (r.length() !== fields.length) throw new Error('Columnar field count does not match schema');
+            for (const field of fields) {
+                const name = field.name;
+                const size = r.length();
+                const end = r.pos + size;
+                if (size > r.remaining) throw new Error('Column exceeds input');
+                switch (field.type) {
+                    case 'null':
+                        for (const item of items) item[name] = null;
+                        break;
+                    case 'bool': {
+                        const i = r.pos;
+                        if (size !== Math.ceil(count / 8) || (count % 8 && r.buf[end - 1] >> (count % 8))) throw new Error('Bool column does not match count');
+                        for (let j = 0; j < count; ++j) items[j][name] = (r.buf[i + (j >> 3)] & (1 << (j & 7))) !== 0;
+                        r.pos = end;
+                        break;
+                    }
+                    case 'int':
+                        for (const item of items) item[name] = r.uint();
+                        break;
+                    case 'string': {
+                        const lens: number[] = new Array(count);
+                        for (let j = 0; j < count; ++j) lens[j] = r.length();
+                        for (let j = 0; j < count; ++j) items[j][name] = r.string(lens[j]);
+                        break;
+                    }
+                }
+                if (r.pos !== end) throw new Error('Column size does not match its values');
             }
-            default:
-                throw new Error('Unsupported type: ' + field.type);
+            return items;
+        },
+    ];
+}
+
+// Presence of a member of a sparse struct when serializing
+const MEMBER_PRESENT = 0;
+const MEMBER_DEFAULT = 1; // has its default value and may be omitted
+const MEMBER_MISSING = 2; // has no value and must be omitted
+
+// Classify the value of a sparse struct member (structs are present unless missing)
+function presence(field: UteSchemaField, v: any): number {
+    if (field.type === 'null') return MEMBER_DEFAULT;
+    if (v === undefined || v === null) return MEMBER_MISSING;
+    switch (field.type) {
+        case 'bool':
+        case 'int':
+        case 'sint':
+        case 'string':
+            return v ? MEMBER_PRESENT : MEMBER_DEFAULT;
+        case 'list':
+        case 'bytes':
+            return v.length ? MEMBER_PRESENT : MEMBER_DEFAULT;
+        case 'float32':
+        case 'float64':
+        case 'fixed32':
+        case 'fixed64':
+            // All bits zero: a float -0.0 is present
+            return v != 0 || Object.is(v, -0) ? MEMBER_PRESENT : MEMBER_DEFAULT;
+    }
+    return MEMBER_PRESENT;
+}
+
+// Size of the dense encoding of a member with its default value
+function defaultSize(field: UteSchemaField): number {
+    if (field.type === 'null' || field.type === 'bool') return 1;
+    if (fixedWidth(field.type)) return 1 + fixedWidth(field.type);
+    if (field.chunk) {
+        // An empty chunked list still has its chunk size, and no chunks
+        return 2 + varintLength(field.chunk);
+    }
+    if (field.columnar) {
+        // An empty columnar list still lists its columns, all of size 0
+        const n = field.elem!.fields!.length;
+        return 2 + varintLength(n) + n;
+    }
+    return 2;
+}
+
+// Value of an absent member: null, false, 0, '', an empty list, no bytes, or a struct of defaults
+function defaultValue(field: UteSchemaField): any {
+    switch (field.type) {
+        case 'bool':
+            return false;
+        case 'int':
+        case 'sint':
+            return 0;
+        case 'string':
+            return '';
+        case 'float32':
+        case 'float64':
+        case 'fixed32':
+            return 0;
+        case 'fixed64':
+            return BigInt(0);
+        case 'bytes':
+            return new Uint8Array(0);
+        case 'list':
+            return [];
+        case 'struct': {
+            const obj: any = {};
+            for (const f of field.fields!) obj[f.name] = defaultValue(f);
+            return obj;
         }
     }
-    return [out, i - offset];
+    return null;
+}
+
+// Compile a struct declared sparse. It is written in the smallest of three
+// forms: dense, the present members preceded by their index (STRUCT_SPARSE),
+// or a presence bitmap followed by the present members (STRUCT_BITMAP). Ties
+// prefer them in this order. Present values cost the same in every form, so
+// only the counts, the indices or the bitmap and the defaults the dense form
+// writes for absent members are compared. All forms are read.
+function compileSparse(fields: UteSchemaField[]): [Encoder, Decoder] {
+    const n = fields.length;
+    const compiled = fields.map(compileField);
+    const sizes = fields.map(defaultSize);
+    const bitmap = varintLength(n) + Math.ceil(n / 8);
+    return [
+        (w, v) => {
+            const present = new Array<boolean>(n);
+            let count = 0, indices = 0, defaults = 0, missing = false;
+            for (let i = 0; i < n; ++i) {
+                const p = presence(fields[i], v[fields[i].name]);
+                present[i] = p === MEMBER_PRESENT;
+                if (p === MEMBER_PRESENT) {
+                    count++;
+                    indices += varintLength(i);
+                } else {
+                    missing ||= p === MEMBER_MISSING;
+                    defaults += sizes[i];
+                }
+            }
+            const sparse = varintLength(count) + indices;
+            const dense = varintLength(n) + defaults;
+            if (!missing && dense <= sparse && dense <= bitmap) {
+                w.byte(T_STRUCT);
+                w.varint(n);
+                for (let i = 0; i < n; ++i) compiled[i][0](w, v[fields[i].name]);
+                return;
+            }
+            if (bitmap <= sparse) {
+                w.byte(T_STRUCT | STRUCT_BITMAP);
+                w.varint(n);
+                for (let i = 0; i < n; i += 8) {
+                    let bits = 0;
+                    for (let j = 0; j < 8 && i + j < n; ++j) if (present[i + j]) bits |= 1 << j;
+                    w.byte(bits);
+                }
+            } else {
+                w.byte(T_STRUCT | STRUCT_SPARSE);
+                w.varint(count);
+            }
+            for (let i = 0; i < n; ++i) {
+                if (!present[i]) continue;
+                if (bitmap > sparse) w.varint(i);
+                compiled[i][0](w, v[fields[i].name]);
+            }
+        },
+        (r, refs) => {
+            const h = r.byte();
+            if (h >> 5 !== 5) throw new Error('Expected struct');
+            const form = h & 0x1f;
+            if (form !== 0 && form !== STRUCT_SPARSE && form !== STRUCT_BITMAP) throw new Error('Struct flags do not match schema');
+            const count = r.length();
+            if (form === STRUCT_SPARSE ? count > n : count !== n) throw new Error('Struct field count does not match schema');
+            const present = new Array<boolean>(n).fill(form !== STRUCT_SPARSE);
+            if (form === STRUCT_BITMAP) {
+                const bits = r.take(Math.ceil(n / 8));
+                if (n % 8 && bits[bits.length - 1] >> (n % 8)) throw new Error('Struct bitmap has bits past the last member');
+                for (let j = 0; j < n; ++j) present[j] = (bits[j >> 3] & (1 << (j & 7))) !== 0;
+            }
+            const out: any = {};
+            if (form === STRUCT_SPARSE) {
+                let next = 0;
+                for (let k = 0; k < count; ++k) {
+                    const index = r.length();
+                    if (index < next || index >= n) throw new Error('Struct member indices must ascend within the schema');
+                    out[fields[index].name] = compiled[index][1](r, refs);
+                    present[index] = true;
+                    next = index + 1;
+                }
+            } else {
+                for (let j = 0; j < n; ++j) if (present[j]) out[fields[j].name] = compiled[j][1](r, refs);
+            }
+            for (let j = 0; j < n; ++j) if (!present[j]) out[fields[j].name] = defaultValue(fields[j]);
+            return out;
+        },
+    ];
+}
+
+// Compile the encoder and decoder of a schema once, for messages that are
+// encoded or decoded many times: every field gets its own function, so the
+// schema is not walked again per message. Ints and sints decode to numbers,
+// or to bigints when they exceed Number.MAX_SAFE_INTEGER, and are encoded
+// from either (bigints with full 64-bit precision).
+export function compileCodec(schema: UteSchemaField[]): UteCodec {
+    const [encMembers, decMembers] = compileMembers(schema);
+    const scratch = new UteWriter();
+    return {
+        encode(data: UteData): Uint8Array {
+            scratch.reset();
+            encMembers(scratch, data);
+            return scratch.finish();
+        },
+        encodeInto(data: UteData, w: UteWriter): void {
+            encMembers(w, data);
+        },
+        decode(buf: Uint8Array, offset = 0): [UteData, number] {
+            const r = new UteReader(buf, offset);
+            const out = decMembers(r, []);
+            return [out, r.pos - offset];
+        },
+    };
+}
+
+// Codecs of the schemas passed to serialize and deserialize
+const codecs = new WeakMap<UteSchemaField[], UteCodec>();
+
+// Compiled codec of a schema, cached while the schema array lives
+function codecOf(schema: UteSchemaField[]): UteCodec {
+    let codec = codecs.get(schema);
+    if (!codec) {
+        codec = compileCodec(schema);
+        codecs.set(schema, codec);
+    }
+    return codec;
+}
+
+// Serialize a value according to schema (compiled on first use, see compileCodec)
+export function serialize(data: any, schema: UteSchemaField[]): Uint8Array {
+    return codecOf(schema).encode(data);
+}
+
+// Deserialize a value according to schema (compiled on first use, see compileCodec)
+export function deserialize(buf: Uint8Array, schema: UteSchemaField[], offset = 0): [any, number] {
+    return codecOf(schema).decode(buf, offset);
 }
@@ -1,4 +1,5 @@
 // UTE TypeScript/JavaScript public API entry point
 export * from './types';
 export * from './schema';
+export * from './buffer';
 export * from './codex';
@@ -14,6 +14,47 @@ export function parseSchemaField(sf: any): UteSchemaField {
     if (sf.type === 'list' && sf.elem) {
         out.elem = parseSchemaField(sf.elem);
     }
+    if (sf.encoding && sf.encoding !== 'plain') {
+        if (sf.encoding !== 'delta' && sf.encoding !== 'delta-of-delta') {
+            throw new Error('encoding must be plain, delta or delta-of-delta: ' + sf.name);
+        }
+        // Deltas are written like a packed list
+        out.encoding = sf.encoding;
+    }
+    if (sf.packed || sf.encoding) {
+        if (sf.type !== 'list' || !sf.elem || (sf.elem.type !== 'int' && sf.elem.type !== 'sint')) {
+            throw new Error('packed and encoding require a list of int or sint: ' + sf.name);
+        }
+        if (sf.packed || out.encoding) out.packed = true;
+    }
+    if (sf.columnar) {
+        const fields = sf.type === 'list' && sf.elem && sf.elem.type === 'struct' && !sf.elem.sparse && Array.isArray(sf.elem.fields) ? sf.elem.fields : null;
+        // Columns hold plain strings only
+        const scalar = (f: any) => ['null', 'bool', 'int', 'string'].includes(f.type) && (!f.dict || f.dict === 'none');
+        if (!fields || !fields.every(scalar) || fields.every((f: any) => f.type === 'null')) {
+            throw new Error('columnar requires a list of structs of scalar fields: ' + sf.name);
+        }
+        out.columnar = true;
+    }
+    if (sf.chunk) {
+        const fixed = ['float32', 'float64', 'fixed32', 'fixed64'];
+        if (sf.type !== 'list' || !sf.elem || fixed.includes(sf.elem.type) || out.packed || sf.columnar || !Number.isInteger(sf.chunk) || sf.chunk < 1 || sf.chunk > 65535) {
+            throw new Error('chunk requires a list of at most 65535 non-fixed-width elements per chunk, not packed or columnar: ' + sf.name);
+        }
+        out.chunk = sf.chunk;
+    }
+    if (sf.sparse) {
+        if (sf.type !== 'struct') {
+            throw new Error('sparse requires a struct: ' + sf.name);
+        }
+        out.sparse = true;
+    }
+    if (sf.dict && sf.dict !== 'none') {
+        if (sf.type !== 'string' || (sf.dict !== 'message' && sf.dict !== 'shared')) {
+            throw new Error('dict requires a string, and one of none, message or shared: ' + sf.name);
+        }
+        out.dict = sf.dict;
+    }
     if (sf.type === 'struct' && Array.isArray(sf.fields)) {
         out.fields = sf.fields.map(parseSchemaField);
     }
@@ -27,20 +68,35 @@ export function parseSchemaFields(fields: any[]): UteSchemaField[] {
     return fields.map(parseSchemaField);
 }
 
+/**
+ * Parse the fields of a schema version and give its dictionary to the string fields declared shared
+ */
+function parseSchemaVersion(version: number, v: any): UteSchemaVersion {
+    const dictionary: string[] = v.dictionary ?? [];
+    if (!Array.isArray(dictionary) || new Set(dictionary).size !== dictionary.length) {
+        throw new Error('dictionary must be a list of distinct strings');
+    }
+    const attach = (f: UteSchemaField) => {
+        if (f.dict === 'shared') f.dictionary = dictionary;
+        if (f.elem) attach(f.elem);
+        f.fields?.forEach(attach);
+    };
+    const fields = parseSchemaFields(v.fields);
+    fields.forEach(attach);
+    return v.dictionary ? { version, dictionary, fields } : { version, fields };
+}
+
 /**
  * Load a UTE schema from a YAML string. Returns an array of schema versions (normalized).
  */
 export function loadSchemaFromString(yamlString: string): UteSchemaVersion[] {
     const doc = yaml.parse(yamlString);
     if (doc.versions && Array.isArray(doc.versions)) {
-        return doc.versions.map((v: any) => ({
-            version: v.version,
-            fields: parseSchemaFields(v.fields)
-        }));
+        return doc.versions.map((v: any) => parseSchemaVersion(v.version, v));
     }
     if (doc.fields && Array.isArray(doc.fields)) {
         // fallback: single-version schema
-        return [{ version: 1, fields: parseSchemaFields(doc.fields) }];
+        return [parseSchemaVersion(1, doc)];
     }
     throw new Error('Invalid schema string: missing versions or fields');
 }
@@ -1,16 +1,24 @@
 // UTE TypeScript types for schema and data
 
-export type UteFieldType = 'null' | 'bool' | 'int' | 'string' | 'list' | 'struct';
+export type UteFieldType = 'null' | 'bool' | 'int' | 'string' | 'list' | 'struct' | 'float32' | 'float64' | 'fixed32' | 'fixed64' | 'bytes' | 'sint';
 
 export interface UteSchemaField {
     name: string;
     type: UteFieldType;
     elem?: UteSchemaField; // for lists
     fields?: UteSchemaField[]; // for structs
+    packed?: boolean; // lists of ints: elements are encoded as bare varints
+    encoding?: 'delta' | 'delta-of-delta'; // packed lists: elements are encoded as differences (plain if absent)
+    columnar?: boolean; // lists of structs: members are encoded column by column
+    sparse?: boolean; // structs: members with their default value may be omitted
+    chunk?: number; // lists: elements per chunk of a chunked list
+    dict?: 'message' | 'shared'; // strings: repeated values may refer back, or be written as a dictionary id
+    dictionary?: string[]; // strings declared shared: the dictionary of the schema version
 }
 
 export interface UteSchemaVersion {
     version: number;
+    dictionary?: string[]; // shared string dictionary, ids in order
     fields: UteSchemaField[];
 }
 
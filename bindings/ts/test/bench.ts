@@ -0,0 +1,67 @@
+// Throughput of the UTE TypeScript binding against JSON.stringify/JSON.parse
+import { UteSchemaField } from '../src/types';
+import { UteWriter } from '../src/buffer';
+import { compileCodec, serialize, deserialize } from '../src/codex';
+
+const schema: UteSchemaField[] = [
+    { name: 'id', type: 'int' },
+    { name: 'name', type: 'string' },
+    { name: 'active', type: 'bool' },
+    { name: 'offset', type: 'sint' },
+    { name: 'samples', type: 'list', packed: true, elem: { name: '', type: 'int' }, encoding: 'delta' },
+    {
+        name: 'devices',
+        type: 'list',
+        elem: {
+            name: '',
+            type: 'struct',
+            fields: [
+                { name: 'id', type: 'int' },
+                { name: 'label', type: 'string' },
+                { name: 'online', type: 'bool' },
+            ],
+        },
+    },
+];
+
+const message = {
+    id: 123456789,
+    name: 'sensor-gateway-eu-west',
+    active: true,
+    offset: -4200,
+    samples: Array.from({ length: 64 }, (_, i) => 1700000000 + i * 15),
+    devices: Array.from({ length: 32 }, (_, i) => ({ id: i, label: 'device-' + i, online: i % 3 !== 0 })),
+};
+
+// Run fn for about ms milliseconds and report messages and bytes per second
+function bench(name: string, bytes: number, fn: () => void, ms = 1000) {
+    for (let i = 0; i < 1000; ++i) fn();
+    let n = 0;
+    const start = performance.now();
+    let elapsed = 0;
+    while (elapsed < ms) {
+        for (let i = 0; i < 1000; ++i) fn();
+        n += 1000;
+        elapsed = performance.now() - start;
+    }
+    const rate = (n * 1000) / elapsed;
+    const mbs = (rate * bytes) / (1024 * 1024);
+    console.log(`${name.padEnd(28)} ${Math.round(rate).toString().padStart(10)} msg/s ${mbs.toFixed(1).padStart(8)} MB/s`);
+}
+
+const codec = compileCodec(schema);
+const writer = new UteWriter();
+const encoded = codec.encode(message);
+const json = JSON.stringify(message);
+const jsonBytes = Buffer.byteLength(json);
+console.log(`UTE ${encoded.length} bytes, JSON ${jsonBytes} bytes`);
+
+bench('compileCodec encodeInto', encoded.length, () => {
+    writer.reset();
+    codec.encodeInto(message, writer);
+});
+bench('compileCodec decode', encoded.length, () => codec.decode(encoded));
+bench('serialize', encoded.length, () => serialize(message, schema));
+bench('deserialize', encoded.length, () => deserialize(encoded, schema));
+bench('JSON.stringify', jsonBytes, () => JSON.stringify(message));
+bench('JSON.parse', jsonBytes, () => JSON.parse(json));